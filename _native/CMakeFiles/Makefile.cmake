@@ -0,0 +1,109 @@
+# CMAKE generated file: DO NOT EDIT!
+# Generated by "Unix Makefiles" Generator, CMake Version 3.25
+
+# The generator used is:
+set(CMAKE_DEPENDS_GENERATOR "Unix Makefiles")
+
+# The top level Makefile was generated from the following files:
+set(CMAKE_MAKEFILE_DEPENDS
+  "CMakeCache.txt"
+  "/root/repo/3rdparty/googletest/CMakeLists.txt"
+  "/root/repo/3rdparty/googletest/googlemock/CMakeLists.txt"
+  "/root/repo/3rdparty/googletest/googlemock/cmake/gmock.pc.in"
+  "/root/repo/3rdparty/googletest/googlemock/cmake/gmock_main.pc.in"
+  "/root/repo/3rdparty/googletest/googletest/CMakeLists.txt"
+  "/root/repo/3rdparty/googletest/googletest/cmake/Config.cmake.in"
+  "/root/repo/3rdparty/googletest/googletest/cmake/gtest.pc.in"
+  "/root/repo/3rdparty/googletest/googletest/cmake/gtest_main.pc.in"
+  "/root/repo/3rdparty/googletest/googletest/cmake/internal_utils.cmake"
+  "/root/repo/CMakeLists.txt"
+  "CMakeFiles/3.25.1/CMakeCCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeCXXCompiler.cmake"
+  "CMakeFiles/3.25.1/CMakeSystem.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/Boost-1.74.0/BoostConfig.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/Boost-1.74.0/BoostConfigVersion.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/BoostDetectToolset-1.74.0.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/boost_atomic-1.74.0/boost_atomic-config-version.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/boost_atomic-1.74.0/boost_atomic-config.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/boost_atomic-1.74.0/libboost_atomic-variant-shared.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/boost_atomic-1.74.0/libboost_atomic-variant-static.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/boost_headers-1.74.0/boost_headers-config-version.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/boost_headers-1.74.0/boost_headers-config.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/boost_thread-1.74.0/boost_thread-config-version.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/boost_thread-1.74.0/boost_thread-config.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/boost_thread-1.74.0/libboost_thread-variant-shared.cmake"
+  "/usr/lib/x86_64-linux-gnu/cmake/boost_thread-1.74.0/libboost_thread-variant-static.cmake"
+  "/usr/share/cmake-3.25/Modules/BasicConfigVersion-AnyNewerVersion.cmake.in"
+  "/usr/share/cmake-3.25/Modules/CMakeCInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCXXInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeCommonLanguageInclude.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeDependentOption.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeFindDependencyMacro.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeGenericSystem.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeInitializeConfigs.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeLanguageInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakePackageConfigHelpers.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInformation.cmake"
+  "/usr/share/cmake-3.25/Modules/CMakeSystemSpecificInitialize.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckCSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckIncludeFile.cmake"
+  "/usr/share/cmake-3.25/Modules/CheckLibraryExists.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/CMakeCommonCompilerMacros.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-C.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Compiler/GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/FindBoost.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageHandleStandardArgs.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPackageMessage.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPython.cmake"
+  "/usr/share/cmake-3.25/Modules/FindPython/Support.cmake"
+  "/usr/share/cmake-3.25/Modules/FindThreads.cmake"
+  "/usr/share/cmake-3.25/Modules/GNUInstallDirs.cmake"
+  "/usr/share/cmake-3.25/Modules/Internal/CheckSourceCompiles.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-C.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU-CXX.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux-GNU.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/Linux.cmake"
+  "/usr/share/cmake-3.25/Modules/Platform/UnixPaths.cmake"
+  "/usr/share/cmake-3.25/Modules/WriteBasicConfigVersionFile.cmake"
+  )
+
+# The corresponding makefile is:
+set(CMAKE_MAKEFILE_OUTPUTS
+  "Makefile"
+  "CMakeFiles/cmake.check_cache"
+  )
+
+# Byproducts of CMake generate step:
+set(CMAKE_MAKEFILE_PRODUCTS
+  "CMakeFiles/CMakeDirectoryInformation.cmake"
+  "3rdparty/googletest/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "3rdparty/googletest/googletest/generated/gmock.pc"
+  "3rdparty/googletest/googletest/generated/gmock_main.pc"
+  "3rdparty/googletest/googlemock/CMakeFiles/CMakeDirectoryInformation.cmake"
+  "3rdparty/googletest/googletest/generated/GTestConfigVersion.cmake"
+  "3rdparty/googletest/googletest/generated/GTestConfig.cmake"
+  "3rdparty/googletest/googletest/generated/gtest.pc"
+  "3rdparty/googletest/googletest/generated/gtest_main.pc"
+  "3rdparty/googletest/googletest/CMakeFiles/CMakeDirectoryInformation.cmake"
+  )
+
+# Dependency information for all targets:
+set(CMAKE_DEPEND_INFO_FILES
+  "CMakeFiles/bptree.dir/DependInfo.cmake"
+  "CMakeFiles/bptree_unit_tests.dir/DependInfo.cmake"
+  "CMakeFiles/bptree_batch_bench.dir/DependInfo.cmake"
+  "CMakeFiles/bptree_bulk_load_bench.dir/DependInfo.cmake"
+  "CMakeFiles/bptree_cache_miss_bench.dir/DependInfo.cmake"
+  "CMakeFiles/bptree_concurrent_insert_bench.dir/DependInfo.cmake"
+  "CMakeFiles/bptree_contention_bench.dir/DependInfo.cmake"
+  "CMakeFiles/bptree_heap_file_bench.dir/DependInfo.cmake"
+  "CMakeFiles/bptree_lookup_latency_bench.dir/DependInfo.cmake"
+  "CMakeFiles/bptree_node_format_bench.dir/DependInfo.cmake"
+  "CMakeFiles/bptree_node_search_bench.dir/DependInfo.cmake"
+  "CMakeFiles/bptree_scan_bench.dir/DependInfo.cmake"
+  "3rdparty/googletest/googlemock/CMakeFiles/gmock.dir/DependInfo.cmake"
+  "3rdparty/googletest/googlemock/CMakeFiles/gmock_main.dir/DependInfo.cmake"
+  "3rdparty/googletest/googletest/CMakeFiles/gtest.dir/DependInfo.cmake"
+  "3rdparty/googletest/googletest/CMakeFiles/gtest_main.dir/DependInfo.cmake"
+  )
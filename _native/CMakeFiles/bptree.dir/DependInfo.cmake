@@ -0,0 +1,24 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/src/heap_file.cpp" "CMakeFiles/bptree.dir/src/heap_file.cpp.o" "gcc" "CMakeFiles/bptree.dir/src/heap_file.cpp.o.d"
+  "/root/repo/src/heap_page_cache.cpp" "CMakeFiles/bptree.dir/src/heap_page_cache.cpp.o" "gcc" "CMakeFiles/bptree.dir/src/heap_page_cache.cpp.o.d"
+  "/root/repo/src/io_engine.cpp" "CMakeFiles/bptree.dir/src/io_engine.cpp.o" "gcc" "CMakeFiles/bptree.dir/src/io_engine.cpp.o.d"
+  "/root/repo/src/replacer.cpp" "CMakeFiles/bptree.dir/src/replacer.cpp.o" "gcc" "CMakeFiles/bptree.dir/src/replacer.cpp.o.d"
+  "/root/repo/src/tree.cpp" "CMakeFiles/bptree.dir/src/tree.cpp.o" "gcc" "CMakeFiles/bptree.dir/src/tree.cpp.o.d"
+  "/root/repo/src/tree_node.cpp" "CMakeFiles/bptree.dir/src/tree_node.cpp.o" "gcc" "CMakeFiles/bptree.dir/src/tree_node.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,21 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bptree.dir/src/heap_file.cpp.o"
+  "CMakeFiles/bptree.dir/src/heap_file.cpp.o.d"
+  "CMakeFiles/bptree.dir/src/heap_page_cache.cpp.o"
+  "CMakeFiles/bptree.dir/src/heap_page_cache.cpp.o.d"
+  "CMakeFiles/bptree.dir/src/io_engine.cpp.o"
+  "CMakeFiles/bptree.dir/src/io_engine.cpp.o.d"
+  "CMakeFiles/bptree.dir/src/replacer.cpp.o"
+  "CMakeFiles/bptree.dir/src/replacer.cpp.o.d"
+  "CMakeFiles/bptree.dir/src/tree.cpp.o"
+  "CMakeFiles/bptree.dir/src/tree.cpp.o.d"
+  "CMakeFiles/bptree.dir/src/tree_node.cpp.o"
+  "CMakeFiles/bptree.dir/src/tree_node.cpp.o.d"
+  "libbptree.a"
+  "libbptree.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bptree.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
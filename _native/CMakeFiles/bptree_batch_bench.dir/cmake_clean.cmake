@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bptree_batch_bench.dir/bench/batch_bench.cpp.o"
+  "CMakeFiles/bptree_batch_bench.dir/bench/batch_bench.cpp.o.d"
+  "bptree_batch_bench"
+  "bptree_batch_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bptree_batch_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bptree_bulk_load_bench.dir/bench/bulk_load_bench.cpp.o"
+  "CMakeFiles/bptree_bulk_load_bench.dir/bench/bulk_load_bench.cpp.o.d"
+  "bptree_bulk_load_bench"
+  "bptree_bulk_load_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bptree_bulk_load_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
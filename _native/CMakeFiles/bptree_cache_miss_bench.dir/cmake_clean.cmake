@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bptree_cache_miss_bench.dir/bench/cache_miss_bench.cpp.o"
+  "CMakeFiles/bptree_cache_miss_bench.dir/bench/cache_miss_bench.cpp.o.d"
+  "bptree_cache_miss_bench"
+  "bptree_cache_miss_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bptree_cache_miss_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bptree_concurrent_insert_bench.dir/bench/concurrent_insert_bench.cpp.o"
+  "CMakeFiles/bptree_concurrent_insert_bench.dir/bench/concurrent_insert_bench.cpp.o.d"
+  "bptree_concurrent_insert_bench"
+  "bptree_concurrent_insert_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bptree_concurrent_insert_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bptree_contention_bench.dir/bench/contention_bench.cpp.o"
+  "CMakeFiles/bptree_contention_bench.dir/bench/contention_bench.cpp.o.d"
+  "bptree_contention_bench"
+  "bptree_contention_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bptree_contention_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
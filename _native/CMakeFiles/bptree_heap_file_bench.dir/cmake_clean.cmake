@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bptree_heap_file_bench.dir/bench/heap_file_bench.cpp.o"
+  "CMakeFiles/bptree_heap_file_bench.dir/bench/heap_file_bench.cpp.o.d"
+  "bptree_heap_file_bench"
+  "bptree_heap_file_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bptree_heap_file_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bptree_lookup_latency_bench.dir/bench/lookup_latency_bench.cpp.o"
+  "CMakeFiles/bptree_lookup_latency_bench.dir/bench/lookup_latency_bench.cpp.o.d"
+  "bptree_lookup_latency_bench"
+  "bptree_lookup_latency_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bptree_lookup_latency_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bptree_node_format_bench.dir/bench/node_format_bench.cpp.o"
+  "CMakeFiles/bptree_node_format_bench.dir/bench/node_format_bench.cpp.o.d"
+  "bptree_node_format_bench"
+  "bptree_node_format_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bptree_node_format_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
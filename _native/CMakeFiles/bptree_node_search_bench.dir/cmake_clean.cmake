@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bptree_node_search_bench.dir/bench/node_search_bench.cpp.o"
+  "CMakeFiles/bptree_node_search_bench.dir/bench/node_search_bench.cpp.o.d"
+  "bptree_node_search_bench"
+  "bptree_node_search_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bptree_node_search_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,11 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bptree_scan_bench.dir/bench/scan_bench.cpp.o"
+  "CMakeFiles/bptree_scan_bench.dir/bench/scan_bench.cpp.o.d"
+  "bptree_scan_bench"
+  "bptree_scan_bench.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bptree_scan_bench.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
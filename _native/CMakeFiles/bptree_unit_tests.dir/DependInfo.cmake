@@ -0,0 +1,26 @@
+
+# Consider dependencies only in project.
+set(CMAKE_DEPENDS_IN_PROJECT_ONLY OFF)
+
+# The set of languages for which implicit dependencies are needed:
+set(CMAKE_DEPENDS_LANGUAGES
+  )
+
+# The set of dependency files which are needed:
+set(CMAKE_DEPENDS_DEPENDENCY_FILES
+  "/root/repo/tests/heap_file_test.cpp" "CMakeFiles/bptree_unit_tests.dir/tests/heap_file_test.cpp.o" "gcc" "CMakeFiles/bptree_unit_tests.dir/tests/heap_file_test.cpp.o.d"
+  "/root/repo/tests/node_search_test.cpp" "CMakeFiles/bptree_unit_tests.dir/tests/node_search_test.cpp.o" "gcc" "CMakeFiles/bptree_unit_tests.dir/tests/node_search_test.cpp.o.d"
+  "/root/repo/tests/page_cache_test.cpp" "CMakeFiles/bptree_unit_tests.dir/tests/page_cache_test.cpp.o" "gcc" "CMakeFiles/bptree_unit_tests.dir/tests/page_cache_test.cpp.o.d"
+  "/root/repo/tests/replacer_test.cpp" "CMakeFiles/bptree_unit_tests.dir/tests/replacer_test.cpp.o" "gcc" "CMakeFiles/bptree_unit_tests.dir/tests/replacer_test.cpp.o.d"
+  "/root/repo/tests/tree_test.cpp" "CMakeFiles/bptree_unit_tests.dir/tests/tree_test.cpp.o" "gcc" "CMakeFiles/bptree_unit_tests.dir/tests/tree_test.cpp.o.d"
+  )
+
+# Targets to which this target links.
+set(CMAKE_TARGET_LINKED_INFO_FILES
+  "/root/repo/_native/CMakeFiles/bptree.dir/DependInfo.cmake"
+  "/root/repo/_native/3rdparty/googletest/googletest/CMakeFiles/gtest.dir/DependInfo.cmake"
+  "/root/repo/_native/3rdparty/googletest/googletest/CMakeFiles/gtest_main.dir/DependInfo.cmake"
+  )
+
+# Fortran module output directory.
+set(CMAKE_Fortran_TARGET_MODULE_DIR "")
@@ -0,0 +1,19 @@
+file(REMOVE_RECURSE
+  "CMakeFiles/bptree_unit_tests.dir/tests/heap_file_test.cpp.o"
+  "CMakeFiles/bptree_unit_tests.dir/tests/heap_file_test.cpp.o.d"
+  "CMakeFiles/bptree_unit_tests.dir/tests/node_search_test.cpp.o"
+  "CMakeFiles/bptree_unit_tests.dir/tests/node_search_test.cpp.o.d"
+  "CMakeFiles/bptree_unit_tests.dir/tests/page_cache_test.cpp.o"
+  "CMakeFiles/bptree_unit_tests.dir/tests/page_cache_test.cpp.o.d"
+  "CMakeFiles/bptree_unit_tests.dir/tests/replacer_test.cpp.o"
+  "CMakeFiles/bptree_unit_tests.dir/tests/replacer_test.cpp.o.d"
+  "CMakeFiles/bptree_unit_tests.dir/tests/tree_test.cpp.o"
+  "CMakeFiles/bptree_unit_tests.dir/tests/tree_test.cpp.o.d"
+  "bptree_unit_tests"
+  "bptree_unit_tests.pdb"
+)
+
+# Per-language clean rules from dependency scanning.
+foreach(lang CXX)
+  include(CMakeFiles/bptree_unit_tests.dir/cmake_clean_${lang}.cmake OPTIONAL)
+endforeach()
@@ -0,0 +1,104 @@
+/* compares inserting and looking up random keys one at a time against
+ * insert_batch() and get_values_batch(), which descend once per leaf for
+ * each batch. reports throughput in millions of keys per second.
+ *
+ * usage: bptree_batch_bench [num_keys] [batch_size] */
+#include "bptree/mem_page_cache.h"
+#include "bptree/tree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+static const unsigned int ORDER = 128;
+
+using Tree = bptree::BTree<ORDER, KeyType, ValueType>;
+
+template <typename Op> static double time_op(Op&& op)
+{
+    auto t1 = high_resolution_clock::now();
+    op();
+    auto t2 = high_resolution_clock::now();
+    return duration_cast<duration<double>>(t2 - t1).count();
+}
+
+static void run(const char* name, size_t num_keys, size_t batch_size,
+                const std::vector<std::pair<KeyType, ValueType>>& pairs,
+                bool batched)
+{
+    bptree::MemPageCache page_cache(4096);
+    Tree tree(&page_cache);
+
+    double insert_time = time_op([&]() {
+        if (batched) {
+            for (size_t i = 0; i < num_keys; i += batch_size) {
+                tree.insert_batch(&pairs[i],
+                                  std::min(batch_size, num_keys - i));
+            }
+        } else {
+            for (auto&& p : pairs) {
+                tree.insert(p.first, p.second);
+            }
+        }
+    });
+
+    std::vector<KeyType> keys(num_keys);
+    std::mt19937_64 rng(1);
+    for (auto&& k : keys) {
+        k = pairs[rng() % num_keys].first;
+    }
+
+    uint64_t sum = 0;
+    double lookup_time = time_op([&]() {
+        if (batched) {
+            std::vector<std::vector<ValueType>> value_lists;
+            for (size_t i = 0; i < num_keys; i += batch_size) {
+                tree.get_values_batch(&keys[i],
+                                      std::min(batch_size, num_keys - i),
+                                      value_lists);
+                for (auto&& values : value_lists) {
+                    sum += values.front();
+                }
+            }
+        } else {
+            std::vector<ValueType> values;
+            for (auto&& k : keys) {
+                values.clear();
+                tree.get_value(k, values);
+                sum += values.front();
+            }
+        }
+    });
+
+    std::cout << name << "," << num_keys / insert_time / 1e6 << ","
+              << num_keys / lookup_time / 1e6 << "," << sum << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t batch_size = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 10000;
+
+    std::vector<std::pair<KeyType, ValueType>> pairs(num_keys);
+    std::mt19937_64 rng(0);
+    for (auto&& p : pairs) {
+        p.first = rng();
+        p.second = p.first / 2;
+    }
+
+    std::cout << "mode,insert_mkeys_per_sec,lookup_mkeys_per_sec,sum"
+              << std::endl;
+
+    run("single", num_keys, batch_size, pairs, false);
+    run("batch", num_keys, batch_size, pairs, true);
+
+    return 0;
+}
@@ -0,0 +1,75 @@
+/* compares building a tree with one insert per pair against bulk loading
+ * sorted and unsorted input. reports throughput and the number of pages
+ * used by the tree.
+ *
+ * usage: bptree_bulk_load_bench [num_keys] */
+#include "bptree/mem_page_cache.h"
+#include "bptree/tree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+static const unsigned int ORDER = 128;
+
+using Tree = bptree::BTree<ORDER, KeyType, ValueType>;
+
+template <typename Build>
+static void run(const char* name, size_t num_keys, Build&& build)
+{
+    bptree::MemPageCache page_cache(4096);
+    Tree tree(&page_cache);
+
+    auto t1 = high_resolution_clock::now();
+    build(tree);
+    auto t2 = high_resolution_clock::now();
+
+    double time = duration_cast<duration<double>>(t2 - t1).count();
+    std::cout << name << "," << num_keys / time / 1e6 << ","
+              << page_cache.size() << "," << tree.size() << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+
+    std::vector<std::pair<KeyType, ValueType>> sorted(num_keys);
+    for (size_t i = 0; i < num_keys; i++) {
+        sorted[i] = std::make_pair(i, i);
+    }
+    auto shuffled = sorted;
+    std::mt19937_64 rng(0);
+    std::shuffle(shuffled.begin(), shuffled.end(), rng);
+
+    std::cout << "build,mpairs_per_sec,pages,pairs" << std::endl;
+
+    run("insert_sorted", num_keys, [&](Tree& tree) {
+        for (auto&& p : sorted) {
+            tree.insert(p.first, p.second);
+        }
+    });
+    run("insert_shuffled", num_keys, [&](Tree& tree) {
+        for (auto&& p : shuffled) {
+            tree.insert(p.first, p.second);
+        }
+    });
+    run("bulk_load_sorted", num_keys, [&](Tree& tree) {
+        tree.bulk_load(sorted.begin(), sorted.end());
+    });
+    run("bulk_load_shuffled", num_keys, [&](Tree& tree) {
+        bptree::BulkLoadOptions options;
+        options.sorted = false;
+        options.sort_memory = 16 << 20;
+        tree.bulk_load(shuffled.begin(), shuffled.end(), options);
+    });
+
+    return 0;
+}
@@ -0,0 +1,137 @@
+/* single-threaded random point lookups with hardware performance counters:
+ * cache misses and L1 data cache read misses per lookup, next to the time
+ * per lookup. the counters are read with perf_event_open() and reported as
+ * n/a where the kernel or the machine does not provide them (e.g. in most
+ * virtual machines or with kernel.perf_event_paranoid > 2).
+ *
+ * usage: bptree_cache_miss_bench [num_lookups] */
+#include "bptree/mem_page_cache.h"
+#include "bptree/tree.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+/* the largest order whose leaves fit in a page of 4096 bytes */
+static const unsigned int ORDER = 255;
+
+using Tree = bptree::BTree<ORDER, KeyType, ValueType>;
+
+/* a hardware counter of the calling thread, user space only */
+class PerfCounter {
+public:
+    PerfCounter(uint32_t type, uint64_t config)
+    {
+        perf_event_attr attr;
+        ::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = ::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~PerfCounter()
+    {
+        if (fd != -1) ::close(fd);
+    }
+
+    void start()
+    {
+        if (fd == -1) return;
+        ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    /* events per op since start(), or n/a */
+    std::string stop(size_t ops)
+    {
+        if (fd == -1) return "n/a";
+        ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+
+        uint64_t count;
+        if (::read(fd, &count, sizeof(count)) != sizeof(count)) return "n/a";
+        return std::to_string((double)count / ops);
+    }
+
+private:
+    int fd;
+};
+
+static void run(size_t num_keys, size_t num_lookups)
+{
+    bptree::MemPageCache page_cache(4096);
+    Tree tree(&page_cache);
+
+    std::vector<KeyType> keys(num_keys);
+    for (size_t i = 0; i < num_keys; i++) {
+        keys[i] = i;
+    }
+    std::mt19937_64 rng(1);
+    std::shuffle(keys.begin(), keys.end(), rng);
+    for (auto key : keys) {
+        tree.insert(key, key);
+    }
+
+    std::vector<KeyType> lookups(num_lookups);
+    std::uniform_int_distribution<KeyType> dist(0, num_keys - 1);
+    for (auto&& key : lookups) {
+        key = dist(rng);
+    }
+
+    PerfCounter cache_misses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    PerfCounter l1d_misses(PERF_TYPE_HW_CACHE,
+                           PERF_COUNT_HW_CACHE_L1D |
+                               (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                               (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    std::vector<ValueType> values;
+    uint64_t sum = 0;
+
+    cache_misses.start();
+    l1d_misses.start();
+    auto t1 = high_resolution_clock::now();
+    for (auto key : lookups) {
+        tree.get_value(key, values);
+        sum += values.empty() ? 0 : values[0];
+    }
+    auto t2 = high_resolution_clock::now();
+    auto l1d = l1d_misses.stop(num_lookups);
+    auto llc = cache_misses.stop(num_lookups);
+
+    double ns = duration_cast<duration<double, std::nano>>(t2 - t1).count() /
+                num_lookups;
+    std::cout << num_keys << "," << ns << "," << llc << "," << l1d << ","
+              << sum << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_lookups =
+        argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+
+    std::cout << "keys,ns_per_lookup,cache_misses_per_lookup,"
+                 "l1d_misses_per_lookup,sum"
+              << std::endl;
+
+    for (size_t num_keys : {10000, 100000, 1000000, 4000000}) {
+        run(num_keys, num_lookups);
+    }
+
+    return 0;
+}
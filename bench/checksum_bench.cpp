@@ -0,0 +1,113 @@
+/* cost of page checksums. first the crc32c of a page with the SSE4.2 crc32
+ * instruction (if the CPU has it) and with the lookup tables, then random
+ * page reads and writes on a heap file (served by the kernel page cache)
+ * without checksums, verifying every read and verifying only the first
+ * read of each page.
+ *
+ * usage: bptree_checksum_bench [heap file] */
+#include "bptree/checksum.h"
+#include "bptree/heap_file.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+
+static const size_t PAGE_SIZE = 4096;
+static const size_t NUM_PAGES = 16384;
+static const size_t NUM_CRCS = 1000000;
+static const size_t NUM_OPS = 1000000;
+
+template <typename F> static double time_ns(size_t count, F&& fn)
+{
+    auto t1 = high_resolution_clock::now();
+    for (size_t i = 0; i < count; i++) {
+        fn(i);
+    }
+    auto t2 = high_resolution_clock::now();
+    return duration_cast<duration<double, std::nano>>(t2 - t1).count() / count;
+}
+
+static void run_file(const std::string& path, const char* name,
+                     const bptree::HeapFileOptions& options)
+{
+    std::remove(path.c_str());
+    bptree::HeapFile heap_file(path, true, PAGE_SIZE, options);
+    bptree::Page page(0, PAGE_SIZE);
+
+    for (size_t i = 1; i < NUM_PAGES; i++) {
+        page.set_id(heap_file.new_page());
+        boost::upgrade_lock<bptree::Page> lock(page);
+        {
+            boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+            ::memset(page.get_buffer(ulock), (int)i, PAGE_SIZE);
+        }
+        heap_file.write_page(&page, lock);
+    }
+
+    std::mt19937 rng(0);
+    std::uniform_int_distribution<bptree::PageID> dist(1, NUM_PAGES - 1);
+
+    double read_ns = time_ns(NUM_OPS, [&](size_t) {
+        page.set_id(dist(rng));
+        boost::upgrade_lock<bptree::Page> lock(page);
+        boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+        heap_file.read_page(&page, ulock);
+    });
+
+    double write_ns = time_ns(NUM_OPS, [&](size_t) {
+        page.set_id(dist(rng));
+        boost::upgrade_lock<bptree::Page> lock(page);
+        heap_file.write_page(&page, lock);
+    });
+
+    std::cout << name << "," << read_ns << "," << write_ns << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string path = argc > 1 ? argv[1] : "/tmp/bptree_checksum_bench.heap";
+
+    std::vector<uint8_t> buf(PAGE_SIZE);
+    std::mt19937 rng(0);
+    for (auto&& b : buf) {
+        b = rng();
+    }
+
+    uint32_t sum = 0;
+    double hw_ns = time_ns(NUM_CRCS, [&](size_t i) {
+        buf[i % PAGE_SIZE] = (uint8_t)sum;
+        sum += bptree::crc32c(buf.data(), PAGE_SIZE);
+    });
+    double sw_ns = time_ns(NUM_CRCS, [&](size_t i) {
+        buf[i % PAGE_SIZE] = (uint8_t)sum;
+        sum += bptree::crc32c_sw(buf.data(), PAGE_SIZE);
+    });
+
+    std::cout << "crc32c of a " << PAGE_SIZE << "-byte page ("
+              << (bptree::crc32c_is_hardware() ? "sse4.2" : "no sse4.2")
+              << "): " << hw_ns << " ns, " << PAGE_SIZE / hw_ns
+              << " GB/s; tables: " << sw_ns << " ns, " << PAGE_SIZE / sw_ns
+              << " GB/s (" << (sum & 1) << ")" << std::endl;
+
+    bptree::HeapFileOptions options;
+    std::cout << "checksums,read_ns,write_ns" << std::endl;
+
+    options.page_checksums = false;
+    run_file(path, "none", options);
+
+    options.page_checksums = true;
+    options.verify_checksums = bptree::ChecksumVerification::ALWAYS;
+    run_file(path, "always", options);
+
+    options.verify_checksums = bptree::ChecksumVerification::FIRST_READ;
+    run_file(path, "first_read", options);
+
+    std::remove(path.c_str());
+    return 0;
+}
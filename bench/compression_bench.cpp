@@ -0,0 +1,134 @@
+/* compares heap files with uncompressed and compressed pages for trees of
+ * sequential and random integer keys. reports the bytes stored on disk and
+ * the compression ratio, the time to read a page through the heap file
+ * (pread and decompression, the file data is in the kernel page cache) and
+ * random lookups per second with a page cache that is much smaller than the
+ * tree, so that most node reads miss.
+ *
+ * usage: bptree_compression_bench [num_keys] [num_lookups] */
+#include "bptree/heap_page_cache.h"
+#include "bptree/tree.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+/* the largest order whose leaves fit in a page of PAGE_SIZE */
+static const unsigned int ORDER = 255;
+static const size_t PAGE_SIZE = 4096;
+static const size_t CACHE_PAGES = 256;
+
+using Tree = bptree::BTree<ORDER, KeyType, ValueType>;
+
+static void run(const char* name, bptree::PageCompression compression,
+                const char* key_order, const std::vector<KeyType>& keys,
+                size_t num_lookups)
+{
+    std::string path = "/tmp/bptree_compression_bench_" +
+                       std::to_string(getpid()) + ".heap";
+    std::remove(path.c_str());
+
+    bptree::PageCacheOptions options;
+    options.heap_file.compression = compression;
+
+    {
+        bptree::HeapPageCache page_cache(path, true, 1 << 16, PAGE_SIZE,
+                                         options);
+        Tree tree(&page_cache);
+        for (auto key : keys) {
+            tree.insert(key, key);
+        }
+        tree.checkpoint();
+    }
+
+    size_t num_pages, stored_bytes;
+    double read_us;
+    {
+        bptree::HeapFile heap_file(path, false, PAGE_SIZE);
+        num_pages = heap_file.get_num_pages() - 1;
+        stored_bytes = heap_file.get_stored_bytes();
+
+        bptree::Page page(bptree::Page::INVALID_PAGE_ID, PAGE_SIZE);
+        boost::upgrade_lock<bptree::Page> lock(page);
+        boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+
+        auto t1 = high_resolution_clock::now();
+        for (int pass = 0; pass < 2; pass++) {
+            for (size_t pid = 1; pid <= num_pages; pid++) {
+                page.set_id(pid);
+                heap_file.read_page(&page, ulock);
+            }
+        }
+        auto t2 = high_resolution_clock::now();
+        read_us = duration_cast<duration<double, std::micro>>(t2 - t1).count() /
+                  (2 * num_pages);
+    }
+
+    double lookups_per_sec;
+    {
+        bptree::HeapPageCache page_cache(path, false, CACHE_PAGES, PAGE_SIZE,
+                                         options);
+        Tree tree(&page_cache);
+
+        std::mt19937_64 rng(1);
+        std::uniform_int_distribution<size_t> dist(0, keys.size() - 1);
+        std::vector<ValueType> values;
+        uint64_t sum = 0;
+
+        auto t1 = high_resolution_clock::now();
+        for (size_t i = 0; i < num_lookups; i++) {
+            tree.get_value(keys[dist(rng)], values);
+            sum += values.empty() ? 0 : values[0];
+        }
+        auto t2 = high_resolution_clock::now();
+
+        double time = duration_cast<duration<double>>(t2 - t1).count();
+        lookups_per_sec = num_lookups / time;
+        if (sum == 0) std::cerr << "no values found" << std::endl;
+    }
+
+    std::cout << name << "," << key_order << "," << num_pages << ","
+              << stored_bytes / 1e6 << ","
+              << (double)num_pages * PAGE_SIZE / stored_bytes << "," << read_us
+              << "," << lookups_per_sec / 1e3 << std::endl;
+
+    std::remove(path.c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t num_lookups =
+        argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 200000;
+
+    std::vector<KeyType> sequential(num_keys), random(num_keys);
+    std::mt19937_64 rng(0);
+    for (size_t i = 0; i < num_keys; i++) {
+        sequential[i] = i;
+        random[i] = rng();
+    }
+
+    std::cout << "compression,keys,pages,stored_mb,ratio,us_per_page_read,"
+                 "lookups_k_per_sec"
+              << std::endl;
+
+    for (auto* keys : {&sequential, &random}) {
+        const char* key_order = keys == &sequential ? "sequential" : "random";
+        run("none", bptree::PageCompression::NONE, key_order, *keys,
+            num_lookups);
+        run("delta_varint", bptree::PageCompression::DELTA_VARINT, key_order,
+            *keys, num_lookups);
+    }
+
+    return 0;
+}
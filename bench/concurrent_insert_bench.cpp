@@ -0,0 +1,88 @@
+/* multi-threaded random insert benchmark. each thread inserts its own
+ * interleaved share of the keys. runs on a memory page cache and on a heap
+ * file page cache in write-back and write-through mode and reports
+ * throughput in millions of inserts per second.
+ *
+ * usage: bptree_concurrent_insert_bench [num_keys] [max_threads] */
+#include "bptree/heap_page_cache.h"
+#include "bptree/mem_page_cache.h"
+#include "bptree/tree.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+static const unsigned int ORDER = 128;
+static const char* HEAP_FILE = "/tmp/bptree_concurrent_insert_bench.heap";
+
+using Tree = bptree::BTree<ORDER, KeyType, ValueType>;
+
+static void run(const char* cache, bptree::AbstractPageCache* page_cache,
+                const std::vector<KeyType>& keys, size_t num_threads)
+{
+    Tree tree(page_cache);
+
+    auto t1 = high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; i++) {
+        threads.emplace_back([i, num_threads, &keys, &tree]() {
+            for (size_t j = i; j < keys.size(); j += num_threads) {
+                tree.insert(keys[j], j);
+            }
+        });
+    }
+    for (auto&& t : threads) {
+        t.join();
+    }
+    auto t2 = high_resolution_clock::now();
+
+    double time = duration_cast<duration<double>>(t2 - t1).count();
+    std::cout << cache << "," << num_threads << ","
+              << keys.size() / time / 1e6 << "," << tree.size() << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t max_threads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 8;
+
+    std::vector<KeyType> keys(num_keys);
+    std::mt19937_64 rng(0);
+    for (auto&& k : keys) {
+        k = rng();
+    }
+
+    std::cout << "page_cache,threads,minserts_per_sec,pairs" << std::endl;
+
+    for (size_t threads = 1; threads <= max_threads; threads *= 2) {
+        {
+            bptree::MemPageCache page_cache(4096);
+            run("mem", &page_cache, keys, threads);
+        }
+        {
+            std::remove(HEAP_FILE);
+            bptree::HeapPageCache page_cache(HEAP_FILE, true, 1 << 16);
+            run("heap", &page_cache, keys, threads);
+        }
+        {
+            std::remove(HEAP_FILE);
+            bptree::PageCacheOptions options;
+            options.write_through = true;
+            bptree::HeapPageCache page_cache(HEAP_FILE, true, 1 << 16, 4096,
+                                             options);
+            run("heap_write_through", &page_cache, keys, threads);
+        }
+    }
+
+    std::remove(HEAP_FILE);
+    return 0;
+}
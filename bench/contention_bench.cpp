@@ -0,0 +1,129 @@
+/* multi-threaded mixed lookups and inserts on zipf-distributed keys, so
+ * that the threads keep hitting the same few leaves. reports throughput,
+ * latency percentiles of single operations and the number of restarts.
+ *
+ * usage: bptree_contention_bench [num_threads] [ops_per_thread]
+ *                                [read_ratio] [zipf_theta] */
+#include "bptree/mem_page_cache.h"
+#include "bptree/tree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+static const unsigned int ORDER = 64;
+static const size_t NUM_KEYS = 100000;
+
+using Tree = bptree::BTree<ORDER, KeyType, ValueType>;
+
+/* samples ranks in [0, n) with P(rank) ~ 1 / (rank + 1)^theta */
+class ZipfGenerator {
+public:
+    ZipfGenerator(size_t n, double theta) : cdf(n)
+    {
+        double sum = 0;
+        for (size_t i = 0; i < n; i++) {
+            sum += 1.0 / std::pow((double)(i + 1), theta);
+            cdf[i] = sum;
+        }
+        for (auto&& c : cdf) {
+            c /= sum;
+        }
+    }
+
+    template <typename RNG> size_t operator()(RNG& rng) const
+    {
+        double u = std::uniform_real_distribution<double>(0, 1)(rng);
+        return std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    }
+
+private:
+    std::vector<double> cdf;
+};
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_threads = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 8;
+    size_t ops_per_thread =
+        argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 200000;
+    double read_ratio = argc > 3 ? std::strtod(argv[3], nullptr) : 0.5;
+    double theta = argc > 4 ? std::strtod(argv[4], nullptr) : 0.99;
+
+    bptree::MemPageCache page_cache(4096);
+    Tree tree(&page_cache);
+    for (size_t i = 0; i < NUM_KEYS; i++) {
+        tree.insert(i * 2, i);
+    }
+
+    ZipfGenerator zipf(NUM_KEYS, theta);
+    std::vector<std::vector<double>> latencies(num_threads);
+
+    auto t1 = high_resolution_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < num_threads; i++) {
+        threads.emplace_back([i, ops_per_thread, read_ratio, &zipf, &tree,
+                              &latencies]() {
+            std::mt19937_64 rng(i);
+            std::uniform_real_distribution<double> coin(0, 1);
+            std::vector<ValueType> values;
+            auto& lat = latencies[i];
+            lat.reserve(ops_per_thread);
+
+            for (size_t j = 0; j < ops_per_thread; j++) {
+                /* odd keys fall between the preloaded ones */
+                KeyType key = zipf(rng) * 2;
+                bool read = coin(rng) < read_ratio;
+
+                auto start = steady_clock::now();
+                if (read) {
+                    values.clear();
+                    tree.get_value(key, values);
+                } else {
+                    tree.insert(key + 1, j);
+                }
+                auto end = steady_clock::now();
+
+                lat.push_back(
+                    duration<double, std::micro>(end - start).count());
+            }
+        });
+    }
+    for (auto&& t : threads) {
+        t.join();
+    }
+    auto t2 = high_resolution_clock::now();
+
+    std::vector<double> all;
+    for (auto&& lat : latencies) {
+        all.insert(all.end(), lat.begin(), lat.end());
+    }
+    std::sort(all.begin(), all.end());
+
+    double time = duration_cast<duration<double>>(t2 - t1).count();
+    auto restarts = tree.get_restart_stats();
+
+    std::cout << "threads,mops_per_sec,p50_us,p99_us,p999_us,max_us,"
+                 "lookup_restarts,insert_restarts"
+              << std::endl;
+    std::cout << num_threads << "," << all.size() / time / 1e6 << ","
+              << percentile(all, 0.5) << "," << percentile(all, 0.99) << ","
+              << percentile(all, 0.999) << "," << all.back() << ","
+              << restarts.lookups << "," << restarts.inserts << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+/* cost of entering and leaving the read-side guard of an operation. each
+ * thread enters and leaves a guard in a loop, with a shared counter of
+ * operations in flight and with EpochManager guards, whose counters are
+ * sharded by thread. a background thread plays the evictor: with the shared
+ * counter it counts how often no operation is in flight (the only time
+ * retired nodes could be freed), with epochs it advances the epoch.
+ *
+ * usage: bptree_epoch_bench [max_threads] [ops_per_thread] */
+#include "bptree/epoch.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+template <typename F>
+static double run(size_t num_threads, size_t num_ops, F&& op)
+{
+    std::vector<std::thread> threads;
+    auto t1 = high_resolution_clock::now();
+    for (size_t t = 0; t < num_threads; t++) {
+        threads.emplace_back([&]() {
+            for (size_t i = 0; i < num_ops; i++) {
+                op();
+            }
+        });
+    }
+    for (auto&& p : threads) {
+        p.join();
+    }
+    auto t2 = high_resolution_clock::now();
+
+    return duration_cast<duration<double, std::nano>>(t2 - t1).count() /
+           num_ops;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t max_threads = argc > 1 ? std::atoll(argv[1]) : 8;
+    size_t num_ops = argc > 2 ? std::atoll(argv[2]) : 10000000;
+
+    std::cout << "threads,shared_counter_ns,idle_checks,epoch_guard_ns,"
+                 "epochs_advanced"
+              << std::endl;
+
+    for (size_t n = 1; n <= max_threads; n *= 2) {
+        std::atomic<size_t> active_ops(0);
+        bptree::EpochManager epochs;
+        std::atomic<bool> stop(false);
+        size_t idle = 0;
+
+        /* the evictor of the old scheme frees retired nodes when no
+         * operation is in flight */
+        std::thread evictor([&active_ops, &stop, &idle]() {
+            while (!stop.load()) {
+                if (active_ops.load() == 0) idle++;
+                std::this_thread::sleep_for(microseconds(10));
+            }
+        });
+        double shared_ns = run(n, num_ops, [&active_ops]() {
+            active_ops++;
+            active_ops--;
+        });
+        stop.store(true);
+        evictor.join();
+
+        stop.store(false);
+        std::thread advancer([&epochs, &stop]() {
+            while (!stop.load()) {
+                epochs.try_advance();
+                std::this_thread::sleep_for(microseconds(10));
+            }
+        });
+        double epoch_ns = run(n, num_ops, [&epochs]() {
+            bptree::EpochManager::Guard guard(epochs);
+        });
+        stop.store(true);
+        advancer.join();
+
+        std::cout << n << "," << shared_ns << "," << idle << "," << epoch_ns
+                  << "," << epochs.get_epoch() - 1 << std::endl;
+    }
+
+    return 0;
+}
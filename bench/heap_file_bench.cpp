@@ -0,0 +1,120 @@
+/* multi-threaded random page read benchmark. compares HeapFile::read_page
+ * (pread, no file lock) against the previous implementation (global mutex +
+ * lseek + read) */
+#include "bptree/heap_file.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono;
+
+static const size_t PAGE_SIZE = 4096;
+static const size_t NUM_PAGES = 16384;
+static const size_t READS_PER_THREAD = 200000;
+
+class LseekReader {
+public:
+    explicit LseekReader(const std::string& filename)
+    {
+        fd = ::open(filename.c_str(), O_RDONLY);
+    }
+    ~LseekReader() { ::close(fd); }
+
+    void read_page(bptree::PageID pid, uint8_t* buf)
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        lseek64(fd, (off64_t)pid * PAGE_SIZE, SEEK_SET);
+        if (read(fd, buf, PAGE_SIZE) != PAGE_SIZE) {
+            throw bptree::IOException("short read");
+        }
+    }
+
+private:
+    int fd;
+    std::mutex mutex;
+};
+
+template <typename F> static double run_threads(int num_threads, F&& read_fn)
+{
+    std::vector<std::thread> threads;
+    auto t1 = high_resolution_clock::now();
+
+    for (int i = 0; i < num_threads; i++) {
+        threads.emplace_back([i, &read_fn]() {
+            std::mt19937 rng(i);
+            std::uniform_int_distribution<bptree::PageID> dist(1,
+                                                               NUM_PAGES - 1);
+            bptree::Page page(0, PAGE_SIZE);
+
+            for (size_t j = 0; j < READS_PER_THREAD; j++) {
+                read_fn(page, dist(rng));
+            }
+        });
+    }
+
+    for (auto&& t : threads) {
+        t.join();
+    }
+
+    auto t2 = high_resolution_clock::now();
+    return duration_cast<duration<double>>(t2 - t1).count();
+}
+
+int main(int argc, char* argv[])
+{
+    std::string path = argc > 1 ? argv[1] : "/tmp/bptree_heap_file_bench.heap";
+    std::remove(path.c_str());
+
+    {
+        bptree::HeapFile heap_file(path, true, PAGE_SIZE);
+        bptree::Page page(0, PAGE_SIZE);
+
+        for (size_t i = 1; i < NUM_PAGES; i++) {
+            page.set_id(heap_file.new_page());
+            boost::upgrade_lock<bptree::Page> lock(page);
+            {
+                boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+                ::memset(page.get_buffer(ulock), (int)i, PAGE_SIZE);
+            }
+            heap_file.write_page(&page, lock);
+        }
+    }
+
+    bptree::HeapFile heap_file(path, false, PAGE_SIZE);
+    LseekReader lseek_reader(path);
+
+    std::cout << "threads,lseek_mops,pread_mops" << std::endl;
+    for (int num_threads : {1, 2, 4, 8, 16}) {
+        double total = (double)num_threads * READS_PER_THREAD / 1e6;
+
+        double lseek_time =
+            run_threads(num_threads, [&](bptree::Page& page, bptree::PageID pid) {
+                boost::upgrade_lock<bptree::Page> lock(page);
+                boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+                lseek_reader.read_page(pid, page.get_buffer(ulock));
+            });
+
+        double pread_time =
+            run_threads(num_threads, [&](bptree::Page& page, bptree::PageID pid) {
+                page.set_id(pid);
+                boost::upgrade_lock<bptree::Page> lock(page);
+                boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+                heap_file.read_page(&page, ulock);
+            });
+
+        std::cout << num_threads << "," << total / lseek_time << ","
+                  << total / pread_time << std::endl;
+    }
+
+    std::remove(path.c_str());
+    return 0;
+}
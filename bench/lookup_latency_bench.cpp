@@ -0,0 +1,93 @@
+/* single-threaded point lookups of random existing keys. reports the
+ * latency percentiles of single lookups and the lookup throughput for a
+ * small and a large tree, with all nodes cached and with a small node cache
+ * so that nodes on the descent are re-read from the page cache.
+ *
+ * usage: bptree_lookup_latency_bench [num_lookups] */
+#include "bptree/mem_page_cache.h"
+#include "bptree/tree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+static const unsigned int ORDER = 64;
+static const size_t SMALL_NODE_BUDGET = 1 << 20;
+
+using Tree = bptree::BTree<ORDER, KeyType, ValueType>;
+
+static double percentile(const std::vector<double>& sorted, double p)
+{
+    return sorted[std::min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+}
+
+static void run(const char* cache, Tree& tree, size_t num_keys,
+                size_t num_lookups)
+{
+    std::mt19937_64 rng(0);
+    std::uniform_int_distribution<KeyType> dist(0, num_keys - 1);
+    std::vector<double> latencies(num_lookups);
+    std::vector<ValueType> values;
+    uint64_t sum = 0;
+
+    auto t1 = high_resolution_clock::now();
+    for (size_t i = 0; i < num_lookups; i++) {
+        KeyType key = dist(rng);
+
+        auto start = steady_clock::now();
+        tree.get_value(key, values);
+        auto end = steady_clock::now();
+
+        latencies[i] = duration_cast<duration<double, std::nano>>(end - start)
+                           .count();
+        sum += values.empty() ? 0 : values[0];
+    }
+    auto t2 = high_resolution_clock::now();
+
+    double time = duration_cast<duration<double>>(t2 - t1).count();
+    std::sort(latencies.begin(), latencies.end());
+
+    std::cout << num_keys << "," << cache << "," << num_lookups / time / 1e6
+              << "," << percentile(latencies, 0.5) << ","
+              << percentile(latencies, 0.99) << ","
+              << percentile(latencies, 0.999) << "," << sum << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_lookups =
+        argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+
+    std::cout << "keys,node_cache,mlookups_per_sec,p50_ns,p99_ns,p999_ns,sum"
+              << std::endl;
+
+    for (size_t num_keys : {10000, 1000000}) {
+        bptree::MemPageCache page_cache(4096);
+        Tree tree(&page_cache);
+
+        std::vector<KeyType> keys(num_keys);
+        for (size_t i = 0; i < num_keys; i++) {
+            keys[i] = i;
+        }
+        std::mt19937_64 rng(1);
+        std::shuffle(keys.begin(), keys.end(), rng);
+        for (auto key : keys) {
+            tree.insert(key, key);
+        }
+
+        run("all", tree, num_keys, num_lookups);
+
+        tree.set_node_cache_budget(SMALL_NODE_BUDGET);
+        run("small", tree, num_keys, num_lookups);
+    }
+
+    return 0;
+}
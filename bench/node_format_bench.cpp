@@ -0,0 +1,81 @@
+/* compares the in-place node format (keys and values accessed in the page
+ * frame) against the copy format (nodes decoded into separate arrays) for
+ * fixed-size keys. reports throughput and the bytes copied between nodes
+ * and pages per operation. lookups run with a small node cache so that
+ * nodes are re-read from the page cache */
+#include "bptree/mem_page_cache.h"
+#include "bptree/tree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+static const unsigned int ORDER = 128;
+static const size_t NUM_KEYS = 1000000;
+static const size_t NUM_LOOKUPS = 1000000;
+static const size_t LOOKUP_NODE_BUDGET = 1 << 20;
+
+/* same encoding as CopySerializer but forces the copy format */
+template <typename T> class PlainCopySerializer : public bptree::CopySerializer<T> {};
+
+template <typename Tree> static void run(const char* name)
+{
+    bptree::MemPageCache page_cache(4096);
+    Tree tree(&page_cache);
+
+    std::vector<KeyType> keys(NUM_KEYS);
+    for (size_t i = 0; i < NUM_KEYS; i++) {
+        keys[i] = i;
+    }
+    std::mt19937_64 rng(0);
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    auto t1 = high_resolution_clock::now();
+    for (auto k : keys) {
+        tree.insert(k, k + 1);
+    }
+    auto t2 = high_resolution_clock::now();
+    uint64_t insert_bytes = tree.get_node_bytes_copied();
+
+    tree.set_node_cache_budget(LOOKUP_NODE_BUDGET);
+    std::uniform_int_distribution<KeyType> dist(0, NUM_KEYS - 1);
+    std::vector<ValueType> values;
+
+    auto t3 = high_resolution_clock::now();
+    for (size_t i = 0; i < NUM_LOOKUPS; i++) {
+        values.clear();
+        tree.get_value(dist(rng), values);
+    }
+    auto t4 = high_resolution_clock::now();
+    uint64_t lookup_bytes = tree.get_node_bytes_copied() - insert_bytes;
+
+    double insert_time = duration_cast<duration<double>>(t2 - t1).count();
+    double lookup_time = duration_cast<duration<double>>(t4 - t3).count();
+
+    std::cout << name << "," << NUM_KEYS / insert_time / 1e6 << ","
+              << (double)insert_bytes / NUM_KEYS << ","
+              << NUM_LOOKUPS / lookup_time / 1e6 << ","
+              << (double)lookup_bytes / NUM_LOOKUPS << std::endl;
+}
+
+int main()
+{
+    std::cout << "format,insert_mops,insert_bytes_per_op,lookup_mops,"
+                 "lookup_bytes_per_op"
+              << std::endl;
+
+    run<bptree::BTree<ORDER, KeyType, ValueType, PlainCopySerializer<KeyType>,
+                      std::less<KeyType>, std::equal_to<KeyType>,
+                      PlainCopySerializer<ValueType>>>("copy");
+    run<bptree::BTree<ORDER, KeyType, ValueType>>("in_place");
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+/* search within a single node: std::lower_bound() vs. node_lower_bound(),
+ * which uses the AVX2/AVX-512 kernels if the build enables them (configure
+ * with -D BPTREE_NATIVE_ARCH=ON). every search depends on the result of the
+ * previous one like the searches of a descent, so the time per search is
+ * its latency. the keys of a node stay in the L1/L2 cache.
+ *
+ * usage: bptree_node_search_bench [num_searches] */
+#include "bptree/node_search.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace std::chrono;
+
+static const size_t NUM_PROBES = 4096;
+
+template <typename K, typename Search>
+static double run(const std::vector<K>& keys, const std::vector<K>& probes,
+                  size_t num_searches, size_t& checksum, Search&& search)
+{
+    size_t pos = 0;
+
+    auto t1 = high_resolution_clock::now();
+    for (size_t i = 0; i < num_searches; i++) {
+        pos = search(keys.data(), keys.size(),
+                     probes[(i + pos) & (NUM_PROBES - 1)]);
+        checksum += pos;
+    }
+    auto t2 = high_resolution_clock::now();
+
+    return duration_cast<duration<double, std::nano>>(t2 - t1).count() /
+           num_searches;
+}
+
+template <typename K> static void run_type(const char* type, size_t num_searches)
+{
+    std::mt19937_64 rng(0);
+    std::uniform_int_distribution<K> dist;
+    std::less<K> kcmp;
+
+    for (size_t n = 16; n <= 1024; n *= 2) {
+        /* a full node of order n */
+        std::vector<K> keys(n - 1);
+        for (auto&& key : keys) {
+            key = dist(rng);
+        }
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<K> probes(NUM_PROBES);
+        for (auto&& probe : probes) {
+            probe = dist(rng);
+        }
+
+        size_t std_sum = 0, node_sum = 0;
+        double std_ns = run(keys, probes, num_searches, std_sum,
+                            [&](const K* first, size_t count, const K& key) {
+                                return (size_t)(std::lower_bound(
+                                                    first, first + count, key,
+                                                    kcmp) -
+                                                first);
+                            });
+        double node_ns = run(keys, probes, num_searches, node_sum,
+                             [&](const K* first, size_t count, const K& key) {
+                                 return bptree::node_lower_bound(first, count,
+                                                                 key, kcmp);
+                             });
+
+        std::cout << type << "," << n << "," << std_ns << "," << node_ns << ","
+                  << (std_sum == node_sum ? "ok" : "MISMATCH") << std::endl;
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_searches =
+        argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 10000000;
+
+    std::cout << "key,order,std_lower_bound_ns,node_lower_bound_ns,check"
+              << std::endl;
+
+    run_type<uint64_t>("uint64", num_searches);
+    run_type<uint32_t>("uint32", num_searches);
+
+    return 0;
+}
@@ -0,0 +1,150 @@
+/* time to open a tree of random integer keys after a clean close and after
+ * a crash: without a log, where the pairs are recounted, and with a
+ * write-ahead log without and with background checkpoints, where the log
+ * written since the last checkpoint is replayed. copies of the files taken
+ * while the tree is open stand in for the files left by a crash. reports the
+ * time to open the page cache and the tree, the log replayed and the time of
+ * the first lookup after the open. the files are in the kernel page cache.
+ *
+ * usage: bptree_restart_bench [num_keys] [checkpoint_log_mb] */
+#include "bptree/heap_page_cache.h"
+#include "bptree/tree.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+/* the largest order whose leaves fit in a page of 4096 bytes */
+static const unsigned int ORDER = 255;
+static const size_t CACHE_PAGES = 1 << 16;
+
+using Tree = bptree::BTree<ORDER, KeyType, ValueType>;
+
+static void copy_file(const std::string& from, const std::string& to)
+{
+    std::ifstream in(from, std::ios::binary);
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    out << in.rdbuf();
+}
+
+static void remove_files(const std::string& path)
+{
+    std::remove(path.c_str());
+    std::remove((path + ".wal").c_str());
+}
+
+/* build the tree and leave the files of a clean close at path or, if crash
+ * is set, the files of a crash */
+static void build(const std::string& path,
+                  const bptree::PageCacheOptions& options,
+                  const std::vector<KeyType>& keys, bool crash)
+{
+    std::string live_path = path + ".live";
+    remove_files(path);
+    remove_files(live_path);
+
+    {
+        bptree::HeapPageCache page_cache(crash ? live_path : path, true,
+                                         CACHE_PAGES, 4096, options);
+        Tree tree(&page_cache);
+        for (auto key : keys) {
+            tree.insert(key, key);
+        }
+        if (!crash) return;
+
+        auto* wal = page_cache.get_wal();
+        if (wal) {
+            /* let a background checkpoint that is due finish */
+            size_t limit = options.wal.checkpoint_log_size;
+            while (limit && wal->get_log_size() >= limit) {
+                std::this_thread::sleep_for(milliseconds(1));
+            }
+            wal->flush(wal->get_end_lsn());
+        } else {
+            page_cache.flush_all_pages();
+        }
+
+        copy_file(live_path, path);
+        if (wal) copy_file(live_path + ".wal", path + ".wal");
+    }
+    remove_files(live_path);
+}
+
+static void run(const char* name, bptree::PageCacheOptions options,
+                const std::vector<KeyType>& keys, bool crash)
+{
+    std::string path =
+        "/tmp/bptree_restart_bench_" + std::to_string(getpid()) + ".heap";
+    build(path, options, keys, crash);
+
+    double log_mb = 0;
+    {
+        std::ifstream wal_file(path + ".wal", std::ios::binary | std::ios::ate);
+        if (wal_file) log_mb = wal_file.tellg() / 1e6;
+    }
+
+    auto t1 = high_resolution_clock::now();
+    bptree::HeapPageCache page_cache(path, false, CACHE_PAGES, 4096, options);
+    Tree tree(&page_cache);
+    auto t2 = high_resolution_clock::now();
+
+    std::vector<ValueType> values;
+    tree.get_value(keys[keys.size() / 2], values);
+    auto t3 = high_resolution_clock::now();
+
+    if (tree.size() != keys.size() || values.empty()) {
+        std::cerr << name << ": wrong tree after open" << std::endl;
+    }
+
+    std::cout << name << "," << (crash ? "crash" : "clean") << ","
+              << duration_cast<duration<double, std::milli>>(t2 - t1).count()
+              << "," << log_mb << ","
+              << duration_cast<duration<double, std::micro>>(t3 - t2).count()
+              << std::endl;
+
+    remove_files(path);
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 2000000;
+    size_t checkpoint_log_mb =
+        argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 16;
+
+    std::vector<KeyType> keys(num_keys);
+    std::mt19937_64 rng(0);
+    for (auto&& k : keys) {
+        k = rng();
+    }
+
+    std::cout << "log,close,open_ms,log_mb,first_lookup_us" << std::endl;
+
+    bptree::PageCacheOptions none;
+    run("none", none, keys, false);
+    run("none", none, keys, true);
+
+    bptree::PageCacheOptions no_checkpoints;
+    no_checkpoints.wal.enabled = true;
+    no_checkpoints.wal.checkpoint_log_size = 0;
+    run("wal_no_checkpoints", no_checkpoints, keys, false);
+    run("wal_no_checkpoints", no_checkpoints, keys, true);
+
+    bptree::PageCacheOptions checkpoints;
+    checkpoints.wal.enabled = true;
+    checkpoints.wal.checkpoint_log_size = checkpoint_log_mb << 20;
+    run("wal_checkpoints", checkpoints, keys, true);
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+/* compares range scans that hop between leaves through the sibling links
+ * (tree iterators) against scans that descend from the root for every leaf
+ * (collect_values() with the separator key of the next leaf). reports
+ * full-table scan throughput and short range scans per second, with all
+ * nodes cached and with a small node cache so that nodes on the descent are
+ * re-read from the page cache.
+ *
+ * usage: bptree_scan_bench [num_keys] [range_length] [num_ranges] */
+#include "bptree/mem_page_cache.h"
+#include "bptree/tree.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <random>
+#include <vector>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+static const unsigned int ORDER = 128;
+static const size_t SMALL_NODE_BUDGET = 1 << 20;
+
+using Tree = bptree::BTree<ORDER, KeyType, ValueType>;
+
+/* sum of the values of up to count pairs starting at key */
+static uint64_t scan_leaf_hop(Tree& tree, KeyType key, size_t count)
+{
+    uint64_t sum = 0;
+    for (auto it = tree.begin(key); it != tree.end() && count > 0;
+         ++it, count--) {
+        sum += it->second;
+    }
+    return sum;
+}
+
+static uint64_t scan_descend(Tree& tree, KeyType key, size_t count)
+{
+    std::vector<KeyType> keys;
+    std::vector<ValueType> values;
+    std::optional<KeyType> next_key;
+    KeyType search = key;
+    uint64_t sum = 0;
+
+    while (count > 0) {
+        next_key.reset();
+        tree.collect_values(search, &next_key, keys, values);
+
+        for (size_t i = 0; i < keys.size() && count > 0; i++) {
+            if (keys[i] < key) continue;
+            sum += values[i];
+            count--;
+        }
+
+        if (!next_key) break;
+        search = *next_key;
+    }
+
+    return sum;
+}
+
+template <typename Scan>
+static void run(const char* name, const char* cache, Tree& tree, size_t num_keys,
+                size_t range_length, size_t num_ranges, Scan&& scan)
+{
+    auto t1 = high_resolution_clock::now();
+    uint64_t full_sum = scan(tree, 0, num_keys);
+    auto t2 = high_resolution_clock::now();
+
+    std::mt19937_64 rng(0);
+    std::uniform_int_distribution<KeyType> dist(0, num_keys - 1);
+    uint64_t range_sum = 0;
+
+    auto t3 = high_resolution_clock::now();
+    for (size_t i = 0; i < num_ranges; i++) {
+        range_sum += scan(tree, dist(rng), range_length);
+    }
+    auto t4 = high_resolution_clock::now();
+
+    double full_time = duration_cast<duration<double>>(t2 - t1).count();
+    double range_time = duration_cast<duration<double>>(t4 - t3).count();
+
+    std::cout << name << "," << cache << "," << num_keys / full_time / 1e6 << ","
+              << num_ranges / range_time / 1e3 << "," << full_sum << ","
+              << range_sum << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1000000;
+    size_t range_length = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 100;
+    size_t num_ranges = argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 100000;
+
+    bptree::MemPageCache page_cache(4096);
+    Tree tree(&page_cache);
+
+    for (size_t i = 0; i < num_keys; i++) {
+        tree.insert(i, i);
+    }
+
+    std::cout << "scan,node_cache,full_scan_mkeys_per_sec,range_scans_k_per_sec,"
+                 "full_sum,range_sum"
+              << std::endl;
+
+    run("descend", "all", tree, num_keys, range_length, num_ranges,
+        scan_descend);
+    run("leaf_hop", "all", tree, num_keys, range_length, num_ranges,
+        scan_leaf_hop);
+
+    tree.set_node_cache_budget(SMALL_NODE_BUDGET);
+    run("descend", "small", tree, num_keys, range_length, num_ranges,
+        scan_descend);
+    run("leaf_hop", "small", tree, num_keys, range_length, num_ranges,
+        scan_leaf_hop);
+
+    return 0;
+}
@@ -0,0 +1,113 @@
+/* cost of snapshots for writers. threads insert new keys and update
+ * existing ones for a while without any snapshot, then while another thread
+ * takes snapshots back to back and scans each of them. reports the write
+ * throughput, the time of a full scan of a snapshot and the old page
+ * versions kept for the open snapshot at the end of each scan.
+ *
+ * usage: bptree_snapshot_bench [num_keys] [num_writers] [seconds] */
+#include "bptree/mem_page_cache.h"
+#include "bptree/tree.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+static const unsigned int ORDER = 128;
+
+using Tree = bptree::BTree<ORDER, KeyType, ValueType>;
+
+static void run(const char* name, size_t num_keys, size_t num_writers,
+                double seconds, bool scan)
+{
+    bptree::MemPageCache page_cache(4096);
+    Tree tree(&page_cache);
+
+    std::vector<std::pair<KeyType, ValueType>> pairs;
+    for (size_t i = 0; i < num_keys; i++) {
+        pairs.emplace_back(2 * i, i);
+    }
+    tree.bulk_load(pairs.begin(), pairs.end());
+
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> writes(0);
+    std::vector<std::thread> writers;
+
+    for (size_t t = 0; t < num_writers; t++) {
+        writers.emplace_back([&, t]() {
+            std::mt19937_64 rng(t);
+            size_t count = 0;
+            while (!stop.load(std::memory_order_relaxed)) {
+                KeyType key = rng() % (2 * num_keys);
+                if (key % 2) {
+                    tree.insert(key, key);
+                } else {
+                    tree.update(key, key);
+                }
+                count++;
+            }
+            writes.fetch_add(count);
+        });
+    }
+
+    size_t scans = 0, versions = 0;
+    double scan_ms = 0;
+    auto start = high_resolution_clock::now();
+    auto deadline = start + duration<double>(seconds);
+
+    if (scan) {
+        while (high_resolution_clock::now() < deadline) {
+            auto t1 = high_resolution_clock::now();
+            auto snap = tree.snapshot();
+            size_t count = 0;
+            for (auto it = snap->begin(); it != snap->end(); ++it) {
+                count++;
+            }
+            auto t2 = high_resolution_clock::now();
+
+            if (count != snap->size()) {
+                std::cerr << "snapshot returned " << count << " of "
+                          << snap->size() << " pairs" << std::endl;
+            }
+            scan_ms += duration_cast<duration<double, std::milli>>(t2 - t1)
+                           .count();
+            versions += tree.get_snapshot_stats().page_versions;
+            scans++;
+        }
+    } else {
+        std::this_thread::sleep_until(deadline);
+    }
+
+    stop.store(true);
+    for (auto&& p : writers) {
+        p.join();
+    }
+    double elapsed = duration_cast<duration<double>>(
+                         high_resolution_clock::now() - start)
+                         .count();
+
+    std::cout << name << "," << writes.load() / elapsed / 1e6 << ","
+              << (scans ? scan_ms / scans : 0) << ","
+              << (scans ? versions / scans : 0) << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_keys = argc > 1 ? std::atoll(argv[1]) : 2000000;
+    size_t num_writers = argc > 2 ? std::atoll(argv[2]) : 2;
+    double seconds = argc > 3 ? std::atof(argv[3]) : 3;
+
+    std::cout << "snapshots,mwrites_per_sec,scan_ms,page_versions"
+              << std::endl;
+    run("none", num_keys, num_writers, seconds, false);
+    run("scanning", num_keys, num_writers, seconds, true);
+    return 0;
+}
@@ -0,0 +1,118 @@
+/* multi-threaded random insert benchmark on a heap file page cache without a
+ * log and with a write-ahead log. with asynchronous commits, the log is
+ * synced every fsync interval in the background. with synchronous commits,
+ * every insert waits for the sync that covers it, so the inserts of all
+ * threads share one sync per interval (group commit). reports throughput in
+ * thousands of inserts per second and the log bytes and syncs per insert.
+ * the runs with synchronous commits insert the first num_sync_keys keys.
+ *
+ * usage: bptree_wal_bench [num_keys] [num_threads] [num_sync_keys] */
+#include "bptree/heap_page_cache.h"
+#include "bptree/tree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+static const unsigned int ORDER = 128;
+static const size_t CACHE_PAGES = 1 << 16;
+
+using Tree = bptree::BTree<ORDER, KeyType, ValueType>;
+
+static void run(const char* name, const bptree::WalOptions& wal_options,
+                const std::vector<KeyType>& keys, size_t num_threads)
+{
+    if (keys.empty()) return;
+
+    std::string path =
+        "/tmp/bptree_wal_bench_" + std::to_string(getpid()) + ".heap";
+    std::remove(path.c_str());
+    std::remove((path + ".wal").c_str());
+
+    bptree::PageCacheOptions options;
+    options.wal = wal_options;
+
+    double time;
+    uint64_t log_bytes = 0, syncs = 0;
+    {
+        bptree::HeapPageCache page_cache(path, true, CACHE_PAGES, 4096,
+                                         options);
+        Tree tree(&page_cache);
+
+        auto t1 = high_resolution_clock::now();
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < num_threads; i++) {
+            threads.emplace_back([i, num_threads, &keys, &tree]() {
+                for (size_t j = i; j < keys.size(); j += num_threads) {
+                    tree.insert(keys[j], j);
+                }
+            });
+        }
+        for (auto&& t : threads) {
+            t.join();
+        }
+        auto t2 = high_resolution_clock::now();
+        time = duration_cast<duration<double>>(t2 - t1).count();
+
+        if (auto* wal = page_cache.get_wal()) {
+            log_bytes = wal->get_bytes_written();
+            syncs = wal->get_sync_count();
+        }
+    }
+
+    std::cout << name << "," << num_threads << ","
+              << keys.size() / time / 1e3 << ","
+              << (double)log_bytes / keys.size() << ","
+              << (double)syncs / keys.size() << std::endl;
+
+    std::remove(path.c_str());
+    std::remove((path + ".wal").c_str());
+}
+
+int main(int argc, char* argv[])
+{
+    size_t num_keys = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 200000;
+    size_t num_threads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 8;
+    size_t num_sync_keys =
+        argc > 3 ? std::strtoull(argv[3], nullptr, 10) : 10000;
+
+    std::vector<KeyType> keys(num_keys);
+    std::mt19937_64 rng(0);
+    for (auto&& k : keys) {
+        k = rng();
+    }
+
+    std::cout << "log,threads,k_inserts_per_sec,log_bytes_per_insert,"
+                 "syncs_per_insert"
+              << std::endl;
+
+    bptree::WalOptions none;
+    run("none", none, keys, num_threads);
+
+    bptree::WalOptions async;
+    async.enabled = true;
+    run("async", async, keys, num_threads);
+
+    bptree::WalOptions sync;
+    sync.enabled = true;
+    sync.sync_commit = true;
+    std::vector<KeyType> sync_keys(
+        keys.begin(), keys.begin() + std::min(num_sync_keys, keys.size()));
+    for (size_t threads : {(size_t)1, num_threads}) {
+        run("sync", sync, sync_keys, threads);
+    }
+
+    return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef _BPTREE_CHECKSUM_H_
+#define _BPTREE_CHECKSUM_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace bptree {
+
+/* crc32c (Castagnoli) of len bytes. crc is the checksum of the bytes before
+ * buf, so that crc32c(b, crc32c(a)) is the checksum of a followed by b. the
+ * SSE4.2 crc32 instruction is used if the CPU has it (checked at run time),
+ * otherwise a table lookup per byte eight bytes at a time */
+uint32_t crc32c(const uint8_t* buf, size_t len, uint32_t crc = 0);
+
+/* the table-driven version that crc32c() falls back to */
+uint32_t crc32c_sw(const uint8_t* buf, size_t len, uint32_t crc = 0);
+
+/* whether crc32c() uses the crc32 instruction */
+bool crc32c_is_hardware();
+
+} // namespace bptree
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef _BPTREE_EPOCH_H_
+#define _BPTREE_EPOCH_H_
+
+#include "bptree/sharded_counter.h"
+
+#include <atomic>
+#include <cstdint>
+
+namespace bptree {
+
+/* epoch-based reclamation. readers of shared objects run inside a Guard,
+ * which counts the thread as active in the epoch it saw on entry. an object
+ * that is unlinked from the shared structure is retired with the current
+ * epoch and freed once the epoch is two steps ahead: the epoch only moves
+ * from e to e + 1 when no guard that entered in e - 1 is left, so at e + 2
+ * every guard that was active when the object was retired is gone.
+ *
+ * only the parity of the epoch of a guard matters, so the active guards are
+ * counted in two sharded counters. entering and leaving a guard touches the
+ * shard of the thread and no shared cache line */
+class EpochManager {
+public:
+    typedef uint64_t Epoch;
+
+    class Guard {
+    public:
+        explicit Guard(EpochManager& manager)
+        {
+            Epoch epoch = manager.epoch.load(std::memory_order_acquire);
+            active = &manager.active[epoch & 1];
+            active->add(1);
+            /* the count is visible before any shared object is read. the
+             * counter is updated with a relaxed add, which only this fence
+             * orders before the loads */
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+        ~Guard()
+        {
+            /* the reads of the guard are done before the count drops */
+            std::atomic_thread_fence(std::memory_order_release);
+            active->add(-1);
+        }
+
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+    private:
+        ShardedCounter* active;
+    };
+
+    EpochManager() : epoch(1) {}
+
+    EpochManager(const EpochManager&) = delete;
+    EpochManager& operator=(const EpochManager&) = delete;
+
+    Epoch get_epoch() const { return epoch.load(std::memory_order_acquire); }
+
+    /* move to the next epoch if the guards of the previous one are gone and
+     * return the current epoch. the caller serializes this with the
+     * retirement of objects, so that an object retired at e is unlinked
+     * before the epoch leaves e */
+    Epoch try_advance()
+    {
+        Epoch e = epoch.load(std::memory_order_relaxed);
+
+        /* pairs with the fence in Guard: a guard that is not counted here
+         * enters after the fence and cannot find the unlinked objects */
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (active[(e - 1) & 1].load() != 0) return e;
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        epoch.store(e + 1, std::memory_order_release);
+        return e + 1;
+    }
+
+    /* whether an object retired at the epoch can be freed */
+    bool is_safe(Epoch retired) const { return get_epoch() >= retired + 2; }
+
+private:
+    std::atomic<Epoch> epoch;
+    ShardedCounter active[2];
+};
+
+} // namespace bptree
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef _BPTREE_EXTERNAL_SORT_H_
+#define _BPTREE_EXTERNAL_SORT_H_
+
+#include "bptree/heap_file.h"
+#include "bptree/io_engine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <functional>
+#include <queue>
+#include <string>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace bptree {
+
+/* sorts key-value pairs with bounded memory. pairs are buffered until the
+ * buffer reaches memory_limit bytes, then sorted and spilled as a run to a
+ * temporary file in temp_dir. the sorted pairs are produced by merging the
+ * runs. pairs with equal keys keep their input order. keys and values are
+ * written to the runs as-is so they must be trivially copyable */
+template <typename K, typename V, typename KeyComparator = std::less<K>>
+class ExternalSorter {
+    static_assert(std::is_trivially_copyable<K>::value &&
+                      std::is_trivially_copyable<V>::value,
+                  "external sort requires trivially copyable keys and values");
+
+public:
+    ExternalSorter(size_t memory_limit, std::string_view temp_dir,
+                   KeyComparator kcmp = KeyComparator{})
+        : temp_dir(temp_dir), fd(-1), file_size(0), kcmp(kcmp)
+    {
+        buffer_pairs = std::max((size_t)1, memory_limit / sizeof(Pair));
+    }
+
+    ~ExternalSorter()
+    {
+        if (fd != -1) ::close(fd);
+    }
+
+    ExternalSorter(const ExternalSorter&) = delete;
+    ExternalSorter& operator=(const ExternalSorter&) = delete;
+
+    void add(const K& key, const V& value)
+    {
+        buffer.emplace_back(key, value);
+        if (buffer.size() >= buffer_pairs) spill();
+    }
+
+    /* call f for all pairs in key order. the sorter is empty afterwards */
+    void sort(const std::function<void(const K&, const V&)>& f)
+    {
+        if (runs.empty()) {
+            sort_buffer();
+            for (auto&& p : buffer) {
+                f(p.first, p.second);
+            }
+            buffer.clear();
+            return;
+        }
+
+        if (!buffer.empty()) spill();
+        buffer.clear();
+        buffer.shrink_to_fit();
+
+        merge(f);
+        runs.clear();
+        file_size = 0;
+    }
+
+    size_t get_num_runs() const { return runs.size(); }
+
+private:
+    using Pair = std::pair<K, V>;
+
+    struct Run {
+        off64_t offset;
+        size_t count;
+    };
+
+    /* read position in a run during the merge */
+    struct Cursor {
+        const Run* run;
+        size_t next;            /* next pair to read from the file */
+        std::vector<Pair> pairs; /* pairs read but not merged yet */
+        size_t pos;
+    };
+
+    std::string temp_dir;
+    int fd;
+    off64_t file_size;
+    KeyComparator kcmp;
+    size_t buffer_pairs;
+    std::vector<Pair> buffer;
+    std::vector<Run> runs;
+
+    void sort_buffer()
+    {
+        std::stable_sort(buffer.begin(), buffer.end(),
+                         [this](const Pair& a, const Pair& b) {
+                             return kcmp(a.first, b.first);
+                         });
+    }
+
+    /* runs are appended to one temporary file, which is unlinked right
+     * after it is created */
+    void open_file()
+    {
+        std::string path = temp_dir + "/bptree_sort_XXXXXX";
+        std::vector<char> name(path.begin(), path.end());
+        name.push_back('\0');
+
+        fd = ::mkstemp(name.data());
+        if (fd == -1) {
+            throw IOException(("unable to create run file(error code: " +
+                               std::to_string(errno) + ")")
+                                  .c_str());
+        }
+        ::unlink(name.data());
+    }
+
+    void spill()
+    {
+        if (fd == -1) open_file();
+
+        sort_buffer();
+        size_t bytes = buffer.size() * sizeof(Pair);
+        pwrite_full(fd, reinterpret_cast<const uint8_t*>(buffer.data()), bytes,
+                    file_size);
+
+        runs.push_back(Run{file_size, buffer.size()});
+        file_size += bytes;
+        buffer.clear();
+    }
+
+    void fill(Cursor& cursor, size_t batch)
+    {
+        size_t count = std::min(batch, cursor.run->count - cursor.next);
+        cursor.pairs.resize(count);
+        cursor.pos = 0;
+        if (!count) return;
+
+        pread_full(fd, reinterpret_cast<uint8_t*>(cursor.pairs.data()),
+                   count * sizeof(Pair),
+                   cursor.run->offset + cursor.next * sizeof(Pair));
+        cursor.next += count;
+    }
+
+    /* k-way merge. the memory budget is split between the read buffers of
+     * the runs */
+    void merge(const std::function<void(const K&, const V&)>& f)
+    {
+        size_t batch = std::max((size_t)1, buffer_pairs / runs.size());
+        std::vector<Cursor> cursors(runs.size());
+
+        /* ties are broken by the run index so that equal keys come out in
+         * input order */
+        auto greater = [this, &cursors](size_t a, size_t b) {
+            const K& ka = cursors[a].pairs[cursors[a].pos].first;
+            const K& kb = cursors[b].pairs[cursors[b].pos].first;
+            if (kcmp(kb, ka)) return true;
+            if (kcmp(ka, kb)) return false;
+            return a > b;
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(greater)>
+            heap(greater);
+
+        for (size_t i = 0; i < runs.size(); i++) {
+            cursors[i].run = &runs[i];
+            cursors[i].next = 0;
+            fill(cursors[i], batch);
+            if (!cursors[i].pairs.empty()) heap.push(i);
+        }
+
+        while (!heap.empty()) {
+            size_t i = heap.top();
+            heap.pop();
+
+            auto& cursor = cursors[i];
+            const auto& p = cursor.pairs[cursor.pos];
+            f(p.first, p.second);
+
+            if (++cursor.pos == cursor.pairs.size()) fill(cursor, batch);
+            if (cursor.pos < cursor.pairs.size()) heap.push(i);
+        }
+    }
+};
+
+} // namespace bptree
+
+#endif
@@ -1,11 +1,21 @@
 #ifndef _BPTREE_HEAP_FILE_H_
 #define _BPTREE_HEAP_FILE_H_
 
+#include "bptree/io_engine.h"
 #include "bptree/page.h"
+#include "bptree/page_codec.h"
 
+#include <atomic>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <set>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 
 namespace bptree {
 
@@ -14,33 +24,234 @@ public:
     IOException(const char* message) : runtime_error(message) {}
 };
 
+/* a page read from the file does not match its checksum or holds another
+ * page, e.g. after a torn write */
+class ChecksumException : public IOException {
+public:
+    ChecksumException(const char* message) : IOException(message) {}
+};
+
+/* when page checksums are verified */
+enum class ChecksumVerification {
+    /* every time a page is read */
+    ALWAYS,
+    /* the first time a page is read after the file is opened. pages
+     * written since then are not verified either, so a page that is
+     * evicted and read again costs no checksum */
+    FIRST_READ,
+};
+
+struct HeapFileOptions {
+    /* use io_uring for the asynchronous I/O interface. falls back to
+     * synchronous I/O if io_uring is not supported by the kernel */
+    bool use_io_uring = false;
+    unsigned int io_queue_depth = 128;
+
+    /* open the file with O_DIRECT to bypass the kernel page cache. the page
+     * size must be a multiple of DIRECT_IO_ALIGNMENT */
+    bool direct_io = false;
+
+    /* the file grows by this many pages at a time. the extent is
+     * preallocated with fallocate() where the file system supports it */
+    size_t extent_pages = 64;
+
+    /* compress pages on write-back and decompress them on reads. pages are
+     * stored in as many sectors as they take and are located through a
+     * page map, which is persisted with the free list. a new file uses
+     * this codec, an existing file keeps the codec it was created with.
+     * I/O on compressed files is always synchronous */
+    PageCompression compression = PageCompression::NONE;
+
+    /* store a crc32c of the page and its page ID in the page header (see
+     * Page) when a page is written and check them when it is read. a page
+     * that fails the check is not returned, ChecksumException is thrown
+     * instead. a new file uses this setting, an existing file keeps the
+     * one it was created with */
+    bool page_checksums = true;
+    ChecksumVerification verify_checksums = ChecksumVerification::ALWAYS;
+};
+
 class HeapFile {
 public:
-    explicit HeapFile(std::string_view filename, bool create, size_t page_size);
+    static const size_t DIRECT_IO_ALIGNMENT = 512;
+
+    explicit HeapFile(std::string_view filename, bool create, size_t page_size,
+                      const HeapFileOptions& options = HeapFileOptions{});
     ~HeapFile();
 
     bool is_open() const { return fd != -1; }
+    /* whether the file was created by the constructor */
+    bool is_new() const { return created; }
     size_t get_page_size() const { return page_size; }
 
+    /* allocate a page. the lowest free page is reused if there is one,
+     * otherwise the file grows by an extent when it is full */
     PageID new_page();
-    void read_page(Page* page, boost::upgrade_to_unique_lock<Page>& lock);
+    /* release the page for reuse by new_page() */
+    void free_page(PageID pid);
+    /* allocate a given page. used by recovery for pages that were allocated
+     * after the last sync(): the file is extended up to the page (the pages
+     * in between are free) or the page is taken out of the free list */
+    void reserve_page(PageID pid);
+
+    size_t get_num_pages() const { return file_size_pages.load(); }
+    size_t get_num_free_pages();
+
+    /* bytes of page data on disk. less than the pages in use take in
+     * memory if the file is compressed */
+    size_t get_stored_bytes();
+    bool is_compressed() const { return !!codec; }
+    bool has_checksums() const { return checksums; }
+
+    /* truncate the free pages at the end of the file. returns the number of
+     * pages released */
+    size_t shrink();
+
+    /* page I/O uses positional reads/writes and does not take the file
+     * mutex, so that I/O on different pages can proceed in parallel. pages
+     * are checksummed in place on writes, which is why the page lock must
+     * exclude other writers. a page read without verify is not checked
+     * against its checksum */
+    void read_page(Page* page, boost::upgrade_to_unique_lock<Page>& lock,
+                   bool verify = true);
     void write_page(Page* page, boost::upgrade_lock<Page>& lock);
 
+    /* read/write a run of pages with consecutive IDs with one vectored I/O */
+    void read_pages(Page* const* pages,
+                    boost::upgrade_to_unique_lock<Page>* locks, size_t count);
+    void write_pages(Page* const* pages, boost::upgrade_lock<Page>* locks,
+                     size_t count);
+
+    /* asynchronous interface. the pages need not be contiguous. the caller
+     * must hold the page locks until wait() returns for the ticket. without
+     * io_uring the I/O is done synchronously during submission. the pages
+     * read are verified in wait() */
+    bool is_async() const { return !!io_engine; }
+    uint64_t submit_read_pages(Page* const* pages,
+                               boost::upgrade_to_unique_lock<Page>* locks,
+                               size_t count);
+    uint64_t submit_write_pages(Page* const* pages,
+                                boost::upgrade_lock<Page>* locks, size_t count);
+    void wait(uint64_t ticket);
+
+    /* write the header, the free list and the page map and flush file data
+     * to the storage device. they are only updated on disk here, on shrink()
+     * and when the file is closed */
+    void sync();
+
 private:
     static const uint32_t MAGIC = 0xDEADBEEF;
+    static const uint32_t FREE_TRUNK_MAGIC = 0xF5EEF5EF;
+    static constexpr size_t TRUNK_HEADER_SIZE =
+        Page::HEADER_SIZE + 2 * sizeof(uint32_t);
+    /* header flags */
+    static const uint32_t FLAG_CHECKSUMS = 1;
+    /* unit of space allocation in compressed files */
+    static const size_t SECTOR_SIZE = DIRECT_IO_ALIGNMENT;
+
+    /* location of a compressed page. the page is stored uncompressed if its
+     * length is the page size and was never written if it is 0 */
+    struct PageExtent {
+        uint32_t sector;
+        uint32_t length;
+    };
 
     int fd;
+    bool created;
     size_t page_size;
-    uint32_t file_size_pages;
+    std::atomic<uint32_t> file_size_pages; /* pages in use, incl. free ones */
+    size_t capacity_pages;                 /* pages allocated on disk */
     std::string filename;
-    std::mutex mutex;
+    HeapFileOptions options;
+
+    std::mutex mutex; /* protects file growth, the header and the free list */
+    std::set<PageID> free_pages;
+    PageID free_list_head;
+    bool header_dirty;
+    std::unique_ptr<IOUringEngine> io_engine;
+
+    /* page checksums. with ChecksumVerification::FIRST_READ, a page is
+     * marked in verified_pages when it is verified or written. the bitmap
+     * has two levels of atomic words so that it is used without the mutex:
+     * chunks of VERIFIED_CHUNK_PAGES bits are allocated on first use */
+    static const size_t VERIFIED_CHUNK_PAGES = 1 << 16;
+    bool checksums;
+    std::unique_ptr<std::atomic<std::atomic<uint64_t>*>[]> verified_pages;
+    /* pages of asynchronous reads to verify in wait(), by ticket */
+    std::mutex verify_mutex;
+    std::unordered_map<uint64_t, std::vector<std::pair<PageID, uint8_t*>>>
+        pending_verifies;
+
+    /* compressed files. the page map and the free sectors are protected by
+     * the mutex. free extents are indexed by start and by length (best
+     * fit) */
+    std::unique_ptr<PageCodec> codec;
+    PageCompression compression;
+    std::vector<PageExtent> page_map;
+    PageExtent map_extent; /* where the page map is stored on disk */
+    std::map<uint32_t, uint32_t> free_extents;
+    std::set<std::pair<uint32_t, uint32_t>> free_extents_by_size;
+    /* the page map on disk is the one written last, or the one before it
+     * until the last one is synced. pages are moved to new sectors when
+     * they are written for the first time after the map is written. the
+     * sectors they leave (and the old map) are retired until the next map
+     * is written and unmapped until it is synced, then they are freed */
+    std::unordered_set<PageID> moved_pages;
+    std::vector<PageExtent> retired_extents;
+    std::vector<PageExtent> unmapped_extents;
+    size_t end_sector;       /* end of the allocated sectors */
+    size_t capacity_sectors; /* sectors allocated on disk */
+    size_t stored_bytes;
 
     void create();
     void open(bool create);
     void close();
 
+    int open_flags() const;
+    void check_page_id(PageID pid) const;
+
+    void grow(size_t min_pages);
+    void extend_file(off64_t offset, off64_t len);
+
     void read_header();
     void write_header();
+    void read_free_list();
+    void write_free_list();
+    /* write the free list, the page map and the header. called with the
+     * mutex held or when no other thread uses the file */
+    void write_metadata();
+
+    /* page I/O through the page map. write_mapped() takes the mutex unless
+     * the caller holds it */
+    void read_block(PageID pid, uint8_t* buf);
+    void write_block(PageID pid, const uint8_t* buf, bool locked = false);
+    void read_mapped(PageID pid, uint8_t* buf);
+    void write_mapped(PageID pid, const uint8_t* buf, bool locked);
+
+    /* sector allocation. called with the mutex held */
+    static size_t sectors_of(size_t bytes)
+    {
+        return (bytes + SECTOR_SIZE - 1) / SECTOR_SIZE;
+    }
+    size_t header_sectors() const { return sectors_of(page_size); }
+    uint32_t place_page(PageID pid, size_t length);
+    void release_page(PageID pid);
+    uint32_t alloc_sectors(size_t count);
+    void free_sectors(uint32_t sector, size_t count);
+    void unmap_extent(PageID pid, const PageExtent& extent);
+    void free_unmapped(std::vector<PageExtent>& extents);
+    void add_free_extent(uint32_t sector, size_t count);
+
+    /* set the checksum and the page ID of a page about to be written, and
+     * check them on a page that was read */
+    void seal_page(PageID pid, uint8_t* buf);
+    void verify_page(PageID pid, const uint8_t* buf);
+    bool is_verified(PageID pid) const;
+    void set_verified(PageID pid);
+
+    void read_page_map();
+    PageExtent write_page_map();
+    void build_free_extents();
 };
 
 } // namespace bptree
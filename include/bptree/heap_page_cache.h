@@ -3,51 +3,141 @@
 
 #include "bptree/heap_file.h"
 #include "bptree/page_cache.h"
+#include "bptree/replacer.h"
+#include "bptree/wal.h"
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdint>
-#include <deque>
-#include <list>
 #include <memory>
 #include <mutex>
+#include <optional>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 namespace bptree {
 
+struct PageCacheOptions {
+    HeapFileOptions heap_file;
+
+    /* page replacement policy and number of page table partitions */
+    ReplacementPolicy replacement_policy = ReplacementPolicy::CLOCK;
+    size_t num_shards = 16;
+
+    /* max. number of pages written back in one I/O batch */
+    size_t write_back_batch = 32;
+
+    /* write every dirty page back when it is unpinned */
+    bool write_through = false;
+
+    /* background flusher: write back dirty pages when more than
+     * dirty_ratio * max_pages pages are dirty or when a page has been dirty
+     * for longer than max_dirty_age */
+    bool background_flush = false;
+    double dirty_ratio = 0.5;
+    std::chrono::milliseconds max_dirty_age{1000};
+    std::chrono::milliseconds flush_interval{100};
+
+    /* write-ahead log. a page is only written back once the log entries
+     * of its changes are durable */
+    WalOptions wal;
+};
+
 class HeapPageCache : public AbstractPageCache {
 public:
     HeapPageCache(std::string_view filename, bool create,
-                  size_t max_pages = 4096, size_t page_size = 4096);
+                  size_t max_pages = 4096, size_t page_size = 4096,
+                  const PageCacheOptions& options = PageCacheOptions{});
+    ~HeapPageCache();
 
     virtual Page* new_page(boost::upgrade_lock<Page>& lock);
     virtual Page* fetch_page(PageID id, boost::upgrade_lock<Page>& lock);
+    virtual Page* fetch_page_unchecked(PageID id,
+                                       boost::upgrade_lock<Page>& lock);
+    virtual bool has_page(PageID id) const
+    {
+        return id < heap_file->get_num_pages();
+    }
+    virtual void free_page(PageID id);
+
+    virtual void prefetch_pages(const PageID* ids, size_t count);
 
-    virtual void pin_page(Page* page, boost::upgrade_lock<Page>& lock);
+    virtual void pin_page(Page* page);
     virtual void unpin_page(Page* page, bool dirty, boost::upgrade_lock<Page>& lock);
 
     virtual void flush_page(Page* page, boost::upgrade_lock<Page>& lock);
     virtual void flush_all_pages();
+    virtual void sync() { heap_file->sync(); }
+    virtual size_t shrink() { return heap_file->shrink(); }
 
-    virtual size_t size() const { return pages.size(); }
+    virtual WriteAheadLog* get_wal() const { return wal.get(); }
+    virtual void reserve_page(PageID id) { heap_file->reserve_page(id); }
+
+    virtual size_t size() const { return num_frames.load(); }
+    virtual size_t get_capacity() const { return max_pages; }
     virtual size_t get_page_size() const { return page_size; }
 
+    size_t get_dirty_page_count() const { return dirty_pages.load(); }
+    HeapFile* get_heap_file() const { return heap_file.get(); }
+
 private:
+    /* page table partition. a page hit only takes the latch of its shard */
+    struct alignas(64) Shard {
+        std::mutex mutex;
+        std::unordered_map<PageID, Page*> page_map;
+    };
+
     std::unique_ptr<HeapFile> heap_file;
+    std::unique_ptr<WriteAheadLog> wal;
     size_t page_size;
     size_t max_pages;
-    std::mutex mutex;
-    std::mutex lru_mutex;
+    PageCacheOptions options;
+
+    std::vector<Shard> shards;
+    std::unique_ptr<AbstractReplacer> replacer;
+
+    /* frame allocation (miss path only) */
+    std::mutex frame_mutex;
+    std::vector<std::unique_ptr<Page>> frames;
+    std::atomic<size_t> num_frames;
+    std::vector<Page*> free_list;
+
+    std::atomic<size_t> dirty_pages;
+    std::thread flusher_thread;
+    std::mutex flusher_mutex;
+    std::condition_variable flusher_cv;
+    bool flusher_stop;
+
+    Shard& get_shard(PageID id) { return shards[id % shards.size()]; }
 
-    std::list<std::unique_ptr<Page>> pages;
-    std::unordered_map<PageID, Page*> page_map;
-    std::list<PageID> lru_list;
-    std::unordered_map<PageID, std::list<PageID>::iterator> lru_map;
+    /* get an unmapped frame, evicting a page if necessary. the frame is
+     * returned with its lock held */
+    Page* alloc_frame(boost::upgrade_lock<Page>& lock);
+    Page* fetch_page_impl(PageID id, boost::upgrade_lock<Page>& lock,
+                          bool verify);
+    Page* evict_frame(boost::upgrade_lock<Page>& lock);
+    void free_frame(Page* page);
+    /* drop a page freed while it was pinned once it is unpinned */
+    void release_freed_page(Page* page);
+    /* map the frame to the page ID. returns the page already mapped to the
+     * ID (pinned) if another thread has loaded it in the meantime */
+    Page* install_page(Page* page, PageID id, bool pin);
 
-    Page* alloc_page(PageID new_id, boost::upgrade_lock<Page>& lock);
+    void write_back_victim(Page* victim, boost::upgrade_lock<Page>& lock);
 
-    void lru_insert(PageID id);
-    void lru_erase(PageID id);
-    bool lru_victim(PageID& id);
+    /* write back dirty pages in page ID order. if min_age is given, only
+     * pages that have been dirty for at least min_age are written */
+    void flush_dirty_pages(
+        std::optional<std::chrono::steady_clock::duration> min_age);
+    void write_back_pages(std::vector<Page*>& batch,
+                          std::vector<boost::upgrade_lock<Page>>& locks);
+    /* make the log entries of the locked pages durable before the pages
+     * are written */
+    void flush_log(Page* const* pages, boost::upgrade_lock<Page>* locks,
+                   size_t count);
+    void flusher_main();
 };
 
 } // namespace bptree
@@ -0,0 +1,99 @@
+#ifndef _BPTREE_IO_ENGINE_H_
+#define _BPTREE_IO_ENGINE_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unordered_map>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace bptree {
+
+/* positional I/O helpers. they transfer exactly the requested number of
+ * bytes, retrying on EINTR and short transfers, and throw IOException on
+ * failure. iov is modified to track progress */
+void pread_full(int fd, uint8_t* buf, size_t count, off64_t offset);
+void pwrite_full(int fd, const uint8_t* buf, size_t count, off64_t offset);
+void preadv_full(int fd, struct iovec* iov, int iovcnt, off64_t offset);
+void pwritev_full(int fd, struct iovec* iov, int iovcnt, off64_t offset);
+
+struct IORequest {
+    enum class Op { READ, WRITE };
+
+    Op op;
+    uint8_t* buf;
+    size_t len;
+    off64_t offset;
+};
+
+/* asynchronous I/O engine backed by io_uring. the ring is driven directly
+ * through the io_uring_setup/io_uring_enter system calls */
+class IOUringEngine {
+public:
+    /* throws IOException if io_uring is not available */
+    IOUringEngine(int fd, unsigned int queue_depth);
+    ~IOUringEngine();
+
+    /* queue a batch of requests and return a ticket for the batch */
+    uint64_t submit(const IORequest* reqs, size_t count);
+    /* block until all requests in the batch are completed. throws
+     * IOException if any of them failed */
+    void wait(uint64_t ticket);
+
+private:
+    struct Batch {
+        size_t remaining;
+        std::string error;
+    };
+
+    struct InFlight {
+        uint64_t ticket;
+        IORequest req;
+    };
+
+    int fd;
+    int ring_fd;
+    /* protects the rings and the requests. a thread that blocks for
+     * completions drops it and sets reaping, see wait_completion() */
+    std::mutex mutex;
+    std::condition_variable completion_cv;
+    bool reaping;
+
+    void* sq_ring;
+    void* cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned sq_entries;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    io_uring_cqe* cqes;
+
+    unsigned pending; /* queued but not yet submitted to the kernel */
+    uint64_t next_ticket;
+    uint64_t next_user_data;
+    std::unordered_map<uint64_t, Batch> batches;
+    std::unordered_map<uint64_t, InFlight> in_flight;
+
+    void push_sqe(uint64_t user_data, const IORequest& req);
+    void submit_pending(std::unique_lock<std::mutex>& guard);
+    void wait_completion(std::unique_lock<std::mutex>& guard);
+    void reap();
+};
+
+} // namespace bptree
+
+#endif
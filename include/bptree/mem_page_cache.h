@@ -19,6 +19,7 @@ public:
         page_map[id] = std::make_unique<Page>(id, page_size);
         Page* page = page_map[id].get();
         lock = boost::upgrade_lock<Page>(*page);
+        page->pin();
         return page;
     }
 
@@ -28,22 +29,46 @@ public:
         auto it = page_map.find(id);
         if (it == page_map.end()) return nullptr;
         lock = boost::upgrade_lock<Page>(*it->second);
+        it->second->pin();
         return it->second.get();
     }
 
-    virtual void pin_page(Page* page, boost::upgrade_lock<Page>&) {}
-    virtual void unpin_page(Page* page, bool dirty, boost::upgrade_lock<Page>&) {}
+    virtual bool has_page(PageID id) const
+    {
+        std::shared_lock<std::shared_mutex> guard(mutex);
+        return page_map.find(id) != page_map.end();
+    }
+
+    virtual void free_page(PageID id)
+    {
+        std::unique_lock<std::shared_mutex> guard(mutex);
+        auto it = page_map.find(id);
+        /* pages still pinned (e.g. by an iterator) are kept until the
+         * cache is destroyed so that their IDs are not reused */
+        if (it == page_map.end() || it->second->get_pin_count() > 0) return;
+        page_map.erase(it);
+    }
+
+    virtual void prefetch_pages(const PageID* ids, size_t count) {}
+
+    virtual void pin_page(Page* page) { page->pin(); }
+    virtual void unpin_page(Page* page, bool dirty, boost::upgrade_lock<Page>&)
+    {
+        page->unpin();
+    }
 
     virtual void flush_page(Page* page, boost::upgrade_lock<Page>&) {}
     virtual void flush_all_pages() {}
+    virtual size_t shrink() { return 0; }
 
     virtual size_t size() const { return page_map.size(); }
+    virtual size_t get_capacity() const { return 0; }
     virtual size_t get_page_size() const { return page_size; }
 
 private:
     size_t page_size;
     std::atomic<PageID> next_id;
-    std::shared_mutex mutex;
+    mutable std::shared_mutex mutex;
     std::unordered_map<PageID, std::unique_ptr<Page>> page_map;
 
     PageID get_next_id() { return next_id++; }
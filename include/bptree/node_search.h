@@ -0,0 +1,230 @@
+#ifndef _BPTREE_NODE_SEARCH_H_
+#define _BPTREE_NODE_SEARCH_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+namespace bptree {
+
+static constexpr size_t CACHE_LINE_SIZE = 64;
+
+/* keys that are searched in a node with the integer kernels below instead of
+ * std::lower_bound()/std::upper_bound(): 32 and 64-bit integers ordered by
+ * std::less. specialize it for a comparator that orders integers the same
+ * way to use the kernels with it */
+template <typename K, typename KeyComparator>
+struct is_simd_searchable
+    : std::integral_constant<
+          bool, std::is_integral<K>::value &&
+                    (sizeof(K) == 4 || sizeof(K) == 8) &&
+                    (std::is_same<KeyComparator, std::less<K>>::value ||
+                     std::is_same<KeyComparator, std::less<>>::value)> {};
+
+namespace detail {
+
+/* a node is narrowed down by a branchless binary search to at most
+ * SEARCH_BLOCK keys, which are then compared against the key all at once */
+static constexpr size_t SEARCH_BLOCK = 32;
+
+/* number of keys below key (or not above key if inclusive) in a sorted
+ * block. with AVX-512 or AVX2 (the build has to enable them, e.g. with
+ * -march=native) the keys are compared a vector at a time */
+template <typename K, bool inclusive>
+inline size_t count_below(const K* keys, size_t n, K key)
+{
+    size_t i = 0, count = 0;
+
+#if defined(__AVX512F__)
+    if constexpr (sizeof(K) == 8) {
+        __m512i k = _mm512_set1_epi64((long long)key);
+        for (; i + 8 <= n; i += 8) {
+            __m512i v = _mm512_loadu_si512(keys + i);
+            __mmask8 m;
+            if constexpr (std::is_signed<K>::value) {
+                m = inclusive ? _mm512_cmple_epi64_mask(v, k)
+                              : _mm512_cmplt_epi64_mask(v, k);
+            } else {
+                m = inclusive ? _mm512_cmple_epu64_mask(v, k)
+                              : _mm512_cmplt_epu64_mask(v, k);
+            }
+            count += __builtin_popcount(m);
+        }
+    } else {
+        __m512i k = _mm512_set1_epi32((int)key);
+        for (; i + 16 <= n; i += 16) {
+            __m512i v = _mm512_loadu_si512(keys + i);
+            __mmask16 m;
+            if constexpr (std::is_signed<K>::value) {
+                m = inclusive ? _mm512_cmple_epi32_mask(v, k)
+                              : _mm512_cmplt_epi32_mask(v, k);
+            } else {
+                m = inclusive ? _mm512_cmple_epu32_mask(v, k)
+                              : _mm512_cmplt_epu32_mask(v, k);
+            }
+            count += __builtin_popcount(m);
+        }
+    }
+#elif defined(__AVX2__)
+    /* AVX2 only has signed compares, unsigned keys are compared with their
+     * sign bits flipped */
+    if constexpr (sizeof(K) == 8) {
+        const __m256i flip = std::is_signed<K>::value
+                                 ? _mm256_setzero_si256()
+                                 : _mm256_set1_epi64x(INT64_MIN);
+        __m256i k = _mm256_xor_si256(_mm256_set1_epi64x((long long)key), flip);
+        for (; i + 4 <= n; i += 4) {
+            __m256i v = _mm256_xor_si256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)),
+                flip);
+            __m256i m = inclusive ? _mm256_cmpgt_epi64(v, k)
+                                  : _mm256_cmpgt_epi64(k, v);
+            int bits = __builtin_popcount(
+                _mm256_movemask_pd(_mm256_castsi256_pd(m)));
+            count += inclusive ? 4 - bits : bits;
+        }
+    } else {
+        const __m256i flip = std::is_signed<K>::value
+                                 ? _mm256_setzero_si256()
+                                 : _mm256_set1_epi32(INT32_MIN);
+        __m256i k = _mm256_xor_si256(_mm256_set1_epi32((int)key), flip);
+        for (; i + 8 <= n; i += 8) {
+            __m256i v = _mm256_xor_si256(
+                _mm256_loadu_si256(reinterpret_cast<const __m256i*>(keys + i)),
+                flip);
+            __m256i m = inclusive ? _mm256_cmpgt_epi32(v, k)
+                                  : _mm256_cmpgt_epi32(k, v);
+            int bits = __builtin_popcount(
+                _mm256_movemask_ps(_mm256_castsi256_ps(m)));
+            count += inclusive ? 8 - bits : bits;
+        }
+    }
+#endif
+
+    for (; i < n; i++) {
+        count += inclusive ? !(key < keys[i]) : keys[i] < key;
+    }
+    return count;
+}
+
+template <typename K, bool inclusive>
+inline size_t search(const K* keys, size_t n, K key)
+{
+    const K* base = keys;
+    while (n > SEARCH_BLOCK) {
+        size_t half = n / 2;
+        bool right = inclusive ? !(key < base[half]) : base[half] < key;
+        base = right ? base + half + 1 : base;
+        n = right ? n - half - 1 : half;
+    }
+    return (base - keys) + count_below<K, inclusive>(base, n, key);
+}
+
+} // namespace detail
+
+/* index of the first of the n sorted keys that is not below key */
+template <typename K, typename KeyComparator>
+inline size_t node_lower_bound(const K* keys, size_t n, const K& key,
+                               const KeyComparator& kcmp)
+{
+    if constexpr (is_simd_searchable<K, KeyComparator>::value) {
+        return detail::search<K, false>(keys, n, key);
+    } else {
+        return std::lower_bound(keys, keys + n, key, kcmp) - keys;
+    }
+}
+
+/* index of the first of the n sorted keys that is above key */
+template <typename K, typename KeyComparator>
+inline size_t node_upper_bound(const K* keys, size_t n, const K& key,
+                               const KeyComparator& kcmp)
+{
+    if constexpr (is_simd_searchable<K, KeyComparator>::value) {
+        return detail::search<K, true>(keys, n, key);
+    } else {
+        return std::upper_bound(keys, keys + n, key, kcmp) - keys;
+    }
+}
+
+/* summary of the sorted keys of a node for the searches above. keys that
+ * are not searched with the integer kernels have no summary and are searched
+ * directly */
+template <typename K, typename KeyComparator,
+          bool = is_simd_searchable<K, KeyComparator>::value>
+class KeySummary {
+public:
+    void build(const K* keys, size_t n) {}
+
+    size_t lower_bound(const K* keys, size_t n, const K& key,
+                       const KeyComparator& kcmp) const
+    {
+        return node_lower_bound(keys, n, key, kcmp);
+    }
+    size_t upper_bound(const K* keys, size_t n, const K& key,
+                       const KeyComparator& kcmp) const
+    {
+        return node_upper_bound(keys, n, key, kcmp);
+    }
+};
+
+/* the keys at stride - 1, 2 * stride - 1, ... in one cache line. a search
+ * counts the samples below the key and then searches only the segment
+ * between two samples, so it reads the summary line and the one or two
+ * lines of a segment instead of one line per step of a binary search over
+ * the node. the summary is read optimistically along with the node, so the
+ * searches stay within the n keys even if it is stale */
+template <typename K, typename KeyComparator>
+class alignas(CACHE_LINE_SIZE) KeySummary<K, KeyComparator, true> {
+public:
+    static constexpr size_t SIZE =
+        (CACHE_LINE_SIZE - 2 * sizeof(uint32_t)) / sizeof(K);
+
+    KeySummary() : count(0), stride(1) {}
+
+    void build(const K* keys, size_t n)
+    {
+        /* at most SIZE + 1 segments */
+        stride = (uint32_t)((n + SIZE + 1) / (SIZE + 1));
+        count = (uint32_t)(n / stride);
+        for (size_t i = 0; i < count; i++) {
+            samples[i] = keys[(i + 1) * stride - 1];
+        }
+    }
+
+    size_t lower_bound(const K* keys, size_t n, const K& key,
+                       const KeyComparator&) const
+    {
+        return search<false>(keys, n, key);
+    }
+    size_t upper_bound(const K* keys, size_t n, const K& key,
+                       const KeyComparator&) const
+    {
+        return search<true>(keys, n, key);
+    }
+
+private:
+    K samples[SIZE];
+    uint32_t count;
+    uint32_t stride;
+
+    template <bool inclusive>
+    size_t search(const K* keys, size_t n, K key) const
+    {
+        size_t segment = detail::count_below<K, inclusive>(
+            samples, std::min((size_t)count, SIZE), key);
+        size_t first = std::min(segment * stride, n);
+        size_t last = std::min(first + stride - 1, n);
+        return first + detail::search<K, inclusive>(keys + first, last - first,
+                                                    key);
+    }
+};
+
+} // namespace bptree
+
+#endif
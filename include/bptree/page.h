@@ -2,8 +2,11 @@
 #define _BPTREE_PAGE_H_
 
 #include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <mutex>
 #include <boost/thread.hpp>
@@ -15,11 +18,45 @@ typedef uint32_t PageID;
 
 class Page : public boost::upgrade_lockable_adapter<boost::shared_mutex> {
 public:
-    static const PageID INVALID_PAGE_ID = 0;
+    static constexpr PageID INVALID_PAGE_ID = 0;
+    /* page buffers are aligned for direct I/O */
+    static constexpr size_t BUFFER_ALIGNMENT = 4096;
 
-    explicit Page(PageID id, size_t size) : id(id), size(size), dirty(false), pin_count(0)
+    /* pages of a tree start with a header: | tag(4 bytes) | LSN(8 bytes) |
+     * | checksum(4 bytes) | page ID(4 bytes) |. the tag tells what the page
+     * holds and the LSN is the end of the log entry of the last logged
+     * change to the page (0 if none). the checksum and the page ID are set
+     * by the heap file when the page is written, see
+     * HeapFileOptions::page_checksums */
+    static constexpr size_t LSN_OFFSET = sizeof(uint32_t);
+    static constexpr size_t CHECKSUM_OFFSET = LSN_OFFSET + sizeof(uint64_t);
+    static constexpr size_t PAGE_ID_OFFSET = CHECKSUM_OFFSET + sizeof(uint32_t);
+    static constexpr size_t HEADER_SIZE = PAGE_ID_OFFSET + sizeof(PageID);
+    /* LSN of a page with changes that could not be logged. such a page is
+     * not written back, see HeapPageCache::flush_log() */
+    static constexpr uint64_t UNLOGGED_LSN = UINT64_MAX;
+
+    static uint64_t read_lsn(const uint8_t* buf)
+    {
+        uint64_t lsn;
+        ::memcpy(&lsn, &buf[LSN_OFFSET], sizeof(lsn));
+        return lsn;
+    }
+    static void write_lsn(uint8_t* buf, uint64_t lsn)
     {
-        buffer = std::make_unique<uint8_t[]>(size);
+        ::memcpy(&buf[LSN_OFFSET], &lsn, sizeof(lsn));
+    }
+
+    explicit Page(PageID id, size_t size)
+        : id(id), size(size), frame(0), dirty(false), dirty_since(0),
+          pin_count(0), free_pending(false)
+    {
+        size_t alloc_size =
+            (size + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+        buffer.reset(static_cast<uint8_t*>(
+            std::aligned_alloc(BUFFER_ALIGNMENT, alloc_size)));
+        if (!buffer) throw std::bad_alloc();
+        ::memset(buffer.get(), 0, alloc_size);
     }
 
     uint8_t* get_buffer(boost::upgrade_to_unique_lock<Page>&) {
@@ -32,20 +69,61 @@ public:
 
     int32_t pin() { return pin_count.fetch_add(1); }
     int32_t unpin() { return pin_count.fetch_add(-1); }
+    int32_t get_pin_count() const { return pin_count.load(); }
+
+    void set_id(PageID pid) { id.store(pid); }
+    PageID get_id() const { return id.load(); }
 
-    void set_id(PageID pid) { id = pid; }
-    PageID get_id() const { return id; }
+    /* slot of the page in the page cache */
+    size_t get_frame() const { return frame; }
+    void set_frame(size_t f) { frame = f; }
     size_t get_size() const { return size; }
 
-    bool is_dirty() const { return dirty; }
-    void set_dirty(bool d) { dirty = d; }
+    bool is_dirty() const { return dirty.load(); }
+    void set_dirty(bool d) { dirty.store(d); }
+
+    /* mark the page dirty. the flag is sticky: it is only cleared when the
+     * page is written back. returns true if the page was clean before */
+    bool mark_dirty()
+    {
+        if (dirty.load(std::memory_order_relaxed)) return false;
+        if (dirty.exchange(true)) return false;
+
+        dirty_since.store(
+            std::chrono::steady_clock::now().time_since_epoch().count());
+        return true;
+    }
+
+    /* clear the dirty flag before the page is written back. returns true if
+     * the page was dirty */
+    bool clear_dirty() { return dirty.exchange(false); }
+
+    /* the page was freed while pinned and is released by the last unpin.
+     * take_free_pending() returns whether it was set and clears it */
+    void set_free_pending() { free_pending.store(true); }
+    bool is_free_pending() const { return free_pending.load(); }
+    bool take_free_pending() { return free_pending.exchange(false); }
+
+    /* time when the page became dirty */
+    std::chrono::steady_clock::time_point get_dirty_since() const
+    {
+        return std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(dirty_since.load()));
+    }
 
 private:
-    PageID id;
-    std::unique_ptr<uint8_t[]> buffer;
+    struct BufferDeleter {
+        void operator()(uint8_t* p) const { std::free(p); }
+    };
+
+    std::atomic<PageID> id;
+    std::unique_ptr<uint8_t[], BufferDeleter> buffer;
     size_t size;
-    bool dirty;
+    size_t frame;
+    std::atomic<bool> dirty;
+    std::atomic<std::chrono::steady_clock::rep> dirty_since;
     std::atomic<int32_t> pin_count;
+    std::atomic<bool> free_pending;
     std::mutex mutex;
 };
 
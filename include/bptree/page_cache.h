@@ -5,18 +5,53 @@
 
 namespace bptree {
 
+class WriteAheadLog;
+
 class AbstractPageCache {
 public:
     virtual Page* new_page(boost::upgrade_lock<Page>& lock) = 0;
+    /* returns nullptr if the page cannot be read. a page that fails its
+     * checksum throws ChecksumException */
     virtual Page* fetch_page(PageID id, boost::upgrade_lock<Page>& lock) = 0;
-
-    virtual void pin_page(Page* page, boost::upgrade_lock<Page>&) = 0;
+    /* fetch a page without checking its checksum. used by recovery to
+     * overwrite a page torn by a crash with its logged image */
+    virtual Page* fetch_page_unchecked(PageID id,
+                                       boost::upgrade_lock<Page>& lock)
+    {
+        return fetch_page(id, lock);
+    }
+    /* whether the page exists in the backing store. a fresh store has no
+     * pages to fetch */
+    virtual bool has_page(PageID id) const = 0;
+    /* drop the page from the cache and release its ID for reuse. the page
+     * must not be pinned by the caller */
+    virtual void free_page(PageID id) = 0;
+    /* hint that the pages will be fetched soon */
+    virtual void prefetch_pages(const PageID* ids, size_t count) = 0;
+
+    /* pin a page that the caller holds a reference to, e.g. through the
+     * node that owns the page */
+    virtual void pin_page(Page* page) = 0;
     virtual void unpin_page(Page* page, bool dirty, boost::upgrade_lock<Page>&) = 0;
 
     virtual void flush_page(Page* page, boost::upgrade_lock<Page>&) = 0;
     virtual void flush_all_pages() = 0;
+    /* make the pages flushed so far durable */
+    virtual void sync() {}
+    /* release the free pages at the end of the backing store. returns the
+     * number of pages released */
+    virtual size_t shrink() = 0;
+
+    /* the log that changes to the pages are written to ahead of the pages,
+     * nullptr if they are not logged */
+    virtual WriteAheadLog* get_wal() const { return nullptr; }
+    /* make sure that the page is allocated. called by recovery for pages
+     * whose allocation may have been lost in a crash */
+    virtual void reserve_page(PageID id) {}
 
     virtual size_t size() const = 0;
+    /* max. number of resident pages, 0 if unbounded */
+    virtual size_t get_capacity() const = 0;
     virtual size_t get_page_size() const = 0;
 };
 
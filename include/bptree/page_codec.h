@@ -0,0 +1,50 @@
+#ifndef _BPTREE_PAGE_CODEC_H_
+#define _BPTREE_PAGE_CODEC_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace bptree {
+
+/* compression of the pages in a heap file. the value is stored in the file
+ * header so that the file is always read with the codec it was written with */
+enum class PageCompression : uint32_t { NONE = 0, DELTA_VARINT = 1 };
+
+/* compresses one page at a time. codecs are stateless and shared by all
+ * threads doing I/O on a heap file */
+class PageCodec {
+public:
+    virtual ~PageCodec() {}
+
+    /* compress a page of size bytes into dst, which has room for size
+     * bytes. returns the compressed length, or 0 if the page does not get
+     * smaller */
+    virtual size_t compress(const uint8_t* src, size_t size,
+                            uint8_t* dst) const = 0;
+
+    /* decompress len bytes into a page of size bytes. returns false if the
+     * compressed bytes are corrupt */
+    virtual bool decompress(const uint8_t* src, size_t len, uint8_t* dst,
+                            size_t size) const = 0;
+};
+
+/* built-in codec for pages of integers. the page is read as 64-bit words
+ * and each word is stored as the zigzag varint of its difference to the
+ * previous word, with runs of equal differences stored once. sorted integer
+ * keys, page IDs and the zeroed free space of a node shrink to a few bytes
+ * each, pages of random bytes are left uncompressed */
+class DeltaVarintCodec : public PageCodec {
+public:
+    virtual size_t compress(const uint8_t* src, size_t size,
+                            uint8_t* dst) const;
+    virtual bool decompress(const uint8_t* src, size_t len, uint8_t* dst,
+                            size_t size) const;
+};
+
+/* nullptr for PageCompression::NONE */
+std::unique_ptr<PageCodec> create_page_codec(PageCompression compression);
+
+} // namespace bptree
+
+#endif
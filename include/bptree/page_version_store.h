@@ -0,0 +1,100 @@
+#ifndef _BPTREE_PAGE_VERSION_STORE_H_
+#define _BPTREE_PAGE_VERSION_STORE_H_
+
+#include "bptree/page.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+namespace bptree {
+
+struct SnapshotStats {
+    size_t snapshots;     /* open snapshots */
+    size_t page_versions; /* old page images kept for them */
+    size_t bytes;         /* size of the page images */
+};
+
+/* old versions of pages kept for snapshots. changes are numbered by
+ * versions: a snapshot taken at version s sees the pages as they were
+ * before any change made at a version after s. the first time a page is
+ * changed at a version, its previous image is copied here if an open
+ * snapshot may see it (copy-on-write), and the image is dropped when the
+ * last snapshot that sees it is released. pages that are not changed while
+ * a snapshot is open are read from the page cache as usual */
+class PageVersionStore {
+public:
+    typedef uint64_t Version;
+    typedef std::shared_ptr<const std::vector<uint8_t>> Image;
+
+    PageVersionStore();
+
+    PageVersionStore(const PageVersionStore&) = delete;
+    PageVersionStore& operator=(const PageVersionStore&) = delete;
+
+    /* open a snapshot at the current version and start a new version. no
+     * page may be changed meanwhile */
+    Version acquire();
+    /* close a snapshot and drop the images no other snapshot sees */
+    void release(Version version);
+
+    bool has_snapshots() const
+    {
+        return num_snapshots.load(std::memory_order_acquire) > 0;
+    }
+
+    /* called with the page latched exclusively before it is changed or
+     * freed. buf holds the whole page */
+    void before_write(PageID pid, const uint8_t* buf, size_t size)
+    {
+        if (has_snapshots()) preserve(pid, buf, size);
+    }
+
+    /* the image of the page that a snapshot at version sees, or nullptr if
+     * it sees the current page */
+    Image find(PageID pid, Version version);
+
+    SnapshotStats get_stats();
+
+private:
+    static const size_t NUM_SHARDS = 16;
+
+    /* an image is seen by the snapshots in [from, until) */
+    struct SavedImage {
+        Version from, until;
+        Image image;
+    };
+
+    /* saved images in the order they were taken. modified is the last
+     * version at which the page was changed */
+    struct PageHistory {
+        Version modified = 0;
+        std::vector<SavedImage> saved;
+    };
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<PageID, PageHistory> pages;
+    };
+
+    std::mutex mutex;
+    std::multiset<Version> snapshots;
+    std::atomic<size_t> num_snapshots;
+    std::atomic<Version> current;
+    std::atomic<Version> newest_snapshot;
+    std::array<Shard, NUM_SHARDS> shards;
+
+    Shard& get_shard(PageID pid) { return shards[pid % NUM_SHARDS]; }
+
+    void preserve(PageID pid, const uint8_t* buf, size_t size);
+};
+
+} // namespace bptree
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef _BPTREE_REPLACER_H_
+#define _BPTREE_REPLACER_H_
+
+#include "bptree/page.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_set>
+#include <vector>
+
+namespace bptree {
+
+enum class ReplacementPolicy { CLOCK, TWO_Q };
+
+/* page replacement policy of the page cache. frames are identified by their
+ * slot index in the page cache. record_access() is called on the hit path
+ * and must not take any lock shared between frames. all other methods are
+ * only called on the miss path */
+class AbstractReplacer {
+public:
+    virtual ~AbstractReplacer() {}
+
+    /* the page in the frame is accessed */
+    virtual void record_access(size_t frame) = 0;
+    /* a page is loaded into the frame */
+    virtual void record_insert(size_t frame, PageID id) = 0;
+    /* the page in the frame is evicted or dropped */
+    virtual void record_remove(size_t frame) = 0;
+
+    /* select a victim among the frames for which evictable() returns true.
+     * the victim stays resident until record_remove() is called for it */
+    virtual bool victim(const std::function<bool(size_t)>& evictable,
+                        size_t& frame) = 0;
+    /* append up to n frames that are likely to be evicted next */
+    virtual void peek_victims(size_t n, std::vector<size_t>& frames) = 0;
+};
+
+/* CLOCK-sweep: a hit sets the reference bit of the frame and the clock hand
+ * evicts the first frame whose bit is clear, clearing bits as it passes */
+class ClockReplacer : public AbstractReplacer {
+public:
+    explicit ClockReplacer(size_t num_frames);
+
+    virtual void record_access(size_t frame);
+    virtual void record_insert(size_t frame, PageID id);
+    virtual void record_remove(size_t frame);
+
+    virtual bool victim(const std::function<bool(size_t)>& evictable,
+                        size_t& frame);
+    virtual void peek_victims(size_t n, std::vector<size_t>& frames);
+
+private:
+    std::mutex mutex;
+    size_t hand;
+    std::vector<uint8_t> resident;
+    std::unique_ptr<std::atomic<uint8_t>[]> ref_bits;
+};
+
+/* 2Q: pages enter a FIFO queue (A1in) on their first reference and are only
+ * promoted to the main queue (Am) when they are referenced again after they
+ * have been evicted from A1in (tracked by the ghost queue A1out). Am is
+ * managed with CLOCK instead of LRU so that a hit does not need to move
+ * entries in a shared list */
+class TwoQReplacer : public AbstractReplacer {
+public:
+    explicit TwoQReplacer(size_t num_frames, double in_ratio = 0.25,
+                          double out_ratio = 0.5);
+
+    virtual void record_access(size_t frame);
+    virtual void record_insert(size_t frame, PageID id);
+    virtual void record_remove(size_t frame);
+
+    virtual bool victim(const std::function<bool(size_t)>& evictable,
+                        size_t& frame);
+    virtual void peek_victims(size_t n, std::vector<size_t>& frames);
+
+private:
+    enum Queue : uint8_t { NONE, A1IN, AM };
+
+    std::mutex mutex;
+    size_t in_capacity;
+    size_t out_capacity;
+    size_t am_size;
+    size_t hand;
+
+    std::vector<Queue> queue;
+    std::vector<PageID> frame_pages;
+    std::vector<std::list<size_t>::iterator> a1in_pos;
+    std::unique_ptr<std::atomic<uint8_t>[]> ref_bits;
+
+    std::list<size_t> a1in;
+    std::deque<PageID> a1out;
+    std::unordered_multiset<PageID> a1out_set;
+
+    void a1out_push(PageID id);
+    bool clock_victim(const std::function<bool(size_t)>& evictable,
+                      size_t& frame);
+};
+
+std::unique_ptr<AbstractReplacer> create_replacer(ReplacementPolicy policy,
+                                                  size_t num_frames);
+
+} // namespace bptree
+
+#endif
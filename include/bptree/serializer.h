@@ -4,6 +4,8 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
+#include <string>
+#include <type_traits>
 
 namespace bptree {
 
@@ -38,6 +40,27 @@ public:
     }
 };
 
+/* whether the serialized form of T is its object representation, i.e. the
+ * elements can be accessed directly in a page buffer without a copy */
+template <typename T, typename Serializer>
+struct is_in_place_serializable
+    : std::integral_constant<
+          bool, std::is_trivially_copyable<T>::value &&
+                    std::is_same<Serializer, CopySerializer<T>>::value> {};
+
+/* strings stored with their actual length in a slotted page (see SlotArray)
+ * instead of being serialized into fixed-size elements. it only selects the
+ * page format, nodes never call into it */
+template <typename T> class VarLenSerializer {
+    static_assert(std::is_same<T, std::string>::value,
+                  "variable-length elements must be std::string");
+};
+
+template <typename T, typename Serializer>
+struct is_var_len_serializable
+    : std::integral_constant<
+          bool, std::is_same<Serializer, VarLenSerializer<T>>::value> {};
+
 } // namespace bptree
 
 #endif
@@ -0,0 +1,66 @@
+#ifndef _BPTREE_SHARDED_COUNTER_H_
+#define _BPTREE_SHARDED_COUNTER_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace bptree {
+
+/* a counter split into shards on separate cache lines. each thread updates
+ * its own shard so concurrent updates do not contend on one cache line.
+ * reads sum up all shards */
+class ShardedCounter {
+public:
+    static const size_t NUM_SHARDS = 16;
+
+    explicit ShardedCounter(int64_t value = 0) { store(value); }
+
+    ShardedCounter(const ShardedCounter&) = delete;
+    ShardedCounter& operator=(const ShardedCounter&) = delete;
+
+    void add(int64_t delta)
+    {
+        shards[shard_index()].value.fetch_add(delta,
+                                              std::memory_order_relaxed);
+    }
+
+    int64_t load() const
+    {
+        int64_t sum = 0;
+        for (auto&& shard : shards) {
+            sum += shard.value.load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    /* not safe to call concurrently with add() */
+    void store(int64_t value)
+    {
+        for (auto&& shard : shards) {
+            shard.value.store(0, std::memory_order_relaxed);
+        }
+        shards[0].value.store(value, std::memory_order_relaxed);
+    }
+
+private:
+    struct alignas(64) Shard {
+        std::atomic<int64_t> value{0};
+    };
+
+    std::array<Shard, NUM_SHARDS> shards;
+
+    /* threads are assigned to shards round-robin on first use */
+    static size_t shard_index()
+    {
+        static std::atomic<size_t> next_index{0};
+        static thread_local size_t index =
+            next_index.fetch_add(1, std::memory_order_relaxed) % NUM_SHARDS;
+        return index;
+    }
+};
+
+} // namespace bptree
+
+#endif
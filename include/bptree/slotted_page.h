@@ -0,0 +1,444 @@
+#ifndef _BPTREE_SLOTTED_PAGE_H_
+#define _BPTREE_SLOTTED_PAGE_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace bptree {
+
+/* comparators that order strings byte by byte. among keys that share a
+ * prefix, the order only depends on the bytes after it, so nodes store the
+ * common prefix of their keys once, and the separators in inner nodes only
+ * keep the bytes needed to tell the keys around them apart. specialize it
+ * for other comparators that order std::string keys like std::less */
+template <typename KeyComparator> struct is_lexicographic : std::false_type {};
+template <> struct is_lexicographic<std::less<>> : std::true_type {};
+template <>
+struct is_lexicographic<std::less<std::string_view>> : std::true_type {};
+
+/* length of the common prefix of two strings */
+inline size_t common_prefix(std::string_view a, std::string_view b)
+{
+    size_t n = std::min(a.size(), b.size());
+    size_t i = 0;
+    while (i < n && a[i] == b[i]) {
+        i++;
+    }
+    return i;
+}
+
+/* shortest prefix of right that is greater than left in byte order (suffix
+ * truncation). it separates the keys up to left from the keys from right on
+ * as well as right itself does. right if the keys are equal */
+inline std::string_view shortest_separator(std::string_view left,
+                                           std::string_view right)
+{
+    return right.substr(0, common_prefix(left, right) + 1);
+}
+
+/* heap area of a slotted page. the bytes of variable-length elements are
+ * allocated from the end of the page downwards, towards the fixed-size part
+ * of the node (header and slot arrays) at the start of the page. the top of
+ * the heap is kept in a header word of the page, 0 while the heap is empty.
+ * the bytes of removed or replaced elements stay in the heap until the node
+ * resets it and writes its live elements again */
+class SlotHeap {
+public:
+    SlotHeap() : buf(nullptr), size(0), top_word(nullptr), fixed_end(0) {}
+
+    void bind(uint8_t* buf, size_t size, size_t top_offset, size_t fixed_end)
+    {
+        /* slots hold 16-bit offsets and lengths */
+        assert(size <= UINT16_MAX && fixed_end <= size);
+        this->buf = buf;
+        this->size = size;
+        top_word = reinterpret_cast<uint32_t*>(buf + top_offset);
+        this->fixed_end = fixed_end;
+    }
+
+    const uint8_t* base() const { return buf; }
+    size_t buf_size() const { return size; }
+
+    /* bytes for elements in an empty heap */
+    size_t capacity() const { return size - fixed_end; }
+    /* bytes that can be allocated without resetting the heap */
+    size_t contiguous() const { return top() - fixed_end; }
+
+    /* copy head and tail to the heap one after the other and return their
+     * offset. the caller makes sure that they fit */
+    size_t alloc(std::string_view head, std::string_view tail = {})
+    {
+        size_t len = head.size() + tail.size();
+        assert(len <= contiguous());
+        size_t offset = top() - len;
+        if (!head.empty()) ::memcpy(buf + offset, head.data(), head.size());
+        if (!tail.empty()) {
+            ::memcpy(buf + offset + head.size(), tail.data(), tail.size());
+        }
+        *top_word = (uint32_t)offset;
+        return offset;
+    }
+
+    void reset() { *top_word = 0; }
+
+private:
+    uint8_t* buf;
+    size_t size;
+    uint32_t* top_word;
+    size_t fixed_end;
+
+    size_t top() const
+    {
+        size_t top = *top_word;
+        return (top == 0 || top > size || top < fixed_end) ? size : top;
+    }
+};
+
+/* array of variable-length strings in a slotted page. a slot holds the
+ * offset and the length of an element in the heap, so elements are moved
+ * within a node by moving their slots and only adding an element writes to
+ * the heap. slots are not trusted on reads: an optimistic reader can see a
+ * slot and bytes that a writer is changing, so elements are clamped to the
+ * page and the reader validates the node version before using them.
+ *
+ * an array bound with a prefix slot shares a prefix between its elements:
+ * the prefix is stored once in the heap and the slots only cover the bytes
+ * after it. the prefix is chosen when the heap is reset and all elements
+ * that are set until the next reset must start with it */
+class SlotArray {
+public:
+    static constexpr bool VAR_LEN = true;
+    static constexpr size_t SLOT_SIZE = sizeof(uint32_t);
+
+    SlotArray() : slots(nullptr), heap(nullptr), prefix_slot(nullptr) {}
+
+    void bind(uint8_t* buf, SlotHeap* heap, uint32_t* prefix_slot = nullptr)
+    {
+        slots = reinterpret_cast<uint32_t*>(buf);
+        this->heap = heap;
+        this->prefix_slot = prefix_slot;
+    }
+
+    /* the element at i without the prefix */
+    std::string_view get(size_t i) const { return view(slots[i]); }
+
+    /* the whole element at i */
+    std::string element(size_t i) const
+    {
+        std::string element(prefix());
+        element.append(get(i));
+        return element;
+    }
+
+    /* the heap must have room for the element, see insert_bytes() */
+    void set(size_t i, std::string_view element) { store(i, {}, element); }
+
+    void move(size_t dst, size_t src, size_t n)
+    {
+        ::memmove(&slots[dst], &slots[src], n * SLOT_SIZE);
+    }
+
+    /* copy n elements from another node */
+    void copy(size_t dst, const SlotArray& from, size_t src, size_t n)
+    {
+        for (size_t i = 0; i < n; i++) {
+            store(dst + i, from.prefix(), from.get(src + i));
+        }
+    }
+
+    void append_to(std::vector<std::string>& list, size_t first,
+                   size_t last) const
+    {
+        for (size_t i = first; i < last; i++) {
+            list.emplace_back(element(i));
+        }
+    }
+
+    /* bytes taken in the heap by the element at i and by an element */
+    size_t heap_bytes(size_t i) const { return slots[i] & 0xffff; }
+    static size_t heap_bytes_of(std::string_view element)
+    {
+        return element.size();
+    }
+
+    std::string_view prefix() const
+    {
+        return prefix_slot ? view(*prefix_slot) : std::string_view();
+    }
+
+    /* store the prefix of the elements in a heap that was just reset */
+    void set_prefix(std::string_view prefix)
+    {
+        assert(prefix_slot || prefix.empty());
+        if (!prefix_slot) return;
+        *prefix_slot =
+            prefix.empty() ? 0 : make_slot(heap->alloc(prefix), prefix.size());
+    }
+
+    bool has_prefix(std::string_view element) const
+    {
+        std::string_view p = prefix();
+        return element.substr(0, p.size()) == p;
+    }
+
+    /* heap bytes needed to add an element to the first n elements. if the
+     * element does not start with the prefix, the prefix is cut to the part
+     * that it shares and the n elements grow by the bytes that were cut */
+    size_t insert_bytes(std::string_view element, size_t n) const
+    {
+        std::string_view p = prefix();
+        size_t shared = common_prefix(p, element);
+        return element.size() - shared + n * (p.size() - shared);
+    }
+
+    /* locate a key in byte order against the prefix: -1 if it is less and
+     * 1 if it is greater than all elements. otherwise the key starts with
+     * the prefix, which is removed from it, and 0 is returned */
+    int strip_prefix(std::string_view& key) const
+    {
+        std::string_view p = prefix();
+        size_t shared = common_prefix(p, key);
+        if (shared == p.size()) {
+            key.remove_prefix(shared);
+            return 0;
+        }
+        return (shared == key.size() ||
+                (uint8_t)key[shared] < (uint8_t)p[shared])
+                   ? -1
+                   : 1;
+    }
+
+    /* whether the element at i is the key, in byte order */
+    bool equals(size_t i, std::string_view key) const
+    {
+        return strip_prefix(key) == 0 && key == get(i);
+    }
+
+private:
+    uint32_t* slots;
+    SlotHeap* heap;
+    uint32_t* prefix_slot;
+
+    static uint32_t make_slot(size_t offset, size_t len)
+    {
+        return (uint32_t)(offset << 16 | len);
+    }
+
+    std::string_view view(uint32_t slot) const
+    {
+        size_t offset = std::min<size_t>(slot >> 16, heap->buf_size());
+        size_t len =
+            std::min<size_t>(slot & 0xffff, heap->buf_size() - offset);
+        return std::string_view(
+            reinterpret_cast<const char*>(heap->base() + offset), len);
+    }
+
+    /* store the element head + tail without the prefix, which it must
+     * start with */
+    void store(size_t i, std::string_view head, std::string_view tail)
+    {
+        size_t skip = prefix().size();
+        if (skip > head.size()) {
+            tail.remove_prefix(std::min(skip - head.size(), tail.size()));
+            head = {};
+        } else {
+            head.remove_prefix(skip);
+        }
+        size_t len = head.size() + tail.size();
+        slots[i] = make_slot(heap->alloc(head, tail), len);
+    }
+};
+
+/* binary searches over the elements [first, last) of a slot array. keys
+ * under lexicographic comparators are compared byte by byte after the
+ * prefix of the array */
+template <typename K, typename KeyComparator>
+size_t slot_lower_bound(const SlotArray& keys, size_t first, size_t last,
+                        const K& key, const KeyComparator& kcmp)
+{
+    if constexpr (is_lexicographic<KeyComparator>::value) {
+        std::string_view rest = key;
+        int pos = keys.strip_prefix(rest);
+        if (pos) return pos < 0 ? first : last;
+
+        while (first < last) {
+            size_t mid = first + (last - first) / 2;
+            if (keys.get(mid) < rest)
+                first = mid + 1;
+            else
+                last = mid;
+        }
+    } else {
+        while (first < last) {
+            size_t mid = first + (last - first) / 2;
+            if (kcmp(keys.get(mid), key))
+                first = mid + 1;
+            else
+                last = mid;
+        }
+    }
+    return first;
+}
+
+template <typename K, typename KeyComparator>
+size_t slot_upper_bound(const SlotArray& keys, size_t first, size_t last,
+                        const K& key, const KeyComparator& kcmp)
+{
+    if constexpr (is_lexicographic<KeyComparator>::value) {
+        std::string_view rest = key;
+        int pos = keys.strip_prefix(rest);
+        if (pos) return pos < 0 ? first : last;
+
+        while (first < last) {
+            size_t mid = first + (last - first) / 2;
+            if (!(rest < keys.get(mid)))
+                first = mid + 1;
+            else
+                last = mid;
+        }
+    } else {
+        while (first < last) {
+            size_t mid = first + (last - first) / 2;
+            if (!kcmp(key, keys.get(mid)))
+                first = mid + 1;
+            else
+                last = mid;
+        }
+    }
+    return first;
+}
+
+/* number of elements to keep on the left when elements of the given sizes
+ * are split in two by bytes: the smallest count whose elements take at
+ * least half of the bytes, clamped to [min_left, max_left] */
+inline size_t split_by_bytes(const std::vector<size_t>& bytes,
+                             size_t min_left, size_t max_left)
+{
+    size_t total = 0;
+    for (auto b : bytes) {
+        total += b;
+    }
+
+    size_t left = 0, left_bytes = 0;
+    while (left < bytes.size() && left_bytes * 2 < total) {
+        left_bytes += bytes[left++];
+    }
+
+    return std::clamp(left, min_left, max_left);
+}
+
+/* common prefix of sorted elements and of the elements first and last
+ * that are about to be added to them (if not null) */
+inline std::string_view shared_prefix(const std::vector<std::string>& sorted,
+                                      const std::string* first,
+                                      const std::string* last)
+{
+    std::string_view prefix;
+    bool any = false;
+    auto share = [&](std::string_view element) {
+        prefix = any ? prefix.substr(0, common_prefix(prefix, element))
+                     : element;
+        any = true;
+    };
+
+    if (!sorted.empty()) {
+        share(sorted.front());
+        share(sorted.back());
+    }
+    if (first) share(*first);
+    if (last) share(*last);
+    return prefix;
+}
+
+/* common prefix of the sorted elements [first, last) */
+inline std::string_view range_prefix(const std::vector<std::string>& sorted,
+                                     size_t first, size_t last)
+{
+    if (first >= last) return {};
+    std::string_view prefix = sorted[first];
+    return prefix.substr(0, common_prefix(prefix, sorted[last - 1]));
+}
+
+/* position in [first, last] to split at whose separator takes the fewest
+ * bytes (bytes(i) for the split before element i), the closest to mid among
+ * equally short ones. splitting near the middle instead of at it keeps the
+ * separators that go up to the parent short */
+template <typename Bytes>
+size_t shortest_split(size_t mid, size_t first, size_t last, Bytes&& bytes)
+{
+    size_t best = mid, best_bytes = bytes(mid);
+    for (size_t d = 1; d <= std::max(mid - first, last - mid); d++) {
+        for (size_t i : {mid - d, mid + d}) {
+            if (i < first || i > last) continue;
+            size_t b = bytes(i);
+            if (b < best_bytes) {
+                best = i;
+                best_bytes = b;
+            }
+        }
+    }
+    return best;
+}
+
+/* heap bytes of the sorted elements [first, last) in a node that stores
+ * the common prefix of their keys once. extra holds the other heap bytes
+ * of each element (its value) */
+inline size_t prefixed_bytes(const std::vector<std::string>& keys,
+                             const std::vector<size_t>& extra, size_t first,
+                             size_t last)
+{
+    if (first == last) return 0;
+
+    size_t prefix = common_prefix(keys[first], keys[last - 1]);
+    size_t bytes = prefix;
+    for (size_t i = first; i < last; i++) {
+        bytes += keys[i].size() - prefix + extra[i];
+    }
+    return bytes;
+}
+
+/* split_by_bytes() for nodes that store the common prefix of their keys.
+ * moving elements between nodes changes their prefixes, so the bytes of
+ * both sides are computed for every count in [min_left, max_left] and the
+ * count for which the larger side takes the fewest bytes is chosen. if gap
+ * is set, the element at the split point moves up to the parent (inner
+ * nodes) */
+inline size_t split_prefixed(const std::vector<std::string>& keys,
+                             const std::vector<size_t>& extra,
+                             size_t min_left, size_t max_left, bool gap)
+{
+    size_t n = keys.size();
+    std::vector<size_t> sums(n + 1, 0);
+    for (size_t i = 0; i < n; i++) {
+        sums[i + 1] = sums[i] + keys[i].size() + extra[i];
+    }
+
+    /* each side stores its prefix once instead of in every key */
+    auto bytes_of = [&](size_t first, size_t last) -> size_t {
+        if (first >= last) return 0;
+        size_t prefix = common_prefix(keys[first], keys[last - 1]);
+        return sums[last] - sums[first] - (last - first - 1) * prefix;
+    };
+
+    size_t best = min_left, best_bytes = SIZE_MAX;
+    for (size_t left = min_left; left <= max_left; left++) {
+        size_t bytes =
+            std::max(bytes_of(0, left), bytes_of(left + gap, n));
+        if (bytes < best_bytes) {
+            best = left;
+            best_bytes = bytes;
+        }
+    }
+    return best;
+}
+
+} // namespace bptree
+
+#endif
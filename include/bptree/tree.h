@@ -1,42 +1,278 @@
 #ifndef _BPTREE_TREE_H_
 #define _BPTREE_TREE_H_
 
+#include "bptree/epoch.h"
+#include "bptree/external_sort.h"
+#include "bptree/heap_file.h"
 #include "bptree/page_cache.h"
+#include "bptree/page_version_store.h"
+#include "bptree/sharded_counter.h"
 #include "bptree/tree_node.h"
+#include "bptree/wal.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_set>
 
 namespace bptree {
 
+struct NodeCacheStats {
+    size_t budget;       /* effective budget in bytes, 0 if unbounded */
+    size_t usage;        /* bytes used by decoded nodes and their frames */
+    size_t pinned_pages; /* page frames pinned by decoded nodes */
+    size_t evictions;    /* number of nodes unswizzled so far */
+    size_t retired;      /* evicted and merged nodes waiting to be freed */
+};
+
+/* number of times operations restarted their descent from the root because
+ * an optimistic read was invalidated by a concurrent writer */
+struct RestartStats {
+    size_t lookups; /* point and batched lookups */
+    size_t inserts; /* inserts, updates and upserts */
+    size_t erases;
+    size_t scans; /* descents of iterators to a leaf */
+};
+
+struct BulkLoadOptions {
+    /* fraction of the capacity of leaves and inner nodes that is filled */
+    double fill_factor = 1.0;
+
+    /* unsorted input is sorted by an external sort that buffers up to
+     * sort_memory bytes and spills sorted runs to temp_dir */
+    bool sorted = true;
+    size_t sort_memory = 64 << 20;
+    std::string temp_dir = "/tmp";
+};
+
 template <unsigned int N, typename K, typename V,
           typename KeySerializer = CopySerializer<K>,
           typename KeyComparator = std::less<K>,
           typename KeyEq = std::equal_to<K>,
           typename ValueSerializer = CopySerializer<V>>
 class BTree {
+    using InnerNodeType = InnerNode<N, K, V, KeySerializer, KeyComparator,
+                                    KeyEq, ValueSerializer>;
+    using LeafNodeType = LeafNode<N, K, V, KeySerializer, KeyComparator, KeyEq,
+                                  ValueSerializer>;
+
 public:
-    BTree(AbstractPageCache* page_cache) : page_cache(page_cache)
+    /* node_cache_budget bounds the memory used by decoded nodes (in bytes).
+     * every decoded node keeps its page frame pinned, so the frame counts
+     * towards the budget and, if the page cache is bounded, the budget is
+     * capped at NODE_CACHE_POOL_RATIO of the page cache. cold subtrees are
+     * unswizzled when the budget is exceeded and read back from the page
+     * cache on demand. 0 means no limit other than the page cache */
+    BTree(AbstractPageCache* page_cache, size_t node_cache_budget = 0)
+        : page_cache(page_cache), wal(page_cache->get_wal()), redo_lsn(0),
+          node_memory(0), node_pages(0),
+          node_cache_budget(node_cache_budget), node_evictions(0),
+          node_bytes_copied(0), snapshot_pending(false), retired_empty(true),
+          meta_clean(true), meta_stale(false),
+          meta_pair_count(0),
+          checkpointer_stop(false)
     {
+        /* in-place nodes are bound to their page and must fit when full */
+        size_t page_space = page_cache->get_page_size() - Page::HEADER_SIZE;
+        if ((LeafNodeType::IN_PLACE && LeafNodeType::FIXED_END > page_space) ||
+            (InnerNodeType::IN_PLACE &&
+             InnerNodeType::FIXED_END > page_space)) {
+            throw std::invalid_argument(
+                "nodes of this order do not fit in a page");
+        }
+
+        bool recovered = wal && recover();
+
         bool create = !read_metadata();
+        if (wal) wal->set_counter(create ? 0 : (int64_t)size());
 
         if (create) {
             {
                 boost::upgrade_lock<Page> lock;
                 auto page = page_cache->new_page(lock);
                 assert(page->get_id() == META_PAGE_ID);
+                page_cache->unpin_page(page, true, lock);
             }
 
+            LogScope scope(this);
             root = create_node<LeafNode<N, K, V, KeySerializer, KeyComparator,
                                         KeyEq, ValueSerializer>>(nullptr);
+            write_node(root.get());
             num_pairs.store(0);
-            write_metadata();
+            write_metadata(true);
+        } else if (recovered) {
+            /* the pages replayed from the log are written back so that the
+             * next crash does not replay it again */
+            checkpoint();
+        } else if (!wal && !meta_clean.load()) {
+            /* the tree was modified after the last checkpoint and not closed
+             * cleanly, recount the pairs */
+            size_t count = 0;
+            for (auto it = begin(); it != end(); ++it) {
+                count++;
+            }
+            num_pairs.store(count);
+            write_metadata(true);
+        }
+
+        if (wal && wal->get_options().checkpoint_log_size) {
+            checkpointer = std::thread([this]() { checkpointer_main(); });
+        }
+    }
+
+    ~BTree()
+    {
+        if (!wal) {
+            write_metadata(true);
+            return;
+        }
+
+        if (checkpointer.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(checkpointer_mutex);
+                checkpointer_stop = true;
+            }
+            checkpointer_cv.notify_one();
+            checkpointer.join();
+        }
+
+        /* a tree that is closed cleanly leaves an empty log */
+        try {
+            checkpoint();
+        } catch (std::exception& e) {
+            std::cerr << "Failed to checkpoint: " << e.what() << std::endl;
+        }
+    }
+
+    size_t size() const
+    {
+        return (size_t)std::max<int64_t>(0, num_pairs.load());
+    }
+
+    /* write the root and the pair count to the meta page and flush all dirty
+     * pages. between checkpoints, the meta page is only written when the root
+     * changes or, once, to mark the pair count stale. without a log, a tree
+     * that is opened without a clean checkpoint or close recounts its pairs.
+     *
+     * with a log, the checkpoint is fuzzy: operations go on while the pages
+     * are written back in page ID order, and the log entries whose changes
+     * are on disk after the flush are dropped. the pair count is logged with
+     * the pages, so it is recovered without a recount. checkpoints are taken
+     * in the background once the log reaches wal.checkpoint_log_size */
+    void checkpoint()
+    {
+        std::lock_guard<std::mutex> guard(checkpoint_mutex);
+
+        /* the pages of the entries before the stable LSN are dirty (or were
+         * written back) by now. it is read before the pair count so that
+         * the log keeps the entries counted after it */
+        LSN lsn = wal ? wal->get_stable_lsn() : 0;
+        {
+            /* the root may be replaced and retired meanwhile */
+            OpGuard op_guard(this);
+            write_metadata(true);
+        }
+
+        if (!wal) {
+            page_cache->flush_all_pages();
+            return;
+        }
+
+        /* if nothing is logged meanwhile, the entries after the count LSN
+         * do not change the count and the whole log can be dropped. a tree
+         * that is closed cleanly leaves an empty log */
+        LSN end, flushed_end;
+        bool idle = wal->get_counter(end) == get_meta_pair_count() &&
+                    wal->get_stable_lsn() == end;
+        page_cache->flush_all_pages();
+        wal->get_counter(flushed_end);
+        wal->truncate(idle && flushed_end == end ? end : lsn);
+
+        /* the meta page is on disk, nothing to wait for. this also keeps a
+         * closed tree from being waited on by a later tree at its address */
+        if (pending_commit.tree == this) pending_commit = PendingCommit{};
+    }
+
+    NodeCacheStats get_node_cache_stats()
+    {
+        std::lock_guard<std::mutex> guard(evict_mutex);
+        return NodeCacheStats{get_effective_budget(), node_memory.load(),
+                              node_pages.load(), node_evictions.load(),
+                              retired_nodes.size()};
+    }
+
+    RestartStats get_restart_stats() const
+    {
+        return RestartStats{(size_t)lookup_restarts.load(),
+                            (size_t)insert_restarts.load(),
+                            (size_t)erase_restarts.load(),
+                            (size_t)scan_restarts.load()};
+    }
+
+    void set_node_cache_budget(size_t bytes)
+    {
+        node_cache_budget.store(bytes);
+        maybe_evict_nodes();
+    }
+
+    /* node memory accounting, called by the node constructors/destructors.
+     * a node releases the pin on its page frame when it is freed */
+    void node_allocated(size_t bytes) { node_memory.fetch_add(bytes); }
+    void node_freed(BaseNode<K, V, KeyComparator, KeyEq>* node, size_t bytes)
+    {
+        auto* page = node->get_page();
+        if (page) {
+            {
+                boost::upgrade_lock<Page> lock(*page);
+                /* the page of a merged node may be reused or overwritten by
+                 * the free list once it is freed */
+                if (node->is_deleted()) {
+                    versions.before_write(page->get_id(),
+                                          page->get_buffer(lock),
+                                          page->get_size());
+                }
+                page_cache->unpin_page(page, false, lock);
+            }
+            node_memory.fetch_sub(page_cache->get_page_size());
+            node_pages--;
+        }
+        node_memory.fetch_sub(bytes);
+
+        /* the page of a merged node is returned to the heap file */
+        if (node->is_deleted()) {
+            page_cache->free_page(node->get_pid());
         }
     }
 
-    ~BTree() { write_metadata(); }
+    /* a node removed from the tree by a merge or a root collapse. it is
+     * freed together with the evicted nodes once no operation can hold a
+     * pointer to it. the caller has marked the node obsolete */
+    void retire_node(std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>> node,
+                     bool delete_page)
+    {
+        if (delete_page) node->mark_deleted();
+
+        std::lock_guard<std::mutex> guard(evict_mutex);
+        retired_nodes.push_back(
+            RetiredNode{epochs.get_epoch(), std::move(node)});
+        retired_empty.store(false);
+    }
 
-    size_t size() const { return num_pairs.load(); }
+    size_t node_footprint(const BaseNode<K, V, KeyComparator, KeyEq>* node) const
+    {
+        return node->get_memory_size() +
+               (node->get_page() ? page_cache->get_page_size() : 0);
+    }
 
     template <
         typename T,
@@ -47,100 +283,242 @@ public:
         boost::upgrade_lock<Page> lock;
         auto page = page_cache->new_page(lock);
         auto node = std::make_unique<T>(this, parent, page->get_id());
-        page_cache->unpin_page(page, false, lock);
 
+        /* the node keeps the pin on the new page */
+        boost::upgrade_to_unique_lock<Page> ulock(lock);
+        attach_page(node.get(), page, ulock);
         return node;
     }
 
     void get_value(const K& key, std::vector<V>& value_list)
     {
-        while (true) {
-            try {
-                value_list.clear();
-                auto* root_node = root.get();
-                root_node->get_values(key, false, nullptr, nullptr, value_list,
-                                      0);
-                if (root_node != root.get()) continue;
-                break;
-            } catch (OLCRestart&) {
-                continue;
-            }
+        {
+            OpGuard guard(this);
+            get_value_impl(key, value_list);
         }
+        maybe_evict_nodes();
     }
 
     void collect_values(const K& key, std::optional<K>* next_key,
                         std::vector<K>& key_list, std::vector<V>& value_list)
     {
-        while (true) {
-            try {
-                key_list.clear();
-                value_list.clear();
-                auto* root_node = root.get();
-                root_node->get_values(key, true, next_key, &key_list,
-                                      value_list, 0);
-                if (root_node != root.get()) continue;
-                break;
-            } catch (OLCRestart&) {
-                continue;
-            }
+        {
+            OpGuard guard(this);
+            collect_values_impl(key, next_key, key_list, value_list);
         }
+        maybe_evict_nodes();
     }
 
     void insert(const K& key, const V& value)
     {
-        while (true) {
-            try {
-                K split_key;
-                auto old_root = root.get();
-                if (!old_root)
-                    continue; /* old_root may be nullptr when another thread is
-                                 updating the root node pointer */
-
-                auto root_sibling = old_root->insert(key, value, split_key, 0);
-
-                if (root_sibling) {
-                    auto new_root =
-                        create_node<InnerNode<N, K, V, KeySerializer,
-                                              KeyComparator, KeyEq>>(nullptr);
-
-                    root->set_parent(new_root.get());
-                    root_sibling->set_parent(new_root.get());
-
-                    new_root->set_size(1);
-                    new_root->keys[0] = split_key;
-                    new_root->child_pages[0] = root->get_pid();
-                    new_root->child_pages[1] = root_sibling->get_pid();
-                    new_root->child_cache[0] = std::move(root);
-                    new_root->child_cache[1] = std::move(root_sibling);
-
-                    root = std::move(new_root);
-                    write_node(root.get());
-                    write_metadata();
+        check_entry(key, value);
+        {
+            WriteGate gate(this);
+            OpGuard guard(this);
+            insert_impl(key, value, InsertMode::INSERT);
+        }
+        wait_for_log();
+        maybe_evict_nodes();
+    }
 
-                    /* release the lock on the old root */
-                    old_root->write_unlock();
-                    continue;
-                }
+    /* replace the value of the first pair with the key. returns false if
+     * the key does not exist */
+    bool update(const K& key, const V& value)
+    {
+        check_entry(key, value);
+        InsertResult result;
+        {
+            WriteGate gate(this);
+            OpGuard guard(this);
+            result = insert_impl(key, value, InsertMode::UPDATE);
+        }
+        wait_for_log();
+        maybe_evict_nodes();
+        return result == InsertResult::UPDATED;
+    }
 
-                num_pairs++;
-                write_metadata();
-                break;
-            } catch (OLCRestart&) {
-                continue;
+    /* update the key if it exists, insert it otherwise */
+    void upsert(const K& key, const V& value)
+    {
+        check_entry(key, value);
+        {
+            WriteGate gate(this);
+            OpGuard guard(this);
+            insert_impl(key, value, InsertMode::UPSERT);
+        }
+        wait_for_log();
+        maybe_evict_nodes();
+    }
+
+    /* insert count pairs, descending once per leaf instead of once per pair.
+     * the pairs are sorted by key first (pairs with equal keys keep their
+     * order) and the pairs that go to the same leaf are inserted under one
+     * write lock. the pair count in the metadata is updated once */
+    void insert_batch(const std::pair<K, V>* pairs, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            check_entry(pairs[i].first, pairs[i].second);
+        }
+
+        KeyComparator kcmp;
+        auto pair_cmp = [&kcmp](const std::pair<K, V>& a,
+                                const std::pair<K, V>& b) {
+            return kcmp(a.first, b.first);
+        };
+
+        std::vector<std::pair<K, V>> sorted;
+        if (!std::is_sorted(pairs, pairs + count, pair_cmp)) {
+            sorted.assign(pairs, pairs + count);
+            std::stable_sort(sorted.begin(), sorted.end(), pair_cmp);
+            pairs = sorted.data();
+        }
+
+        {
+            WriteGate gate(this);
+            OpGuard guard(this);
+            size_t pos = 0;
+            if (count > 0) mark_modified();
+            while (pos < count) {
+                pos += insert_batch_impl(pairs + pos, count - pos);
             }
+            num_pairs.add(count);
         }
+        wait_for_log();
+        maybe_evict_nodes();
     }
 
-    void print(std::ostream& os) const
+    /* look up count keys, descending once per leaf instead of once per key.
+     * value_lists[i] receives the values of keys[i] */
+    void get_values_batch(const K* keys, size_t count,
+                          std::vector<std::vector<V>>& value_lists)
     {
-        while (true) {
-            try {
-                root->print(os, "");
-                break;
-            } catch (OLCRestart&) {
-                continue;
+        KeyComparator kcmp;
+        value_lists.resize(count);
+
+        /* visit the keys in order and keep the output list of each key */
+        std::vector<const K*> sorted_keys(count);
+        for (size_t i = 0; i < count; i++) {
+            sorted_keys[i] = &keys[i];
+            value_lists[i].clear();
+        }
+        std::sort(sorted_keys.begin(), sorted_keys.end(),
+                  [&kcmp](const K* a, const K* b) { return kcmp(*a, *b); });
+
+        std::vector<std::vector<V>*> lists(count);
+        for (size_t i = 0; i < count; i++) {
+            lists[i] = &value_lists[sorted_keys[i] - keys];
+        }
+
+        {
+            OpGuard guard(this);
+            size_t pos = 0;
+            while (pos < count) {
+                pos += get_values_batch_impl(&sorted_keys[pos], count - pos,
+                                             &lists[pos]);
+            }
+        }
+        maybe_evict_nodes();
+    }
+
+    /* remove all pairs with the key. returns the number of pairs removed */
+    size_t erase(const K& key)
+    {
+        size_t removed;
+        {
+            WriteGate gate(this);
+            OpGuard guard(this);
+            removed = erase_impl(key, nullptr);
+        }
+        wait_for_log();
+        maybe_evict_nodes();
+        return removed;
+    }
+
+    /* remove the pairs with the key and the value */
+    size_t erase(const K& key, const V& value)
+    {
+        size_t removed;
+        {
+            WriteGate gate(this);
+            OpGuard guard(this);
+            removed =
+                erase_impl(key, [&value](const V& v) { return v == value; });
+        }
+        wait_for_log();
+        maybe_evict_nodes();
+        return removed;
+    }
+
+    /* move nodes to the lowest free pages of the page cache and truncate the
+     * free pages at the end of the file. can run concurrently with other
+     * operations, nodes that are locked by other threads are skipped. the
+     * pages of moved nodes are freed once no operation is in flight and are
+     * truncated by the next compact(). returns the number of pages released */
+    size_t compact()
+    {
+        {
+            WriteGate gate(this);
+            OpGuard guard(this);
+            compact_impl();
+        }
+        wait_for_log();
+        maybe_evict_nodes();
+        return page_cache->shrink();
+    }
+
+    /* build the tree bottom-up from pairs in key order, see BulkLoader. the
+     * tree must be empty and no other operation may run during the load */
+    template <typename InputIt>
+    void bulk_load(InputIt first, InputIt last,
+                   const BulkLoadOptions& options = BulkLoadOptions{})
+    {
+        bulk_load(
+            [&first, &last](K& key, V& value) {
+                if (first == last) return false;
+                key = first->first;
+                value = first->second;
+                ++first;
+                return true;
+            },
+            options);
+    }
+
+    /* next() stores the next pair and returns true, or returns false at the
+     * end of the input */
+    void bulk_load(const std::function<bool(K&, V&)>& next,
+                   const BulkLoadOptions& options = BulkLoadOptions{})
+    {
+        WriteGate gate(this);
+        BulkLoader loader(this, options.fill_factor);
+        K key;
+        V value;
+
+        if (options.sorted) {
+            while (next(key, value)) {
+                loader.add(key, value);
             }
+        } else if constexpr (std::is_trivially_copyable<K>::value &&
+                             std::is_trivially_copyable<V>::value) {
+            ExternalSorter<K, V, KeyComparator> sorter(options.sort_memory,
+                                                       options.temp_dir);
+            while (next(key, value)) {
+                sorter.add(key, value);
+            }
+            sorter.sort(
+                [&loader](const K& k, const V& v) { loader.add(k, v); });
+        } else {
+            throw std::invalid_argument(
+                "unsorted bulk load requires trivially copyable pairs");
         }
+
+        loader.finish();
+        wait_for_log();
+    }
+
+    void print(std::ostream& os)
+    {
+        OpGuard guard(this);
+        root->print(os, "");
     } /* for debug purpose */
     friend std::ostream& operator<<(std::ostream& os, BTree& tree)
     {
@@ -173,232 +551,2463 @@ public:
                                                                    pid);
         }
 
-        node->deserialize(&buf[sizeof(uint32_t)],
-                          page->get_size() - sizeof(uint32_t));
+        if (!node) {
+            page_cache->unpin_page(page, false, lock);
+            throw std::runtime_error("bad node page(tag)");
+        }
+
+        /* the node keeps the pin so that the frame cannot be evicted or
+         * reused while the node exists. in-place nodes are bound to the
+         * frame and only decode their header */
+        boost::upgrade_to_unique_lock<Page> ulock(lock);
+        attach_page(node.get(), page, ulock);
+        node_bytes_copied.fetch_add(
+            node->deserialize(&buf[Page::HEADER_SIZE],
+                              page->get_size() - Page::HEADER_SIZE),
+            std::memory_order_relaxed);
 
-        page_cache->unpin_page(page, false, lock);
         return node;
     }
 
-    void write_node(const BaseNode<K, V, KeyComparator, KeyEq>* node)
-    {
-        boost::upgrade_lock<Page> lock;
-        auto page = page_cache->fetch_page(node->get_pid(), lock);
-
-        {
-            boost::upgrade_to_unique_lock<Page> ulock(lock);
-            if (!page) return;
-            auto* buf = page->get_buffer(ulock);
-            uint32_t tag = node->is_leaf() ? LEAF_TAG : INNER_TAG;
-
-            *reinterpret_cast<uint32_t*>(buf) = tag;
-            node->serialize(&buf[sizeof(uint32_t)],
-                            page->get_size() - sizeof(uint32_t));
-        }
+    /* max. pages written by one operation: a split that grows the root
+     * writes four, a relocation during compaction five */
+    static const size_t MAX_MTR_PAGES = 8;
 
-        page_cache->unpin_page(page, true, lock);
-    }
+    /* a page latched and pinned by a mini-transaction */
+    struct LoggedPage {
+        Page* page = nullptr;
+        boost::upgrade_lock<Page> lock;
+        std::optional<boost::upgrade_to_unique_lock<Page>> ulock;
+        /* number of times the page was written in the mini-transaction */
+        unsigned int writes = 0;
 
-    /* iterator interface */
-    class iterator {
-        friend class BTree<N, K, V, KeySerializer, KeyComparator, KeyEq,
-                           ValueSerializer>;
+        uint8_t* get_buffer() { return page->get_buffer(*ulock); }
+    };
 
+    /* if the page cache has a write-ahead log, the page writes of an
+     * operation are logged as one mini-transaction. the pages stay latched
+     * and pinned until the operation is done, then their changes are
+     * appended to the log as one entry, which is redone as a whole on
+     * recovery so that a split or a merge is never seen half done. write
+     * guards join the mini-transaction of their thread or run their own.
+     * it is committed before the nodes that own its pages are unlocked, so
+     * node pages are latched in the order the nodes are locked */
+    class MiniTransaction {
     public:
-        using self_type = iterator;
-        using value_type = std::pair<K, V>;
-        using reference = value_type&;
-        using pointer = value_type*;
-        using iterator_category = std::forward_iterator_tag;
-        using difference_type = int;
-
-        self_type operator++()
+        explicit MiniTransaction(BTree* tree)
+            : tree(tree), outer(active_mtr), num_pages(0),
+              insert_pid(Page::INVALID_PAGE_ID), pair_delta(0),
+              uncaught(std::uncaught_exceptions())
         {
-            self_type i = *this;
-            inc();
-            return i;
+            active_mtr = this;
         }
-        self_type operator++(int _unused)
+        MiniTransaction(const MiniTransaction&) = delete;
+        MiniTransaction& operator=(const MiniTransaction&) = delete;
+
+        ~MiniTransaction()
         {
-            inc();
-            return *this;
+            active_mtr = outer;
+
+            /* an operation that throws leaves its changes half done, they
+             * are not logged */
+            if (std::uncaught_exceptions() > uncaught) {
+                release_pages(Page::UNLOGGED_LSN);
+                return;
+            }
+            commit();
         }
-        reference operator*() { return kvp; }
-        pointer operator->() { return &kvp; }
-        bool operator==(const self_type& rhs) { return false; }
-        bool operator!=(const self_type& rhs) { return true; }
-        bool is_end() const { return ended; }
 
-    private:
-        std::vector<K> key_buf;
-        std::vector<V> value_buf;
-        size_t idx;
-        value_type kvp;
-        std::optional<K> next_key;
-        bool ended;
-        KeyComparator kcmp;
+        BTree* get_tree() const { return tree; }
 
-        using container_type = BTree<N, K, V, KeySerializer, KeyComparator,
-                                     KeyEq, ValueSerializer>;
-        container_type* tree;
+        LoggedPage* find_page(PageID pid)
+        {
+            for (size_t i = 0; i < num_pages; i++) {
+                if (pages[i].page->get_id() == pid) return &pages[i];
+            }
+            return nullptr;
+        }
 
-        iterator(container_type* tree, KeyComparator kcmp = KeyComparator{})
-            : tree(tree), kcmp(kcmp), next_key(std::nullopt)
+        /* latch and pin a page for writing, unless it is already held. if
+         * lock is given, the page is pinned and latched by the caller and
+         * both are handed over */
+        LoggedPage& add_page(Page* page,
+                             boost::upgrade_lock<Page>* lock = nullptr)
         {
-            ended = false;
-            auto first_node = tree->read_node(
-                nullptr, BTree<N, K, V, KeySerializer, KeyComparator, KeyEq,
-                               ValueSerializer>::FIRST_NODE_PAGE_ID);
+            for (size_t i = 0; i < num_pages; i++) {
+                if (pages[i].page == page) return pages[i];
+            }
 
-            if (!first_node) {
-                ended = true;
-                return;
+            if (num_pages == MAX_MTR_PAGES) {
+                throw std::length_error("too many pages in mini-transaction");
             }
 
-            auto leaf =
-                static_cast<LeafNode<N, K, V, KeySerializer, KeyComparator,
-                                     KeyEq, ValueSerializer>*>(
-                    first_node.get());
-            key_buf.clear();
-            value_buf.clear();
-            std::copy(leaf->keys.begin(), leaf->keys.begin() + leaf->get_size(),
-                      std::back_inserter(key_buf));
-            std::copy(leaf->values.begin(),
-                      leaf->values.begin() + leaf->get_size(),
-                      std::back_inserter(value_buf));
-
-            idx = 0;
-            if (key_buf.empty()) {
-                ended = true;
+            auto& p = pages[num_pages++];
+            p.page = page;
+            p.writes = 0;
+            if (lock) {
+                p.lock = std::move(*lock);
             } else {
-                kvp = std::make_pair(key_buf[idx], value_buf[idx]);
+                p.lock = boost::upgrade_lock<Page>(*page);
+                tree->page_cache->pin_page(page);
             }
+            p.ulock.emplace(p.lock);
+            return p;
         }
 
-        iterator(container_type* tree, const K& key,
-                 KeyComparator kcmp = KeyComparator{})
-            : tree(tree), kcmp(kcmp)
+        /* the next write of the leaf in this mini-transaction inserts the
+         * pair. if it is the only write of the page, it is logged as the
+         * insert instead of as an image of the page. key and value must
+         * outlive the mini-transaction */
+        void log_insert(PageID pid, const K& key, const V& value)
         {
-            ended = false;
-            tree->collect_values(key, &next_key, key_buf, value_buf);
-            idx = std::lower_bound(key_buf.begin(), key_buf.end(), key, kcmp) -
-                  key_buf.begin();
-            if (idx == key_buf.size()) {
-                ended = true;
-            } else {
-                kvp = std::make_pair(key_buf[idx], value_buf[idx]);
-            }
+            insert_pid = pid;
+            insert_key = &key;
+            insert_value = &value;
         }
 
-        void inc()
+        /* the pair count of the tree changes by delta with the pages */
+        void add_pair_count(int64_t delta) { pair_delta += delta; }
+
+    private:
+        BTree* tree;
+        MiniTransaction* outer;
+        std::array<LoggedPage, MAX_MTR_PAGES> pages;
+        size_t num_pages;
+        PageID insert_pid;
+        const K* insert_key;
+        const V* insert_value;
+        int64_t pair_delta;
+        int uncaught;
+
+        void commit()
         {
-            if (ended) return;
-            idx++;
-            if (idx == key_buf.size()) {
-                get_next_batch();
+            if (!num_pages && !pair_delta) return;
+
+            size_t page_size = tree->page_cache->get_page_size();
+            static thread_local std::vector<uint8_t> payload;
+            payload.clear();
+
+            for (size_t i = 0; i < num_pages; i++) {
+                auto& p = pages[i];
+                PageID pid = p.page->get_id();
+
+                if constexpr (LOG_INSERTS) {
+                    /* a page with unlogged changes is logged whole */
+                    if (pid == insert_pid && p.writes == 1 &&
+                        Page::read_lsn(p.get_buffer()) != Page::UNLOGGED_LSN) {
+                        size_t start = put_record_header(
+                            payload, LOG_LEAF_INSERT, pid);
+                        put_logged<K, KeySerializer>(payload, *insert_key);
+                        put_logged<V, ValueSerializer>(payload, *insert_value);
+                        end_record(payload, start);
+                        continue;
+                    }
+                }
+
+                size_t start = put_record_header(payload, LOG_PAGE_IMAGE, pid);
+                const auto* buf = p.get_buffer();
+                payload.insert(payload.end(), buf, buf + page_size);
+                end_record(payload, start);
             }
-            if (ended) return;
-            kvp = std::make_pair(key_buf[idx], value_buf[idx]);
-        }
 
-        void get_next_batch()
-        {
-            if (!next_key) {
-                ended = true;
+            if (pair_delta) {
+                size_t start = put_record_header(payload, LOG_PAIR_COUNT,
+                                                 Page::INVALID_PAGE_ID);
+                const auto* p = reinterpret_cast<const uint8_t*>(&pair_delta);
+                payload.insert(payload.end(), p, p + sizeof(pair_delta));
+                end_record(payload, start);
+            }
+
+            LSN lsn = 0;
+            try {
+                lsn = tree->wal->append(payload.data(), payload.size(),
+                                        pair_delta);
+            } catch (...) {
+                /* the pages are released whatever happens to the log but
+                 * are kept in memory, and the error is thrown to the caller
+                 * once the nodes are unlocked, see wait_for_log() */
+                release_pages(Page::UNLOGGED_LSN);
+                pending_commit =
+                    PendingCommit{tree, 0, std::current_exception()};
                 return;
             }
 
-            K key = *next_key;
-            next_key = std::nullopt;
-            tree->collect_values(key, &next_key, key_buf, value_buf);
-            idx = std::lower_bound(key_buf.begin(), key_buf.end(), key, kcmp) -
-                  key_buf.begin();
-            if (idx == key_buf.size()) {
-                ended = true;
+            release_pages(lsn);
+            tree->wal->commit(lsn);
+            if (pending_commit.tree != tree || !pending_commit.error) {
+                pending_commit = PendingCommit{tree, lsn, nullptr};
+            }
+        }
+
+        void release_pages(LSN lsn)
+        {
+            for (size_t i = 0; i < num_pages; i++) {
+                auto& p = pages[i];
+
+                Page::write_lsn(p.get_buffer(), lsn);
+                p.ulock.reset();
+                try {
+                    tree->page_cache->unpin_page(p.page, true, p.lock);
+                } catch (std::exception& e) {
+                    std::cerr << "Failed to write node: " << e.what()
+                              << std::endl;
+                }
+                p.lock = boost::upgrade_lock<Page>();
+                p.page = nullptr;
             }
+            num_pages = 0;
+            pair_delta = 0;
         }
     };
 
-private:
-    struct Sentinel {
-        friend bool operator==(iterator const& it, Sentinel)
+    /* runs the page writes in its scope as one mini-transaction, unless the
+     * thread is already in one or the tree is not logged */
+    class LogScope {
+    public:
+        explicit LogScope(BTree* tree)
         {
-            return it.is_end();
+            if (tree->logging() && !tree->get_mtr()) mtr.emplace(tree);
         }
 
-        template <class Rhs,
-                  std::enable_if_t<!std::is_same<Rhs, Sentinel>{}, int> = 0>
-        friend bool operator!=(Rhs const& ptr, Sentinel)
+    private:
+        std::optional<MiniTransaction> mtr;
+    };
+
+    /* exclusive access to the page frame of a node while the node is being
+     * modified. the node is written to its frame and the page is marked
+     * dirty when the guard is released */
+    class NodeWriteGuard {
+    public:
+        NodeWriteGuard(BTree* tree,
+                       const BaseNode<K, V, KeyComparator, KeyEq>* node)
+            : tree(tree), node(node), page(node->get_page()), logged(nullptr)
         {
-            return !(ptr == Sentinel{});
+            if (tree->logging()) {
+                if (!tree->get_mtr()) own_mtr.emplace(tree);
+                logged = &tree->get_mtr()->add_page(page);
+            } else {
+                lock = boost::upgrade_lock<Page>(*page);
+                /* the frame is pinned by the node, no page table lookup
+                 * needed */
+                tree->page_cache->pin_page(page);
+                ulock.emplace(lock);
+            }
+
+            /* open snapshots keep the page as it was */
+            tree->versions.before_write(page->get_id(), get_buffer(),
+                                        page->get_size());
         }
-        friend bool operator==(Sentinel, iterator const& it)
+        NodeWriteGuard(const NodeWriteGuard&) = delete;
+        NodeWriteGuard& operator=(const NodeWriteGuard&) = delete;
+
+        ~NodeWriteGuard()
         {
-            return it.is_end();
+            auto* buf = get_buffer();
+
+            /* pages of removed nodes are tagged so that iterators holding
+             * them can tell that they are gone */
+            *reinterpret_cast<uint32_t*>(buf) =
+                node->is_deleted() ? FREE_TAG
+                                   : (node->is_leaf() ? LEAF_TAG : INNER_TAG);
+            tree->node_bytes_copied.fetch_add(
+                node->serialize(&buf[Page::HEADER_SIZE],
+                                page->get_size() - Page::HEADER_SIZE),
+                std::memory_order_relaxed);
+
+            if (logged) {
+                logged->writes++;
+                /* commits if the guard started the mini-transaction */
+                own_mtr.reset();
+                return;
+            }
+
+            if (tree->redo_lsn) Page::write_lsn(buf, tree->redo_lsn);
+            ulock.reset();
+            try {
+                tree->page_cache->unpin_page(page, true, lock);
+            } catch (std::exception& e) {
+                /* write-through failed. the page stays dirty and is written
+                 * back later */
+                std::cerr << "Failed to write node: " << e.what() << std::endl;
+            }
         }
-        template <class Lhs,
-                  std::enable_if_t<!std::is_same<Lhs, Sentinel>{}, int> = 0>
-        friend bool operator!=(Sentinel, Lhs const& ptr)
+
+    private:
+        BTree* tree;
+        const BaseNode<K, V, KeyComparator, KeyEq>* node;
+        Page* page;
+        boost::upgrade_lock<Page> lock;
+        std::optional<boost::upgrade_to_unique_lock<Page>> ulock;
+        LoggedPage* logged;
+        std::optional<MiniTransaction> own_mtr;
+
+        uint8_t* get_buffer()
         {
-            return !(Sentinel{} == ptr);
+            return logged ? logged->get_buffer() : page->get_buffer(*ulock);
         }
-        friend bool operator==(Sentinel, Sentinel) { return true; }
-        friend bool operator!=(Sentinel, Sentinel) { return false; }
     };
 
-public:
-    iterator begin() { return iterator(this); }
-    iterator begin(const K& key) { return iterator(this, key); }
-    Sentinel end() const { return Sentinel{}; }
+    NodeWriteGuard
+    write_guard(const BaseNode<K, V, KeyComparator, KeyEq>* node)
+    {
+        return NodeWriteGuard(this, node);
+    }
+
+    void write_node(const BaseNode<K, V, KeyComparator, KeyEq>* node)
+    {
+        auto guard = write_guard(node);
+    }
+
+    /* pairs are added or removed by the pages written in the current
+     * mini-transaction. called by leaves under their write guard */
+    void log_pair_count(int64_t delta)
+    {
+        if (auto* mtr = get_mtr()) mtr->add_pair_count(delta);
+    }
+
+    /* bytes transferred between decoded nodes and their pages so far */
+    uint64_t get_node_bytes_copied() const { return node_bytes_copied.load(); }
+
+    /* leaf access for iterators. leaves are read through their page frames
+     * under the page latch, which writers hold while they modify a node */
+    Page* pin_node_page(const BaseNode<K, V, KeyComparator, KeyEq>* node)
+    {
+        auto* page = node->get_page();
+        page_cache->pin_page(page);
+        return page;
+    }
+
+    void pin_leaf_page(Page* page) { page_cache->pin_page(page); }
+
+    void unpin_leaf_page(Page* page)
+    {
+        boost::upgrade_lock<Page> lock(*page);
+        page_cache->unpin_page(page, false, lock);
+    }
+
+    /* pinned page of the leaf that may hold the key, see descend_to_leaf().
+     * the pin keeps the page ID from being reused while it is held */
+    Page* find_leaf_page(const K* key, bool upper, std::optional<K>& low_fence)
+    {
+        OpGuard guard(this);
+
+        while (true) {
+            bool need_restart;
+            uint64_t version;
+            Page* page = nullptr;
+
+            auto* leaf = descend_to_leaf(key, upper, version, &low_fence,
+                                         nullptr, need_restart);
+            if (leaf) {
+                page = pin_node_page(leaf);
+                need_restart = leaf->read_unlock_or_restart(version);
+            }
+            if (need_restart) {
+                if (page) unpin_leaf_page(page);
+                scan_restarts.add(1);
+                continue;
+            }
+            return page;
+        }
+    }
+
+    /* read the entries of a leaf page. returns false if the page no longer
+     * holds a leaf */
+    bool read_leaf_page(Page* page, boost::upgrade_lock<Page>& lock,
+                        std::vector<K>& key_list, std::vector<V>& value_list,
+                        PageID& next_leaf)
+    {
+        const auto* buf = page->get_buffer(lock);
+        if (*reinterpret_cast<const uint32_t*>(buf) != LEAF_TAG) return false;
+
+        next_leaf = LeafNodeType::read_page(buf + Page::HEADER_SIZE,
+                                            page->get_size() - Page::HEADER_SIZE,
+                                            key_list, value_list);
+        return true;
+    }
+
+    /* iterator interface. a forward iterator keeps the page of the current
+     * leaf pinned and moves to the next leaf through the sibling link, so a
+     * scan does not descend from the root for every leaf. the next leaf is
+     * pinned before the latch on the current one is released, which keeps
+     * it from being merged away or moved in between. a reverse iterator
+     * descends to the leaf on the left of the current one */
+    class iterator {
+        friend class BTree<N, K, V, KeySerializer, KeyComparator, KeyEq,
+                           ValueSerializer>;
+
+    public:
+        using self_type = iterator;
+        using value_type = std::pair<K, V>;
+        using reference = value_type&;
+        using pointer = value_type*;
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = int;
+
+        iterator(const iterator& other)
+            : tree(other.tree), reverse(other.reverse), page(other.page),
+              key_buf(other.key_buf), value_buf(other.value_buf),
+              idx(other.idx), kvp(other.kvp), ended(other.ended),
+              bound(other.bound), bound_count(other.bound_count),
+              leaf_pid(other.leaf_pid), low_fence(other.low_fence),
+              kcmp(other.kcmp), keq(other.keq)
+        {
+            if (page) tree->pin_leaf_page(page);
+        }
+        iterator& operator=(const iterator& other)
+        {
+            if (this != &other) {
+                iterator copy(other);
+                std::swap(page, copy.page);
+                tree = other.tree;
+                reverse = other.reverse;
+                key_buf = other.key_buf;
+                value_buf = other.value_buf;
+                idx = other.idx;
+                kvp = other.kvp;
+                ended = other.ended;
+                bound = other.bound;
+                bound_count = other.bound_count;
+                leaf_pid = other.leaf_pid;
+                low_fence = other.low_fence;
+            }
+            return *this;
+        }
+        ~iterator()
+        {
+            if (page) tree->unpin_leaf_page(page);
+        }
+
+        /* the postfix form copies the buffered leaf */
+        self_type& operator++()
+        {
+            inc();
+            return *this;
+        }
+        self_type operator++(int _unused)
+        {
+            self_type i = *this;
+            inc();
+            return i;
+        }
+        reference operator*() { return kvp; }
+        pointer operator->() { return &kvp; }
+        bool operator==(const self_type& rhs) { return false; }
+        bool operator!=(const self_type& rhs) { return true; }
+        bool is_end() const { return ended; }
+
+    private:
+        using container_type = BTree<N, K, V, KeySerializer, KeyComparator,
+                                     KeyEq, ValueSerializer>;
+        container_type* tree;
+        bool reverse;
+        Page* page; /* current leaf (forward only), pinned */
+        std::vector<K> key_buf;
+        std::vector<V> value_buf;
+        size_t idx;
+        value_type kvp;
+        bool ended;
+        /* last key returned and how many of the pairs with this key in the
+         * current leaf have been returned. updated when the buffered pairs
+         * run out and used to resume after the leaf has changed */
+        std::optional<K> bound;
+        size_t bound_count;
+        PageID leaf_pid;            /* last leaf read (reverse only) */
+        std::optional<K> low_fence; /* of the current leaf (reverse only) */
+        KeyComparator kcmp;
+        KeyEq keq;
+
+        /* a forward iterator starts at the first pair with a key not less
+         * than key and a reverse iterator at the last pair with a key not
+         * greater than key. a null key starts at either end */
+        iterator(container_type* tree, const K* key, bool reverse)
+            : tree(tree), reverse(reverse), page(nullptr), idx(0),
+              ended(false), bound_count(0), leaf_pid(Page::INVALID_PAGE_ID)
+        {
+            if (key) bound = *key;
+
+            if (!reverse) {
+                page = tree->find_leaf_page(key, false, low_fence);
+                fill_forward(true);
+            } else {
+                while (true) {
+                    Page* leaf = tree->find_leaf_page(key, true, low_fence);
+                    if (!leaf) {
+                        ended = true;
+                        break;
+                    }
+
+                    bool live;
+                    if (read_reverse(leaf, true, live)) break;
+                    if (live) {
+                        fill_reverse();
+                        break;
+                    }
+                }
+            }
+
+            if (!ended) set_current();
+        }
+
+        void inc()
+        {
+            if (ended) return;
+
+            if (!reverse) {
+                if (++idx == key_buf.size()) {
+                    /* all pairs of the leaf as read have been returned */
+                    bound = key_buf.back();
+                    bound_count =
+                        key_buf.end() - std::lower_bound(key_buf.begin(),
+                                                         key_buf.end(), *bound,
+                                                         kcmp);
+                    fill_forward(false);
+                }
+            } else {
+                if (idx-- == 0) {
+                    bound = key_buf.front();
+                    fill_reverse();
+                }
+            }
+
+            if (!ended) set_current();
+        }
+
+        void set_current()
+        {
+            kvp.first = key_buf[idx];
+            kvp.second = value_buf[idx];
+        }
+
+        /* position of the first pair after the ones returned so far. copies
+         * is set to the number of pairs with the last key in the leaf */
+        size_t skip_returned(size_t& copies) const
+        {
+            copies = 0;
+            if (!bound) return 0;
+
+            size_t i = std::lower_bound(key_buf.begin(), key_buf.end(),
+                                        *bound, kcmp) -
+                       key_buf.begin();
+            for (size_t j = i; j < key_buf.size() && keq(key_buf[j], *bound);
+                 j++) {
+                copies++;
+            }
+            return i + std::min(copies, bound_count);
+        }
+
+        /* whether the current leaf may hold pairs that have not been
+         * returned, checked without copying the leaf if possible */
+        bool may_have_more(Page* page, boost::upgrade_lock<Page>& lock)
+        {
+            if constexpr (LeafNodeType::IN_PLACE) {
+                const auto* buf = page->get_buffer(lock);
+                if (*reinterpret_cast<const uint32_t*>(buf) != LEAF_TAG)
+                    return true;
+
+                K last_key;
+                size_t n = LeafNodeType::read_page_last_key(
+                    buf + Page::HEADER_SIZE,
+                    page->get_size() - Page::HEADER_SIZE, last_key);
+                return n > 0 && (!bound || !kcmp(last_key, *bound));
+            }
+            return true;
+        }
+
+        /* load the pairs following the ones returned so far. fresh is set if
+         * the current leaf has not been read yet */
+        void fill_forward(bool fresh)
+        {
+            boost::upgrade_lock<Page> lock;
+            if (page) lock = boost::upgrade_lock<Page>(*page);
+
+            while (page) {
+                PageID next_pid = Page::INVALID_PAGE_ID;
+                size_t copies = 0;
+
+                if (fresh || may_have_more(page, lock)) {
+                    if (!tree->read_leaf_page(page, lock, key_buf, value_buf,
+                                              next_pid)) {
+                        /* the leaf has been merged or moved, look up the
+                         * position again */
+                        tree->page_cache->unpin_page(page, false, lock);
+                        lock.unlock();
+
+                        std::optional<K> low_fence;
+                        page = tree->find_leaf_page(bound ? &*bound : nullptr,
+                                                    false, low_fence);
+                        if (page) lock = boost::upgrade_lock<Page>(*page);
+                        fresh = true;
+                        continue;
+                    }
+
+                    idx = skip_returned(copies);
+                    if (idx < key_buf.size()) return;
+                } else {
+                    next_pid = *reinterpret_cast<const PageID*>(
+                        page->get_buffer(lock) + Page::HEADER_SIZE +
+                        LeafNodeType::NEXT_LEAF_OFFSET);
+                }
+
+                /* the next leaf is latched before the current one is
+                 * released and is read under the same latch */
+                Page* next = nullptr;
+                boost::upgrade_lock<Page> next_lock;
+                if (next_pid != Page::INVALID_PAGE_ID) {
+                    next = tree->page_cache->fetch_page(next_pid, next_lock);
+
+                    /* a leaf that cannot be read is not the end of the
+                     * scan */
+                    if (!next) {
+                        tree->page_cache->unpin_page(page, false, lock);
+                        lock.unlock();
+                        page = nullptr;
+                        throw std::runtime_error("unable to read leaf page");
+                    }
+                }
+
+                tree->page_cache->unpin_page(page, false, lock);
+                lock = std::move(next_lock);
+                page = next;
+                fresh = true;
+                /* pairs with the last key that have been returned but are
+                 * no longer in the leaf have been moved to the next leaf by
+                 * a split */
+                bound_count -= std::min(bound_count, copies);
+            }
+
+            ended = true;
+        }
+
+        /* read a leaf and position on the last pair that precedes the ones
+         * returned so far. returns false if there is none. live is cleared
+         * if the page no longer holds a leaf */
+        bool read_reverse(Page* leaf, bool first, bool& live)
+        {
+            PageID next_pid;
+            {
+                boost::upgrade_lock<Page> lock(*leaf);
+                live = tree->read_leaf_page(leaf, lock, key_buf, value_buf,
+                                            next_pid);
+            }
+            PageID pid = leaf->get_id();
+            tree->unpin_leaf_page(leaf);
+
+            if (!live) return false;
+
+            /* pairs with the last key returned are only taken from another
+             * leaf. the first leaf holds the pairs not greater than the
+             * start key */
+            size_t end = key_buf.size();
+            if (bound) {
+                if (first || pid != leaf_pid) {
+                    end = std::upper_bound(key_buf.begin(), key_buf.end(),
+                                           *bound, kcmp) -
+                          key_buf.begin();
+                } else {
+                    end = std::lower_bound(key_buf.begin(), key_buf.end(),
+                                           *bound, kcmp) -
+                          key_buf.begin();
+                }
+            }
+
+            leaf_pid = pid;
+            if (end == 0) return false;
+
+            idx = end - 1;
+            return true;
+        }
+
+        /* move to the leaf on the left, which is found by descending with
+         * the low fence of the current leaf */
+        void fill_reverse()
+        {
+            while (low_fence) {
+                std::optional<K> fence;
+                K search = *low_fence;
+                Page* leaf = tree->find_leaf_page(&search, false, fence);
+                if (!leaf) break;
+
+                bool live;
+                bool found = read_reverse(leaf, false, live);
+                /* a dead page is looked up again */
+                if (!live) continue;
+
+                low_fence = fence;
+                if (found) return;
+            }
+
+            ended = true;
+        }
+    };
+
+    /* builds the tree bottom-up from pairs added in key order. leaves are
+     * filled up to the fill factor and linked as they are created, and a
+     * node is passed to its parent level as soon as the next node on its
+     * level is started, so at most two nodes per level are in memory. the
+     * pages are allocated in ascending order as the nodes are created.
+     * finish() rebalances the last two nodes of every level and installs
+     * the root through the meta page. the tree must be empty and no other
+     * operation may run until finish() returns. the pages of a load that is
+     * not finished are not reclaimed */
+    class BulkLoader {
+    public:
+        using container_type = BTree<N, K, V, KeySerializer, KeyComparator,
+                                     KeyEq, ValueSerializer>;
+
+        explicit BulkLoader(container_type* tree, double fill_factor = 1.0)
+            : tree(tree), fill_factor(fill_factor), num_pairs(0),
+              finished(false)
+        {
+            if (tree->size() > 0) {
+                throw std::logic_error("bulk load into a non-empty tree");
+            }
+
+            leaf_fill = std::clamp((size_t)((N - 1) * fill_factor), (size_t)1,
+                                   (size_t)(N - 1));
+            inner_fill =
+                std::clamp((size_t)(N * fill_factor), (size_t)2, (size_t)N);
+        }
+
+        BulkLoader(const BulkLoader&) = delete;
+        BulkLoader& operator=(const BulkLoader&) = delete;
+
+        void add(const K& key, const V& value)
+        {
+            if (num_pairs > 0 && kcmp(key, last_key)) {
+                throw std::invalid_argument("bulk load input is not sorted");
+            }
+
+            if (levels.empty()) levels.emplace_back();
+            auto* leaf = static_cast<LeafNodeType*>(levels[0].cur.get());
+
+            tree->check_entry(key, value);
+            if (!leaf || leaf->size >= leaf_fill ||
+                !fits_filled(leaf, LeafNodeType::entry_bytes(key, value))) {
+                auto next = tree->template create_node<LeafNodeType>(nullptr);
+                if (leaf) leaf->next_leaf = next->get_pid();
+                leaf = next.get();
+                push_node(0, std::move(next),
+                          num_pairs > 0
+                              ? LeafNodeType::make_separator(last_key, key)
+                              : key);
+            }
+
+            leaf->keys.set(leaf->size, key);
+            leaf->values.set(leaf->size, value);
+            leaf->size++;
+
+            last_key = key;
+            num_pairs++;
+        }
+
+        void finish()
+        {
+            if (finished || levels.empty()) return;
+            finished = true;
+
+            std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>> top;
+            for (size_t level = 0;; level++) {
+                auto& lv = levels[level];
+
+                /* the only node on the level is the root */
+                if (!lv.prev && !lv.count) {
+                    top = std::move(lv.cur);
+                    break;
+                }
+
+                /* the last node is only partially filled */
+                if (lv.prev && lv.cur->is_underfull()) {
+                    K separator = lv.cur_first;
+                    if (lv.prev->merge_or_redistribute(lv.cur.get(),
+                                                       separator)) {
+                        lv.cur->mark_deleted();
+                        lv.cur.reset();
+                    } else {
+                        lv.cur_first = separator;
+                    }
+                }
+
+                if (lv.prev) emit(level, std::move(lv.prev), lv.prev_first);
+                if (lv.cur) emit(level, std::move(lv.cur), lv.cur_first);
+            }
+
+            /* an inner root with a single child is dropped */
+            while (!top->is_leaf() && top->get_size() == 0) {
+                auto* inner = static_cast<InnerNodeType*>(top.get());
+                auto child = tree->read_node(nullptr, inner->child_pages[0]);
+                top->mark_deleted();
+                top = std::move(child);
+            }
+            set_prefix(top.get());
+
+            {
+                /* the new root is logged together with the meta page */
+                LogScope scope(tree);
+                tree->write_node(top.get());
+
+                /* replace the empty root */
+                top.swap(tree->root);
+                tree->log_pair_count(num_pairs);
+                tree->num_pairs.store(num_pairs);
+                tree->write_metadata();
+            }
+            tree->retire_node(std::move(top), true);
+            tree->maybe_evict_nodes();
+        }
+
+    private:
+
+        /* the last two nodes of a level and the smallest keys under them.
+         * count is the number of nodes passed to the parent level */
+        struct Level {
+            std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>> prev, cur;
+            K prev_first, cur_first;
+            size_t count = 0;
+        };
+
+        container_type* tree;
+        double fill_factor;
+        size_t leaf_fill;  /* max. pairs per leaf */
+        size_t inner_fill; /* max. children per inner node */
+        std::deque<Level> levels;
+        K last_key;
+        size_t num_pairs;
+        bool finished;
+        KeyComparator kcmp;
+
+        /* whether bytes more fit into a slotted node on the level within
+         * the fill factor. nodes under construction have no garbage in
+         * their heap */
+        template <typename Node>
+        bool fits_filled(const Node* node, size_t bytes) const
+        {
+            if constexpr (Node::SLOTTED) {
+                size_t free = node->heap.contiguous();
+                size_t used = node->heap.capacity() - free;
+                return bytes <= free &&
+                       (used == 0 ||
+                        used + bytes <= node->heap.capacity() * fill_factor);
+            }
+            return true;
+        }
+
+        /* start a new last node on the level */
+        void push_node(size_t level,
+                       std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>> node,
+                       const K& first)
+        {
+            auto& lv = levels[level];
+
+            if (lv.prev) emit(level, std::move(lv.prev), lv.prev_first);
+            lv.prev = std::move(lv.cur);
+            lv.prev_first = lv.cur_first;
+            lv.cur = std::move(node);
+            lv.cur_first = first;
+        }
+
+        void add_child(size_t level, PageID pid, const K& first)
+        {
+            if (levels.size() == level) levels.emplace_back();
+            auto* node = static_cast<InnerNodeType*>(levels[level].cur.get());
+
+            if (!node || node->size + 1 >= inner_fill ||
+                !fits_filled(node,
+                             InnerNodeType::KeyArray::heap_bytes_of(first))) {
+                auto next = tree->template create_node<InnerNodeType>(nullptr);
+                next->child_pages[0] = pid;
+                push_node(level, std::move(next), first);
+                return;
+            }
+
+            node->keys.set(node->size, first);
+            node->child_pages[node->size + 1] = pid;
+            node->size++;
+        }
+
+        /* nodes are filled with whole keys. the common prefix of their keys
+         * is stored once they are complete */
+        static void set_prefix(BaseNode<K, V, KeyComparator, KeyEq>* node)
+        {
+            if (node->is_leaf()) {
+                if constexpr (LeafNodeType::TRUNCATE_KEYS) {
+                    static_cast<LeafNodeType*>(node)->compact_heap();
+                }
+            } else if constexpr (InnerNodeType::TRUNCATE_KEYS) {
+                static_cast<InnerNodeType*>(node)->compact_heap();
+            }
+        }
+
+        /* write a completed node to its page and add it to the parent */
+        void emit(size_t level,
+                  std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>> node,
+                  K first)
+        {
+            PageID pid = node->get_pid();
+            set_prefix(node.get());
+            tree->write_node(node.get());
+            node.reset();
+
+            levels[level].count++;
+            add_child(level + 1, pid, first);
+        }
+    };
+
+private:
+    struct Sentinel {
+        template <class It,
+                  std::enable_if_t<!std::is_same<It, Sentinel>{}, int> = 0>
+        friend bool operator==(It const& it, Sentinel)
+        {
+            return it.is_end();
+        }
+
+        template <class Rhs,
+                  std::enable_if_t<!std::is_same<Rhs, Sentinel>{}, int> = 0>
+        friend bool operator!=(Rhs const& ptr, Sentinel)
+        {
+            return !(ptr == Sentinel{});
+        }
+        template <class It,
+                  std::enable_if_t<!std::is_same<It, Sentinel>{}, int> = 0>
+        friend bool operator==(Sentinel, It const& it)
+        {
+            return it.is_end();
+        }
+        template <class Lhs,
+                  std::enable_if_t<!std::is_same<Lhs, Sentinel>{}, int> = 0>
+        friend bool operator!=(Sentinel, Lhs const& ptr)
+        {
+            return !(Sentinel{} == ptr);
+        }
+        friend bool operator==(Sentinel, Sentinel) { return true; }
+        friend bool operator!=(Sentinel, Sentinel) { return false; }
+    };
+
+public:
+    iterator begin() { return iterator(this, nullptr, false); }
+    iterator begin(const K& key) { return iterator(this, &key, false); }
+    Sentinel end() const { return Sentinel{}; }
+
+    using reverse_iterator = iterator;
+    reverse_iterator rbegin() { return iterator(this, nullptr, true); }
+    reverse_iterator rbegin(const K& key) { return iterator(this, &key, true); }
+    Sentinel rend() const { return Sentinel{}; }
+
+    /* a read-only view of the tree as of the call to snapshot(). pages
+     * that writers change afterwards are read from their old versions (see
+     * PageVersionStore), all others from the page cache, and nodes are
+     * read from the pages without node locks, so a reader never waits for
+     * a node lock or restarts. the snapshot holds no latch between calls
+     * and must not outlive the tree */
+    class Snapshot {
+        friend class BTree<N, K, V, KeySerializer, KeyComparator, KeyEq,
+                           ValueSerializer>;
+
+    public:
+        using container_type = BTree<N, K, V, KeySerializer, KeyComparator,
+                                     KeyEq, ValueSerializer>;
+
+        ~Snapshot() { tree->versions.release(version); }
+
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        /* number of pairs in the snapshot */
+        size_t size() const { return num_pairs; }
+
+        void get_value(const K& key, std::vector<V>& value_list) const
+        {
+            KeyEq keq;
+            value_list.clear();
+            for (auto it = begin(key); !it.is_end() && keq(it->first, key);
+                 ++it) {
+                value_list.push_back(it->second);
+            }
+        }
+
+        /* forward iterator over the snapshot. it reads a leaf at a time and
+         * moves to the next leaf through the sibling link */
+        class iterator {
+            friend class Snapshot;
+
+        public:
+            using self_type = iterator;
+            using value_type = std::pair<K, V>;
+            using reference = value_type&;
+            using pointer = value_type*;
+            using iterator_category = std::forward_iterator_tag;
+            using difference_type = int;
+
+            self_type& operator++()
+            {
+                inc();
+                return *this;
+            }
+            self_type operator++(int _unused)
+            {
+                self_type i = *this;
+                inc();
+                return i;
+            }
+            reference operator*() { return kvp; }
+            pointer operator->() { return &kvp; }
+            bool is_end() const { return ended; }
+
+        private:
+            const Snapshot* snapshot;
+            std::vector<K> key_buf;
+            std::vector<V> value_buf;
+            size_t idx;
+            PageID next_pid;
+            value_type kvp;
+            bool ended;
+
+            /* starts at the first pair with a key not less than key, or at
+             * the first pair if key is null */
+            iterator(const Snapshot* snapshot, const K* key)
+                : snapshot(snapshot), idx(0), next_pid(Page::INVALID_PAGE_ID),
+                  ended(false)
+            {
+                fill(snapshot->root_pid, key);
+            }
+
+            void inc()
+            {
+                if (ended) return;
+                if (++idx == key_buf.size()) fill(next_pid, nullptr);
+                if (!ended) set_current();
+            }
+
+            void set_current()
+            {
+                kvp.first = key_buf[idx];
+                kvp.second = value_buf[idx];
+            }
+
+            /* read the leaf under pid that may hold the key and the leaves
+             * after it until one has a pair not less than the key */
+            void fill(PageID pid, const K* key)
+            {
+                KeyComparator kcmp;
+
+                while (pid != Page::INVALID_PAGE_ID) {
+                    next_pid =
+                        snapshot->read_leaf(pid, key, key_buf, value_buf);
+                    idx = key ? std::lower_bound(key_buf.begin(),
+                                                 key_buf.end(), *key, kcmp) -
+                                    key_buf.begin()
+                              : 0;
+                    if (idx < key_buf.size()) {
+                        set_current();
+                        return;
+                    }
+                    pid = next_pid;
+                }
+
+                ended = true;
+            }
+        };
+
+        iterator begin() const { return iterator(this, nullptr); }
+        iterator begin(const K& key) const { return iterator(this, &key); }
+        Sentinel end() const { return Sentinel{}; }
+
+    private:
+        container_type* tree;
+        PageVersionStore::Version version;
+        PageID root_pid;
+        size_t num_pairs;
+
+        Snapshot(container_type* tree, PageVersionStore::Version version,
+                 PageID root_pid, size_t num_pairs)
+            : tree(tree), version(version), root_pid(root_pid),
+              num_pairs(num_pairs)
+        {}
+
+        /* descend from pid to the leftmost leaf that may hold the key and
+         * read its entries. returns the ID of the next leaf */
+        PageID read_leaf(PageID pid, const K* key, std::vector<K>& key_list,
+                         std::vector<V>& value_list) const
+        {
+            while (true) {
+                bool leaf = false;
+                PageID next = Page::INVALID_PAGE_ID;
+
+                tree->read_snapshot_page(
+                    pid, version, [&](const uint8_t* buf, size_t size) {
+                        uint32_t tag = *reinterpret_cast<const uint32_t*>(buf);
+                        buf += Page::HEADER_SIZE;
+                        size -= Page::HEADER_SIZE;
+
+                        if (tag == LEAF_TAG) {
+                            leaf = true;
+                            next = LeafNodeType::read_page(buf, size, key_list,
+                                                           value_list);
+                        } else if (tag == INNER_TAG) {
+                            next = InnerNodeType::read_page_child(buf, size,
+                                                                  key, false);
+                        } else {
+                            throw std::runtime_error("bad node page(tag)");
+                        }
+                    });
+
+                if (leaf) return next;
+                pid = next;
+            }
+        }
+    };
+
+    /* a consistent read-only view of the tree, see Snapshot. waits until
+     * the write operations in flight are done and holds back new ones
+     * meanwhile */
+    std::unique_ptr<Snapshot> snapshot()
+    {
+        std::unique_lock<std::mutex> lock(snapshot_mutex);
+        snapshot_cv.wait(lock, [this]() { return !snapshot_pending.load(); });
+
+        snapshot_pending.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        snapshot_cv.wait(lock, [this]() { return active_writers.load() == 0; });
+
+        std::unique_ptr<Snapshot> snap(
+            new Snapshot(this, versions.acquire(), root->get_pid(), size()));
+
+        snapshot_pending.store(false);
+        lock.unlock();
+        snapshot_cv.notify_all();
+        return snap;
+    }
+
+    SnapshotStats get_snapshot_stats() { return versions.get_stats(); }
+
+private:
+    static const PageID META_PAGE_ID = 1;
+    static const PageID FIRST_NODE_PAGE_ID = META_PAGE_ID + 1;
+    static const uint32_t META_PAGE_MAGIC = 0x00C0FFEE;
+    static const uint32_t META_CLEAN = 1;
+    static const uint32_t INNER_TAG = 1;
+    static const uint32_t LEAF_TAG = 2;
+    static const uint32_t FREE_TAG = 3;
+
+    /* a log entry is a sequence of page records: | type(1 byte) | page
+     * ID(4 bytes) | length(4 bytes) | data |. an image replaces the whole
+     * page, an insert is redone on the leaf read from the page. the change
+     * of the pair count (8 bytes) is logged with no page */
+    static const uint8_t LOG_PAGE_IMAGE = 1;
+    static const uint8_t LOG_LEAF_INSERT = 2;
+    static const uint8_t LOG_PAIR_COUNT = 3;
+    static const size_t LOG_RECORD_HEADER_SIZE =
+        sizeof(uint8_t) + sizeof(PageID) + sizeof(uint32_t);
+
+    /* keys and values are logged as their bytes, strings with their length
+     * in front. leaves of other types are logged as page images */
+    template <typename T, typename S>
+    static constexpr bool is_loggable = is_in_place_serializable<T, S>::value ||
+                                        is_var_len_serializable<T, S>::value;
+    static constexpr bool LOG_INSERTS = is_loggable<K, KeySerializer> &&
+                                        is_loggable<V, ValueSerializer>;
+
+    /* how often the background checkpointer looks at the log size */
+    static constexpr auto CHECKPOINT_POLL_INTERVAL =
+        std::chrono::milliseconds(10);
+
+    /* evict until the usage drops below this fraction of the budget */
+    static constexpr double NODE_CACHE_LOW_WATERMARK = 0.9;
+    /* max. fraction of a bounded page cache that can be pinned by decoded
+     * nodes. the rest is left for transient pins and unswizzled pages */
+    static constexpr double NODE_CACHE_POOL_RATIO = 0.5;
+
+    AbstractPageCache* page_cache;
+
+    /* the log of the page cache, if any. page writes are not logged while
+     * the log is replayed, instead redo_lsn is stamped on the pages */
+    WriteAheadLog* wal;
+    LSN redo_lsn;
+    static inline thread_local MiniTransaction* active_mtr = nullptr;
+    /* changes of the pair count replayed from the log with their LSNs */
+    std::vector<std::pair<LSN, int64_t>> recovered_counts;
+
+    /* the last entry logged by the thread, waited for by wait_for_log(),
+     * or the error that kept the changes of the thread from the log */
+    struct PendingCommit {
+        const BTree* tree = nullptr;
+        LSN lsn = 0;
+        std::exception_ptr error;
+    };
+    static inline thread_local PendingCommit pending_commit;
+
+    /* node cache state. declared before root so that it outlives the nodes */
+    std::atomic<size_t> node_memory;
+    std::atomic<size_t> node_pages;
+    std::atomic<size_t> node_cache_budget;
+    std::atomic<size_t> node_evictions;
+    std::atomic<uint64_t> node_bytes_copied;
+
+    /* old page versions for snapshots, declared before root and the
+     * retired nodes so that it outlives them (see node_freed()). write
+     * operations are counted in active_writers so that snapshot() can wait
+     * for them, see WriteGate */
+    PageVersionStore versions;
+    ShardedCounter active_writers;
+    std::atomic<bool> snapshot_pending;
+    std::mutex snapshot_mutex;
+    std::condition_variable snapshot_cv;
+
+    /* nodes unlinked from the tree by evictions, merges and moves, in the
+     * order they were retired, with the epoch they were retired at. they
+     * are freed by the evictor under evict_mutex, see maybe_evict_nodes() */
+    struct RetiredNode {
+        EpochManager::Epoch epoch;
+        std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>> node;
+    };
+    EpochManager epochs;
+    std::mutex evict_mutex;
+    std::deque<RetiredNode> retired_nodes;
+    std::atomic<bool> retired_empty;
+
+    std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>> root;
+    ShardedCounter num_pairs;
+
+    /* set when the pair count on the meta page is exact. cleared, and the
+     * meta page written once, by the first update after a checkpoint.
+     * meta_stale is set once the cleared flag is on disk, see
+     * mark_modified() */
+    std::atomic<bool> meta_clean;
+    std::atomic<bool> meta_stale;
+    std::mutex meta_mutex;
+    std::mutex modify_mutex;
+    int64_t meta_pair_count; /* last written to the meta page */
+
+    /* background checkpoints (see checkpoint()). checkpoint_mutex lets one
+     * checkpoint run at a time */
+    std::mutex checkpoint_mutex;
+    std::mutex checkpointer_mutex;
+    std::condition_variable checkpointer_cv;
+    bool checkpointer_stop;
+    std::thread checkpointer;
+
+    ShardedCounter lookup_restarts;
+    ShardedCounter insert_restarts;
+    ShardedCounter erase_restarts;
+    ShardedCounter scan_restarts;
+
+    /* held by operations that may hold pointers to cached nodes. retired
+     * nodes are only freed once the operations that were in flight when
+     * they were retired are done, see EpochManager */
+    struct OpGuard {
+        EpochManager::Guard guard;
+        explicit OpGuard(BTree* tree) : guard(tree->epochs) {}
+    };
+
+    /* held by write operations. a snapshot is taken while no write
+     * operation is in flight: writers that find one pending back out and
+     * wait until it is taken. the counter is sharded so that writers do
+     * not contend on it, the fences order it against the pending flag */
+    struct WriteGate {
+        BTree* tree;
+
+        explicit WriteGate(BTree* tree) : tree(tree)
+        {
+            while (true) {
+                tree->active_writers.add(1);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if (!tree->snapshot_pending.load(std::memory_order_relaxed))
+                    return;
+
+                leave();
+                std::unique_lock<std::mutex> lock(tree->snapshot_mutex);
+                tree->snapshot_cv.wait(lock, [this]() {
+                    return !this->tree->snapshot_pending.load();
+                });
+            }
+        }
+        ~WriteGate() { leave(); }
+
+        void leave()
+        {
+            tree->active_writers.add(-1);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (tree->snapshot_pending.load(std::memory_order_relaxed)) {
+                std::lock_guard<std::mutex> lock(tree->snapshot_mutex);
+                tree->snapshot_cv.notify_all();
+            }
+        }
+    };
+
+    /* call fn with the page as a snapshot at version sees it. a writer
+     * saves the old image with the page latched, so the saved images are
+     * looked up again once the latch is held */
+    template <typename F>
+    void read_snapshot_page(PageID pid, PageVersionStore::Version version,
+                            F&& fn)
+    {
+        if (auto image = versions.find(pid, version)) {
+            fn(image->data(), image->size());
+            return;
+        }
+
+        boost::upgrade_lock<Page> lock;
+        auto* page = page_cache->fetch_page(pid, lock);
+        if (!page) throw std::runtime_error("unable to read snapshot page");
+
+        try {
+            if (auto image = versions.find(pid, version)) {
+                fn(image->data(), image->size());
+            } else {
+                fn(page->get_buffer(lock), page->get_size());
+            }
+        } catch (...) {
+            page_cache->unpin_page(page, false, lock);
+            throw;
+        }
+        page_cache->unpin_page(page, false, lock);
+    }
+
+    /* inner node on the path of a descent with the version it was read at,
+     * the index of the child taken and the upper fence of that child (the
+     * nearest separator on its right, if any) */
+    struct PathEntry {
+        InnerNodeType* node;
+        uint64_t version;
+        size_t child_idx;
+        std::optional<K> high;
+    };
+    static constexpr size_t MAX_DEPTH = 32;
+
+    /* what a leaf operation asks the insert descent to do next */
+    enum class LeafAction { DONE, SPLIT, RESTART };
+
+    /* descend from the root to the leaf that may hold the key with lock
+     * coupling: the version of a child is read before its parent is
+     * validated. the child is chosen as in InnerNode::find_child(). returns
+     * the leaf, read-locked at version, which the caller validates after
+     * reading it. returns nullptr with need_restart set if a read was
+     * invalidated, or with need_restart cleared if the leaf does not exist.
+     * low_fence and high_fence (if not null) are set to the separators on
+     * the left and on the right of the leaf */
+    LeafNodeType* descend_to_leaf(const K* key, bool upper, uint64_t& version,
+                                  std::optional<K>* low_fence,
+                                  std::optional<K>* high_fence,
+                                  bool& need_restart)
+    {
+        if (low_fence) low_fence->reset();
+        if (high_fence) high_fence->reset();
+
+        auto* node = root.get();
+        version = node->read_lock_or_restart(need_restart);
+        /* the old root is unlocked only after the new one is in place */
+        if (need_restart || node != root.get()) {
+            need_restart = true;
+            return nullptr;
+        }
+
+        while (!node->is_leaf()) {
+            auto* inner = static_cast<InnerNodeType*>(node);
+            size_t child_idx = inner->find_child(key, upper);
+
+            if (low_fence && child_idx > 0) {
+                *low_fence = inner->get_key(child_idx - 1);
+            }
+            if (high_fence && child_idx < inner->size) {
+                *high_fence = inner->get_key(child_idx);
+            }
+
+            auto* child =
+                inner->get_child(child_idx, false, version, need_restart);
+            if (need_restart) return nullptr;
+            if (!child) {
+                need_restart = inner->read_unlock_or_restart(version);
+                return nullptr;
+            }
+
+            /* load the lines of the child that are read next in parallel */
+            child->prefetch();
+            auto child_version = child->read_lock_or_restart(need_restart);
+            if (need_restart || inner->read_unlock_or_restart(version)) {
+                need_restart = true;
+                return nullptr;
+            }
+
+            node = child;
+            version = child_version;
+        }
+
+        return static_cast<LeafNodeType*>(node);
+    }
+
+    void get_value_impl(const K& key, std::vector<V>& value_list)
+    {
+        while (true) {
+            bool need_restart;
+            uint64_t version;
+            value_list.clear();
+
+            auto* leaf = descend_to_leaf(&key, true, version, nullptr, nullptr,
+                                         need_restart);
+            if (leaf) {
+                leaf->copy_values(key, value_list);
+                need_restart = leaf->read_unlock_or_restart(version);
+            }
+            if (need_restart) {
+                lookup_restarts.add(1);
+                continue;
+            }
+            break;
+        }
+    }
+
+    void collect_values_impl(const K& key, std::optional<K>* next_key,
+                             std::vector<K>& key_list,
+                             std::vector<V>& value_list)
+    {
+        while (true) {
+            bool need_restart;
+            uint64_t version;
+            key_list.clear();
+            value_list.clear();
+
+            auto* leaf = descend_to_leaf(&key, true, version, nullptr, next_key,
+                                         need_restart);
+            if (leaf) {
+                leaf->copy_pairs(key_list, value_list);
+                need_restart = leaf->read_unlock_or_restart(version);
+            }
+            if (need_restart) {
+                lookup_restarts.add(1);
+                continue;
+            }
+            break;
+        }
+    }
+
+    /* the root split, put a new root above it and its sibling */
+    void grow_root(std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>>
+                       root_sibling,
+                   const K& split_key)
+    {
+        auto new_root = create_node<InnerNodeType>(nullptr);
+
+        {
+            auto guard = write_guard(new_root.get());
+
+            root->set_parent(new_root.get());
+            root_sibling->set_parent(new_root.get());
+
+            new_root->set_size(1);
+            new_root->keys.set(0, split_key);
+            new_root->child_pages[0] = root->get_pid();
+            new_root->child_pages[1] = root_sibling->get_pid();
+            new_root->child_cache[0] = std::move(root);
+            new_root->child_cache[1] = std::move(root_sibling);
+        }
+
+        root = std::move(new_root);
+        write_metadata();
+    }
+
+    /* variable-length pairs take at most a quarter of the heap of a node so
+     * that a node that is full by bytes has enough entries to split. throws
+     * std::length_error for larger pairs */
+    void check_entry(const K& key, const V& value) const
+    {
+        if constexpr (LeafNodeType::SLOTTED) {
+            size_t page_size = page_cache->get_page_size();
+            size_t limit = LeafNodeType::heap_capacity(page_size);
+            if constexpr (InnerNodeType::SLOTTED) {
+                limit = std::min(limit,
+                                 InnerNodeType::heap_capacity(page_size));
+            }
+
+            if (LeafNodeType::entry_bytes(key, value) > limit / 4) {
+                throw std::length_error("key and value exceed the maximum "
+                                        "size of a pair");
+            }
+        }
+    }
+
+    /* the parent on top of a path (if any) has changed since it was read */
+    static bool parent_changed(const PathEntry* parent)
+    {
+        return parent && parent->node->read_unlock_or_restart(parent->version);
+    }
+
+    /* split the full node read at version, the child of the inner node on
+     * top of path. the parent and the node are write-locked while the new
+     * sibling is linked into the parent. returns true if the descent goes on
+     * from the parent: it was locked all along so its new version is known
+     * and node, version and depth are moved up to it. returns false if the
+     * root was split, or with need_restart set if a lock could not be taken */
+    bool split_node(PathEntry* path, size_t& depth,
+                    BaseNode<K, V, KeyComparator, KeyEq>*& node,
+                    uint64_t& version, bool& need_restart)
+    {
+        auto* parent = depth > 0 ? &path[depth - 1] : nullptr;
+        uint64_t parent_version = 0;
+
+        if (parent) {
+            parent_version = parent->node->upgrade_to_write_lock_or_restart(
+                parent->version, need_restart);
+            if (need_restart) return false;
+        }
+
+        node->upgrade_to_write_lock_or_restart(version, need_restart);
+        if (need_restart) {
+            if (parent) parent->node->write_unlock();
+            return false;
+        }
+
+        {
+            /* the split is logged together with the link to the sibling */
+            LogScope scope(this);
+            K split_key;
+            auto* parent_node = parent ? parent->node : nullptr;
+            auto sibling = node->is_leaf()
+                               ? static_cast<LeafNodeType*>(node)->split(
+                                     parent_node, split_key)
+                               : static_cast<InnerNodeType*>(node)->split(
+                                     parent_node, split_key);
+
+            if (!parent) {
+                grow_root(std::move(sibling), split_key);
+            } else {
+                parent->node->insert_child(parent->child_idx, split_key,
+                                           std::move(sibling));
+            }
+        }
+
+        /* the old root is unlocked only after the new one is in place */
+        node->write_unlock();
+        if (!parent) return false;
+        parent->node->write_unlock();
+
+        depth--;
+        node = parent->node;
+        version = parent_version + 0b10;
+        return true;
+    }
+
+    /* descend to the leaf for the key and call op(leaf, version, parent,
+     * high) on it. parent is the path entry of the leaf's parent (nullptr if
+     * the leaf is the root) and high the upper fence of the leaf, which is
+     * only tracked if need_fence is set (keys are copied for it). op either
+     * finishes, asks for a restart after releasing its locks or asks for the
+     * full leaf to be split. full inner nodes on the way are split eagerly
+     * so that a split never propagates more than one level up, and the
+     * parent to link a sibling into is taken from the path instead of the
+     * parent pointer of the node */
+    template <typename LeafOp>
+    void modify_leaf(const K& key, LeafOp&& op, bool need_fence = false)
+    {
+        static const std::optional<K> no_fence;
+        std::array<PathEntry, MAX_DEPTH> path;
+
+        while (true) {
+            bool need_restart = false;
+            size_t depth = 0;
+
+            auto* node = root.get();
+            auto version = node->read_lock_or_restart(need_restart);
+            if (need_restart || node != root.get()) {
+                insert_restarts.add(1);
+                continue;
+            }
+
+            while (true) {
+                auto* parent = depth > 0 ? &path[depth - 1] : nullptr;
+
+                if (node->is_leaf()) {
+                    auto action = op(static_cast<LeafNodeType*>(node), version,
+                                     parent, parent ? parent->high : no_fence);
+                    if (action == LeafAction::DONE) return;
+                    if (action == LeafAction::RESTART) {
+                        need_restart = true;
+                        break;
+                    }
+                } else if (!static_cast<InnerNodeType*>(node)->is_full()) {
+                    auto* inner = static_cast<InnerNodeType*>(node);
+                    assert(depth < MAX_DEPTH);
+                    auto& entry = path[depth];
+
+                    entry.node = inner;
+                    entry.version = version;
+                    entry.child_idx = inner->find_child(&key, true);
+                    if (!need_fence) {
+                        entry.high.reset();
+                    } else if (entry.child_idx < inner->size) {
+                        entry.high = inner->get_key(entry.child_idx);
+                    } else {
+                        entry.high = parent ? parent->high : no_fence;
+                    }
+
+                    auto* child = inner->get_child(entry.child_idx, false,
+                                                   entry.version, need_restart);
+                    if (need_restart) break;
+                    if (!child) {
+                        need_restart = true;
+                        break;
+                    }
+
+                    child->prefetch();
+                    auto child_version = child->read_lock_or_restart(need_restart);
+                    if (need_restart ||
+                        inner->read_unlock_or_restart(entry.version)) {
+                        need_restart = true;
+                        break;
+                    }
+
+                    depth++;
+                    node = child;
+                    version = child_version;
+                    continue;
+                }
+
+                /* the node is full */
+                if (!split_node(path.data(), depth, node, version,
+                                need_restart))
+                    break;
+            }
+
+            if (need_restart) insert_restarts.add(1);
+        }
+    }
+
+    InsertResult insert_impl(const K& key, const V& value, InsertMode mode)
+    {
+        InsertResult result;
+        if (mode != InsertMode::UPDATE) mark_modified();
+
+        modify_leaf(key, [&](LeafNodeType* leaf, uint64_t version,
+                             const PathEntry* parent, const std::optional<K>&) {
+            bool need_restart;
+
+            if (mode != InsertMode::INSERT) {
+                int pos = leaf->find_key(key);
+
+                if (pos >= 0) {
+                    /* replace the value in place. the leaf only splits if a
+                     * variable-length value does not fit */
+                    if (!leaf->can_replace(value)) return LeafAction::SPLIT;
+
+                    leaf->upgrade_to_write_lock_or_restart(version,
+                                                           need_restart);
+                    if (need_restart) return LeafAction::RESTART;
+                    if (parent_changed(parent)) {
+                        leaf->write_unlock();
+                        return LeafAction::RESTART;
+                    }
+
+                    leaf->replace_value(pos, value);
+
+                    leaf->write_unlock();
+                    result = InsertResult::UPDATED;
+                    return LeafAction::DONE;
+                }
+
+                if (mode == InsertMode::UPDATE) {
+                    if (parent_changed(parent) ||
+                        leaf->read_unlock_or_restart(version))
+                        return LeafAction::RESTART;
+
+                    result = InsertResult::NOT_FOUND;
+                    return LeafAction::DONE;
+                }
+            }
+
+            if (!leaf->can_insert(key, value)) return LeafAction::SPLIT;
+
+            leaf->upgrade_to_write_lock_or_restart(version, need_restart);
+            if (need_restart) return LeafAction::RESTART;
+            if (parent_changed(parent)) {
+                leaf->write_unlock();
+                return LeafAction::RESTART;
+            }
+
+            {
+                LogScope scope(this);
+                log_insert(leaf, key, value);
+                log_pair_count(1);
+                leaf->insert_pair(key, value);
+            }
+            leaf->write_unlock();
 
-private:
-    static const PageID META_PAGE_ID = 1;
-    static const PageID FIRST_NODE_PAGE_ID = META_PAGE_ID + 1;
-    static const uint32_t META_PAGE_MAGIC = 0x00C0FFEE;
-    static const uint32_t INNER_TAG = 1;
-    static const uint32_t LEAF_TAG = 2;
+            result = InsertResult::INSERTED;
+            return LeafAction::DONE;
+        });
 
-    AbstractPageCache* page_cache;
-    std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>> root;
-    std::atomic<size_t> num_pairs;
+        if (result == InsertResult::INSERTED) num_pairs.add(1);
+        return result;
+    }
+
+    /* insert the pairs that go to the leaf of the first pair. returns the
+     * number of pairs inserted */
+    size_t insert_batch_impl(const std::pair<K, V>* pairs, size_t count)
+    {
+        size_t consumed = 0;
+
+        modify_leaf(pairs[0].first, [&](LeafNodeType* leaf, uint64_t version,
+                                        const PathEntry* parent,
+                                        const std::optional<K>& high) {
+            bool need_restart;
+
+            if (!leaf->can_insert(pairs[0].first, pairs[0].second))
+                return LeafAction::SPLIT;
+
+            leaf->upgrade_to_write_lock_or_restart(version, need_restart);
+            if (need_restart) return LeafAction::RESTART;
+            if (parent_changed(parent)) {
+                leaf->write_unlock();
+                return LeafAction::RESTART;
+            }
+
+            /* pairs at or above the fence go to the next leaf */
+            {
+                LogScope scope(this);
+                consumed =
+                    leaf->insert_pairs(pairs, count, high ? &*high : nullptr);
+                log_pair_count(consumed);
+            }
+            leaf->write_unlock();
+
+            return LeafAction::DONE;
+        }, true);
+
+        return consumed;
+    }
+
+    /* look up the sorted keys that fall into the leaf of the first key.
+     * returns the number of keys served */
+    size_t get_values_batch_impl(const K* const* keys, size_t count,
+                                 std::vector<V>* const* value_lists)
+    {
+        while (true) {
+            bool need_restart;
+            uint64_t version;
+            std::optional<K> high;
+            size_t served = 0;
+
+            auto* leaf = descend_to_leaf(keys[0], true, version, nullptr, &high,
+                                         need_restart);
+            if (leaf) {
+                served = leaf->copy_values_batch(keys, count,
+                                                 high ? &*high : nullptr,
+                                                 value_lists);
+                need_restart = leaf->read_unlock_or_restart(version);
+            } else if (!need_restart) {
+                /* no leaf, the keys below the fence have no values */
+                KeyComparator kcmp;
+                while (served < count && (!high || kcmp(*keys[served], *high)))
+                    served++;
+            }
+
+            if (need_restart) {
+                /* drop the values read from an inconsistent leaf */
+                for (size_t i = 0; i < served; i++) {
+                    value_lists[i]->clear();
+                }
+                lookup_restarts.add(1);
+                continue;
+            }
+
+            return served;
+        }
+    }
+
+    size_t erase_impl(const K& key, const std::function<bool(const V&)>& match)
+    {
+        mark_modified();
+
+        while (true) {
+            bool need_restart;
+            auto* root_node = root.get();
+            if (!root_node) continue;
+
+            if (!root_node->is_leaf() && root_node->get_size() == 0) {
+                collapse_root(root_node);
+                continue;
+            }
+
+            size_t removed = root_node->erase(key, match, 0, need_restart);
+            if (need_restart) {
+                erase_restarts.add(1);
+                continue;
+            }
+
+            if (removed > 0) num_pairs.add(-(int64_t)removed);
+            return removed;
+        }
+    }
+
+    void compact_impl()
+    {
+        bool need_restart;
+        auto* root_node = root.get();
+
+        root_node->write_lock_or_restart(need_restart);
+        if (!need_restart) {
+            std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>> moved;
+
+            {
+                LogScope scope(this);
+                moved = root.get() == root_node
+                            ? relocate_node(root_node, nullptr)
+                            : nullptr;
+
+                if (moved) {
+                    moved.swap(root);
+                    write_metadata();
+                    moved->mark_deleted();
+                    write_node(moved.get());
+                }
+            }
+
+            if (moved) {
+                root_node->write_unlock_obsolete();
+                retire_node(std::move(moved), true);
+                root_node = root.get();
+            } else {
+                root_node->write_unlock();
+            }
+        }
+
+        if (!root_node->is_leaf()) {
+            BaseNode<K, V, KeyComparator, KeyEq>* prev_leaf = nullptr;
+            compact_children(static_cast<InnerNode<
+                                 N, K, V, KeySerializer, KeyComparator, KeyEq,
+                                 ValueSerializer>*>(root_node),
+                             prev_leaf);
+        }
+    }
+
+    /* leaves are visited from left to right. prev_leaf is the leaf on the
+     * left of the next leaf child, whose next leaf link has to be updated
+     * if the child is moved, or nullptr if it is unknown */
+    void compact_children(InnerNode<N, K, V, KeySerializer, KeyComparator,
+                                    KeyEq, ValueSerializer>* node,
+                          BaseNode<K, V, KeyComparator, KeyEq>*& prev_leaf)
+    {
+        for (size_t idx = 0;; idx++) {
+            bool need_restart;
+            node->write_lock_or_restart(need_restart);
+            /* the node is modified or removed concurrently, skip it */
+            if (need_restart) {
+                prev_leaf = nullptr;
+                return;
+            }
+
+            if (idx > node->size) {
+                node->write_unlock();
+                return;
+            }
+
+            auto* child = node->load_child(idx);
+            std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>> old_child;
+            LeafNodeType* left = nullptr;
+
+            if (child) {
+                child->write_lock_or_restart(need_restart);
+            }
+
+            if (child && !need_restart && child->is_leaf()) {
+                /* the left neighbor must be locked to relink it */
+                left = static_cast<LeafNodeType*>(prev_leaf);
+                if (left) {
+                    left->write_lock_or_restart(need_restart);
+                    if (!need_restart &&
+                        left->next_leaf != child->get_pid()) {
+                        left->write_unlock();
+                        need_restart = true;
+                    }
+                }
+
+                if (need_restart || !left) {
+                    child->write_unlock();
+                    need_restart = true;
+                    left = nullptr;
+                }
+            }
+
+            if (child && !need_restart) {
+                LogScope scope(this);
+                auto moved = relocate_node(child, node);
+
+                if (moved) {
+                    {
+                        auto guard = write_guard(node);
+                        node->child_pages[idx] = moved->get_pid();
+                        old_child = std::move(node->child_cache[idx]);
+                        node->child_cache[idx] = std::move(moved);
+                        child = node->child_cache[idx].get();
+                    }
+
+                    if (left) {
+                        auto guard = write_guard(left);
+                        left->next_leaf = child->get_pid();
+                    }
+
+                    /* tag the old page as free */
+                    old_child->mark_deleted();
+                    write_node(old_child.get());
+                } else {
+                    child->write_unlock();
+                }
+            }
+            if (left) left->write_unlock();
+            node->write_unlock();
+
+            if (old_child) {
+                old_child->write_unlock_obsolete();
+                retire_node(std::move(old_child), true);
+            }
+
+            if (!child) {
+                prev_leaf = nullptr;
+            } else if (child->is_leaf()) {
+                prev_leaf = child;
+            } else {
+                compact_children(static_cast<InnerNode<
+                                     N, K, V, KeySerializer, KeyComparator,
+                                     KeyEq, ValueSerializer>*>(child),
+                                 prev_leaf);
+            }
+        }
+    }
+
+    /* copy a write-locked node to a free page with a lower ID. returns the
+     * node decoded from the new page, which takes over the cached children,
+     * or nullptr if there is no such page */
+    std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>>
+    relocate_node(BaseNode<K, V, KeyComparator, KeyEq>* node,
+                  BaseNode<K, V, KeyComparator, KeyEq>* parent)
+    {
+        PageID pid;
+
+        {
+            boost::upgrade_lock<Page> lock;
+            auto* page = page_cache->new_page(lock);
+            if (!page) return nullptr;
+            pid = page->get_id();
+
+            if (pid >= node->get_pid()) {
+                page_cache->unpin_page(page, false, lock);
+                lock.unlock();
+                page_cache->free_page(pid);
+                return nullptr;
+            }
+
+            /* the frame of a node always holds its latest state */
+            {
+                auto* old_page = node->get_page();
+                boost::upgrade_lock<Page> old_lock(*old_page);
+                boost::upgrade_to_unique_lock<Page> ulock(lock);
+                ::memcpy(page->get_buffer(ulock), old_page->get_buffer(old_lock),
+                         page->get_size());
+            }
+
+            page_cache->unpin_page(page, true, lock);
+        }
+
+        auto new_node = read_node(parent, pid);
+        if (!new_node) {
+            page_cache->free_page(pid);
+            return nullptr;
+        }
+        /* the copy is logged as an image of the new page */
+        if (logging()) write_node(new_node.get());
+
+        if (!node->is_leaf()) {
+            auto* inner = static_cast<InnerNodeType*>(node);
+            auto* new_inner = static_cast<InnerNodeType*>(new_node.get());
+
+            for (size_t i = 0; i <= inner->size; i++) {
+                new_inner->child_cache[i] = std::move(inner->child_cache[i]);
+                if (new_inner->child_cache[i]) {
+                    new_inner->child_cache[i]->set_parent(new_inner);
+                }
+            }
+        }
+
+        return new_node;
+    }
+
+    /* an inner root without keys is replaced by its only child so that the
+     * tree shrinks as it is emptied */
+    void collapse_root(BaseNode<K, V, KeyComparator, KeyEq>* root_node)
+    {
+        bool need_restart;
+
+        root_node->write_lock_or_restart(need_restart);
+        if (need_restart) return;
+
+        auto* old_root = static_cast<InnerNodeType*>(root_node);
+        auto* child = old_root->size == 0 ? old_root->load_child(0) : nullptr;
+
+        if (root.get() != root_node || !child) {
+            root_node->write_unlock();
+            return;
+        }
+
+        child->write_lock_or_restart(need_restart);
+        if (need_restart) {
+            root_node->write_unlock();
+            return;
+        }
+
+        child->set_parent(nullptr);
+
+        /* swap so that the root pointer is never null */
+        auto retired = std::move(old_root->child_cache[0]);
+        retired.swap(root);
+        write_metadata();
+
+        child->write_unlock();
+        root_node->write_unlock_obsolete();
+        retire_node(std::move(retired), true);
+    }
+
+    void attach_page(BaseNode<K, V, KeyComparator, KeyEq>* node, Page* page,
+                     boost::upgrade_to_unique_lock<Page>& lock)
+    {
+        node->set_page(page);
+        node->bind_page(page->get_buffer(lock) + Page::HEADER_SIZE,
+                        page->get_size() - Page::HEADER_SIZE);
+        node_memory.fetch_add(page_cache->get_page_size());
+        node_pages++;
+    }
+
+    size_t get_effective_budget() const
+    {
+        size_t budget = node_cache_budget.load();
+        size_t capacity = page_cache->get_capacity();
+
+        if (capacity) {
+            size_t pool_limit = (size_t)(capacity * NODE_CACHE_POOL_RATIO) *
+                                page_cache->get_page_size();
+            if (!budget || pool_limit < budget) budget = pool_limit;
+        }
+
+        return budget;
+    }
+
+    void maybe_evict_nodes()
+    {
+        size_t budget = get_effective_budget();
+        bool over_budget = budget && node_memory.load() > budget;
+
+        if (!over_budget && retired_empty.load()) return;
+
+        /* only one evictor at a time, other threads carry on */
+        std::unique_lock<std::mutex> lock(evict_mutex, std::try_to_lock);
+        if (!lock.owns_lock()) return;
+
+        size_t usage = node_memory.load();
+        size_t target = (size_t)(budget * NODE_CACHE_LOW_WATERMARK);
+        auto* root_node = root.get();
+
+        if (over_budget && usage > target && root_node) {
+            size_t released = 0;
+            std::vector<std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>>>
+                evicted;
+
+            /* the first pass may only clear accessed bits */
+            for (int pass = 0; pass < 2 && released < usage - target; pass++) {
+                root_node->evict_children(usage - target, released, evicted);
+            }
+            node_evictions += evicted.size();
+
+            auto epoch = epochs.get_epoch();
+            for (auto& node : evicted) {
+                retired_nodes.push_back(RetiredNode{epoch, std::move(node)});
+            }
+        }
+
+        /* retired nodes are unreachable from the tree so operations that
+         * start from now on cannot find them. a node is freed once the
+         * epoch is two steps past its retirement: the operations that were
+         * in flight by then are done. the epoch can take both steps at once
+         * if no older operation is in flight */
+        if (!retired_nodes.empty()) {
+            epochs.try_advance();
+            epochs.try_advance();
+
+            /* free in retirement order. an evicted node may share its page
+             * with a node that was read back and merged later */
+            while (!retired_nodes.empty() &&
+                   epochs.is_safe(retired_nodes.front().epoch)) {
+                retired_nodes.front().node.reset();
+                retired_nodes.pop_front();
+            }
+        }
+        retired_empty.store(retired_nodes.empty());
+    }
 
-    /* metadata: | magic(4 bytes) | root page id(4 bytes) | */
+    /* meta page: | magic(4 bytes) | LSN(8 bytes) | root page ID(4 bytes) |
+     * flags(4 bytes) | pair count(8 bytes) | count LSN(8 bytes) |. the magic
+     * takes the place of the node tag. with a log, the pair count covers the
+     * log entries up to the count LSN and those after it are added on
+     * recovery. only the meta page and the root are read when the tree is
+     * opened */
     bool read_metadata()
     {
+        if (!page_cache->has_page(META_PAGE_ID)) return false;
+
         boost::upgrade_lock<Page> lock;
         auto page = page_cache->fetch_page(META_PAGE_ID, lock);
         if (!page) return false;
 
         const auto* buf = page->get_buffer(lock);
-        buf += sizeof(uint32_t);
+        buf += Page::HEADER_SIZE;
         PageID root_pid = (PageID) * reinterpret_cast<const uint32_t*>(buf);
         buf += sizeof(uint32_t);
-        size_t pair_count = *reinterpret_cast<const uint32_t*>(buf);
-        root = read_node(nullptr, root_pid);
-        num_pairs.store(pair_count);
+        uint32_t flags = *reinterpret_cast<const uint32_t*>(buf);
+        buf += sizeof(uint32_t);
+        int64_t pair_count;
+        ::memcpy(&pair_count, buf, sizeof(pair_count));
+        buf += sizeof(pair_count);
+        LSN count_lsn;
+        ::memcpy(&count_lsn, buf, sizeof(count_lsn));
 
         page_cache->unpin_page(page, false, lock);
 
+        for (auto [lsn, delta] : recovered_counts) {
+            if (lsn > count_lsn) pair_count += delta;
+        }
+        recovered_counts.clear();
+
+        root = read_node(nullptr, root_pid);
+        num_pairs.store(pair_count);
+        meta_clean.store(flags & META_CLEAN);
+        meta_stale.store(!(flags & META_CLEAN));
+
         return true;
     }
 
-    void write_metadata()
+    /* clean marks the pair count as exact until the next update */
+    void write_metadata(bool clean = false)
     {
+        LogScope scope(this);
+        /* not interleaved with an update that clears the flag */
+        std::unique_lock<std::mutex> modify_guard(modify_mutex,
+                                                  std::defer_lock);
+        if (clean) modify_guard.lock();
+        std::lock_guard<std::mutex> guard(meta_mutex);
+        if (clean) {
+            meta_clean.store(true);
+            meta_stale.store(false);
+        }
+
+        /* the count of the log is exact at its end LSN, whereas num_pairs
+         * lags behind the operations in flight */
+        LSN count_lsn = 0;
+        int64_t pair_count =
+            wal ? wal->get_counter(count_lsn) : (int64_t)size();
+        meta_pair_count = pair_count;
+
+        /* the meta page may already be held by the mini-transaction */
+        auto* mtr = get_mtr();
+        LoggedPage* logged = mtr ? mtr->find_page(META_PAGE_ID) : nullptr;
         boost::upgrade_lock<Page> lock;
-        auto page = page_cache->fetch_page(META_PAGE_ID, lock);
+        auto page = logged ? logged->page
+                           : page_cache->fetch_page(META_PAGE_ID, lock);
+        if (mtr && !logged) logged = &mtr->add_page(page, &lock);
 
         {
-            boost::upgrade_to_unique_lock<Page> ulock(lock);
-            auto* buf = page->get_buffer(ulock);
+            std::optional<boost::upgrade_to_unique_lock<Page>> ulock;
+            if (!logged) ulock.emplace(lock);
+            auto* buf = logged ? logged->get_buffer() : page->get_buffer(*ulock);
 
             *reinterpret_cast<uint32_t*>(buf) = META_PAGE_MAGIC;
-            buf += sizeof(uint32_t);
+            if (redo_lsn) Page::write_lsn(buf, redo_lsn);
+            buf += Page::HEADER_SIZE;
             *reinterpret_cast<uint32_t*>(buf) = (uint32_t)root->get_pid();
             buf += sizeof(uint32_t);
-            *reinterpret_cast<uint32_t*>(buf) = (uint32_t)num_pairs.load();
+            *reinterpret_cast<uint32_t*>(buf) =
+                meta_clean.load() ? META_CLEAN : 0;
+            buf += sizeof(uint32_t);
+            ::memcpy(buf, &pair_count, sizeof(pair_count));
+            buf += sizeof(pair_count);
+            ::memcpy(buf, &count_lsn, sizeof(count_lsn));
+        }
+
+        if (logged) {
+            logged->writes++;
+        } else {
+            page_cache->unpin_page(page, true, lock);
+        }
+    }
+
+    /* called before the pair count changes so that the count is recounted
+     * if the tree is not closed cleanly after the change. only the first
+     * update after a checkpoint writes the meta page, which is synced before
+     * any page with an update can be written back. concurrent updates wait
+     * for it. not needed with a log, which recovers the count */
+    void mark_modified()
+    {
+        if (wal || meta_stale.load(std::memory_order_acquire)) return;
+
+        std::lock_guard<std::mutex> guard(modify_mutex);
+        if (meta_stale.load()) return;
+
+        if (meta_clean.exchange(false)) {
+            write_metadata();
+
+            boost::upgrade_lock<Page> lock;
+            auto page = page_cache->fetch_page(META_PAGE_ID, lock);
+            if (!page) throw std::runtime_error("unable to read meta page");
+            page_cache->flush_page(page, lock);
+            page_cache->unpin_page(page, false, lock);
+            page_cache->sync();
+        }
+        meta_stale.store(true, std::memory_order_release);
+    }
+
+    bool logging() const { return wal && !redo_lsn; }
+
+    /* with synchronous commits, wait for the entries of the last operation
+     * to be durable. called after all nodes are unlocked so that the
+     * operations of other threads can join the same sync. throws if the
+     * changes of the operation could not be logged */
+    void wait_for_log()
+    {
+        if (pending_commit.tree != this) return;
+
+        auto commit = std::move(pending_commit);
+        pending_commit = PendingCommit{};
+        if (commit.error) std::rethrow_exception(commit.error);
+        wal->wait_for_commit(commit.lsn);
+    }
+
+    /* the mini-transaction of the thread, if it writes to this tree */
+    MiniTransaction* get_mtr() const
+    {
+        return active_mtr && active_mtr->get_tree() == this ? active_mtr
+                                                            : nullptr;
+    }
+
+    /* the leaf insert is logged as such (see MiniTransaction::log_insert) */
+    void log_insert(const BaseNode<K, V, KeyComparator, KeyEq>* leaf,
+                    const K& key, const V& value)
+    {
+        if constexpr (LOG_INSERTS) {
+            if (auto* mtr = get_mtr()) mtr->log_insert(leaf->get_pid(), key, value);
+        }
+    }
+
+    static size_t put_record_header(std::vector<uint8_t>& out, uint8_t type,
+                                    PageID pid)
+    {
+        size_t start = out.size();
+        uint32_t pid32 = (uint32_t)pid;
+        out.resize(start + LOG_RECORD_HEADER_SIZE);
+        out[start] = type;
+        ::memcpy(&out[start + 1], &pid32, sizeof(pid32));
+        return start;
+    }
+
+    /* fill in the length of the record that starts at start */
+    static void end_record(std::vector<uint8_t>& out, size_t start)
+    {
+        uint32_t length = out.size() - start - LOG_RECORD_HEADER_SIZE;
+        ::memcpy(&out[start + 1 + sizeof(uint32_t)], &length, sizeof(length));
+    }
+
+    template <typename T, typename S>
+    static void put_logged(std::vector<uint8_t>& out, const T& v)
+    {
+        if constexpr (is_var_len_serializable<T, S>::value) {
+            uint32_t len = v.size();
+            const auto* p = reinterpret_cast<const uint8_t*>(&len);
+            out.insert(out.end(), p, p + sizeof(len));
+            out.insert(out.end(), v.begin(), v.end());
+        } else {
+            const auto* p = reinterpret_cast<const uint8_t*>(&v);
+            out.insert(out.end(), p, p + sizeof(T));
+        }
+    }
+
+    /* returns false if the data ends before the element */
+    template <typename T, typename S>
+    static bool get_logged(const uint8_t*& p, const uint8_t* end, T& v)
+    {
+        if constexpr (is_var_len_serializable<T, S>::value) {
+            uint32_t len;
+            if ((size_t)(end - p) < sizeof(len)) return false;
+            ::memcpy(&len, p, sizeof(len));
+            p += sizeof(len);
+            if ((size_t)(end - p) < len) return false;
+            v.assign(reinterpret_cast<const char*>(p), len);
+            p += len;
+        } else {
+            if ((size_t)(end - p) < sizeof(T)) return false;
+            ::memcpy(&v, p, sizeof(T));
+            p += sizeof(T);
+        }
+        return true;
+    }
+
+    /* redo the log entries that are not on the pages yet and collect the
+     * changes of the pair count. called before the meta page is read.
+     * returns whether there was anything to redo */
+    bool recover()
+    {
+        std::unordered_set<PageID> seen;
+        std::vector<PageID> pids;
+
+        wal->replay([&](LSN lsn, const uint8_t* data, size_t length) {
+            const uint8_t* end = data + length;
+            while (data < end) {
+                uint32_t pid32, record_length;
+                if ((size_t)(end - data) < LOG_RECORD_HEADER_SIZE) {
+                    throw std::runtime_error("corrupt log entry");
+                }
+                uint8_t type = data[0];
+                ::memcpy(&pid32, &data[1], sizeof(pid32));
+                ::memcpy(&record_length, &data[1 + sizeof(uint32_t)],
+                         sizeof(record_length));
+                data += LOG_RECORD_HEADER_SIZE;
+                if ((size_t)(end - data) < record_length) {
+                    throw std::runtime_error("corrupt log entry");
+                }
+
+                if (type == LOG_PAIR_COUNT) {
+                    int64_t delta;
+                    if (record_length != sizeof(delta)) {
+                        throw std::runtime_error("corrupt log entry(count)");
+                    }
+                    ::memcpy(&delta, data, sizeof(delta));
+                    recovered_counts.emplace_back(lsn, delta);
+                    data += record_length;
+                    continue;
+                }
+
+                PageID pid = (PageID)pid32;
+                if (seen.insert(pid).second) {
+                    page_cache->reserve_page(pid);
+                    pids.push_back(pid);
+                }
+                redo_record(lsn, type, pid, data, record_length);
+                data += record_length;
+            }
+        });
+
+        if (pids.empty()) return false;
+
+        /* pages of nodes removed by the log are released again */
+        for (auto pid : pids) {
+            boost::upgrade_lock<Page> lock;
+            auto page = page_cache->fetch_page(pid, lock);
+            if (!page) continue;
+            bool free = *reinterpret_cast<const uint32_t*>(
+                            page->get_buffer(lock)) == FREE_TAG;
+            page_cache->unpin_page(page, false, lock);
+            lock.unlock();
+
+            if (free) page_cache->free_page(pid);
+        }
+
+        return true;
+    }
+
+    int64_t get_meta_pair_count()
+    {
+        std::lock_guard<std::mutex> guard(meta_mutex);
+        return meta_pair_count;
+    }
+
+    void checkpointer_main()
+    {
+        std::unique_lock<std::mutex> guard(checkpointer_mutex);
+        size_t log_size = wal->get_options().checkpoint_log_size;
+
+        while (true) {
+            checkpointer_cv.wait_for(guard, CHECKPOINT_POLL_INTERVAL,
+                                     [this]() { return checkpointer_stop; });
+            if (checkpointer_stop) break;
+            if (wal->get_log_size() < log_size) continue;
+
+            guard.unlock();
+            try {
+                checkpoint();
+            } catch (std::exception& e) {
+                std::cerr << "Failed to checkpoint: " << e.what() << std::endl;
+            }
+            guard.lock();
+        }
+    }
+
+    void redo_record(LSN lsn, uint8_t type, PageID pid, const uint8_t* data,
+                     size_t length)
+    {
+        {
+            boost::upgrade_lock<Page> lock;
+            Page* page;
+            bool torn = false;
+            try {
+                page = page_cache->fetch_page(pid, lock);
+            } catch (ChecksumException&) {
+                /* a page torn by the crash is overwritten by its image */
+                if (type != LOG_PAGE_IMAGE) throw;
+                page = page_cache->fetch_page_unchecked(pid, lock);
+                torn = true;
+            }
+            if (!page) throw std::runtime_error("unable to read logged page");
+
+            /* the page was written back after the entry. only node pages
+             * carry an LSN, other pages (e.g. free list trunks) are older
+             * than any entry */
+            const uint8_t* buf = page->get_buffer(lock);
+            uint32_t tag = *reinterpret_cast<const uint32_t*>(buf);
+            bool applied =
+                !torn &&
+                (tag == INNER_TAG || tag == LEAF_TAG || tag == FREE_TAG) &&
+                Page::read_lsn(buf) >= lsn;
+
+            if (!applied && type == LOG_PAGE_IMAGE) {
+                if (length != page->get_size()) {
+                    page_cache->unpin_page(page, false, lock);
+                    throw std::runtime_error("corrupt log entry(page image)");
+                }
+
+                {
+                    boost::upgrade_to_unique_lock<Page> ulock(lock);
+                    auto* buf = page->get_buffer(ulock);
+                    ::memcpy(buf, data, length);
+                    Page::write_lsn(buf, lsn);
+                }
+                page_cache->unpin_page(page, true, lock);
+                return;
+            }
+
+            page_cache->unpin_page(page, false, lock);
+            if (applied) return;
+        }
+
+        if (type != LOG_LEAF_INSERT) {
+            throw std::runtime_error("corrupt log entry(record type)");
         }
 
-        page_cache->unpin_page(page, true, lock);
+        if constexpr (LOG_INSERTS) {
+            const uint8_t* end = data + length;
+            K key;
+            V value;
+            if (!get_logged<K, KeySerializer>(data, end, key) ||
+                !get_logged<V, ValueSerializer>(data, end, value) ||
+                data != end) {
+                throw std::runtime_error("corrupt log entry(leaf insert)");
+            }
+
+            auto node = read_node(nullptr, pid);
+            if (!node || !node->is_leaf()) {
+                throw std::runtime_error("corrupt log entry(leaf page)");
+            }
+
+            /* the insert is written with the LSN of the entry */
+            redo_lsn = lsn;
+            static_cast<LeafNodeType*>(node.get())->insert_pair(key, value);
+            redo_lsn = 0;
+        } else {
+            throw std::runtime_error("corrupt log entry(leaf insert)");
+        }
     }
 };
 
@@ -1,10 +1,14 @@
 #ifndef _BPTREE_TREE_NODE_H_
 #define _BPTREE_TREE_NODE_H_
 
+#include "bptree/node_search.h"
 #include "bptree/page.h"
 #include "bptree/serializer.h"
+#include "bptree/slotted_page.h"
 
+#include <array>
 #include <atomic>
+#include <cassert>
 #include <functional>
 #include <iostream>
 #include <memory>
@@ -14,7 +18,88 @@
 
 namespace bptree {
 
-class OLCRestart : public std::exception {};
+/* INSERT always adds the pair (duplicate keys are allowed), UPSERT replaces
+ * the value of an existing key or adds the pair and UPDATE only replaces the
+ * value of an existing key */
+enum class InsertMode { INSERT, UPSERT, UPDATE };
+enum class InsertResult { INSERTED, UPDATED, NOT_FOUND };
+
+/* element access shared by the arrays of fixed-size elements of a node. it
+ * mirrors SlotArray so that nodes handle both kinds of arrays alike */
+template <typename Array, typename T> class FixedArrayOps {
+public:
+    static constexpr bool VAR_LEN = false;
+
+    const T& get(size_t i) const { return array().data()[i]; }
+    const T& element(size_t i) const { return get(i); }
+    void set(size_t i, const T& element) { array().data()[i] = element; }
+
+    void move(size_t dst, size_t src, size_t n)
+    {
+        ::memmove(array().data() + dst, array().data() + src, n * sizeof(T));
+    }
+
+    /* copy n elements from another node */
+    void copy(size_t dst, const Array& from, size_t src, size_t n)
+    {
+        ::memcpy(array().data() + dst, from.data() + src, n * sizeof(T));
+    }
+
+    void append_to(std::vector<T>& list, size_t first, size_t last) const
+    {
+        list.insert(list.end(), array().data() + first, array().data() + last);
+    }
+
+    /* fixed-size elements take no heap bytes */
+    size_t heap_bytes(size_t i) const { return 0; }
+    static size_t heap_bytes_of(const T& element) { return 0; }
+    static size_t insert_bytes(const T& element, size_t n) { return 0; }
+
+private:
+    Array& array() { return static_cast<Array&>(*this); }
+    const Array& array() const { return static_cast<const Array&>(*this); }
+};
+
+/* fixed-size array that lives in the page frame of a node. it is bound to
+ * the page buffer when the node is attached to its page */
+template <typename T, size_t Size>
+class PageArray : public FixedArrayOps<PageArray<T, Size>, T> {
+public:
+    PageArray() : elements(nullptr) {}
+
+    void bind(uint8_t* buf, SlotHeap* heap = nullptr)
+    {
+        elements = reinterpret_cast<T*>(buf);
+    }
+
+    T* begin() { return elements; }
+    const T* begin() const { return elements; }
+    T* end() { return elements + Size; }
+    const T* end() const { return elements + Size; }
+    T* data() { return elements; }
+    const T* data() const { return elements; }
+
+    T& operator[](size_t i) { return elements[i]; }
+    const T& operator[](size_t i) const { return elements[i]; }
+
+    constexpr size_t size() const { return Size; }
+
+private:
+    T* elements;
+};
+
+/* decoded copy of an array of a node that is not accessed in place */
+template <typename T, size_t Size>
+class CopyArray : public std::array<T, Size>,
+                  public FixedArrayOps<CopyArray<T, Size>, T> {};
+
+/* keys or values of a node: slots in the page for variable-length elements,
+ * the page buffer itself for elements that are accessed in place and a
+ * decoded copy otherwise */
+template <typename T, typename Serializer, size_t Size, bool InPlace>
+using NodeArray = std::conditional_t<
+    is_var_len_serializable<T, Serializer>::value, SlotArray,
+    std::conditional_t<InPlace, PageArray<T, Size>, CopyArray<T, Size>>>;
 
 template <unsigned int N, typename K, typename V, typename KeySerializer,
           typename KeyComparator, typename KeyEq, typename ValueSerializer>
@@ -23,33 +108,91 @@ class BTree;
 template <typename K, typename V, typename KeyComparator, typename KeyEq>
 class BaseNode {
 public:
-    BaseNode(BaseNode* parent, PageID pid, KeyComparator kcmp = KeyComparator{},
-             KeyEq keq = KeyEq{})
-        : pid(pid), parent(parent), kcmp(kcmp), keq(keq), size(0),
-          version_counter(0b100)
+    BaseNode(BaseNode* parent, PageID pid, bool leaf,
+             KeyComparator kcmp = KeyComparator{}, KeyEq keq = KeyEq{})
+        : size(0), leaf(leaf), deleted(false), pid(pid), parent(parent),
+          page(nullptr), kcmp(kcmp), keq(keq), version_counter(0b100),
+          accessed(true)
     {}
+    virtual ~BaseNode() {}
 
     PageID get_pid() const { return pid; }
     void set_pid(PageID id) { pid = id; }
-    virtual bool is_leaf() const { return false; }
+    Page* get_page() const { return page; }
+    void set_page(Page* page) { this->page = page; }
+    /* the node type is a plain tag so that descents can branch on it and
+     * call the node methods directly */
+    bool is_leaf() const { return leaf; }
+
+    /* prefetch the header, the version and the line after it (the key
+     * summary of a node with integer keys), which are all read right after
+     * a descent reaches the node */
+    void prefetch() const
+    {
+        const char* p = reinterpret_cast<const char*>(this);
+        __builtin_prefetch(p);
+        __builtin_prefetch(p + CACHE_LINE_SIZE);
+        __builtin_prefetch(p + 2 * CACHE_LINE_SIZE);
+    }
 
     BaseNode* get_parent() const { return parent; }
     void set_parent(BaseNode* parent) { this->parent = parent; }
     size_t get_size() const { return size; }
     void set_size(size_t size) { this->size = size; }
 
-    virtual void serialize(uint8_t* buf, size_t size) const = 0;
-    virtual void deserialize(const uint8_t* buf, size_t size) = 0;
+    /* serialize()/deserialize() return the number of bytes copied. nodes in
+     * the in-place format only transfer their header because the keys and
+     * values are accessed in the page buffer bound by bind_page() */
+    virtual size_t serialize(uint8_t* buf, size_t size) const = 0;
+    virtual size_t deserialize(const uint8_t* buf, size_t size) = 0;
+    virtual void bind_page(uint8_t* buf, size_t size) {}
 
-    virtual void get_values(const K& key, bool collect,
-                            std::optional<K>* next_key,
-                            std::vector<K>* key_list,
-                            std::vector<V>& value_list,
-                            uint64_t parent_version) = 0;
+    /* node cache replacement. the accessed bit is set whenever the node is
+     * reached from its parent and cleared by the evictor (second chance) */
+    void mark_accessed()
+    {
+        if (!accessed.load(std::memory_order_relaxed)) {
+            accessed.store(true, std::memory_order_relaxed);
+        }
+    }
+    bool clear_accessed() { return accessed.exchange(false); }
+
+    /* memory used by the decoded node, excluding its page frame */
+    virtual size_t get_memory_size() const = 0;
+    virtual bool has_cached_children() const { return false; }
+
+    /* unswizzle cold cached descendants until released >= to_release bytes.
+     * unswizzled nodes are marked obsolete and moved to retired; they must
+     * not be freed until no concurrent reader can hold a pointer to them */
+    virtual void evict_children(size_t to_release, size_t& released,
+                                std::vector<std::unique_ptr<BaseNode>>& retired)
+    {}
 
-    virtual std::unique_ptr<BaseNode> insert(const K& key, const V& val,
-                                             K& split_key,
-                                             uint64_t parent_version) = 0;
+    /* remove the pairs with the key for which match() returns true (all
+     * pairs with the key if match is empty). returns the number of pairs
+     * removed. lookups and inserts descend iteratively in BTree, erase()
+     * recurses and is optimistic in the same way: need_restart is set if a
+     * concurrent writer invalidated a read or a lock could not be taken; the
+     * node has released its locks and the operation must restart from the
+     * root */
+    virtual size_t erase(const K& key,
+                         const std::function<bool(const V&)>& match,
+                         uint64_t parent_version, bool& need_restart) = 0;
+
+    /* merge the right sibling into this node if the result is small enough,
+     * otherwise move entries between the two nodes so that they are evenly
+     * filled. separator is the key in the parent between the two nodes and
+     * is updated if entries are moved. returns true if merged. the caller
+     * holds the write locks on both nodes and their parent */
+    virtual bool merge_or_redistribute(BaseNode* right, K& separator) = 0;
+
+    /* whether the node is rebalanced with a sibling on erase */
+    virtual bool is_underfull() const = 0;
+
+    /* the node has been removed from the tree and its page is freed when
+     * the node is destroyed */
+    void mark_deleted() { deleted = true; }
+    bool is_deleted() const { return deleted; }
 
     virtual uint64_t read_lock_or_restart(bool& need_restart)
     {
@@ -78,6 +221,7 @@ public:
     }
 
     virtual void write_unlock() { version_counter.fetch_add(0b10); }
+    virtual void write_unlock_obsolete() { version_counter.fetch_add(0b11); }
     virtual bool read_unlock_or_restart(uint64_t start_version) const
     {
         return (start_version != version_counter.load());
@@ -88,12 +232,22 @@ public:
           const std::string& padding = "") = 0; /* for debug purpose */
 
 protected:
+    /* the header is read by every descent and only written under the write
+     * lock, it shares the first cache line with the vtable pointer. the
+     * version counter, written by every lock and unlock, has a line of its
+     * own so that it does not invalidate the header (or a neighboring node)
+     * in the caches of readers */
     size_t size;
-    BaseNode* parent;
+    bool leaf;
+    bool deleted;
     PageID pid;
+    BaseNode* parent;
+    Page* page; /* page frame backing the node, pinned while the node lives */
     KeyComparator kcmp;
     KeyEq keq;
-    std::atomic<uint64_t> version_counter;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> version_counter;
+    std::atomic<bool> accessed;
 
     bool is_locked(uint64_t version) const { return (version & 0b10) == 0b10; }
     bool is_obsolete(uint64_t version) const { return (version & 1) == 1; }
@@ -115,235 +269,740 @@ class InnerNode : public BaseNode<K, V, KeyComparator, KeyEq> {
                        ValueSerializer>;
 
 public:
+    /* page layout: | size | keys | child_pages |. keys and child pages are
+     * accessed in place if the keys are stored as-is and properly aligned.
+     * variable-length keys use a slotted page: | size | heap top | key slots
+     * | child_pages | ... heap |, see SlotArray. keys in byte order (see
+     * is_lexicographic) also have a prefix slot before the key slots and
+     * are stored without their common prefix */
+    static constexpr bool VAR_KEYS =
+        is_var_len_serializable<K, KeySerializer>::value;
+    static constexpr bool SLOTTED = VAR_KEYS;
+    static constexpr bool TRUNCATE_KEYS =
+        VAR_KEYS && is_lexicographic<KeyComparator>::value;
+    static constexpr size_t KEY_SIZE =
+        VAR_KEYS ? SlotArray::SLOT_SIZE : sizeof(K);
+    static constexpr size_t KEY_ALIGN =
+        VAR_KEYS ? alignof(uint32_t) : alignof(K);
+    static constexpr size_t HEAP_TOP_OFFSET = sizeof(uint32_t);
+    static constexpr size_t PREFIX_OFFSET = 2 * sizeof(uint32_t);
+    static constexpr size_t KEYS_OFFSET =
+        (TRUNCATE_KEYS ? 3 : VAR_KEYS ? 2 : 1) * sizeof(uint32_t);
+    static constexpr size_t CHILD_PAGES_OFFSET =
+        KEYS_OFFSET + KEY_SIZE * (N - 1);
+    static constexpr size_t FIXED_END =
+        CHILD_PAGES_OFFSET + sizeof(PageID) * N;
+    static constexpr bool IN_PLACE =
+        (VAR_KEYS || is_in_place_serializable<K, KeySerializer>::value) &&
+        (Page::HEADER_SIZE + KEYS_OFFSET) % KEY_ALIGN == 0 &&
+        (Page::HEADER_SIZE + CHILD_PAGES_OFFSET) % alignof(PageID) == 0;
+
+    static_assert(!VAR_KEYS ||
+                      (std::is_invocable_r<bool, const KeyComparator&,
+                                           std::string_view, const K&>::value &&
+                       std::is_invocable_r<bool, const KeyComparator&,
+                                           const K&, std::string_view>::value &&
+                       std::is_invocable_r<bool, const KeyEq&, const K&,
+                                           std::string_view>::value),
+                  "variable-length keys are compared as std::string_view, use "
+                  "transparent comparators such as std::less<>");
+
+    /* bytes for variable-length keys in a node on a page of page_size */
+    static size_t heap_capacity(size_t page_size)
+    {
+        return page_size - Page::HEADER_SIZE - FIXED_END;
+    }
+
     InnerNode(BTree<N, K, V, KeySerializer, KeyComparator, KeyEq,
                     ValueSerializer>* tree,
               BaseNode<K, V, KeyComparator, KeyEq>* parent,
               PageID pid = Page::INVALID_PAGE_ID,
               KeySerializer kser = KeySerializer{},
               KeyComparator kcmp = KeyComparator{})
-        : BaseNode<K, V, KeyComparator, KeyEq>(parent, pid), tree(tree),
+        : BaseNode<K, V, KeyComparator, KeyEq>(parent, pid, false), tree(tree),
           key_serializer(kser)
     {
-        for (int i = 0; i < N + 1; i++) {
-            child_pages[i] = Page::INVALID_PAGE_ID;
+        /* in-place nodes are bound to a zeroed page */
+        if constexpr (!IN_PLACE) {
+            for (size_t i = 0; i < N; i++) {
+                child_pages[i] = Page::INVALID_PAGE_ID;
+            }
         }
+        tree->node_allocated(sizeof(*this));
     }
 
-    BaseNode<K, V, KeyComparator, KeyEq>* get_child(int idx, bool write_locked,
-                                                    uint64_t& version)
+    virtual ~InnerNode() { tree->node_freed(this, sizeof(*this)); }
+
+    virtual size_t get_memory_size() const { return sizeof(*this); }
+
+    virtual bool has_cached_children() const
     {
-        if (child_cache[idx]) {
-            /* child in cache */
-            return child_cache[idx].get();
+        for (auto&& p : child_cache) {
+            if (p) return true;
         }
+        return false;
+    }
+
+    virtual void
+    evict_children(size_t to_release, size_t& released,
+                   std::vector<std::unique_ptr<BaseNode<K, V, KeyComparator,
+                                                        KeyEq>>>& retired)
+    {
+        /* child_cache is read optimistically here. nodes are only freed by
+         * the evictor itself so the pointers stay valid during the sweep */
+        for (size_t i = 0; i < N && released < to_release; i++) {
+            auto* child = child_cache[i].get();
+            if (!child) continue;
+
+            child->evict_children(to_release, released, retired);
+            if (released >= to_release) break;
+
+            if (child->clear_accessed() || child->has_cached_children())
+                continue;
 
-        if (child_pages[idx] != Page::INVALID_PAGE_ID) {
-            /* read child from page cache */
             bool need_restart;
-            if (!write_locked) {
-                version = this->upgrade_to_write_lock_or_restart(version,
-                                                                 need_restart);
-                if (need_restart) throw OLCRestart();
+            this->write_lock_or_restart(need_restart);
+            if (need_restart) continue;
+
+            if (child_cache[i].get() != child) {
+                this->write_unlock();
+                continue;
             }
 
-            if (!child_cache[idx]) {
-                child_cache[idx] = tree->read_node(this, child_pages[idx]);
+            child->write_lock_or_restart(need_restart);
+            if (need_restart) {
+                this->write_unlock();
+                continue;
+            }
+
+            /* children are only swizzled under the node's write lock */
+            if (child->has_cached_children()) {
+                child->write_unlock();
+                this->write_unlock();
+                continue;
             }
 
+            /* the child is always written back on modification so its page
+             * is up to date and it can be read again from child_pages[i] */
+            released += tree->node_footprint(child);
+            retired.push_back(std::move(child_cache[i]));
+            child->write_unlock_obsolete();
             this->write_unlock();
-            throw OLCRestart();
+        }
+    }
 
-            /* unreachable */
-            return child_cache[idx].get();
+    /* get the child at idx. on a miss, the child is read from the page cache
+     * under the write lock of the node (unless the caller holds it already)
+     * and version is moved past that lock, so the caller goes on with the
+     * child instead of restarting */
+    BaseNode<K, V, KeyComparator, KeyEq>* get_child(int idx, bool write_locked,
+                                                    uint64_t& version,
+                                                    bool& need_restart)
+    {
+        need_restart = false;
+
+        /* read the slot once, it may be cleared by the evictor or moved by
+         * a writer concurrently */
+        auto* cached = child_cache[idx].get();
+        if (cached) {
+            /* child in cache */
+            cached->mark_accessed();
+            return cached;
         }
 
-        return nullptr;
+        if (child_pages[idx] == Page::INVALID_PAGE_ID) return nullptr;
+
+        if (write_locked) return load_child(idx);
+
+        /* read child from page cache */
+        version = this->upgrade_to_write_lock_or_restart(version, need_restart);
+        if (need_restart) return nullptr;
+
+        auto* child = load_child(idx);
+        this->write_unlock();
+        version += 0b10;
+
+        return child;
     }
 
-    virtual void serialize(uint8_t* buf, size_t size) const
+    virtual size_t serialize(uint8_t* buf, size_t size) const
     {
         /* | size | keys | child_pages | */
+        build_summary();
         *reinterpret_cast<uint32_t*>(buf) = (uint32_t)this->size;
-        buf += sizeof(uint32_t);
-        size -= sizeof(uint32_t);
-        size_t nbytes =
-            key_serializer.serialize(buf, size, keys.begin(), keys.end());
-        buf += nbytes;
-        size -= nbytes;
-        ::memcpy(buf, child_pages.begin(), sizeof(PageID) * (N + 1));
+        if constexpr (IN_PLACE) {
+            return sizeof(uint32_t);
+        } else {
+            buf += sizeof(uint32_t);
+            size -= sizeof(uint32_t);
+            size_t nbytes =
+                key_serializer.serialize(buf, size, keys.begin(), keys.end());
+            buf += nbytes;
+            size -= nbytes;
+            ::memcpy(buf, child_pages.begin(), sizeof(PageID) * N);
+
+            return sizeof(uint32_t) + nbytes + sizeof(PageID) * N;
+        }
     }
-    virtual void deserialize(const uint8_t* buf, size_t size)
+    virtual size_t deserialize(const uint8_t* buf, size_t size)
     {
+        size_t copied = sizeof(uint32_t);
         this->size = (size_t) * reinterpret_cast<const uint32_t*>(buf);
-        buf += sizeof(uint32_t);
-        size -= sizeof(uint32_t);
-        size_t nbytes =
-            key_serializer.deserialize(keys.begin(), keys.end(), buf, size);
-        buf += nbytes;
-        size -= nbytes;
-        ::memcpy(child_pages.begin(), buf, sizeof(PageID) * (N + 1));
+        /* concurrent readers may still hold the cached children */
         for (auto&& p : child_cache) {
-            p.reset();
+            if (p) tree->retire_node(std::move(p), false);
+        }
+        if constexpr (IN_PLACE) {
+            build_summary();
+            return copied;
+        } else {
+            buf += sizeof(uint32_t);
+            size -= sizeof(uint32_t);
+            size_t nbytes =
+                key_serializer.deserialize(keys.begin(), keys.end(), buf, size);
+            buf += nbytes;
+            size -= nbytes;
+            ::memcpy(child_pages.begin(), buf, sizeof(PageID) * N);
+            build_summary();
+
+            return copied + nbytes + sizeof(PageID) * N;
+        }
+    }
+    virtual void bind_page(uint8_t* buf, size_t size)
+    {
+        if constexpr (IN_PLACE) {
+            assert(FIXED_END <= size);
+            if constexpr (VAR_KEYS) {
+                heap.bind(buf, size, HEAP_TOP_OFFSET, FIXED_END);
+            }
+            if constexpr (TRUNCATE_KEYS) {
+                keys.bind(buf + KEYS_OFFSET, &heap,
+                          reinterpret_cast<uint32_t*>(buf + PREFIX_OFFSET));
+            } else {
+                keys.bind(buf + KEYS_OFFSET, &heap);
+            }
+            child_pages.bind(buf + CHILD_PAGES_OFFSET);
         }
     }
 
-    virtual void get_values(const K& key, bool collect,
-                            std::optional<K>* next_key,
-                            std::vector<K>* key_list,
-                            std::vector<V>& value_list, uint64_t parent_version)
+    /* index of the child that may hold the key. the child is chosen with
+     * upper_bound() if upper is set and with lower_bound() otherwise. a
+     * null key selects the rightmost (upper) or the leftmost child */
+    int find_child(const K* key, bool upper) const
     {
-        uint64_t version;
-        bool need_restart;
-        version = this->read_lock_or_restart(need_restart);
-        if (need_restart) throw OLCRestart();
+        if (!key) return upper ? this->size : 0;
+
+        if constexpr (VAR_KEYS) {
+            return upper ? slot_upper_bound(keys, 0, this->size, *key,
+                                            this->kcmp)
+                         : slot_lower_bound(keys, 0, this->size, *key,
+                                            this->kcmp);
+        } else {
+            return upper ? summary.upper_bound(&keys[0], this->size, *key,
+                                               this->kcmp)
+                         : summary.lower_bound(&keys[0], this->size, *key,
+                                               this->kcmp);
+        }
+    }
+
+    /* the separator at idx as a key */
+    K get_key(int idx) const { return K(keys.element(idx)); }
+
+    /* the child of an inner node page that may hold the key, chosen as in
+     * find_child(), without decoding a node. buf points past the page
+     * header */
+    static PageID read_page_child(const uint8_t* buf, size_t size,
+                                  const K* key, bool upper)
+    {
+        size_t n = *reinterpret_cast<const uint32_t*>(buf);
+        size_t idx = upper ? n : 0;
+        KeyComparator kcmp;
+
+        if constexpr (IN_PLACE) {
+            SlotHeap heap;
+            KeyArray keys;
+            auto* page = const_cast<uint8_t*>(buf);
+            if constexpr (VAR_KEYS) {
+                heap.bind(page, size, HEAP_TOP_OFFSET, FIXED_END);
+            }
+            if constexpr (TRUNCATE_KEYS) {
+                keys.bind(page + KEYS_OFFSET, &heap,
+                          reinterpret_cast<uint32_t*>(page + PREFIX_OFFSET));
+            } else {
+                keys.bind(page + KEYS_OFFSET, &heap);
+            }
+
+            if (key) {
+                if constexpr (VAR_KEYS) {
+                    idx = upper ? slot_upper_bound(keys, 0, n, *key, kcmp)
+                                : slot_lower_bound(keys, 0, n, *key, kcmp);
+                } else {
+                    const K* first = &keys[0];
+                    idx = (upper ? std::upper_bound(first, first + n, *key,
+                                                    kcmp)
+                                 : std::lower_bound(first, first + n, *key,
+                                                    kcmp)) -
+                          first;
+                }
+            }
+
+            return *reinterpret_cast<const PageID*>(
+                buf + CHILD_PAGES_OFFSET + idx * sizeof(PageID));
+        } else {
+            std::vector<K> keys(N - 1);
+            buf += sizeof(uint32_t);
+            size -= sizeof(uint32_t);
+            size_t key_bytes = KeySerializer{}.deserialize(
+                keys.data(), keys.data() + N - 1, buf, size);
+
+            if (key) {
+                idx = (upper ? std::upper_bound(keys.begin(),
+                                                keys.begin() + n, *key, kcmp)
+                             : std::lower_bound(keys.begin(),
+                                                keys.begin() + n, *key,
+                                                kcmp)) -
+                      keys.begin();
+            }
+
+            PageID pid;
+            ::memcpy(&pid, buf + key_bytes + idx * sizeof(PageID),
+                     sizeof(pid));
+            return pid;
+        }
+    }
+
+    /* a full node is split before a descent goes through it so that it can
+     * take the separator of a split child. nodes with variable-length keys
+     * are also full when a key of the maximum size may not fit */
+    bool is_full() const
+    {
+        return this->size == N - 1 || !fits(max_insert_bytes());
+    }
+
+    /* nodes with variable-length keys only underflow if their keys also
+     * take little space, so that redistributing them by bytes always lifts
+     * both nodes out of underflow */
+    virtual bool is_underfull() const
+    {
+        if constexpr (VAR_KEYS) {
+            return this->size <= UNDERFLOW_SIZE &&
+                   heap_used() * 8 < heap.capacity();
+        }
+        return this->size <= UNDERFLOW_SIZE;
+    }
+
+    virtual size_t erase(const K& key,
+                         const std::function<bool(const V&)>& match,
+                         uint64_t parent_version, bool& need_restart)
+    {
+        auto version = this->read_lock_or_restart(need_restart);
+        if (need_restart) return 0;
 
         if (this->parent &&
             this->parent->read_unlock_or_restart(parent_version)) {
-            throw OLCRestart();
+            need_restart = true;
+            return 0;
         }
 
-        /* direct the search to the child */
-        int child_idx;
-        child_idx = std::distance(keys.begin(),
-                                  std::upper_bound(keys.begin(),
-                                                   keys.begin() + this->size,
-                                                   key, this->kcmp));
-
-        if (next_key && child_idx < this->size) {
-            *next_key = keys[child_idx];
+        int child_idx = find_child(&key, true);
+        if (this->read_unlock_or_restart(version)) {
+            need_restart = true;
+            return 0;
         }
 
-        auto child = get_child(child_idx, false, version);
-        if (!child) return;
+        auto child = get_child(child_idx, false, version, need_restart);
+        if (need_restart) return 0;
+        if (!child) {
+            if (this->read_unlock_or_restart(version)) need_restart = true;
+            return 0;
+        }
 
-        if (this->read_unlock_or_restart(version)) throw OLCRestart();
+        /* eager rebalance: fix an underfull child before descending into it
+         * so that removals never need to propagate upwards. redistributing
+         * may replace the separator with a longer one, which the node must
+         * have room for */
+        if (this->size > 0 && child->is_underfull() &&
+            fits(max_insert_bytes()) && rebalance_child(child_idx, version)) {
+            need_restart = true;
+            return 0;
+        }
 
-        child->get_values(key, collect, next_key, key_list, value_list,
-                          version);
+        return child->erase(key, match, version, need_restart);
     }
 
-    virtual std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>>
-    insert(const K& key, const V& val, K& split_key, uint64_t parent_version)
+    virtual bool
+    merge_or_redistribute(BaseNode<K, V, KeyComparator, KeyEq>* right_node,
+                          K& separator)
     {
-        bool need_restart;
-        auto version = this->read_lock_or_restart(need_restart);
-        if (need_restart) throw OLCRestart();
-
-        if (this->size == N - 1) { /* node is full, do eager split */
-            /* upgrade parent's and own lock to write lock */
-            if (this->parent) {
-                parent_version = this->parent->upgrade_to_write_lock_or_restart(
-                    parent_version, need_restart);
-                if (need_restart) throw OLCRestart();
-            }
+        auto* right = static_cast<InnerNode*>(right_node);
+        size_t total = this->size + right->size + 1;
+
+        /* concatenate both nodes with the separator in between */
+        std::vector<K> all_keys;
+        keys.append_to(all_keys, 0, this->size);
+        all_keys.push_back(separator);
+        right->keys.append_to(all_keys, 0, right->size);
+
+        std::vector<PageID> all_pages(child_pages.begin(),
+                                      child_pages.begin() + this->size + 1);
+        all_pages.insert(all_pages.end(), right->child_pages.begin(),
+                         right->child_pages.begin() + right->size + 1);
+
+        std::vector<std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>>>
+            all_cached;
+        for (size_t i = 0; i <= this->size; i++) {
+            all_cached.push_back(std::move(child_cache[i]));
+        }
+        for (size_t i = 0; i <= right->size; i++) {
+            all_cached.push_back(std::move(right->child_cache[i]));
+        }
 
-            version =
-                this->upgrade_to_write_lock_or_restart(version, need_restart);
-            if (need_restart) {
-                if (this->parent) {
-                    this->parent->write_unlock();
-                }
-                throw OLCRestart();
+        bool merge = total <= MERGE_SIZE;
+        size_t left_size = merge ? total : total / 2;
+
+        if constexpr (TRUNCATE_KEYS) {
+            /* as below, with the bytes of the keys counted without the
+             * prefixes that the nodes end up with */
+            std::vector<size_t> extra(total, 0);
+            if (prefixed_bytes(all_keys, extra, 0, total) * 4 >
+                heap.capacity() * 3) {
+                merge = false;
+                left_size = split_prefixed(
+                    all_keys, extra, std::max<size_t>(total, N + 1) - N,
+                    std::min<size_t>(N - 1, total - 2), true);
             }
 
-            /* safe to split now */
-            auto right_sibling = tree->template create_node<InnerNode<
-                N, K, V, KeySerializer, KeyComparator, KeyEq, ValueSerializer>>(
-                this->parent);
+            heap.reset();
+            right->heap.reset();
+            keys.set_prefix(range_prefix(all_keys, 0, left_size));
+            right->keys.set_prefix(
+                range_prefix(all_keys, left_size + 1, total));
+        } else if constexpr (VAR_KEYS) {
+            /* merge if the keys fit in 3/4 of a node, otherwise split them
+             * by bytes if they take more than that */
+            std::vector<size_t> bytes;
+            size_t total_bytes = 0;
+            for (auto&& key : all_keys) {
+                bytes.push_back(key.size());
+                total_bytes += key.size();
+            }
 
-            right_sibling->size = this->size - N / 2 - 1;
+            if (total_bytes * 4 > heap.capacity() * 3) {
+                merge = false;
+                left_size = split_by_bytes(
+                    bytes, std::max<size_t>(total, N + 1) - N,
+                    std::min<size_t>(N - 1, total - 2));
+            }
 
-            ::memcpy(right_sibling->keys.begin(), &this->keys[N / 2 + 1],
-                     sizeof(K) * right_sibling->size);
-            ::memcpy(right_sibling->child_pages.begin(),
-                     &this->child_pages[N / 2 + 1],
-                     sizeof(PageID) * (1 + right_sibling->size));
+            /* the keys are rewritten from the copies */
+            heap.reset();
+            right->heap.reset();
+        }
 
-            for (size_t i = N / 2 + 1, j = 0; i <= this->size; i++, j++) {
-                right_sibling->child_cache[j] = std::move(this->child_cache[i]);
-                if (right_sibling->child_cache[j]) {
-                    right_sibling->child_cache[j]->set_parent(
-                        right_sibling.get());
-                }
-            }
+        this->size = left_size;
+        for (size_t i = 0; i < left_size; i++) {
+            keys.set(i, all_keys[i]);
+        }
+        for (size_t i = 0; i <= left_size; i++) {
+            child_pages[i] = all_pages[i];
+            child_cache[i] = std::move(all_cached[i]);
+            if (child_cache[i]) child_cache[i]->set_parent(this);
+        }
 
-            split_key = this->keys[N / 2];
-            this->size = N / 2;
+        if (merge) {
+            right->size = 0;
+            return true;
+        }
 
-            tree->write_node(this);
-            tree->write_node(right_sibling.get());
+        separator = all_keys[left_size];
+        right->size = total - left_size - 1;
+        for (size_t i = 0; i < right->size; i++) {
+            right->keys.set(i, all_keys[left_size + 1 + i]);
+        }
+        for (size_t i = 0; i <= right->size; i++) {
+            right->child_pages[i] = all_pages[left_size + 1 + i];
+            right->child_cache[i] = std::move(all_cached[left_size + 1 + i]);
+            if (right->child_cache[i]) right->child_cache[i]->set_parent(right);
+        }
 
-            /* if the current node is the root node, the lock is not
-             * released until new root is created in BTree::insert() */
-            if (this->parent) {
-                this->write_unlock();
-            }
+        return false;
+    }
 
-            /* hold parent's lock until the new sibling node has been
-             * inserted into parent node */
-            return right_sibling;
+    virtual void print(std::ostream& os, const std::string& padding = "")
+    {
+        uint64_t version;
+        bool need_restart;
+        this->get_child(0, true, version, need_restart)
+            ->print(os, padding + "    ");
+        for (int i = 0; i < this->size; i++) {
+            // os << padding << keys[i] << std::endl;
+            this->get_child(i + 1, true, version, need_restart)
+                ->print(os, padding + "    ");
         }
+    }
 
-        if (this->parent) {
-            if (this->parent->read_unlock_or_restart(parent_version))
-                throw OLCRestart();
+private:
+    /* split a full node. the upper half is moved to a new right sibling
+     * created under parent and the key between the halves is returned in
+     * split_key. the caller holds the write locks on the node and its parent
+     * and links the sibling into the parent */
+    std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>>
+    split(BaseNode<K, V, KeyComparator, KeyEq>* parent, K& split_key)
+    {
+        auto right_sibling = tree->template create_node<InnerNode<
+            N, K, V, KeySerializer, KeyComparator, KeyEq, ValueSerializer>>(
+            parent);
+
+        /* both nodes are written back when the guards are released */
+        auto guard = tree->write_guard(this);
+        auto sibling_guard = tree->write_guard(right_sibling.get());
+
+        size_t mid = N / 2;
+        if constexpr (VAR_KEYS) {
+            /* a node that is full by bytes has at least four keys */
+            std::vector<size_t> bytes(this->size);
+            for (size_t i = 0; i < this->size; i++) {
+                bytes[i] = keys.heap_bytes(i);
+            }
+            mid = split_by_bytes(bytes, 1, this->size - 2);
+        }
+        if constexpr (TRUNCATE_KEYS) {
+            /* the keys share the prefix, so the shortest key near the
+             * middle is the one with the fewest bytes in the heap */
+            size_t window = this->size / 8;
+            mid = shortest_split(
+                mid, std::max<size_t>(mid, window + 1) - window,
+                std::min<size_t>(mid + window, this->size - 2),
+                [this](size_t i) { return keys.heap_bytes(i); });
+
+            /* the sibling is empty, this only sets its prefix */
+            K first = get_key(mid + 1), last = get_key(this->size - 1);
+            right_sibling->compact_heap(&first, &last);
         }
 
-        auto it = std::upper_bound(keys.begin(), keys.begin() + this->size, key,
-                                   this->kcmp);
-        if (this->read_unlock_or_restart(version))
-            throw OLCRestart(); /* make sure current node is still valid */
+        right_sibling->size = this->size - mid - 1;
+
+        right_sibling->keys.copy(0, this->keys, mid + 1, right_sibling->size);
+        ::memcpy(right_sibling->child_pages.begin(),
+                 &this->child_pages[mid + 1],
+                 sizeof(PageID) * (1 + right_sibling->size));
+
+        for (size_t i = mid + 1, j = 0; i <= this->size; i++, j++) {
+            right_sibling->child_cache[j] = std::move(this->child_cache[i]);
+            if (right_sibling->child_cache[j]) {
+                right_sibling->child_cache[j]->set_parent(right_sibling.get());
+            }
+        }
 
-        int child_idx = it - keys.begin();
-        auto child = get_child(child_idx, false, version);
-        auto new_child = child->insert(key, val, split_key, version);
+        split_key = get_key(mid);
+        this->size = mid;
+        /* the moved elements are garbage in the heap now */
+        compact_heap();
 
-        if (!new_child)
-            return nullptr; /* child did not split so the lock is already
-                               released in child insert */
+        return right_sibling;
+    }
 
-        /* insert the key pushed up by the child to current node
-         * we may assume that current node will not overflow at this point
+    /* insert the key pushed up by a split child at child_idx. the caller
+     * holds the write lock */
+    void insert_child(
+        size_t child_idx, const K& split_key,
+        std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>> new_child)
+    {
+        /* we may assume that current node will not overflow at this point
          */
-        ::memmove(&keys[child_idx + 1], &keys[child_idx],
-                  (this->size - child_idx) * sizeof(K));
+        auto guard = tree->write_guard(this);
+        reserve(keys.insert_bytes(split_key, this->size), &split_key);
+
+        keys.move(child_idx + 1, child_idx, this->size - child_idx);
         ::memmove(&child_pages[child_idx + 2], &child_pages[child_idx + 1],
                   (this->size - child_idx) * sizeof(PageID));
         for (size_t i = this->size; i > child_idx; i--) {
             child_cache[i + 1] = std::move(child_cache[i]);
         }
 
-        keys[child_idx] = split_key;
+        keys.set(child_idx, split_key);
         child_pages[child_idx + 1] = new_child->get_pid();
         child_cache[child_idx + 1] = std::move(new_child);
 
         this->size++;
-        tree->write_node(this);
+    }
 
-        /* current lock is upgraded during child insert, release the lock
-         * now and restart */
-        this->write_unlock();
-        throw OLCRestart();
+    /* nodes with at most UNDERFLOW_SIZE keys are rebalanced on erase. two
+     * siblings are merged if the result has at most MERGE_SIZE keys */
+    static constexpr size_t UNDERFLOW_SIZE = (N - 1) / 4;
+    static constexpr size_t MERGE_SIZE = (N - 1) * 3 / 4;
+
+    using KeyArray = NodeArray<K, KeySerializer, N - 1, IN_PLACE>;
 
-        return nullptr;
+    void build_summary() const
+    {
+        if constexpr (!VAR_KEYS) summary.build(&keys[0], this->size);
     }
 
-    virtual void print(std::ostream& os, const std::string& padding = "")
+    /* space for variable-length keys. keys are limited to a quarter of the
+     * heap so that a full node always has enough keys to split */
+    size_t max_key_bytes() const { return heap.capacity() / 4; }
+
+    /* heap bytes needed to add any key. a key that does not share the
+     * prefix of the node cuts it, in the worst case to nothing */
+    size_t max_insert_bytes() const
     {
-        uint64_t version;
-        this->get_child(0, true, version)->print(os, padding + "    ");
-        for (int i = 0; i < this->size; i++) {
-            // os << padding << keys[i] << std::endl;
-            this->get_child(i + 1, true, version)->print(os, padding + "    ");
+        if constexpr (TRUNCATE_KEYS) {
+            return max_key_bytes() + this->size * keys.prefix().size();
         }
+        return max_key_bytes();
     }
 
-private:
+    size_t heap_used() const
+    {
+        size_t used = 0;
+        if constexpr (TRUNCATE_KEYS) used = keys.prefix().size();
+        for (size_t i = 0; i < this->size; i++) {
+            used += keys.heap_bytes(i);
+        }
+        return used;
+    }
+
+    /* whether keys of the given bytes can be added, after compacting the
+     * heap if needed. always true for fixed-size keys */
+    bool fits(size_t bytes) const
+    {
+        if constexpr (VAR_KEYS) {
+            return bytes <= heap.contiguous() ||
+                   heap_used() + bytes <= heap.capacity();
+        }
+        return true;
+    }
+
+    /* make room for bytes that fit() in the heap before the key (if not
+     * null) is set. the caller holds the write guard */
+    void reserve(size_t bytes, const K* key = nullptr)
+    {
+        if constexpr (VAR_KEYS) {
+            if (bytes > heap.contiguous() || (key && !keys.has_prefix(*key)))
+                compact_heap(key);
+        }
+    }
+
+    /* drop the bytes of removed keys by rewriting the live keys to the end
+     * of the heap. the prefix is chosen again for the live keys and for
+     * the keys first and last that are about to be set (if not null) */
+    void compact_heap(const K* first = nullptr, const K* last = nullptr)
+    {
+        if constexpr (VAR_KEYS) {
+            std::vector<K> live;
+            keys.append_to(live, 0, this->size);
+            heap.reset();
+            if constexpr (TRUNCATE_KEYS) {
+                keys.set_prefix(shared_prefix(live, first, last));
+            }
+            for (size_t i = 0; i < this->size; i++) {
+                keys.set(i, live[i]);
+            }
+        }
+    }
+
+    /* get a child with the node write-locked, reading it if necessary */
+    BaseNode<K, V, KeyComparator, KeyEq>* load_child(int idx)
+    {
+        if (!child_cache[idx] && child_pages[idx] != Page::INVALID_PAGE_ID) {
+            child_cache[idx] = tree->read_node(this, child_pages[idx]);
+        }
+        return child_cache[idx].get();
+    }
+
+    /* merge the child at idx with a sibling or redistribute their entries.
+     * returns true if the operation must restart. false is returned if the
+     * entries could not be moved (the key prefixes of the nodes would take
+     * more room, see split_prefixed()); the locks are released and version
+     * is moved past the lock of the node so that the descent goes on */
+    bool rebalance_child(int idx, uint64_t& version)
+    {
+        bool need_restart;
+        version = this->upgrade_to_write_lock_or_restart(version, need_restart);
+        if (need_restart) return true;
+
+        /* prefer the right sibling */
+        int left_idx = idx < (int)this->size ? idx : idx - 1;
+        auto* left = load_child(left_idx);
+        auto* right = load_child(left_idx + 1);
+
+        if (!left || !right) {
+            this->write_unlock();
+            return true;
+        }
+
+        left->write_lock_or_restart(need_restart);
+        if (need_restart) {
+            this->write_unlock();
+            return true;
+        }
+        right->write_lock_or_restart(need_restart);
+        if (need_restart) {
+            left->write_unlock();
+            this->write_unlock();
+            return true;
+        }
+
+        std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>> removed;
+        size_t left_size = left->get_size();
+        bool merged;
+        {
+            auto guard = tree->write_guard(this);
+            auto left_guard = tree->write_guard(left);
+            auto right_guard = tree->write_guard(right);
+
+            K separator = get_key(left_idx);
+            merged = left->merge_or_redistribute(right, separator);
+
+            if (merged) {
+                /* the page of the right node is tagged as free when the
+                 * guard is released */
+                right->mark_deleted();
+
+                /* drop the separator and the right child */
+                removed = std::move(child_cache[left_idx + 1]);
+                size_t count = this->size - left_idx - 1;
+
+                keys.move(left_idx, left_idx + 1, count);
+                ::memmove(&child_pages[left_idx + 1],
+                          &child_pages[left_idx + 2], count * sizeof(PageID));
+                for (size_t i = left_idx + 1; i < this->size; i++) {
+                    child_cache[i] = std::move(child_cache[i + 1]);
+                }
+                child_pages[this->size] = Page::INVALID_PAGE_ID;
+                this->size--;
+            } else if (left->get_size() != left_size) {
+                reserve(keys.insert_bytes(separator, this->size), &separator);
+                keys.set(left_idx, separator);
+            }
+        }
+
+        bool moved = merged || left->get_size() != left_size;
+        left->write_unlock();
+        if (merged) {
+            right->write_unlock_obsolete();
+            tree->retire_node(std::move(removed), true);
+        } else {
+            right->write_unlock();
+        }
+        this->write_unlock();
+
+        version += 0b10;
+        return moved;
+    }
+
+    /* starts the line after the version counter. rebuilt whenever the node
+     * is serialized, which the write guard does after every modification,
+     * and when it is deserialized */
+    mutable KeySummary<K, KeyComparator> summary;
     BTree<N, K, V, KeySerializer, KeyComparator, KeyEq, ValueSerializer>* tree;
-    std::array<K, N - 1> keys;
-    std::array<PageID, N> child_pages;
+    KeyArray keys;
+    std::conditional_t<IN_PLACE, PageArray<PageID, N>, CopyArray<PageID, N>>
+        child_pages;
     std::array<std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>>, N>
         child_cache;
+    SlotHeap heap; /* only used by variable-length keys */
     KeySerializer key_serializer;
 };
 
@@ -361,6 +1020,62 @@ class LeafNode : public BaseNode<K, V, KeyComparator, KeyEq> {
                        ValueSerializer>::iterator;
 
 public:
+    /* page layout: | size | next leaf | (unused) | keys | values |. the
+     * unused word keeps 8-byte keys aligned. if the keys or the values have
+     * variable length, the page is slotted: the unused word holds the top
+     * of the heap that fills the page from its end, and the keys or values
+     * are slots (see SlotArray). keys in byte order have a prefix slot
+     * before the key slots, see InnerNode */
+    static constexpr bool VAR_KEYS =
+        is_var_len_serializable<K, KeySerializer>::value;
+    static constexpr bool VAR_VALUES =
+        is_var_len_serializable<V, ValueSerializer>::value;
+    static constexpr bool SLOTTED = VAR_KEYS || VAR_VALUES;
+    static constexpr bool TRUNCATE_KEYS =
+        VAR_KEYS && is_lexicographic<KeyComparator>::value;
+    static constexpr size_t KEY_SIZE =
+        VAR_KEYS ? SlotArray::SLOT_SIZE : sizeof(K);
+    static constexpr size_t VALUE_SIZE =
+        VAR_VALUES ? SlotArray::SLOT_SIZE : sizeof(V);
+    static constexpr size_t KEY_ALIGN =
+        VAR_KEYS ? alignof(uint32_t) : alignof(K);
+    static constexpr size_t VALUE_ALIGN =
+        VAR_VALUES ? alignof(uint32_t) : alignof(V);
+    static constexpr size_t NEXT_LEAF_OFFSET = sizeof(uint32_t);
+    static constexpr size_t HEAP_TOP_OFFSET = 2 * sizeof(uint32_t);
+    static constexpr size_t PREFIX_OFFSET = 3 * sizeof(uint32_t);
+    static constexpr size_t KEYS_OFFSET =
+        (TRUNCATE_KEYS ? 4 : 3) * sizeof(uint32_t);
+    /* fixed-size values after key slots are padded to their alignment */
+    static constexpr size_t VALUES_OFFSET =
+        VAR_KEYS ? (KEYS_OFFSET + KEY_SIZE * (N - 1) + Page::HEADER_SIZE +
+                    VALUE_ALIGN - 1) / VALUE_ALIGN * VALUE_ALIGN -
+                       Page::HEADER_SIZE
+                 : KEYS_OFFSET + KEY_SIZE * (N - 1);
+    static constexpr size_t FIXED_END = VALUES_OFFSET + VALUE_SIZE * (N - 1);
+    static constexpr bool IN_PLACE =
+        (VAR_KEYS || is_in_place_serializable<K, KeySerializer>::value) &&
+        (VAR_VALUES || is_in_place_serializable<V, ValueSerializer>::value) &&
+        (Page::HEADER_SIZE + KEYS_OFFSET) % KEY_ALIGN == 0 &&
+        (Page::HEADER_SIZE + VALUES_OFFSET) % VALUE_ALIGN == 0;
+
+    static_assert(!SLOTTED || IN_PLACE,
+                  "slotted pages need keys and values that are either "
+                  "variable-length or accessed in place");
+
+    /* bytes for variable-length keys and values in a leaf on a page of
+     * page_size */
+    static size_t heap_capacity(size_t page_size)
+    {
+        return page_size - Page::HEADER_SIZE - FIXED_END;
+    }
+
+    /* heap bytes taken by a pair */
+    static size_t entry_bytes(const K& key, const V& value)
+    {
+        return KeyArray::heap_bytes_of(key) + ValueArray::heap_bytes_of(value);
+    }
+
     LeafNode(BTree<N, K, V, KeySerializer, KeyComparator, KeyEq,
                    ValueSerializer>* tree,
              BaseNode<K, V, KeyComparator, KeyEq>* parent,
@@ -368,151 +1083,338 @@ public:
              KeySerializer kser = KeySerializer{},
              KeyComparator kcmp = KeyComparator{},
              ValueSerializer vser = ValueSerializer{})
-        : BaseNode<K, V, KeyComparator, KeyEq>(parent, pid, kcmp), tree(tree),
-          key_serializer(kser), value_serializer(vser)
-    {}
+        : BaseNode<K, V, KeyComparator, KeyEq>(parent, pid, true, kcmp),
+          tree(tree),
+          next_leaf(Page::INVALID_PAGE_ID), key_serializer(kser),
+          value_serializer(vser)
+    {
+        tree->node_allocated(sizeof(*this));
+    }
+
+    virtual ~LeafNode() { tree->node_freed(this, sizeof(*this)); }
 
-    virtual bool is_leaf() const { return true; }
+    virtual size_t get_memory_size() const { return sizeof(*this); }
 
-    virtual void serialize(uint8_t* buf, size_t size) const
+    virtual size_t serialize(uint8_t* buf, size_t size) const
     {
-        /* | size | keys | child_pages | */
+        /* | size | next leaf | (unused) | keys | values | */
+        build_summary();
         *reinterpret_cast<uint32_t*>(buf) = (uint32_t)this->size;
-        buf += sizeof(uint32_t);
-        size -= sizeof(uint32_t);
-        size_t nbytes =
-            key_serializer.serialize(buf, size, keys.begin(), keys.end());
-        buf += nbytes;
-        size -= nbytes;
-        nbytes =
-            value_serializer.serialize(buf, size, values.begin(), values.end());
+        *reinterpret_cast<PageID*>(buf + NEXT_LEAF_OFFSET) = next_leaf;
+        if constexpr (IN_PLACE) {
+            return NEXT_LEAF_OFFSET + sizeof(PageID);
+        } else {
+            buf += KEYS_OFFSET;
+            size -= KEYS_OFFSET;
+            size_t key_bytes =
+                key_serializer.serialize(buf, size, keys.begin(), keys.end());
+            buf += key_bytes;
+            size -= key_bytes;
+            size_t value_bytes = value_serializer.serialize(
+                buf, size, values.begin(), values.end());
+
+            return KEYS_OFFSET + key_bytes + value_bytes;
+        }
     }
-    virtual void deserialize(const uint8_t* buf, size_t size)
+    virtual size_t deserialize(const uint8_t* buf, size_t size)
     {
         this->size = (size_t) * reinterpret_cast<const uint32_t*>(buf);
-        buf += sizeof(uint32_t);
-        size -= sizeof(uint32_t);
-        size_t nbytes =
-            key_serializer.deserialize(keys.begin(), keys.end(), buf, size);
-        buf += nbytes;
-        size -= nbytes;
-        nbytes = value_serializer.deserialize(values.begin(), values.end(), buf,
-                                              size);
+        next_leaf = *reinterpret_cast<const PageID*>(buf + NEXT_LEAF_OFFSET);
+        if constexpr (IN_PLACE) {
+            build_summary();
+            return NEXT_LEAF_OFFSET + sizeof(PageID);
+        } else {
+            buf += KEYS_OFFSET;
+            size -= KEYS_OFFSET;
+            size_t key_bytes =
+                key_serializer.deserialize(keys.begin(), keys.end(), buf, size);
+            buf += key_bytes;
+            size -= key_bytes;
+            size_t value_bytes = value_serializer.deserialize(
+                values.begin(), values.end(), buf, size);
+            build_summary();
+
+            return KEYS_OFFSET + key_bytes + value_bytes;
+        }
+    }
+    virtual void bind_page(uint8_t* buf, size_t size)
+    {
+        if constexpr (IN_PLACE) {
+            assert(FIXED_END <= size);
+            bind_arrays(buf, size, heap, keys, values);
+        }
     }
 
-    virtual void get_values(const K& key, bool collect,
-                            std::optional<K>* next_key,
-                            std::vector<K>* key_list,
-                            std::vector<V>& value_list, uint64_t parent_version)
+    /* the helpers below work on a node that the caller has read-locked
+     * (optimistically) or write-locked. they never lock or validate */
+
+    /* position of the first pair with the key, or -1 if there is none */
+    int find_key(const K& key) const
     {
-        bool need_restart;
-        auto version = this->read_lock_or_restart(need_restart);
-        if (need_restart) throw OLCRestart();
+        size_t lower = search(key, false);
+        if (lower == this->size || !key_equals(lower, key)) return -1;
+        return lower;
+    }
 
-        if (this->parent &&
-            this->parent->read_unlock_or_restart(parent_version)) {
-            throw OLCRestart();
-        }
+    /* append the values of all pairs with the key */
+    void copy_values(const K& key, std::vector<V>& value_list) const
+    {
+        size_t lower = search(key, false);
+        size_t upper = lower;
+        while (upper < this->size && key_equals(upper, key))
+            upper++;
 
-        if (collect) {
-            std::copy(keys.begin(), keys.begin() + this->size,
-                      std::back_inserter(*key_list));
-            std::copy(values.begin(), values.begin() + this->size,
-                      std::back_inserter(value_list));
-        } else {
-            auto lower = std::lower_bound(
-                keys.begin(), keys.begin() + this->size, key, this->kcmp);
+        values.append_to(value_list, lower, upper);
+    }
 
-            if (lower == keys.begin() + this->size) return;
+    /* append all pairs of the leaf */
+    void copy_pairs(std::vector<K>& key_list, std::vector<V>& value_list) const
+    {
+        keys.append_to(key_list, 0, this->size);
+        values.append_to(value_list, 0, this->size);
+    }
 
-            auto upper = lower;
-            while (this->keq(key, *upper))
-                upper++;
+    /* whether the pair can be inserted without a split */
+    bool can_insert(const K& key, const V& value) const
+    {
+        return this->size < N - 1 && fits(insert_bytes(key, value));
+    }
 
-            std::copy(&values[lower - keys.begin()],
-                      &values[upper - keys.begin()],
-                      std::back_inserter(value_list));
-        }
+    /* whether a value can be replaced by this one without a split */
+    bool can_replace(const V& value) const
+    {
+        return fits(ValueArray::heap_bytes_of(value));
+    }
 
-        if (this->read_unlock_or_restart(version)) throw OLCRestart();
+    /* replace the value of the pair at pos, see can_replace() */
+    void replace_value(size_t pos, const V& value)
+    {
+        auto guard = tree->write_guard(this);
+        reserve(ValueArray::heap_bytes_of(value));
+        values.set(pos, value);
     }
 
-    virtual std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>>
-    insert(const K& key, const V& val, K& split_key, uint64_t parent_version)
+    /* see InnerNode::is_underfull() */
+    virtual bool is_underfull() const
     {
-        bool need_restart;
-        auto version = this->read_lock_or_restart(need_restart);
-        if (need_restart) throw OLCRestart();
-
-        if (this->size == N - 1) { /* leaf node is full, do eager split */
-            /* upgrade parent's and own lock to write lock */
-            if (this->parent) {
-                parent_version = this->parent->upgrade_to_write_lock_or_restart(
-                    parent_version, need_restart);
-                if (need_restart) throw OLCRestart();
-            }
+        if constexpr (SLOTTED) {
+            return this->size <= UNDERFLOW_SIZE &&
+                   heap_used() * 8 < heap.capacity();
+        }
+        return this->size <= UNDERFLOW_SIZE;
+    }
 
-            version =
-                this->upgrade_to_write_lock_or_restart(version, need_restart);
-            if (need_restart) {
-                if (this->parent) {
-                    this->parent->write_unlock();
-                }
-                throw OLCRestart();
-            }
+    /* batched copy_values() for sorted keys. the values of keys[i] are
+     * appended to value_lists[i]. serves the keys below high (if not null)
+     * and returns their number */
+    size_t copy_values_batch(const K* const* keys, size_t count, const K* high,
+                             std::vector<V>* const* value_lists) const
+    {
+        /* the keys are sorted so each search starts where the previous one
+         * ended */
+        size_t first = 0;
+        size_t served = 0;
+
+        while (served < count &&
+               (!high || this->kcmp(*keys[served], *high))) {
+            const K& key = *keys[served];
+            size_t lower = search_from(key, first);
+            size_t upper = lower;
+            while (upper < this->size && key_equals(upper, key))
+                upper++;
 
-            auto right_sibling = tree->template create_node<LeafNode<
-                N, K, V, KeySerializer, KeyComparator, KeyEq, ValueSerializer>>(
-                this->parent);
+            values.append_to(*value_lists[served], lower, upper);
 
-            right_sibling->size = this->size - N / 2;
+            first = lower;
+            served++;
+        }
 
-            ::memcpy(right_sibling->keys.begin(), &this->keys[N / 2],
-                     right_sibling->size * sizeof(K));
-            ::memcpy(right_sibling->values.begin(), &this->values[N / 2],
-                     right_sibling->size * sizeof(V));
+        return served;
+    }
 
-            split_key = this->keys[N / 2];
-            this->size = N / 2;
+    /* insert a pair into a leaf that is not full. the pair goes after
+     * existing pairs with an equal key */
+    void insert_pair(const K& key, const V& val)
+    {
+        auto guard = tree->write_guard(this);
+        reserve(insert_bytes(key, val), &key);
 
-            tree->write_node(this);
-            tree->write_node(right_sibling.get());
+        size_t pos = search(key, true);
 
-            if (this->parent) {
-                this->write_unlock();
+        keys.move(pos + 1, pos, this->size - pos);
+        values.move(pos + 1, pos, this->size - pos);
+
+        keys.set(pos, key);
+        values.set(pos, val);
+        this->size++;
+    }
+
+    /* insert the pairs sorted by key that belong to this leaf, i.e. those
+     * below high (if not null), as many as fit. returns the number of pairs
+     * inserted */
+    size_t insert_pairs(const std::pair<K, V>* pairs, size_t count,
+                        const K* high)
+    {
+        size_t n = 0;
+        size_t room = N - 1 - this->size;
+        size_t bytes = 0, free_bytes = heap_free();
+        while (n < count && n < room &&
+               (!high || this->kcmp(pairs[n].first, *high))) {
+            size_t pair_bytes = entry_bytes(pairs[n].first, pairs[n].second);
+            if (batch_bytes(pairs, n + 1, bytes + pair_bytes) > free_bytes)
+                break;
+            bytes += pair_bytes;
+            n++;
+        }
+        if (n == 0) return 0;
+
+        /* merge from the back. new pairs go after existing pairs with equal
+         * keys, like in insert_pair() */
+        auto guard = tree->write_guard(this);
+        reserve(batch_bytes(pairs, n, bytes), &pairs[0].first,
+                &pairs[n - 1].first);
+
+        int i = (int)this->size - 1, j = (int)n - 1;
+        size_t pos = this->size + n;
+
+        while (j >= 0) {
+            pos--;
+            if (i >= 0 && key_less(pairs[j].first, i)) {
+                keys.move(pos, i, 1);
+                values.move(pos, i, 1);
+                i--;
+            } else {
+                keys.set(pos, pairs[j].first);
+                values.set(pos, pairs[j].second);
+                j--;
             }
+        }
 
-            /* hold parent's lock */
-            return right_sibling;
+        this->size += n;
+        return n;
+    }
+
+    virtual size_t erase(const K& key,
+                         const std::function<bool(const V&)>& match,
+                         uint64_t parent_version, bool& need_restart)
+    {
+        auto version = this->read_lock_or_restart(need_restart);
+        if (need_restart) return 0;
+
+        size_t first = search(key, false);
+        size_t last = first;
+        while (last < this->size && key_equals(last, key))
+            last++;
+
+        if (first == last) {
+            if ((this->parent &&
+                 this->parent->read_unlock_or_restart(parent_version)) ||
+                this->read_unlock_or_restart(version))
+                need_restart = true;
+            return 0;
         }
 
-        /* no need to split, only lock current node */
         version = this->upgrade_to_write_lock_or_restart(version, need_restart);
-        if (need_restart) throw OLCRestart();
-        if (this->parent) {
-            if (this->parent->read_unlock_or_restart(parent_version)) {
-                this->write_unlock();
-                throw OLCRestart();
-            }
+        if (need_restart) return 0;
+        if (this->parent &&
+            this->parent->read_unlock_or_restart(parent_version)) {
+            this->write_unlock();
+            need_restart = true;
+            return 0;
         }
 
-        /* we may assume current will not overflow at this point */
-        auto it = std::upper_bound(keys.begin(), keys.begin() + this->size, key,
-                                   this->kcmp);
-        size_t pos = it - keys.begin();
+        size_t removed = 0;
 
-        ::memmove(it + 1, it, (this->size - pos) * sizeof(K));
-        ::memmove(&values[pos + 1], &values[pos],
-                  (this->size - pos) * sizeof(V));
+        {
+            auto guard = tree->write_guard(this);
 
-        keys[pos] = key;
-        values[pos] = val;
-        this->size++;
+            /* compact the matching range, then close the gap */
+            size_t out = first;
+            for (size_t i = first; i < last; i++) {
+                if (match && !match(V(values.get(i)))) {
+                    keys.move(out, i, 1);
+                    values.move(out, i, 1);
+                    out++;
+                }
+            }
+
+            removed = last - out;
+            if (removed > 0) {
+                keys.move(out, last, this->size - last);
+                values.move(out, last, this->size - last);
+                this->size -= removed;
+                tree->log_pair_count(-(int64_t)removed);
+            }
+        }
 
-        tree->write_node(this);
         this->write_unlock();
+        return removed;
+    }
+
+    virtual bool
+    merge_or_redistribute(BaseNode<K, V, KeyComparator, KeyEq>* right_node,
+                          K& separator)
+    {
+        auto* right = static_cast<LeafNode*>(right_node);
+        if constexpr (TRUNCATE_KEYS) return rebuild_pairs(right, separator);
+
+        size_t total = this->size + right->size;
+        size_t left_size = total / 2;
+
+        if constexpr (SLOTTED) {
+            /* merge if the pairs fit in 3/4 of a node, otherwise split them
+             * by bytes if they take more than that, see is_underfull() */
+            std::vector<size_t> bytes(total);
+            size_t total_bytes = 0;
+            for (size_t i = 0; i < total; i++) {
+                auto* node = i < this->size ? this : right;
+                size_t j = i < this->size ? i : i - this->size;
+                bytes[i] = node->range_bytes(j, j + 1);
+                total_bytes += bytes[i];
+            }
+
+            if (total_bytes * 4 > heap.capacity() * 3) {
+                left_size = split_by_bytes(
+                    bytes, std::max<size_t>(total, N) - (N - 1),
+                    std::min<size_t>(N - 1, total - 1));
+            } else if (total <= MERGE_SIZE) {
+                left_size = total;
+            }
+        } else if (total <= MERGE_SIZE) {
+            left_size = total;
+        }
 
-        return nullptr;
+        if (left_size == total) {
+            reserve(right->range_bytes(0, right->size));
+            copy_from(right, 0, this->size, right->size);
+            this->size = total;
+            right->size = 0;
+            next_leaf = right->next_leaf;
+            return true;
+        }
+
+        if (this->size < left_size) {
+            /* move the first entries of the right node to the end */
+            size_t count = left_size - this->size;
+            reserve(right->range_bytes(0, count));
+            copy_from(right, 0, this->size, count);
+            right->keys.move(0, count, right->size - count);
+            right->values.move(0, count, right->size - count);
+            right->size -= count;
+        } else {
+            /* move the last entries to the front of the right node. the
+             * heap of the right node is compacted before its slots move */
+            size_t count = this->size - left_size;
+            right->reserve(range_bytes(left_size, this->size));
+            right->keys.move(count, 0, right->size);
+            right->values.move(count, 0, right->size);
+            right->copy_from(this, left_size, 0, count);
+            right->size += count;
+        }
+        this->size = left_size;
+        separator = right->get_key(0);
+
+        return false;
     }
 
     virtual void print(std::ostream& os, const std::string& padding = "")
@@ -524,10 +1426,368 @@ public:
         // }
     }
 
+    /* read the entries of a leaf page without decoding a node. buf points
+     * past the page header. returns the ID of the next leaf */
+    static PageID read_page(const uint8_t* buf, size_t size,
+                            std::vector<K>& key_list,
+                            std::vector<V>& value_list)
+    {
+        size_t n = *reinterpret_cast<const uint32_t*>(buf);
+        PageID next = *reinterpret_cast<const PageID*>(buf + NEXT_LEAF_OFFSET);
+
+        if constexpr (SLOTTED) {
+            SlotHeap heap;
+            KeyArray keys;
+            ValueArray values;
+            bind_arrays(const_cast<uint8_t*>(buf), size, heap, keys, values);
+
+            key_list.clear();
+            value_list.clear();
+            keys.append_to(key_list, 0, n);
+            values.append_to(value_list, 0, n);
+        } else if constexpr (IN_PLACE) {
+            key_list.resize(n);
+            value_list.resize(n);
+            ::memcpy(key_list.data(), buf + KEYS_OFFSET, n * sizeof(K));
+            ::memcpy(value_list.data(), buf + VALUES_OFFSET, n * sizeof(V));
+        } else {
+            key_list.resize(N - 1);
+            value_list.resize(N - 1);
+            buf += KEYS_OFFSET;
+            size -= KEYS_OFFSET;
+            size_t key_bytes = KeySerializer{}.deserialize(
+                key_list.data(), key_list.data() + N - 1, buf, size);
+            ValueSerializer{}.deserialize(value_list.data(),
+                                          value_list.data() + N - 1,
+                                          buf + key_bytes, size - key_bytes);
+            key_list.resize(n);
+            value_list.resize(n);
+        }
+
+        return next;
+    }
+
+    /* number of entries and the last key of a leaf page, only for pages
+     * that are accessed in place */
+    static size_t read_page_last_key(const uint8_t* buf, size_t size,
+                                     K& last_key)
+    {
+        static_assert(IN_PLACE);
+        size_t n = *reinterpret_cast<const uint32_t*>(buf);
+        if (n == 0) return n;
+
+        if constexpr (VAR_KEYS) {
+            SlotHeap heap;
+            KeyArray keys;
+            ValueArray values;
+            bind_arrays(const_cast<uint8_t*>(buf), size, heap, keys, values);
+            last_key = K(keys.element(n - 1));
+        } else {
+            ::memcpy(&last_key, buf + KEYS_OFFSET + (n - 1) * sizeof(K),
+                     sizeof(K));
+        }
+        return n;
+    }
+
 private:
+    /* split a full leaf, see InnerNode::split() */
+    std::unique_ptr<BaseNode<K, V, KeyComparator, KeyEq>>
+    split(BaseNode<K, V, KeyComparator, KeyEq>* parent, K& split_key)
+    {
+        auto right_sibling = tree->template create_node<LeafNode<
+            N, K, V, KeySerializer, KeyComparator, KeyEq, ValueSerializer>>(
+            parent);
+
+        auto guard = tree->write_guard(this);
+        auto sibling_guard = tree->write_guard(right_sibling.get());
+
+        size_t mid = N / 2;
+        if constexpr (SLOTTED) {
+            /* a leaf can be full by bytes with fewer pairs */
+            std::vector<size_t> bytes(this->size);
+            for (size_t i = 0; i < this->size; i++) {
+                bytes[i] = range_bytes(i, i + 1);
+            }
+            mid = split_by_bytes(bytes, 1, this->size - 1);
+        }
+        if constexpr (TRUNCATE_KEYS) {
+            /* split where the keys differ early so that the separator is
+             * short, see make_separator() */
+            size_t window = this->size / 8;
+            mid = shortest_split(
+                mid, std::max<size_t>(mid, window + 1) - window,
+                std::min<size_t>(mid + window, this->size - 1),
+                [this](size_t i) {
+                    return common_prefix(keys.get(i - 1), keys.get(i));
+                });
+
+            /* the sibling is empty, this only sets its prefix */
+            K first = get_key(mid), last = get_key(this->size - 1);
+            right_sibling->compact_heap(&first, &last);
+        }
+
+        right_sibling->size = this->size - mid;
+        right_sibling->copy_from(this, mid, 0, right_sibling->size);
+
+        right_sibling->next_leaf = next_leaf;
+        next_leaf = right_sibling->get_pid();
+
+        split_key = make_separator(get_key(mid - 1), get_key(mid));
+        this->size = mid;
+        /* the moved elements are garbage in the heap now */
+        compact_heap();
+
+        return right_sibling;
+    }
+
+    static constexpr size_t UNDERFLOW_SIZE = (N - 1) / 4;
+    static constexpr size_t MERGE_SIZE = (N - 1) * 3 / 4;
+
+    using KeyArray = NodeArray<K, KeySerializer, N - 1, IN_PLACE>;
+    using ValueArray = NodeArray<V, ValueSerializer, N - 1, IN_PLACE>;
+
+    /* bind the arrays of a slotted or in-place page */
+    static void bind_arrays(uint8_t* buf, size_t size, SlotHeap& heap,
+                            KeyArray& keys, ValueArray& values)
+    {
+        if constexpr (SLOTTED) {
+            heap.bind(buf, size, HEAP_TOP_OFFSET, FIXED_END);
+        }
+        if constexpr (TRUNCATE_KEYS) {
+            keys.bind(buf + KEYS_OFFSET, &heap,
+                      reinterpret_cast<uint32_t*>(buf + PREFIX_OFFSET));
+        } else {
+            keys.bind(buf + KEYS_OFFSET, &heap);
+        }
+        values.bind(buf + VALUES_OFFSET, &heap);
+    }
+
+    void build_summary() const
+    {
+        if constexpr (!VAR_KEYS) summary.build(&keys[0], this->size);
+    }
+
+    K get_key(size_t idx) const { return K(keys.element(idx)); }
+
+    bool key_equals(size_t idx, const K& key) const
+    {
+        if constexpr (TRUNCATE_KEYS) {
+            return keys.equals(idx, key);
+        } else {
+            return this->keq(key, keys.get(idx));
+        }
+    }
+
+    bool key_less(const K& key, size_t idx) const
+    {
+        if constexpr (TRUNCATE_KEYS) {
+            std::string_view rest = key;
+            int pos = keys.strip_prefix(rest);
+            return pos ? pos < 0 : rest < keys.get(idx);
+        } else {
+            return this->kcmp(key, keys.get(idx));
+        }
+    }
+
+    /* the separator between the last key of a leaf and the first key of
+     * the next leaf. keys in byte order are cut after the first byte that
+     * differs (suffix truncation), which keeps the separators in the inner
+     * nodes short */
+    static K make_separator(const K& left, const K& right)
+    {
+        if constexpr (TRUNCATE_KEYS) {
+            return K(shortest_separator(left, right));
+        } else {
+            return right;
+        }
+    }
+
+    /* position of the first key not less than (lower) or greater than
+     * (upper) the key */
+    size_t search(const K& key, bool upper) const
+    {
+        if constexpr (VAR_KEYS) {
+            return upper ? slot_upper_bound(keys, 0, this->size, key,
+                                            this->kcmp)
+                         : slot_lower_bound(keys, 0, this->size, key,
+                                            this->kcmp);
+        } else {
+            return upper ? summary.upper_bound(&keys[0], this->size, key,
+                                               this->kcmp)
+                         : summary.lower_bound(&keys[0], this->size, key,
+                                               this->kcmp);
+        }
+    }
+
+    /* lower bound of the key among the keys from first on */
+    size_t search_from(const K& key, size_t first) const
+    {
+        if constexpr (VAR_KEYS) {
+            return slot_lower_bound(keys, first, this->size, key, this->kcmp);
+        } else {
+            return first + node_lower_bound(&keys[0] + first,
+                                            this->size - first, key,
+                                            this->kcmp);
+        }
+    }
+
+    /* heap space, see InnerNode::fits(). a pair takes at most a quarter of
+     * the heap so that a full leaf always has enough pairs to split */
+    size_t max_entry_bytes() const { return heap.capacity() / 4; }
+
+    size_t range_bytes(size_t first, size_t last) const
+    {
+        size_t bytes = 0;
+        for (size_t i = first; i < last; i++) {
+            bytes += keys.heap_bytes(i) + values.heap_bytes(i);
+        }
+        return bytes;
+    }
+
+    size_t heap_used() const
+    {
+        size_t used = range_bytes(0, this->size);
+        if constexpr (TRUNCATE_KEYS) used += keys.prefix().size();
+        return used;
+    }
+
+    /* heap bytes needed to add the pair, see SlotArray::insert_bytes() */
+    size_t insert_bytes(const K& key, const V& value) const
+    {
+        return keys.insert_bytes(key, this->size) +
+               ValueArray::heap_bytes_of(value);
+    }
+
+    /* heap bytes needed to add the first n of the sorted pairs, which take
+     * bytes with their whole keys. the keys that start with a part of the
+     * prefix form a range, so the part that all n keys share is the part
+     * that the first and the last one share */
+    size_t batch_bytes(const std::pair<K, V>* pairs, size_t n,
+                       size_t bytes) const
+    {
+        if constexpr (TRUNCATE_KEYS) {
+            std::string_view prefix = keys.prefix();
+            size_t shared = std::min(common_prefix(prefix, pairs[0].first),
+                                     common_prefix(prefix, pairs[n - 1].first));
+            return bytes - n * shared + this->size * (prefix.size() - shared);
+        }
+        return bytes;
+    }
+
+    /* bytes that can be added to the heap after compacting it */
+    size_t heap_free() const
+    {
+        if constexpr (SLOTTED) {
+            return heap.capacity() - heap_used();
+        }
+        return SIZE_MAX;
+    }
+
+    bool fits(size_t bytes) const
+    {
+        if constexpr (SLOTTED) {
+            return bytes <= heap.contiguous() || bytes <= heap_free();
+        }
+        return true;
+    }
+
+    /* see InnerNode::reserve(), first and last are the smallest and the
+     * largest key about to be set */
+    void reserve(size_t bytes, const K* first = nullptr,
+                 const K* last = nullptr)
+    {
+        if constexpr (SLOTTED) {
+            bool cut = false;
+            if constexpr (TRUNCATE_KEYS) {
+                cut = (first && !keys.has_prefix(*first)) ||
+                      (last && !keys.has_prefix(*last));
+            }
+            if (bytes > heap.contiguous() || cut) compact_heap(first, last);
+        }
+    }
+
+    void compact_heap(const K* first = nullptr, const K* last = nullptr)
+    {
+        if constexpr (SLOTTED) {
+            std::vector<K> live_keys;
+            std::vector<V> live_values;
+            keys.append_to(live_keys, 0, this->size);
+            values.append_to(live_values, 0, this->size);
+            heap.reset();
+            if constexpr (TRUNCATE_KEYS) {
+                keys.set_prefix(shared_prefix(live_keys, first, last));
+            }
+            for (size_t i = 0; i < this->size; i++) {
+                keys.set(i, live_keys[i]);
+                values.set(i, live_values[i]);
+            }
+        }
+    }
+
+    /* merge_or_redistribute() for leaves whose keys share prefixes. the
+     * pairs of both leaves are copied out and written back with the
+     * prefixes of the leaves they end up in */
+    bool rebuild_pairs(LeafNode* right, K& separator)
+    {
+        size_t total = this->size + right->size;
+        std::vector<K> all_keys;
+        std::vector<V> all_values;
+        keys.append_to(all_keys, 0, this->size);
+        right->keys.append_to(all_keys, 0, right->size);
+        values.append_to(all_values, 0, this->size);
+        right->values.append_to(all_values, 0, right->size);
+
+        std::vector<size_t> extra(total);
+        for (size_t i = 0; i < total; i++) {
+            extra[i] = ValueArray::heap_bytes_of(all_values[i]);
+        }
+
+        size_t left_size = total <= MERGE_SIZE ? total : total / 2;
+        if (prefixed_bytes(all_keys, extra, 0, total) * 4 >
+            heap.capacity() * 3) {
+            left_size = split_prefixed(
+                all_keys, extra, std::max<size_t>(total, N) - (N - 1),
+                std::min<size_t>(N - 1, total - 1), false);
+        }
+
+        heap.reset();
+        right->heap.reset();
+        keys.set_prefix(range_prefix(all_keys, 0, left_size));
+        right->keys.set_prefix(range_prefix(all_keys, left_size, total));
+
+        for (size_t i = 0; i < total; i++) {
+            auto* node = i < left_size ? this : right;
+            size_t j = i < left_size ? i : i - left_size;
+            node->keys.set(j, all_keys[i]);
+            node->values.set(j, all_values[i]);
+        }
+        this->size = left_size;
+        right->size = total - left_size;
+
+        if (left_size == total) {
+            next_leaf = right->next_leaf;
+            return true;
+        }
+
+        separator =
+            make_separator(all_keys[left_size - 1], all_keys[left_size]);
+        return false;
+    }
+
+    /* copy n pairs from another leaf. the heap must have room for them */
+    void copy_from(const LeafNode* from, size_t src, size_t dst, size_t n)
+    {
+        keys.copy(dst, from->keys, src, n);
+        values.copy(dst, from->values, src, n);
+    }
+
+    /* see InnerNode::summary */
+    mutable KeySummary<K, KeyComparator> summary;
     BTree<N, K, V, KeySerializer, KeyComparator, KeyEq, ValueSerializer>* tree;
-    std::array<K, N - 1> keys;
-    std::array<V, N - 1> values;
+    PageID next_leaf;
+    KeyArray keys;
+    ValueArray values;
+    SlotHeap heap; /* only used by variable-length keys or values */
     KeySerializer key_serializer;
     ValueSerializer value_serializer;
 };
@@ -0,0 +1,163 @@
+#ifndef _BPTREE_WAL_H_
+#define _BPTREE_WAL_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace bptree {
+
+struct WalOptions {
+    /* log page changes ahead of the pages so that a tree that was not
+     * closed cleanly is recovered when it is opened */
+    bool enabled = false;
+
+    /* the log file, the heap file name with ".wal" appended if empty */
+    std::string path;
+
+    /* group commit: the log is written and synced by a background thread
+     * at least every fsync_interval, together with all entries appended
+     * since the last sync */
+    std::chrono::microseconds fsync_interval{1000};
+
+    /* an operation returns only once its log entry is durable. otherwise
+     * the operations of the last fsync_interval can be lost in a crash,
+     * but the tree is still recovered to a consistent state */
+    bool sync_commit = false;
+
+    /* trees are checkpointed in the background once the log holds this many
+     * bytes, which bounds the log replayed on recovery. 0 leaves
+     * checkpoints to the application */
+    size_t checkpoint_log_size = 64 << 20;
+};
+
+typedef uint64_t LSN;
+
+/* redo log of page changes. an entry is the payload of one atomic change,
+ * stored as | length(4 bytes) | crc32c(4 bytes) | payload |, and is known
+ * by its LSN: the position of the end of the entry in the log. the file
+ * starts with a header that holds the LSN of its first byte so that LSNs
+ * keep growing when the log is truncated. a torn or corrupt entry ends the
+ * log */
+class WriteAheadLog {
+public:
+    /* open the log, or create it if it does not exist. an existing log is
+     * discarded if reset is set */
+    WriteAheadLog(std::string_view path, bool reset,
+                  const WalOptions& options = WalOptions{});
+    ~WriteAheadLog();
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    /* buffer an entry and return its LSN. the entry is in flight until it
+     * is committed, see get_stable_lsn(). delta is added to the counter */
+    LSN append(const uint8_t* payload, size_t length, int64_t delta = 0);
+
+    /* the pages of the entry have been marked dirty */
+    void commit(LSN lsn);
+
+    /* wait for a committed entry to be durable if sync_commit is set. the
+     * caller should not hold locks that other writers need so that their
+     * entries can join the same sync */
+    void wait_for_commit(LSN lsn);
+
+    /* wait until the log is durable up to lsn (or to its end if lsn is
+     * beyond it). throws IOException if the log cannot be written */
+    void flush(LSN lsn);
+
+    /* all entries that end at or before this LSN are committed. a
+     * checkpoint that flushes all dirty pages after reading it can drop
+     * these entries */
+    LSN get_stable_lsn();
+    LSN get_end_lsn();
+    LSN get_durable_lsn();
+
+    /* bytes of entries in the log file, i.e. the log to be replayed if the
+     * process crashed now */
+    uint64_t get_log_size();
+
+    /* a counter that moves in step with the LSNs: get_counter() returns the
+     * sum of the deltas of all entries up to the end LSN, which it stores
+     * in lsn. trees keep their pair count here so that a checkpoint records
+     * a count that matches an LSN */
+    int64_t get_counter(LSN& lsn);
+    void set_counter(int64_t value);
+
+    /* call fn(lsn, payload, length) for the entries in the log, oldest
+     * first */
+    void replay(const std::function<void(LSN, const uint8_t*, size_t)>& fn);
+
+    /* drop the entries that end at or before lsn. the rest of the log is
+     * copied to a new file, which replaces the log atomically */
+    void truncate(LSN lsn);
+
+    /* bytes and syncs written to the log file so far */
+    uint64_t get_bytes_written() const { return bytes_written; }
+    uint64_t get_sync_count() const { return sync_count; }
+
+    const WalOptions& get_options() const { return options; }
+
+private:
+    static const uint32_t MAGIC = 0x00DEC0DE;
+    static const size_t HEADER_SIZE = 512;
+    static const size_t ENTRY_HEADER_SIZE = 2 * sizeof(uint32_t);
+    /* the flusher is woken early when this many bytes are buffered */
+    static const size_t MAX_BUFFERED = 4 << 20;
+
+    std::string path;
+    WalOptions options;
+    int fd;
+
+    /* protects everything below, except that the flusher writes the
+     * buffer it has taken out without the mutex. io_mutex is held during
+     * all file I/O */
+    std::mutex mutex;
+    std::mutex io_mutex;
+    std::condition_variable flush_cv;   /* wakes the flusher */
+    std::condition_variable durable_cv; /* wakes threads waiting in flush() */
+
+    LSN base_lsn;    /* LSN of the first byte after the header */
+    LSN end_lsn;     /* end of the last entry appended */
+    LSN written_lsn; /* end of the entries handed to the flusher */
+    LSN durable_lsn; /* end of the entries synced */
+    std::vector<uint8_t> buffer;
+    int64_t counter;
+    bool flush_requested;
+    bool failed;
+    bool stop;
+
+    /* entries appended but not committed, in LSN order */
+    struct InFlight {
+        LSN start, end;
+        bool committed;
+    };
+    std::deque<InFlight> in_flight;
+
+    std::atomic<uint64_t> bytes_written;
+    std::atomic<uint64_t> sync_count;
+    std::thread flusher_thread;
+
+    void open(bool reset);
+    void write_header(int fd, LSN base);
+    /* scan the entries of the file and return the LSN after the last good
+     * one */
+    LSN scan(const std::function<void(LSN, const uint8_t*, size_t)>& fn);
+    /* wait until durable_lsn >= lsn. requests a write right away if now is
+     * set, otherwise waits for the next periodic one */
+    void wait_durable(std::unique_lock<std::mutex>& guard, LSN lsn, bool now);
+    void flusher_main();
+};
+
+} // namespace bptree
+
+#endif
@@ -0,0 +1,198 @@
+#include "bptree/checksum.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <nmmintrin.h>
+#define BPTREE_CRC32C_SSE42 1
+#endif
+
+namespace bptree {
+
+/* slicing-by-8: table[k][b] is the crc of byte b followed by k zero bytes */
+typedef std::array<std::array<uint32_t, 256>, 8> Crc32cTables;
+
+static const Crc32cTables& crc32c_tables()
+{
+    static const Crc32cTables tables = []() {
+        Crc32cTables t;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? (c >> 1) ^ 0x82F63B78 : c >> 1;
+            }
+            t[0][i] = c;
+        }
+        for (uint32_t i = 0; i < 256; i++) {
+            for (int k = 1; k < 8; k++) {
+                t[k][i] = t[0][t[k - 1][i] & 0xff] ^ (t[k - 1][i] >> 8);
+            }
+        }
+        return t;
+    }();
+    return tables;
+}
+
+uint32_t crc32c_sw(const uint8_t* buf, size_t len, uint32_t crc)
+{
+    const auto& t = crc32c_tables();
+    crc = ~crc;
+
+    while (len >= 8) {
+        uint64_t word;
+        ::memcpy(&word, buf, sizeof(word));
+        word ^= crc;
+        crc = t[7][word & 0xff] ^ t[6][(word >> 8) & 0xff] ^
+              t[5][(word >> 16) & 0xff] ^ t[4][(word >> 24) & 0xff] ^
+              t[3][(word >> 32) & 0xff] ^ t[2][(word >> 40) & 0xff] ^
+              t[1][(word >> 48) & 0xff] ^ t[0][word >> 56];
+        buf += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = t[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+#ifdef BPTREE_CRC32C_SSE42
+
+/* the crc32 instruction has a latency of three cycles and a throughput of
+ * one, so three streams of STREAM_BYTES are checksummed at once and then
+ * combined: the crc of a stream is shifted over the zeros the bytes of the
+ * next stream would be followed by. shifting is a linear operator on the
+ * crc, applied a byte of the crc at a time with the tables below */
+static const size_t STREAM_BYTES = 256;
+
+typedef std::array<std::array<uint32_t, 256>, 4> Crc32cShiftTables;
+
+static uint32_t gf2_matrix_times(const uint32_t* mat, uint32_t vec)
+{
+    uint32_t sum = 0;
+    for (; vec; vec >>= 1, mat++) {
+        if (vec & 1) sum ^= *mat;
+    }
+    return sum;
+}
+
+static void gf2_matrix_square(uint32_t* square, const uint32_t* mat)
+{
+    for (int n = 0; n < 32; n++) {
+        square[n] = gf2_matrix_times(mat, mat[n]);
+    }
+}
+
+/* tables that append len zero bytes to a crc. len is a power of 2 */
+static Crc32cShiftTables crc32c_zeros(size_t len)
+{
+    uint32_t even[32], odd[32];
+
+    /* the operator for one zero bit, then squared to two and four bits */
+    odd[0] = 0x82F63B78;
+    for (int n = 1; n < 32; n++) {
+        odd[n] = (uint32_t)1 << (n - 1);
+    }
+    gf2_matrix_square(even, odd);
+    gf2_matrix_square(odd, even);
+
+    /* the next square gives the operator for one zero byte */
+    const uint32_t* op;
+    while (true) {
+        gf2_matrix_square(even, odd);
+        len >>= 1;
+        if (len == 0) {
+            op = even;
+            break;
+        }
+        gf2_matrix_square(odd, even);
+        len >>= 1;
+        if (len == 0) {
+            op = odd;
+            break;
+        }
+    }
+
+    Crc32cShiftTables t;
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int k = 0; k < 4; k++) {
+            t[k][n] = gf2_matrix_times(op, n << (8 * k));
+        }
+    }
+    return t;
+}
+
+static inline uint32_t crc32c_shift(const Crc32cShiftTables& t, uint32_t crc)
+{
+    return t[0][crc & 0xff] ^ t[1][(crc >> 8) & 0xff] ^
+           t[2][(crc >> 16) & 0xff] ^ t[3][crc >> 24];
+}
+
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_hw(const uint8_t* buf, size_t len, uint32_t crc)
+{
+    static const Crc32cShiftTables stream_shift = crc32c_zeros(STREAM_BYTES);
+    uint64_t c0 = ~crc;
+
+    while (len >= 3 * STREAM_BYTES) {
+        uint64_t c1 = 0, c2 = 0;
+        for (const uint8_t* end = buf + STREAM_BYTES; buf < end; buf += 8) {
+            uint64_t w0, w1, w2;
+            ::memcpy(&w0, buf, sizeof(w0));
+            ::memcpy(&w1, &buf[STREAM_BYTES], sizeof(w1));
+            ::memcpy(&w2, &buf[2 * STREAM_BYTES], sizeof(w2));
+            c0 = _mm_crc32_u64(c0, w0);
+            c1 = _mm_crc32_u64(c1, w1);
+            c2 = _mm_crc32_u64(c2, w2);
+        }
+        c0 = crc32c_shift(stream_shift, (uint32_t)c0) ^ (uint32_t)c1;
+        c0 = crc32c_shift(stream_shift, (uint32_t)c0) ^ (uint32_t)c2;
+        buf += 2 * STREAM_BYTES;
+        len -= 3 * STREAM_BYTES;
+    }
+
+    while (len >= 8) {
+        uint64_t word;
+        ::memcpy(&word, buf, sizeof(word));
+        c0 = _mm_crc32_u64(c0, word);
+        buf += 8;
+        len -= 8;
+    }
+    uint32_t c32 = (uint32_t)c0;
+    while (len--) {
+        c32 = _mm_crc32_u8(c32, *buf++);
+    }
+
+    return ~c32;
+}
+
+static bool detect_sse42()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}
+
+/* false until the static initializers of this file have run, which only
+ * means that earlier callers take the table-driven path */
+static const bool has_sse42 = detect_sse42();
+
+uint32_t crc32c(const uint8_t* buf, size_t len, uint32_t crc)
+{
+    return has_sse42 ? crc32c_hw(buf, len, crc) : crc32c_sw(buf, len, crc);
+}
+
+bool crc32c_is_hardware() { return has_sse42; }
+
+#else
+
+uint32_t crc32c(const uint8_t* buf, size_t len, uint32_t crc)
+{
+    return crc32c_sw(buf, len, crc);
+}
+
+bool crc32c_is_hardware() { return false; }
+
+#endif
+
+} // namespace bptree
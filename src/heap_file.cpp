@@ -1,92 +1,548 @@
 #include "bptree/heap_file.h"
+#include "bptree/checksum.h"
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
 #include <cstdlib>
+#include <cstring>
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <iostream>
 #include <unistd.h>
 #include <sstream>
+#include <vector>
 
 namespace bptree {
 
-HeapFile::HeapFile(std::string_view filename, bool create, size_t page_size)
-    : filename(filename), page_size(page_size)
+/* per-thread buffer for compressed pages, aligned for direct I/O */
+static uint8_t* io_buffer(size_t size)
+{
+    thread_local std::unique_ptr<uint8_t, decltype(&std::free)> buf(
+        nullptr, &std::free);
+    thread_local size_t buf_size = 0;
+
+    if (buf_size < size) {
+        size_t alloc_size = (size + Page::BUFFER_ALIGNMENT - 1) /
+                            Page::BUFFER_ALIGNMENT * Page::BUFFER_ALIGNMENT;
+        buf.reset(static_cast<uint8_t*>(
+            std::aligned_alloc(Page::BUFFER_ALIGNMENT, alloc_size)));
+        if (!buf) {
+            buf_size = 0;
+            throw std::bad_alloc();
+        }
+        buf_size = alloc_size;
+    }
+
+    return buf.get();
+}
+
+/* crc32c of a page without its checksum field */
+static uint32_t page_checksum(const uint8_t* buf, size_t page_size)
+{
+    const size_t end = Page::CHECKSUM_OFFSET + sizeof(uint32_t);
+    uint32_t crc = crc32c(buf, Page::CHECKSUM_OFFSET);
+    return crc32c(&buf[end], page_size - end, crc);
+}
+
+static bool is_zero_page(const uint8_t* buf, size_t page_size)
+{
+    return buf[0] == 0 && ::memcmp(buf, &buf[1], page_size - 1) == 0;
+}
+
+HeapFile::HeapFile(std::string_view filename, bool create, size_t page_size,
+                   const HeapFileOptions& options)
+    : filename(filename), page_size(page_size), options(options)
 {
     fd = -1;
+    created = false;
+    capacity_pages = 0;
+    free_list_head = Page::INVALID_PAGE_ID;
+    header_dirty = false;
+    compression = options.compression;
+    map_extent = PageExtent{0, 0};
+    end_sector = 0;
+    capacity_sectors = 0;
+    stored_bytes = 0;
+    checksums = options.page_checksums;
+
+    if (options.direct_io && page_size % DIRECT_IO_ALIGNMENT != 0) {
+        throw IOException("page size is not aligned for direct I/O");
+    }
 
     open(create);
+
+    if (checksums &&
+        options.verify_checksums == ChecksumVerification::FIRST_READ) {
+        verified_pages.reset(new std::atomic<std::atomic<uint64_t>*>
+                                 [((size_t)1 << 32) / VERIFIED_CHUNK_PAGES]());
+    }
+
+    /* the location of a compressed page is only known after the page map
+     * is updated, which the asynchronous interface does not do */
+    if (options.use_io_uring && !codec) {
+        try {
+            io_engine =
+                std::make_unique<IOUringEngine>(fd, options.io_queue_depth);
+        } catch (IOException& e) {
+            /* fall back to synchronous I/O */
+            std::cerr << "io_uring is not available: " << e.what()
+                      << std::endl;
+        }
+    }
 }
 
 HeapFile::~HeapFile()
 {
+    io_engine.reset();
+
     if (is_open()) {
         close();
     }
+
+    if (verified_pages) {
+        for (size_t i = 0; i < ((size_t)1 << 32) / VERIFIED_CHUNK_PAGES; i++) {
+            delete[] verified_pages[i].load();
+        }
+    }
 }
 
 PageID HeapFile::new_page()
 {
     std::lock_guard<std::mutex> guard(mutex);
 
-    PageID new_page = (PageID)file_size_pages;
-    ftruncate(fd, file_size_pages * page_size);
+    /* reuse the lowest free page so that the end of the file stays free and
+     * can be truncated */
+    if (!free_pages.empty()) {
+        auto it = free_pages.begin();
+        PageID pid = *it;
+        free_pages.erase(it);
+        header_dirty = true;
+        return pid;
+    }
+
+    PageID new_page = (PageID)file_size_pages.load();
 
-    file_size_pages++;
-    write_header();
+    if (codec) {
+        page_map.resize(new_page + 1, PageExtent{0, 0});
+    } else if (new_page >= capacity_pages) {
+        grow(new_page + 1);
+    }
+
+    file_size_pages.store(new_page + 1);
+    header_dirty = true;
 
     return new_page;
 }
 
-void HeapFile::read_page(Page* page, boost::upgrade_to_unique_lock<Page>& lock)
+void HeapFile::free_page(PageID pid)
+{
+    check_page_id(pid);
+
+    std::lock_guard<std::mutex> guard(mutex);
+    free_pages.insert(pid);
+    /* the sectors of a compressed page are reused right away */
+    if (codec) release_page(pid);
+    header_dirty = true;
+}
+
+void HeapFile::reserve_page(PageID pid)
 {
+    if (pid == Page::INVALID_PAGE_ID) check_page_id(pid);
+
     std::lock_guard<std::mutex> guard(mutex);
+    size_t num_pages = file_size_pages.load();
 
-    auto pid = page->get_id();
+    if (pid < num_pages) {
+        if (free_pages.erase(pid)) header_dirty = true;
+        return;
+    }
+
+    if (codec) {
+        page_map.resize(pid + 1, PageExtent{0, 0});
+    } else if (pid >= capacity_pages) {
+        grow(pid + 1);
+    }
+
+    for (size_t skipped = num_pages; skipped < pid; skipped++) {
+        free_pages.insert((PageID)skipped);
+    }
+    file_size_pages.store(pid + 1);
+    header_dirty = true;
+}
+
+size_t HeapFile::get_num_free_pages()
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    return free_pages.size();
+}
+
+size_t HeapFile::get_stored_bytes()
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    if (codec) return stored_bytes;
+    return (file_size_pages.load() - 1 - free_pages.size()) * page_size;
+}
+
+size_t HeapFile::shrink()
+{
+    std::lock_guard<std::mutex> guard(mutex);
+
+    size_t num_pages = file_size_pages.load();
+    size_t released = 0;
+    while (!free_pages.empty() && *free_pages.rbegin() == num_pages - 1) {
+        free_pages.erase(std::prev(free_pages.end()));
+        num_pages--;
+        released++;
+        if (codec) release_page(num_pages);
+    }
+
+    if (!codec && num_pages < capacity_pages) {
+        if (ftruncate(fd, (off64_t)num_pages * page_size) != 0) {
+            throw IOException(("unable to resize heap file(error code: " + std::to_string(errno) + ")").c_str());
+        }
+        capacity_pages = num_pages;
+    }
+
+    file_size_pages.store(num_pages);
+    if (codec) page_map.resize(num_pages);
+
+    /* the old free list may refer to truncated pages */
+    write_metadata();
+    header_dirty = false;
+
+    /* the sectors of the truncated pages are free once the new page map
+     * is durable */
+    if (codec) {
+        if (::fdatasync(fd) != 0) {
+            throw IOException(("fdatasync failed(error code: " + std::to_string(errno) + ")").c_str());
+        }
+        free_unmapped(unmapped_extents);
+    }
+
+    /* the sectors after the last page or the page map are free */
+    if (codec && end_sector < capacity_sectors) {
+        if (ftruncate(fd, (off64_t)end_sector * SECTOR_SIZE) != 0) {
+            throw IOException(("unable to resize heap file(error code: " + std::to_string(errno) + ")").c_str());
+        }
+        capacity_sectors = end_sector;
+    }
+
+    return released;
+}
+
+/* extend the file by at least one extent. called with the mutex held */
+void HeapFile::grow(size_t min_pages)
+{
+    size_t new_capacity =
+        std::max(min_pages, capacity_pages + std::max((size_t)1, options.extent_pages));
+    extend_file((off64_t)capacity_pages * page_size,
+                (off64_t)(new_capacity - capacity_pages) * page_size);
+    capacity_pages = new_capacity;
+}
+
+void HeapFile::extend_file(off64_t offset, off64_t len)
+{
+    if (::fallocate(fd, 0, offset, len) != 0) {
+        if (errno != EOPNOTSUPP && errno != ENOSYS) {
+            throw IOException(("unable to allocate heap file extent(error code: " + std::to_string(errno) + ")").c_str());
+        }
+
+        /* not supported by the file system */
+        if (ftruncate(fd, offset + len) != 0) {
+            throw IOException(("unable to resize heap file(error code: " + std::to_string(errno) + ")").c_str());
+        }
+    }
+}
+
+void HeapFile::check_page_id(PageID pid) const
+{
     if (pid == Page::INVALID_PAGE_ID) {
         std::stringstream ss;
         ss << "page ID (" << pid << ") is invalid";
         throw IOException(ss.str().c_str());
     }
 
-    if (pid >= file_size_pages) {
+    auto num_pages = file_size_pages.load();
+    if (pid >= num_pages) {
         std::stringstream ss;
-        ss << "page ID (" << pid << ") >= # pages (" << file_size_pages << ")";
+        ss << "page ID (" << pid << ") >= # pages (" << num_pages << ")";
         throw IOException(ss.str().c_str());
     }
+}
 
-    auto* buf = page->get_buffer(lock);
+void HeapFile::read_page(Page* page, boost::upgrade_to_unique_lock<Page>& lock,
+                         bool verify)
+{
+    auto pid = page->get_id();
+    check_page_id(pid);
 
-    off64_t retval;
-    if ((retval = lseek64(fd, (off64_t)pid * page_size, SEEK_SET)) != (off64_t)pid * page_size) {
-        std::stringstream ss;
-        ss << "seek failed (return code: " << retval << ", errno: " << errno << ")";
-        throw IOException(ss.str().c_str());
+    uint8_t* buf = page->get_buffer(lock);
+    read_block(pid, buf);
+    if (verify) verify_page(pid, buf);
+}
+
+void HeapFile::write_page(Page* page, boost::upgrade_lock<Page>& lock)
+{
+    auto pid = page->get_id();
+    check_page_id(pid);
+
+    auto* buf = const_cast<uint8_t*>(page->get_buffer(lock));
+    seal_page(pid, buf);
+    write_block(pid, buf);
+}
+
+void HeapFile::read_pages(Page* const* pages,
+                          boost::upgrade_to_unique_lock<Page>* locks,
+                          size_t count)
+{
+    if (count == 0) return;
+
+    auto first_pid = pages[0]->get_id();
+    std::vector<struct iovec> iov(count);
+
+    for (size_t i = 0; i < count; i++) {
+        auto pid = pages[i]->get_id();
+        check_page_id(pid);
+        if (pid != first_pid + i) {
+            throw IOException("pages are not contiguous");
+        }
+
+        iov[i].iov_base = pages[i]->get_buffer(locks[i]);
+        iov[i].iov_len = page_size;
     }
 
-    read(fd, buf, page_size);
+    /* compressed pages are not stored next to each other */
+    if (codec) {
+        for (size_t i = 0; i < count; i++) {
+            read_mapped(first_pid + i, (uint8_t*)iov[i].iov_base);
+        }
+    } else {
+        for (size_t i = 0; i < count; i += IOV_MAX) {
+            size_t n = std::min(count - i, (size_t)IOV_MAX);
+            preadv_full(fd, &iov[i], n, (off64_t)(first_pid + i) * page_size);
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        verify_page(first_pid + i, pages[i]->get_buffer(locks[i]));
+    }
 }
 
-void HeapFile::write_page(Page* page, boost::upgrade_lock<Page>& lock)
+void HeapFile::write_pages(Page* const* pages,
+                           boost::upgrade_lock<Page>* locks, size_t count)
 {
-    std::lock_guard<std::mutex> guard(mutex);
+    if (count == 0) return;
 
-    auto pid = page->get_id();
-    if (pid == Page::INVALID_PAGE_ID) {
-        throw IOException("page ID is invalid");
+    auto first_pid = pages[0]->get_id();
+    std::vector<struct iovec> iov(count);
+
+    for (size_t i = 0; i < count; i++) {
+        auto pid = pages[i]->get_id();
+        check_page_id(pid);
+        if (pid != first_pid + i) {
+            throw IOException("pages are not contiguous");
+        }
+
+        iov[i].iov_base = const_cast<uint8_t*>(pages[i]->get_buffer(locks[i]));
+        iov[i].iov_len = page_size;
+        seal_page(pid, (uint8_t*)iov[i].iov_base);
+    }
+
+    if (codec) {
+        for (size_t i = 0; i < count; i++) {
+            write_mapped(first_pid + i, (const uint8_t*)iov[i].iov_base,
+                         false);
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < count; i += IOV_MAX) {
+        size_t n = std::min(count - i, (size_t)IOV_MAX);
+        pwritev_full(fd, &iov[i], n, (off64_t)(first_pid + i) * page_size);
+    }
+}
+
+uint64_t HeapFile::submit_read_pages(Page* const* pages,
+                                     boost::upgrade_to_unique_lock<Page>* locks,
+                                     size_t count)
+{
+    if (!io_engine) {
+        /* synchronous fallback. coalesce runs of consecutive pages */
+        size_t start = 0;
+        for (size_t i = 1; i <= count; i++) {
+            if (i == count ||
+                pages[i]->get_id() != pages[i - 1]->get_id() + 1) {
+                read_pages(&pages[start], &locks[start], i - start);
+                start = i;
+            }
+        }
+        return 0;
+    }
+
+    std::vector<IORequest> reqs(count);
+    std::vector<std::pair<PageID, uint8_t*>> verifies;
+    for (size_t i = 0; i < count; i++) {
+        auto pid = pages[i]->get_id();
+        check_page_id(pid);
+
+        reqs[i] = IORequest{IORequest::Op::READ, pages[i]->get_buffer(locks[i]),
+                            page_size, (off64_t)(pid * page_size)};
+        if (checksums) verifies.emplace_back(pid, reqs[i].buf);
+    }
+
+    auto ticket = io_engine->submit(reqs.data(), count);
+    if (!verifies.empty()) {
+        std::lock_guard<std::mutex> guard(verify_mutex);
+        pending_verifies[ticket] = std::move(verifies);
+    }
+    return ticket;
+}
+
+uint64_t HeapFile::submit_write_pages(Page* const* pages,
+                                      boost::upgrade_lock<Page>* locks,
+                                      size_t count)
+{
+    if (!io_engine) {
+        size_t start = 0;
+        for (size_t i = 1; i <= count; i++) {
+            if (i == count ||
+                pages[i]->get_id() != pages[i - 1]->get_id() + 1) {
+                write_pages(&pages[start], &locks[start], i - start);
+                start = i;
+            }
+        }
+        return 0;
+    }
+
+    std::vector<IORequest> reqs(count);
+    for (size_t i = 0; i < count; i++) {
+        auto pid = pages[i]->get_id();
+        check_page_id(pid);
+
+        reqs[i] = IORequest{IORequest::Op::WRITE,
+                            const_cast<uint8_t*>(pages[i]->get_buffer(locks[i])),
+                            page_size, (off64_t)(pid * page_size)};
+        seal_page(pid, reqs[i].buf);
     }
 
-    if (pid >= file_size_pages) {
-        throw IOException("page ID >= # pages");
+    return io_engine->submit(reqs.data(), count);
+}
+
+void HeapFile::wait(uint64_t ticket)
+{
+    if (!io_engine) return;
+
+    std::vector<std::pair<PageID, uint8_t*>> verifies;
+    if (checksums) {
+        std::lock_guard<std::mutex> guard(verify_mutex);
+        auto it = pending_verifies.find(ticket);
+        if (it != pending_verifies.end()) {
+            verifies = std::move(it->second);
+            pending_verifies.erase(it);
+        }
+    }
+
+    io_engine->wait(ticket);
+
+    for (const auto& [pid, buf] : verifies) {
+        verify_page(pid, buf);
+    }
+}
+
+void HeapFile::seal_page(PageID pid, uint8_t* buf)
+{
+    if (!checksums) return;
+
+    ::memcpy(&buf[Page::PAGE_ID_OFFSET], &pid, sizeof(pid));
+    uint32_t checksum = page_checksum(buf, page_size);
+    ::memcpy(&buf[Page::CHECKSUM_OFFSET], &checksum, sizeof(checksum));
+
+    /* the page on disk is the one just checksummed */
+    if (verified_pages) set_verified(pid);
+}
+
+void HeapFile::verify_page(PageID pid, const uint8_t* buf)
+{
+    if (!checksums || (verified_pages && is_verified(pid))) return;
+
+    uint32_t checksum;
+    PageID stored_pid;
+    ::memcpy(&checksum, &buf[Page::CHECKSUM_OFFSET], sizeof(checksum));
+    ::memcpy(&stored_pid, &buf[Page::PAGE_ID_OFFSET], sizeof(stored_pid));
+
+    /* pages that were allocated but never written read as zeros */
+    if ((checksum != page_checksum(buf, page_size) || stored_pid != pid) &&
+        !(checksum == 0 && stored_pid == 0 && is_zero_page(buf, page_size))) {
+        std::stringstream ss;
+        if (stored_pid != pid) {
+            ss << "page (" << pid << ") holds page (" << stored_pid << ")";
+        } else {
+            ss << "page (" << pid << ") checksum mismatch";
+        }
+        throw ChecksumException(ss.str().c_str());
+    }
+
+    if (verified_pages) set_verified(pid);
+}
+
+bool HeapFile::is_verified(PageID pid) const
+{
+    const auto* chunk =
+        verified_pages[pid / VERIFIED_CHUNK_PAGES].load(std::memory_order_acquire);
+    if (!chunk) return false;
+
+    size_t bit = pid % VERIFIED_CHUNK_PAGES;
+    return chunk[bit / 64].load(std::memory_order_relaxed) &
+           ((uint64_t)1 << (bit % 64));
+}
+
+void HeapFile::set_verified(PageID pid)
+{
+    auto& slot = verified_pages[pid / VERIFIED_CHUNK_PAGES];
+    auto* chunk = slot.load(std::memory_order_acquire);
+
+    if (!chunk) {
+        auto* new_chunk = new std::atomic<uint64_t>[VERIFIED_CHUNK_PAGES / 64]();
+        if (slot.compare_exchange_strong(chunk, new_chunk,
+                                         std::memory_order_acq_rel)) {
+            chunk = new_chunk;
+        } else {
+            delete[] new_chunk;
+        }
     }
 
-    const auto* buf = page->get_buffer(lock);
+    size_t bit = pid % VERIFIED_CHUNK_PAGES;
+    chunk[bit / 64].fetch_or((uint64_t)1 << (bit % 64),
+                             std::memory_order_relaxed);
+}
+
+void HeapFile::sync()
+{
+    std::vector<PageExtent> unmapped;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
 
-    off64_t retval;
-    if ((retval = lseek64(fd, (off64_t)pid * page_size, SEEK_SET)) != (off64_t)pid * page_size) {
-         throw IOException(("seek failed(error code: " + std::to_string(errno) + ")").c_str());
+        if (header_dirty) {
+            write_metadata();
+            header_dirty = false;
+        }
+        unmapped.swap(unmapped_extents);
     }
 
-    write(fd, buf, page_size);
+    if (::fdatasync(fd) != 0) {
+        std::lock_guard<std::mutex> guard(mutex);
+        unmapped_extents.insert(unmapped_extents.end(), unmapped.begin(),
+                                unmapped.end());
+        throw IOException(("fdatasync failed(error code: " + std::to_string(errno) + ")").c_str());
+    }
+
+    if (!unmapped.empty()) {
+        std::lock_guard<std::mutex> guard(mutex);
+        free_unmapped(unmapped);
+    }
 }
 
 void HeapFile::open(bool create)
@@ -97,6 +553,7 @@ void HeapFile::open(bool create)
     if (err < 0 && errno == ENOENT) {
         if (create) {
             this->create();
+            created = true;
             return;
         }
     }
@@ -106,25 +563,45 @@ void HeapFile::open(bool create)
         throw IOException("unable to get heap file status");
     }
 
-    fd = ::open(filename.c_str(), O_RDWR);
+    fd = ::open(filename.c_str(), open_flags());
     if (fd < 0) {
         fd = -1;
         throw IOException("unable to open heap file");
     }
 
     read_header();
+
+    if (::fstat(fd, &sbuf) != 0) {
+        throw IOException("unable to get heap file status");
+    }
+    capacity_pages = std::max((size_t)sbuf.st_size / page_size,
+                              (size_t)file_size_pages.load());
+
+    codec = create_page_codec(compression);
+    if (compression != PageCompression::NONE && !codec) {
+        throw IOException("bad heap file(compression)");
+    }
+    if (codec) {
+        capacity_sectors = sectors_of(sbuf.st_size);
+        read_page_map();
+        build_free_extents();
+    }
+
+    read_free_list();
 }
 
 void HeapFile::close()
 {
-    write_header();
+    if (header_dirty) {
+        write_metadata();
+    }
     ::close(fd);
     fd = -1;
 }
 
 void HeapFile::create()
 {
-    fd = ::open(filename.c_str(), O_RDWR | O_CREAT | O_EXCL,
+    fd = ::open(filename.c_str(), open_flags() | O_CREAT | O_EXCL,
                 S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
     if (fd < 0) {
         fd = -1;
@@ -132,37 +609,497 @@ void HeapFile::create()
     }
 
     int err = ftruncate(fd, page_size);
-    file_size_pages = 1;
+    file_size_pages.store(1);
+    capacity_pages = 1;
     if (err != 0) {
         fd = -1;
         throw IOException("unable to resize heap file");
     }
 
+    /* pages must have room for the page header */
+    if (page_size < Page::HEADER_SIZE) checksums = false;
+
+    codec = create_page_codec(compression);
+    if (codec) {
+        page_map.assign(1, PageExtent{0, 0});
+        end_sector = capacity_sectors = header_sectors();
+    }
+
     write_header();
 }
 
+int HeapFile::open_flags() const
+{
+    return O_RDWR | (options.direct_io ? O_DIRECT : 0);
+}
+
+/* header: | magic(4 bytes) | page size(8 bytes) | # pages(4 bytes) |
+ *         | free list head(4 bytes) | # free pages(4 bytes) |
+ *         | compression(4 bytes) | page map sector(4 bytes) |
+ *         | page map length(4 bytes) | flags(4 bytes) |
+ * the header is transferred as a whole page in an aligned buffer so that it
+ * works with direct I/O */
 void HeapFile::read_header()
 {
+    Page header_page(Page::INVALID_PAGE_ID, page_size);
+    boost::upgrade_lock<Page> lock(header_page);
+    boost::upgrade_to_unique_lock<Page> ulock(lock);
+    uint8_t* buf = header_page.get_buffer(ulock);
     uint32_t magic;
+    uint64_t header_page_size;
+    uint32_t num_pages;
 
-    lseek(fd, 0, SEEK_SET);
-    read(fd, &magic, sizeof(magic));
+    pread_full(fd, buf, page_size, 0);
+
+    ::memcpy(&magic, buf, sizeof(magic));
     if (magic != MAGIC) {
         throw IOException("bad heap file(magic)");
     }
 
-    read(fd, &page_size, sizeof(page_size));
-    read(fd, &file_size_pages, sizeof(file_size_pages));
+    ::memcpy(&header_page_size, &buf[sizeof(magic)], sizeof(header_page_size));
+    ::memcpy(&num_pages, &buf[sizeof(magic) + sizeof(header_page_size)],
+             sizeof(num_pages));
+    /* zero in files written before the free list was added */
+    ::memcpy(&free_list_head,
+             &buf[sizeof(magic) + sizeof(header_page_size) + sizeof(num_pages)],
+             sizeof(free_list_head));
+    /* zero (uncompressed) in files written before compression was added */
+    const uint8_t* map_info = &buf[sizeof(magic) + sizeof(header_page_size) +
+                                   sizeof(num_pages) + 2 * sizeof(uint32_t)];
+    ::memcpy(&compression, map_info, sizeof(compression));
+    ::memcpy(&map_extent.sector, &map_info[sizeof(uint32_t)],
+             sizeof(map_extent.sector));
+    ::memcpy(&map_extent.length, &map_info[2 * sizeof(uint32_t)],
+             sizeof(map_extent.length));
+    /* zero (no checksums) in files written before checksums were added */
+    uint32_t flags;
+    ::memcpy(&flags, &map_info[3 * sizeof(uint32_t)], sizeof(flags));
+    checksums = flags & FLAG_CHECKSUMS;
+
+    page_size = header_page_size;
+    file_size_pages.store(num_pages);
 }
 
 void HeapFile::write_header()
 {
+    Page header_page(Page::INVALID_PAGE_ID, page_size);
+    boost::upgrade_lock<Page> lock(header_page);
+    boost::upgrade_to_unique_lock<Page> ulock(lock);
+    uint8_t* buf = header_page.get_buffer(ulock);
     uint32_t magic = MAGIC;
+    uint64_t header_page_size = page_size;
+    uint32_t num_pages = file_size_pages.load();
+
+    ::memcpy(buf, &magic, sizeof(magic));
+    ::memcpy(&buf[sizeof(magic)], &header_page_size, sizeof(header_page_size));
+    ::memcpy(&buf[sizeof(magic) + sizeof(header_page_size)], &num_pages,
+             sizeof(num_pages));
+    uint8_t* free_list = &buf[sizeof(magic) + sizeof(header_page_size) +
+                              sizeof(num_pages)];
+    uint32_t num_free_pages = free_pages.size();
+    ::memcpy(free_list, &free_list_head, sizeof(free_list_head));
+    ::memcpy(&free_list[sizeof(free_list_head)], &num_free_pages,
+             sizeof(num_free_pages));
+    uint8_t* map_info = &free_list[2 * sizeof(uint32_t)];
+    ::memcpy(map_info, &compression, sizeof(compression));
+    ::memcpy(&map_info[sizeof(uint32_t)], &map_extent.sector,
+             sizeof(map_extent.sector));
+    ::memcpy(&map_info[2 * sizeof(uint32_t)], &map_extent.length,
+             sizeof(map_extent.length));
+    uint32_t flags = checksums ? FLAG_CHECKSUMS : 0;
+    ::memcpy(&map_info[3 * sizeof(uint32_t)], &flags, sizeof(flags));
+
+    pwrite_full(fd, buf, page_size, 0);
+}
+
+/* the free pages are stored in trunk pages, which are free pages themselves:
+ * | magic(4 bytes) | LSN(8 bytes) | checksum(4 bytes) | page ID(4 bytes) |
+ * | next trunk(4 bytes) | # entries(4 bytes) | entries |. the trunk header
+ * is laid out as a page header and the LSN is left 0, so that the log
+ * replays the changes of a node that reuses the trunk.
+ * the free list on disk is only consistent with the last sync(). a trunk
+ * that has been reused since then ends the list and the free pages after it
+ * are lost */
+void HeapFile::read_free_list()
+{
+    Page trunk_page(Page::INVALID_PAGE_ID, page_size);
+    boost::upgrade_lock<Page> lock(trunk_page);
+    boost::upgrade_to_unique_lock<Page> ulock(lock);
+    uint8_t* buf = trunk_page.get_buffer(ulock);
+    size_t num_pages = file_size_pages.load();
+    size_t max_entries = (page_size - TRUNK_HEADER_SIZE) / sizeof(PageID);
+    PageID trunk = free_list_head;
+
+    free_pages.clear();
+
+    while (trunk != Page::INVALID_PAGE_ID) {
+        uint32_t magic, count;
+        PageID next;
+
+        if (trunk >= num_pages || free_pages.count(trunk)) break;
+        read_block(trunk, buf);
+        try {
+            verify_page(trunk, buf);
+        } catch (ChecksumException& e) {
+            std::cerr << e.what() << std::endl;
+            break;
+        }
+
+        ::memcpy(&magic, buf, sizeof(magic));
+        ::memcpy(&next, &buf[Page::HEADER_SIZE], sizeof(next));
+        ::memcpy(&count, &buf[Page::HEADER_SIZE + sizeof(uint32_t)],
+                 sizeof(count));
+        if (magic != FREE_TRUNK_MAGIC || count > max_entries) break;
+
+        const auto* entries =
+            reinterpret_cast<const PageID*>(&buf[TRUNK_HEADER_SIZE]);
+        free_pages.insert(trunk);
+        for (size_t i = 0; i < count; i++) {
+            if (entries[i] != Page::INVALID_PAGE_ID && entries[i] < num_pages) {
+                free_pages.insert(entries[i]);
+            }
+        }
+
+        trunk = next;
+    }
+
+    if (trunk != Page::INVALID_PAGE_ID) {
+        std::cerr << "heap file free list is truncated at page " << trunk
+                  << std::endl;
+    }
+}
+
+void HeapFile::write_free_list()
+{
+    Page trunk_page(Page::INVALID_PAGE_ID, page_size);
+    boost::upgrade_lock<Page> lock(trunk_page);
+    boost::upgrade_to_unique_lock<Page> ulock(lock);
+    uint8_t* buf = trunk_page.get_buffer(ulock);
+    size_t max_entries = (page_size - TRUNK_HEADER_SIZE) / sizeof(PageID);
+    std::vector<PageID> pids(free_pages.begin(), free_pages.end());
+    PageID next = Page::INVALID_PAGE_ID;
+
+    /* the highest free pages are used as trunks as they are reused last */
+    size_t i = pids.size();
+    while (i > 0) {
+        PageID trunk = pids[--i];
+        uint32_t magic = FREE_TRUNK_MAGIC;
+        uint32_t count = std::min(max_entries, i);
+        i -= count;
+
+        ::memcpy(buf, &magic, sizeof(magic));
+        Page::write_lsn(buf, 0);
+        ::memcpy(&buf[Page::HEADER_SIZE], &next, sizeof(next));
+        ::memcpy(&buf[Page::HEADER_SIZE + sizeof(uint32_t)], &count,
+                 sizeof(count));
+        ::memcpy(&buf[TRUNK_HEADER_SIZE], &pids[i], count * sizeof(PageID));
+
+        seal_page(trunk, buf);
+        write_block(trunk, buf, true);
+        next = trunk;
+    }
+
+    free_list_head = next;
+}
+
+void HeapFile::write_metadata()
+{
+    write_free_list();
+    if (!codec) {
+        write_header();
+        return;
+    }
+
+    /* the sectors that the old page map and the pages moved since it was
+     * written are stored in are freed once the new map is durable */
+    if (map_extent.length) retired_extents.push_back(map_extent);
+    map_extent = write_page_map();
+    write_header();
+
+    unmapped_extents.insert(unmapped_extents.end(), retired_extents.begin(),
+                            retired_extents.end());
+    retired_extents.clear();
+    moved_pages.clear();
+}
+
+void HeapFile::free_unmapped(std::vector<PageExtent>& extents)
+{
+    for (const auto& extent : extents) {
+        free_sectors(extent.sector, sectors_of(extent.length));
+    }
+    extents.clear();
+}
+
+void HeapFile::read_block(PageID pid, uint8_t* buf)
+{
+    if (codec) {
+        read_mapped(pid, buf);
+        return;
+    }
+    pread_full(fd, buf, page_size, (off64_t)pid * page_size);
+}
+
+void HeapFile::write_block(PageID pid, const uint8_t* buf, bool locked)
+{
+    if (codec) {
+        write_mapped(pid, buf, locked);
+        return;
+    }
+    pwrite_full(fd, buf, page_size, (off64_t)pid * page_size);
+}
+
+void HeapFile::read_mapped(PageID pid, uint8_t* buf)
+{
+    PageExtent extent{0, 0};
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (pid < page_map.size()) extent = page_map[pid];
+    }
 
-    lseek(fd, 0, SEEK_SET);
-    write(fd, &magic, sizeof(magic));
-    write(fd, &page_size, sizeof(page_size));
-    write(fd, &file_size_pages, sizeof(file_size_pages));
+    off64_t offset = (off64_t)extent.sector * SECTOR_SIZE;
+    if (extent.length == 0) {
+        ::memset(buf, 0, page_size);
+        return;
+    }
+    if (extent.length == page_size) {
+        pread_full(fd, buf, page_size, offset);
+        return;
+    }
+
+    uint8_t* data = io_buffer(page_size);
+    pread_full(fd, data, sectors_of(extent.length) * SECTOR_SIZE, offset);
+    if (!codec->decompress(data, extent.length, buf, page_size)) {
+        std::stringstream ss;
+        ss << "compressed page (" << pid << ") is corrupt";
+        throw IOException(ss.str().c_str());
+    }
+}
+
+void HeapFile::write_mapped(PageID pid, const uint8_t* buf, bool locked)
+{
+    uint8_t* data = io_buffer(page_size);
+    size_t length = codec->compress(buf, page_size, data);
+    size_t sectors = sectors_of(length);
+
+    /* keep the page as it is if compression does not save a sector */
+    if (length == 0 || sectors >= sectors_of(page_size)) {
+        length = page_size;
+    } else {
+        ::memset(&data[length], 0, sectors * SECTOR_SIZE - length);
+    }
+
+    uint32_t sector;
+    {
+        std::unique_lock<std::mutex> guard(mutex, std::defer_lock);
+        if (!locked) guard.lock();
+        sector = place_page(pid, length);
+    }
+
+    off64_t offset = (off64_t)sector * SECTOR_SIZE;
+    if (length == page_size) {
+        pwrite_full(fd, buf, page_size, offset);
+    } else {
+        pwrite_full(fd, data, sectors * SECTOR_SIZE, offset);
+    }
+}
+
+/* the page map on disk must stay valid until the next one is written, so
+ * a page that it refers to is written to new sectors. a page that has
+ * moved since is rewritten in place if it does not take more sectors than
+ * before */
+uint32_t HeapFile::place_page(PageID pid, size_t length)
+{
+    if (pid >= page_map.size()) page_map.resize(pid + 1, PageExtent{0, 0});
+
+    PageExtent& extent = page_map[pid];
+    size_t sectors = sectors_of(length);
+    size_t old_sectors = sectors_of(extent.length);
+
+    if (extent.length && sectors <= old_sectors && moved_pages.count(pid)) {
+        if (sectors < old_sectors) {
+            free_sectors(extent.sector + sectors, old_sectors - sectors);
+        }
+    } else {
+        if (extent.length) unmap_extent(pid, extent);
+        extent.sector = alloc_sectors(sectors);
+        moved_pages.insert(pid);
+    }
+
+    stored_bytes = stored_bytes - extent.length + length;
+    extent.length = length;
+    header_dirty = true;
+
+    return extent.sector;
+}
+
+void HeapFile::release_page(PageID pid)
+{
+    if (pid >= page_map.size()) return;
+
+    PageExtent& extent = page_map[pid];
+    if (extent.length) {
+        unmap_extent(pid, extent);
+        stored_bytes -= extent.length;
+    }
+    extent = PageExtent{0, 0};
+    moved_pages.erase(pid);
+}
+
+void HeapFile::unmap_extent(PageID pid, const PageExtent& extent)
+{
+    if (moved_pages.count(pid)) {
+        free_sectors(extent.sector, sectors_of(extent.length));
+    } else {
+        retired_extents.push_back(extent);
+    }
+}
+
+/* best fit among the free extents, otherwise the sectors are taken from
+ * the end and the file grows by an extent when it is full */
+uint32_t HeapFile::alloc_sectors(size_t count)
+{
+    auto it = free_extents_by_size.lower_bound(
+        std::make_pair((uint32_t)count, (uint32_t)0));
+    if (it != free_extents_by_size.end()) {
+        uint32_t len = it->first;
+        uint32_t sector = it->second;
+        free_extents_by_size.erase(it);
+        free_extents.erase(sector);
+        if (len > count) add_free_extent(sector + count, len - count);
+        return sector;
+    }
+
+    if (end_sector + count > UINT32_MAX) {
+        throw IOException("heap file is full");
+    }
+
+    size_t sector = end_sector;
+    end_sector += count;
+
+    if (end_sector > capacity_sectors) {
+        size_t extent =
+            std::max((size_t)1, options.extent_pages) * header_sectors();
+        size_t new_capacity =
+            std::max(end_sector, capacity_sectors + extent);
+        extend_file((off64_t)capacity_sectors * SECTOR_SIZE,
+                    (off64_t)(new_capacity - capacity_sectors) * SECTOR_SIZE);
+        capacity_sectors = new_capacity;
+    }
+
+    return (uint32_t)sector;
+}
+
+/* free extents are merged with their neighbours. sectors at the end give
+ * back their space to the end of the allocated sectors */
+void HeapFile::free_sectors(uint32_t sector, size_t count)
+{
+    size_t end = sector + count;
+
+    auto next = free_extents.lower_bound(sector);
+    if (next != free_extents.end() && next->first == end) {
+        end += next->second;
+        free_extents_by_size.erase(std::make_pair(next->second, next->first));
+        next = free_extents.erase(next);
+    }
+    if (next != free_extents.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == sector) {
+            sector = prev->first;
+            free_extents_by_size.erase(
+                std::make_pair(prev->second, prev->first));
+            free_extents.erase(prev);
+        }
+    }
+
+    if (end == end_sector) {
+        end_sector = sector;
+        return;
+    }
+    add_free_extent(sector, end - sector);
+}
+
+void HeapFile::add_free_extent(uint32_t sector, size_t count)
+{
+    free_extents[sector] = (uint32_t)count;
+    free_extents_by_size.emplace((uint32_t)count, sector);
+}
+
+/* the page map is an array of (sector, length) for all pages. it is
+ * written to new sectors on every update so that the header points to a
+ * complete map at all times */
+void HeapFile::read_page_map()
+{
+    size_t num_pages = file_size_pages.load();
+    page_map.assign(num_pages, PageExtent{0, 0});
+    stored_bytes = 0;
+    if (!map_extent.length) return;
+
+    size_t sectors = sectors_of(map_extent.length);
+    if (map_extent.sector < header_sectors() ||
+        map_extent.sector + sectors > capacity_sectors) {
+        throw IOException("bad heap file(page map)");
+    }
+
+    uint8_t* buf = io_buffer(sectors * SECTOR_SIZE);
+    pread_full(fd, buf, sectors * SECTOR_SIZE,
+               (off64_t)map_extent.sector * SECTOR_SIZE);
+    size_t count =
+        std::min(num_pages, (size_t)map_extent.length / sizeof(PageExtent));
+    ::memcpy(page_map.data(), buf, count * sizeof(PageExtent));
+    page_map[0] = PageExtent{0, 0};
+
+    for (const auto& extent : page_map) {
+        if (!extent.length) continue;
+        if (extent.length > page_size || extent.sector < header_sectors() ||
+            extent.sector + sectors_of(extent.length) > capacity_sectors) {
+            throw IOException("bad heap file(page map)");
+        }
+        stored_bytes += extent.length;
+    }
+}
+
+HeapFile::PageExtent HeapFile::write_page_map()
+{
+    size_t length = page_map.size() * sizeof(PageExtent);
+    size_t sectors = sectors_of(length);
+    uint32_t sector = alloc_sectors(sectors);
+
+    uint8_t* buf = io_buffer(sectors * SECTOR_SIZE);
+    ::memset(buf, 0, sectors * SECTOR_SIZE);
+    ::memcpy(buf, page_map.data(), length);
+    pwrite_full(fd, buf, sectors * SECTOR_SIZE,
+                (off64_t)sector * SECTOR_SIZE);
+
+    return PageExtent{sector, (uint32_t)length};
+}
+
+/* the sectors that are not taken by a page or the page map are free */
+void HeapFile::build_free_extents()
+{
+    std::vector<std::pair<size_t, size_t>> used;
+    for (const auto& extent : page_map) {
+        if (extent.length) {
+            used.emplace_back(extent.sector,
+                              extent.sector + sectors_of(extent.length));
+        }
+    }
+    if (map_extent.length) {
+        used.emplace_back(map_extent.sector,
+                          map_extent.sector + sectors_of(map_extent.length));
+    }
+    std::sort(used.begin(), used.end());
+
+    free_extents.clear();
+    free_extents_by_size.clear();
+    size_t pos = header_sectors();
+    for (const auto& range : used) {
+        if (range.first < pos) {
+            throw IOException("bad heap file(page map)");
+        }
+        if (range.first > pos) add_free_extent(pos, range.first - pos);
+        pos = range.second;
+    }
+    end_sector = pos;
 }
 
 } // namespace bptree
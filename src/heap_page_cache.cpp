@@ -2,166 +2,637 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 
 namespace bptree {
 
 HeapPageCache::HeapPageCache(std::string_view filename, bool create,
-                             size_t max_pages, size_t page_size)
-    : heap_file(std::make_unique<HeapFile>(filename, create, page_size)),
-      max_pages(max_pages)
+                             size_t max_pages, size_t page_size,
+                             const PageCacheOptions& options)
+    : heap_file(std::make_unique<HeapFile>(filename, create, page_size,
+                                           options.heap_file)),
+      max_pages(max_pages), options(options),
+      shards(std::max((size_t)1, options.num_shards)),
+      replacer(create_replacer(options.replacement_policy, max_pages)),
+      frames(max_pages), num_frames(0), dirty_pages(0), flusher_stop(false)
 {
     this->page_size = page_size;
+
+    if (options.wal.enabled) {
+        std::string wal_path = options.wal.path.empty()
+                                   ? std::string(filename) + ".wal"
+                                   : options.wal.path;
+        /* the log of a new heap file starts empty */
+        wal = std::make_unique<WriteAheadLog>(wal_path, heap_file->is_new(),
+                                              options.wal);
+    }
+
+    if (options.background_flush) {
+        flusher_thread = std::thread([this]() { flusher_main(); });
+    }
+}
+
+HeapPageCache::~HeapPageCache()
+{
+    if (flusher_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(flusher_mutex);
+            flusher_stop = true;
+        }
+        flusher_cv.notify_one();
+        flusher_thread.join();
+    }
+
+    try {
+        flush_all_pages();
+    } catch (IOException& e) {
+        std::cerr << "Failed to flush pages: " << e.what() << std::endl;
+    }
 }
 
-Page* HeapPageCache::alloc_page(PageID id, boost::upgrade_lock<Page>& lock)
+Page* HeapPageCache::alloc_frame(boost::upgrade_lock<Page>& lock)
 {
-    if (size() < max_pages) {
-        auto page = new Page(id, page_size);
-        lock = boost::upgrade_lock(*page);
-        pages.emplace_back(page);
-        page_map[id] = page;
+    {
+        std::lock_guard<std::mutex> guard(frame_mutex);
+
+        if (!free_list.empty()) {
+            auto* page = free_list.back();
+            free_list.pop_back();
+            lock = boost::upgrade_lock(*page);
+            return page;
+        }
+
+        size_t frame = num_frames.load();
+        if (frame < max_pages) {
+            frames[frame] =
+                std::make_unique<Page>(Page::INVALID_PAGE_ID, page_size);
+            auto* page = frames[frame].get();
+            page->set_frame(frame);
+            lock = boost::upgrade_lock(*page);
+            num_frames.store(frame + 1);
+
+            return page;
+        }
+    }
 
+    return evict_frame(lock);
+}
+
+Page* HeapPageCache::evict_frame(boost::upgrade_lock<Page>& lock)
+{
+    /* frames that could not be evicted in this round */
+    std::vector<size_t> skipped;
+    auto evictable = [this, &skipped](size_t frame) {
+        return frames[frame]->get_pin_count() == 0 &&
+               std::find(skipped.begin(), skipped.end(), frame) ==
+                   skipped.end();
+    };
+
+    while (true) {
+        size_t frame;
+        if (!replacer->victim(evictable, frame)) {
+            /* all frames are pinned */
+            if (skipped.empty()) return nullptr;
+
+            skipped.clear();
+            std::this_thread::yield();
+            continue;
+        }
+        skipped.push_back(frame);
+
+        auto* page = frames[frame].get();
+        boost::upgrade_lock<Page> page_lock(*page, boost::try_to_lock);
+        if (!page_lock.owns_lock()) continue;
+
+        /* write back the victim before the frame is reused. the page stays
+         * mapped during the write so that concurrent fetches do not read a
+         * stale copy from the file */
+        if (page->is_dirty()) {
+            try {
+                write_back_victim(page, page_lock);
+            } catch (IOException& e) {
+                std::cerr << "Failed to write back page: " << e.what()
+                          << std::endl;
+                continue;
+            }
+        }
+
+        auto id = page->get_id();
+        auto& shard = get_shard(id);
+        {
+            std::lock_guard<std::mutex> guard(shard.mutex);
+
+            /* pins are only taken under the shard latch. a freed page is
+             * released by its last unpin */
+            if (page->get_pin_count() != 0 || page->is_dirty() ||
+                page->is_free_pending())
+                continue;
+
+            auto it = shard.page_map.find(id);
+            if (it != shard.page_map.end() && it->second == page) {
+                shard.page_map.erase(it);
+            }
+            replacer->record_remove(frame);
+        }
+
+        lock = std::move(page_lock);
         return page;
     }
+}
 
-    PageID victim_id;
-    if (!lru_victim(victim_id)) {
-        return nullptr;
+void HeapPageCache::release_freed_page(Page* page)
+{
+    PageID id = page->get_id();
+    auto& shard = get_shard(id);
+    {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+
+        /* pinned again meanwhile, or released by another thread */
+        if (page->get_pin_count() != 0 || !page->take_free_pending()) return;
+        shard.page_map.erase(id);
+        replacer->record_remove(page->get_frame());
     }
 
-    auto it = page_map.find(victim_id);
-    assert(it != page_map.end());
+    if (page->clear_dirty()) dirty_pages--;
+    free_frame(page);
+    heap_file->free_page(id);
+}
 
-    auto* page = it->second;
-    lock = boost::upgrade_lock(*page);
+void HeapPageCache::free_frame(Page* page)
+{
+    std::lock_guard<std::mutex> guard(frame_mutex);
 
-    if (page->is_dirty()) {
-        flush_page(page, lock);
+    page->set_id(Page::INVALID_PAGE_ID);
+    free_list.push_back(page);
+}
+
+Page* HeapPageCache::install_page(Page* page, PageID id, bool pin)
+{
+    auto& shard = get_shard(id);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+
+    auto it = shard.page_map.find(id);
+    if (it != shard.page_map.end()) {
+        if (pin) it->second->pin();
+        return it->second;
     }
 
-    boost::upgrade_to_unique_lock<Page> ulock(lock);
-    page_map.erase(it);
     page->set_id(id);
-    page_map[id] = page;
+    if (pin) page->pin();
+    shard.page_map[id] = page;
+    replacer->record_insert(page->get_frame(), id);
 
-    return page;
+    return nullptr;
 }
 
-Page* HeapPageCache::new_page(boost::upgrade_lock<Page>& lock)
+void HeapPageCache::write_back_victim(Page* victim,
+                                      boost::upgrade_lock<Page>& lock)
 {
-    std::lock_guard<std::mutex> guard(mutex);
+    std::vector<Page*> batch{victim};
+    std::vector<boost::upgrade_lock<Page>> locks;
+    std::vector<size_t> candidates;
+
+    /* write back the victim together with other dirty pages that are close
+     * to eviction so that they can be reused without I/O later */
+    replacer->peek_victims(options.write_back_batch, candidates);
+    for (auto frame : candidates) {
+        auto* page = frames[frame].get();
+        if (page == victim) continue;
+
+        boost::upgrade_lock<Page> page_lock(*page, boost::try_to_lock);
+        if (!page_lock.owns_lock() || !page->is_dirty() ||
+            page->get_id() == Page::INVALID_PAGE_ID)
+            continue;
+
+        batch.push_back(page);
+        locks.push_back(std::move(page_lock));
+    }
 
+    /* the victim's lock is owned by the caller */
+    locks.insert(locks.begin(), std::move(lock));
+    try {
+        write_back_pages(batch, locks);
+    } catch (IOException&) {
+        lock = std::move(locks.front());
+        throw;
+    }
+    lock = std::move(locks.front());
+}
+
+Page* HeapPageCache::new_page(boost::upgrade_lock<Page>& lock)
+{
     PageID new_id = heap_file->new_page();
-    auto page = alloc_page(new_id, lock);
+    auto* page = alloc_frame(lock);
+    if (!page) {
+        heap_file->free_page(new_id);
+        return nullptr;
+    }
+
+    {
+        boost::upgrade_to_unique_lock<Page> ulock(lock);
+        ::memset(page->get_buffer(ulock), 0, page_size);
+    }
 
-    pin_page(page, lock);
+    [[maybe_unused]] auto* existing = install_page(page, new_id, true);
+    assert(!existing);
 
     return page;
 }
 
 Page* HeapPageCache::fetch_page(PageID id, boost::upgrade_lock<Page>& lock)
 {
-    bptree::Page* page = nullptr;
-    {
-        std::lock_guard<std::mutex> guard(mutex);
+    return fetch_page_impl(id, lock, true);
+}
 
-        auto it = page_map.find(id);
+Page* HeapPageCache::fetch_page_unchecked(PageID id,
+                                          boost::upgrade_lock<Page>& lock)
+{
+    return fetch_page_impl(id, lock, false);
+}
 
-        if (it == page_map.end()) {
-            auto page = alloc_page(id, lock);
+Page* HeapPageCache::fetch_page_impl(PageID id, boost::upgrade_lock<Page>& lock,
+                                     bool verify)
+{
+    auto& shard = get_shard(id);
 
-            try {
-                boost::upgrade_to_unique_lock<Page> ulock(lock);
-                heap_file->read_page(page, ulock);
-                pin_page(page, lock);
-
-                return page;
-            } catch (IOException e) {
-                std::cerr << "Failed to read page: " << e.what() << std::endl;
-                return nullptr;
+    while (true) {
+        Page* page = nullptr;
+        {
+            std::lock_guard<std::mutex> guard(shard.mutex);
+
+            auto it = shard.page_map.find(id);
+            if (it != shard.page_map.end()) {
+                page = it->second;
+                page->pin();
+            }
+        }
+
+        if (!page) {
+            /* miss: read the page into a free frame */
+            boost::upgrade_lock<Page> frame_lock;
+            auto* frame = alloc_frame(frame_lock);
+            if (!frame) return nullptr;
+
+            page = install_page(frame, id, true);
+            if (!page) {
+                /* the page is mapped and pinned. concurrent fetches of the
+                 * same page wait on the page lock until the read is done */
+                lock = std::move(frame_lock);
+
+                auto discard = [&]() {
+                    {
+                        std::lock_guard<std::mutex> guard(shard.mutex);
+                        shard.page_map.erase(id);
+                        replacer->record_remove(frame->get_frame());
+                    }
+                    /* waiters see the invalid page ID and retry */
+                    frame->set_id(Page::INVALID_PAGE_ID);
+                    lock = boost::upgrade_lock<Page>();
+                    if (frame->unpin() == 1) free_frame(frame);
+                };
+
+                try {
+                    boost::upgrade_to_unique_lock<Page> ulock(lock);
+                    heap_file->read_page(frame, ulock, verify);
+                } catch (ChecksumException&) {
+                    /* a corrupt page is reported to the caller rather than
+                     * looking like a page that cannot be cached */
+                    discard();
+                    throw;
+                } catch (IOException& e) {
+                    std::cerr << "Failed to read page: " << e.what()
+                              << std::endl;
+                    discard();
+                    return nullptr;
+                }
+
+                return frame;
             }
+
+            /* loaded by another thread in the meantime */
+            frame_lock.unlock();
+            free_frame(frame);
+        }
+
+        replacer->record_access(page->get_frame());
+        lock = boost::upgrade_lock<Page>(*page);
+
+        if (page->get_id() == id) {
+            return page;
         }
 
-        page = it->second;
-        pin_page(page, lock);
+        /* the read failed in the thread that loaded the page */
+        lock = boost::upgrade_lock<Page>();
+        if (page->unpin() == 1) free_frame(page);
     }
+}
 
-    lock = boost::upgrade_lock<Page>(*page);
-    return page;
+void HeapPageCache::free_page(PageID id)
+{
+    auto& shard = get_shard(id);
+    Page* page = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+
+        auto it = shard.page_map.find(id);
+        if (it != shard.page_map.end()) {
+            page = it->second;
+            page->pin();
+        }
+    }
+
+    if (page) {
+        boost::upgrade_lock<Page> lock(*page);
+
+        if (page->get_id() == id) {
+            /* the content is discarded, no need to write it back */
+            if (page->clear_dirty()) dirty_pages--;
+
+            bool in_use;
+            {
+                std::lock_guard<std::mutex> guard(shard.mutex);
+
+                /* set before the pin is dropped so that a concurrent last
+                 * unpin sees it */
+                page->set_free_pending();
+                in_use = page->unpin() != 1;
+                if (!in_use) {
+                    page->take_free_pending();
+                    shard.page_map.erase(id);
+                    replacer->record_remove(page->get_frame());
+                }
+            }
+
+            lock.unlock();
+            /* someone still holds the page (e.g. an iterator), the last
+             * unpin releases the page and its ID */
+            if (in_use) return;
+
+            free_frame(page);
+        } else {
+            /* the read failed in the thread that loaded the page */
+            lock.unlock();
+            if (page->unpin() == 1) free_frame(page);
+        }
+    }
+
+    heap_file->free_page(id);
 }
 
-void HeapPageCache::pin_page(Page* page, boost::upgrade_lock<Page>& lock)
+void HeapPageCache::prefetch_pages(const PageID* ids, size_t count)
 {
-    if (page->pin() == 0) {
-        lru_erase(page->get_id());
+    std::vector<Page*> batch;
+    std::vector<boost::upgrade_lock<Page>> locks;
+
+    for (size_t i = 0; i < count; i++) {
+        auto& shard = get_shard(ids[i]);
+        {
+            std::lock_guard<std::mutex> guard(shard.mutex);
+            if (shard.page_map.find(ids[i]) != shard.page_map.end()) continue;
+        }
+
+        boost::upgrade_lock<Page> lock;
+        auto* page = alloc_frame(lock);
+        if (!page) break;
+
+        /* the frames are mapped and pinned before they are read, as in
+         * fetch_page_impl(), so that a concurrent fetch waits on the page
+         * lock instead of reading the page on its own */
+        bool mapped;
+        {
+            std::lock_guard<std::mutex> guard(shard.mutex);
+
+            mapped = shard.page_map.find(ids[i]) != shard.page_map.end();
+            if (!mapped) {
+                page->set_id(ids[i]);
+                page->pin();
+                shard.page_map[ids[i]] = page;
+                replacer->record_insert(page->get_frame(), ids[i]);
+            }
+        }
+
+        if (mapped) {
+            /* loaded by another thread in the meantime */
+            lock.unlock();
+            free_frame(page);
+            continue;
+        }
+
+        batch.push_back(page);
+        locks.push_back(std::move(lock));
+    }
+
+    if (batch.empty()) return;
+
+    bool failed = false;
+    {
+        std::vector<boost::upgrade_to_unique_lock<Page>> ulocks;
+        for (auto&& lock : locks) {
+            ulocks.emplace_back(lock);
+        }
+
+        try {
+            auto ticket = heap_file->submit_read_pages(batch.data(),
+                                                       ulocks.data(), batch.size());
+            heap_file->wait(ticket);
+        } catch (IOException& e) {
+            std::cerr << "Failed to prefetch pages: " << e.what() << std::endl;
+            failed = true;
+        }
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) {
+        auto* page = batch[i];
+
+        if (!failed) {
+            unpin_page(page, false, locks[i]);
+            continue;
+        }
+
+        PageID id = page->get_id();
+        {
+            auto& shard = get_shard(id);
+            std::lock_guard<std::mutex> guard(shard.mutex);
+            shard.page_map.erase(id);
+            replacer->record_remove(page->get_frame());
+        }
+        /* waiters see the invalid page ID and retry */
+        page->set_id(Page::INVALID_PAGE_ID);
+        locks[i].unlock();
+        if (page->unpin() == 1) free_frame(page);
     }
 }
 
+void HeapPageCache::pin_page(Page* page)
+{
+    page->pin();
+    replacer->record_access(page->get_frame());
+}
+
 void HeapPageCache::unpin_page(Page* page, bool dirty, boost::upgrade_lock<Page>& lock)
 {
-    page->set_dirty(dirty);
+    /* a clean unpin never clears the dirty flag set by an earlier writer */
+    if (dirty && page->mark_dirty()) {
+        dirty_pages++;
+    }
 
-    int pin_count = page->unpin();
-    if (pin_count == 1) {
-        lru_insert(page->get_id());
+    if (page->unpin() == 1 && page->is_free_pending()) {
+        release_freed_page(page);
+        return;
     }
 
-    flush_page(page, lock);
+    if (options.write_through) {
+        flush_page(page, lock);
+    } else if (options.background_flush &&
+               dirty_pages.load() > options.dirty_ratio * max_pages) {
+        flusher_cv.notify_one();
+    }
 }
 
 void HeapPageCache::flush_page(Page* page, boost::upgrade_lock<Page>& lock)
 {
-    if (page->is_dirty()) {
-        heap_file->write_page(page, lock);
-
-        page->set_dirty(false);
+    /* clear the flag before writing so that a concurrent modification
+     * re-dirties the page instead of being lost */
+    if (page->clear_dirty()) {
+        dirty_pages--;
+
+        try {
+            flush_log(&page, &lock, 1);
+            heap_file->write_page(page, lock);
+        } catch (IOException&) {
+            if (page->mark_dirty()) {
+                dirty_pages++;
+            }
+            throw;
+        }
     }
 }
 
 void HeapPageCache::flush_all_pages()
 {
-    for (auto&& p : pages) {
-        auto lock = boost::upgrade_lock<Page>(*p);
-        flush_page(p.get(), lock);
-    }
+    flush_dirty_pages(std::nullopt);
+    heap_file->sync();
 }
 
-void HeapPageCache::lru_insert(PageID id)
+void HeapPageCache::flush_dirty_pages(
+    std::optional<std::chrono::steady_clock::duration> min_age)
 {
-    std::lock_guard<std::mutex> lock(lru_mutex);
+    std::vector<std::pair<PageID, Page*>> dirty_list;
 
-    if (lru_map.find(id) == lru_map.end()) {
-        lru_list.push_front(id);
-        lru_map.emplace(id, lru_list.begin());
+    {
+        std::lock_guard<std::mutex> guard(frame_mutex);
+
+        for (size_t i = 0; i < num_frames.load(); i++) {
+            auto* page = frames[i].get();
+            if (page->is_dirty()) {
+                dirty_list.emplace_back(page->get_id(), page);
+            }
+        }
+    }
+
+    /* write pages in ID order so that runs of consecutive pages can be
+     * coalesced */
+    std::sort(dirty_list.begin(), dirty_list.end());
+
+    auto now = std::chrono::steady_clock::now();
+    size_t i = 0;
+    while (i < dirty_list.size()) {
+        std::vector<Page*> batch;
+        std::vector<boost::upgrade_lock<Page>> locks;
+
+        while (i < dirty_list.size() && batch.size() < options.write_back_batch) {
+            auto [id, page] = dirty_list[i];
+
+            /* only block on the first page of a batch so that we never wait
+             * for a page lock while holding others */
+            boost::upgrade_lock<Page> lock(*page, boost::defer_lock);
+            if (batch.empty()) {
+                lock.lock();
+            } else if (!lock.try_lock()) {
+                break;
+            }
+            i++;
+
+            /* skip pages that have been reused or are not old enough */
+            if (page->get_id() != id || !page->is_dirty() ||
+                (min_age && now - page->get_dirty_since() < *min_age)) {
+                continue;
+            }
+
+            batch.push_back(page);
+            locks.push_back(std::move(lock));
+        }
+
+        write_back_pages(batch, locks);
     }
 }
 
-void HeapPageCache::lru_erase(PageID id)
+void HeapPageCache::write_back_pages(std::vector<Page*>& batch,
+                                     std::vector<boost::upgrade_lock<Page>>& locks)
 {
-    std::lock_guard<std::mutex> lock(lru_mutex);
-
-    auto it = lru_map.find(id);
+    if (batch.empty()) return;
+
+    /* clean pages are identical to their on-disk copies (writers hold the
+     * page lock while modifying it) so they can be written again */
+    std::vector<bool> was_dirty(batch.size());
+    for (size_t i = 0; i < batch.size(); i++) {
+        was_dirty[i] = batch[i]->clear_dirty();
+        if (was_dirty[i]) dirty_pages--;
+    }
 
-    if (it != lru_map.end()) {
-        lru_list.erase(it->second);
-        lru_map.erase(it);
+    try {
+        flush_log(batch.data(), locks.data(), batch.size());
+        auto ticket =
+            heap_file->submit_write_pages(batch.data(), locks.data(), batch.size());
+        heap_file->wait(ticket);
+    } catch (IOException&) {
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (was_dirty[i] && batch[i]->mark_dirty()) dirty_pages++;
+        }
+        throw;
     }
 }
 
-bool HeapPageCache::lru_victim(PageID& id)
+void HeapPageCache::flush_log(Page* const* pages,
+                              boost::upgrade_lock<Page>* locks, size_t count)
 {
-    std::lock_guard<std::mutex> lock(lru_mutex);
+    if (!wal) return;
 
-    if (lru_list.empty()) {
-        return false;
+    LSN lsn = 0;
+    for (size_t i = 0; i < count; i++) {
+        LSN page_lsn = Page::read_lsn(pages[i]->get_buffer(locks[i]));
+        if (page_lsn == Page::UNLOGGED_LSN) {
+            throw IOException("page changes are not logged");
+        }
+        lsn = std::max(lsn, page_lsn);
     }
+    /* pages that were never logged have no LSN */
+    if (lsn) wal->flush(lsn);
+}
+
+void HeapPageCache::flusher_main()
+{
+    std::unique_lock<std::mutex> guard(flusher_mutex);
+
+    while (!flusher_stop) {
+        flusher_cv.wait_for(guard, options.flush_interval);
+        if (flusher_stop) break;
 
-    id = lru_list.back();
-    lru_map.erase(id);
-    lru_list.pop_back();
+        guard.unlock();
 
-    return true;
+        try {
+            if (dirty_pages.load() > options.dirty_ratio * max_pages) {
+                flush_dirty_pages(std::nullopt);
+            } else {
+                flush_dirty_pages(options.max_dirty_age);
+            }
+        } catch (IOException& e) {
+            std::cerr << "Failed to flush pages: " << e.what() << std::endl;
+        }
+
+        guard.lock();
+    }
 }
 
 } // namespace bptree
@@ -0,0 +1,402 @@
+#include "bptree/io_engine.h"
+#include "bptree/heap_file.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace bptree {
+
+void pread_full(int fd, uint8_t* buf, size_t count, off64_t offset)
+{
+    while (count > 0) {
+        ssize_t retval = ::pread64(fd, buf, count, offset);
+
+        if (retval < 0) {
+            if (errno == EINTR) continue;
+
+            std::stringstream ss;
+            ss << "read failed (offset: " << offset << ", errno: " << errno
+               << ")";
+            throw IOException(ss.str().c_str());
+        }
+
+        if (retval == 0) {
+            std::stringstream ss;
+            ss << "unexpected end of file (offset: " << offset << ")";
+            throw IOException(ss.str().c_str());
+        }
+
+        buf += retval;
+        count -= retval;
+        offset += retval;
+    }
+}
+
+void pwrite_full(int fd, const uint8_t* buf, size_t count, off64_t offset)
+{
+    while (count > 0) {
+        ssize_t retval = ::pwrite64(fd, buf, count, offset);
+
+        if (retval < 0) {
+            if (errno == EINTR) continue;
+
+            std::stringstream ss;
+            ss << "write failed (offset: " << offset << ", errno: " << errno
+               << ")";
+            throw IOException(ss.str().c_str());
+        }
+
+        buf += retval;
+        count -= retval;
+        offset += retval;
+    }
+}
+
+static void advance_iov(struct iovec*& iov, int& iovcnt, size_t nbytes)
+{
+    while (iovcnt > 0 && nbytes >= iov->iov_len) {
+        nbytes -= iov->iov_len;
+        iov++;
+        iovcnt--;
+    }
+    if (iovcnt > 0) {
+        iov->iov_base = (uint8_t*)iov->iov_base + nbytes;
+        iov->iov_len -= nbytes;
+    }
+}
+
+void preadv_full(int fd, struct iovec* iov, int iovcnt, off64_t offset)
+{
+    while (iovcnt > 0) {
+        ssize_t retval = ::preadv64(fd, iov, iovcnt, offset);
+
+        if (retval < 0) {
+            if (errno == EINTR) continue;
+
+            std::stringstream ss;
+            ss << "read failed (offset: " << offset << ", errno: " << errno
+               << ")";
+            throw IOException(ss.str().c_str());
+        }
+
+        if (retval == 0) {
+            std::stringstream ss;
+            ss << "unexpected end of file (offset: " << offset << ")";
+            throw IOException(ss.str().c_str());
+        }
+
+        offset += retval;
+        advance_iov(iov, iovcnt, retval);
+    }
+}
+
+void pwritev_full(int fd, struct iovec* iov, int iovcnt, off64_t offset)
+{
+    while (iovcnt > 0) {
+        ssize_t retval = ::pwritev64(fd, iov, iovcnt, offset);
+
+        if (retval < 0) {
+            if (errno == EINTR) continue;
+
+            std::stringstream ss;
+            ss << "write failed (offset: " << offset << ", errno: " << errno
+               << ")";
+            throw IOException(ss.str().c_str());
+        }
+
+        offset += retval;
+        advance_iov(iov, iovcnt, retval);
+    }
+}
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* p)
+{
+    return (int)::syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int ring_fd, unsigned to_submit,
+                          unsigned min_complete, unsigned flags)
+{
+    return (int)::syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                          min_complete, flags, nullptr, 0);
+}
+
+template <typename T> static T* ring_ptr(void* ring, uint32_t offset)
+{
+    return reinterpret_cast<T*>(static_cast<uint8_t*>(ring) + offset);
+}
+
+IOUringEngine::IOUringEngine(int fd, unsigned int queue_depth)
+    : fd(fd), reaping(false), pending(0), next_ticket(1), next_user_data(1)
+{
+    struct io_uring_params params;
+    ::memset(&params, 0, sizeof(params));
+
+    ring_fd = io_uring_setup(queue_depth, &params);
+    if (ring_fd < 0) {
+        throw IOException(("io_uring_setup failed(error code: " + std::to_string(errno) + ")").c_str());
+    }
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap) {
+        sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+    }
+
+    sq_ring = ::mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        ::close(ring_fd);
+        throw IOException("unable to map io_uring submission queue");
+    }
+
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = ::mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ring_fd,
+                         IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            ::munmap(sq_ring, sq_ring_size);
+            ::close(ring_fd);
+            throw IOException("unable to map io_uring completion queue");
+        }
+    }
+
+    sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes_ptr = ::mmap(nullptr, sqes_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqes_ptr == MAP_FAILED) {
+        if (!single_mmap) ::munmap(cq_ring, cq_ring_size);
+        ::munmap(sq_ring, sq_ring_size);
+        ::close(ring_fd);
+        throw IOException("unable to map io_uring submission entries");
+    }
+    sqes = static_cast<struct io_uring_sqe*>(sqes_ptr);
+
+    sq_head = ring_ptr<unsigned>(sq_ring, params.sq_off.head);
+    sq_tail = ring_ptr<unsigned>(sq_ring, params.sq_off.tail);
+    sq_mask = ring_ptr<unsigned>(sq_ring, params.sq_off.ring_mask);
+    sq_array = ring_ptr<unsigned>(sq_ring, params.sq_off.array);
+    sq_entries = params.sq_entries;
+    cq_head = ring_ptr<unsigned>(cq_ring, params.cq_off.head);
+    cq_tail = ring_ptr<unsigned>(cq_ring, params.cq_off.tail);
+    cq_mask = ring_ptr<unsigned>(cq_ring, params.cq_off.ring_mask);
+    cqes = ring_ptr<struct io_uring_cqe>(cq_ring, params.cq_off.cqes);
+}
+
+IOUringEngine::~IOUringEngine()
+{
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+
+        /* drain requests that are still owned by the kernel */
+        try {
+            submit_pending(guard);
+            while (!in_flight.empty()) {
+                wait_completion(guard);
+            }
+        } catch (IOException&) {
+        }
+    }
+
+    ::munmap(sqes, sqes_size);
+    if (cq_ring != sq_ring) ::munmap(cq_ring, cq_ring_size);
+    ::munmap(sq_ring, sq_ring_size);
+    ::close(ring_fd);
+}
+
+void IOUringEngine::push_sqe(uint64_t user_data, const IORequest& req)
+{
+    /* we are the only producer (under the mutex) so the tail can be read
+     * without synchronization; the head is advanced by the kernel */
+    unsigned tail = *sq_tail;
+    unsigned index = tail & *sq_mask;
+    auto* sqe = &sqes[index];
+
+    ::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode =
+        req.op == IORequest::Op::READ ? IORING_OP_READ : IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)req.buf;
+    sqe->len = (uint32_t)req.len;
+    sqe->off = (uint64_t)req.offset;
+    sqe->user_data = user_data;
+    sq_array[index] = index;
+
+    __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    pending++;
+}
+
+void IOUringEngine::submit_pending(std::unique_lock<std::mutex>& guard)
+{
+    while (pending > 0) {
+        int retval = io_uring_enter(ring_fd, pending, 0, 0);
+
+        if (retval >= 0) {
+            pending -= std::min((unsigned)retval, pending);
+            continue;
+        }
+
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN || errno == EBUSY) {
+            /* completion queue is backed up. wait for completions to be
+             * reaped and retry */
+            if (in_flight.size() > pending) {
+                wait_completion(guard);
+            } else {
+                guard.unlock();
+                std::this_thread::yield();
+                guard.lock();
+            }
+            continue;
+        }
+
+        throw IOException(("io_uring_enter failed(error code: " + std::to_string(errno) + ")").c_str());
+    }
+}
+
+/* wait until at least one more completion is reaped. one thread at a time
+ * blocks in the kernel for completions, without the mutex so that other
+ * threads can submit meanwhile. the others wait for it on completion_cv
+ * and find their completions routed to their batches by reap() */
+void IOUringEngine::wait_completion(std::unique_lock<std::mutex>& guard)
+{
+    if (reaping) {
+        completion_cv.wait(guard);
+        return;
+    }
+
+    reaping = true;
+    guard.unlock();
+
+    int retval;
+    do {
+        retval = io_uring_enter(ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+    } while (retval < 0 && errno == EINTR);
+    int error = retval < 0 ? errno : 0;
+
+    guard.lock();
+    reaping = false;
+    reap();
+    completion_cv.notify_all();
+
+    if (retval < 0 && error != EAGAIN && error != EBUSY) {
+        throw IOException(("io_uring_enter failed(error code: " + std::to_string(error) + ")").c_str());
+    }
+}
+
+void IOUringEngine::reap()
+{
+    /* the completion queue belongs to the thread that blocks for it. if
+     * another thread took the completions, it could block forever */
+    if (reaping) return;
+
+    unsigned head = *cq_head;
+    unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        auto* cqe = &cqes[head & *cq_mask];
+        auto it = in_flight.find(cqe->user_data);
+        int res = cqe->res;
+        head++;
+
+        if (it == in_flight.end()) continue;
+
+        auto& req = it->second.req;
+        auto& batch = batches[it->second.ticket];
+        bool done = true;
+
+        if (res == -EINTR || res == -EAGAIN) {
+            push_sqe(it->first, req);
+            done = false;
+        } else if (res < 0) {
+            std::stringstream ss;
+            ss << (req.op == IORequest::Op::READ ? "read" : "write")
+               << " failed (offset: " << req.offset << ", errno: " << -res
+               << ")";
+            batch.error = ss.str();
+        } else if (res == 0 && req.op == IORequest::Op::READ) {
+            std::stringstream ss;
+            ss << "unexpected end of file (offset: " << req.offset << ")";
+            batch.error = ss.str();
+        } else if ((size_t)res < req.len) {
+            /* short transfer, queue the rest */
+            req.buf += res;
+            req.len -= res;
+            req.offset += res;
+            push_sqe(it->first, req);
+            done = false;
+        }
+
+        if (done) {
+            batch.remaining--;
+            in_flight.erase(it);
+        }
+    }
+
+    __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+}
+
+uint64_t IOUringEngine::submit(const IORequest* reqs, size_t count)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    uint64_t ticket = next_ticket++;
+    batches[ticket] = Batch{count, ""};
+
+    for (size_t i = 0; i < count; i++) {
+        /* bound the number of in-flight requests by the queue size so that
+         * neither the submission nor the completion queue can overflow */
+        while (in_flight.size() >= sq_entries) {
+            submit_pending(guard);
+            reap();
+            if (in_flight.size() >= sq_entries) wait_completion(guard);
+        }
+
+        uint64_t user_data = next_user_data++;
+        in_flight.emplace(user_data, InFlight{ticket, reqs[i]});
+        push_sqe(user_data, reqs[i]);
+    }
+
+    submit_pending(guard);
+    return ticket;
+}
+
+void IOUringEngine::wait(uint64_t ticket)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+
+    auto it = batches.find(ticket);
+    if (it == batches.end()) return;
+    /* other threads add batches while the mutex is dropped, which
+     * invalidates iterators but not references */
+    auto& batch = it->second;
+
+    while (true) {
+        submit_pending(guard);
+        reap();
+
+        if (batch.remaining == 0) break;
+        wait_completion(guard);
+    }
+
+    std::string error = std::move(batch.error);
+    batches.erase(ticket);
+
+    if (!error.empty()) {
+        throw IOException(error.c_str());
+    }
+}
+
+} // namespace bptree
@@ -0,0 +1,128 @@
+#include "bptree/page_codec.h"
+
+#include <cstring>
+
+namespace bptree {
+
+/* a token is the zigzag-encoded difference as a varint whose first byte
+ * holds a run flag next to the low 6 bits: | more | run | 6 bits | followed
+ * by 7 bits per byte. a run token is followed by the varint of the number
+ * of words with the difference minus 2 */
+static const size_t MAX_TOKEN_BYTES = 20;
+
+static inline uint64_t load_word(const uint8_t* p)
+{
+    uint64_t w;
+    ::memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+static inline size_t put_varint(uint8_t* dst, uint64_t v)
+{
+    size_t n = 0;
+    while (v >= 0x80) {
+        dst[n++] = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    dst[n++] = (uint8_t)v;
+    return n;
+}
+
+static inline bool get_varint(const uint8_t*& p, const uint8_t* end,
+                              uint64_t& v, unsigned shift)
+{
+    while (p < end && shift < 64) {
+        uint8_t b = *p++;
+        v |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) return true;
+        shift += 7;
+    }
+    return false;
+}
+
+size_t DeltaVarintCodec::compress(const uint8_t* src, size_t size,
+                                  uint8_t* dst) const
+{
+    size_t words = size / sizeof(uint64_t);
+    size_t tail = size % sizeof(uint64_t);
+    size_t pos = 0;
+    uint64_t prev = 0;
+
+    for (size_t i = 0; i < words;) {
+        if (pos + MAX_TOKEN_BYTES + tail >= size) return 0;
+
+        uint64_t word = load_word(&src[i * sizeof(uint64_t)]);
+        uint64_t delta = word - prev;
+        size_t run = 1;
+        prev = word;
+        while (i + run < words) {
+            uint64_t next = load_word(&src[(i + run) * sizeof(uint64_t)]);
+            if (next - prev != delta) break;
+            prev = next;
+            run++;
+        }
+
+        uint64_t zz = (delta << 1) ^ (uint64_t)((int64_t)delta >> 63);
+        dst[pos++] = (uint8_t)((zz & 0x3f) | (run > 1 ? 0x40 : 0) |
+                               (zz >= 0x40 ? 0x80 : 0));
+        if (zz >= 0x40) pos += put_varint(&dst[pos], zz >> 6);
+        if (run > 1) pos += put_varint(&dst[pos], run - 2);
+
+        i += run;
+    }
+
+    if (pos + tail >= size) return 0;
+    ::memcpy(&dst[pos], &src[words * sizeof(uint64_t)], tail);
+    return pos + tail;
+}
+
+bool DeltaVarintCodec::decompress(const uint8_t* src, size_t len,
+                                  uint8_t* dst, size_t size) const
+{
+    size_t words = size / sizeof(uint64_t);
+    size_t tail = size % sizeof(uint64_t);
+    if (len < tail) return false;
+
+    const uint8_t* p = src;
+    const uint8_t* end = src + len - tail;
+    uint64_t prev = 0;
+
+    for (size_t i = 0; i < words;) {
+        if (p >= end) return false;
+
+        uint8_t head = *p++;
+        uint64_t zz = head & 0x3f;
+        if ((head & 0x80) && !get_varint(p, end, zz, 6)) return false;
+
+        uint64_t run = 1;
+        if (head & 0x40) {
+            uint64_t extra = 0;
+            if (!get_varint(p, end, extra, 0)) return false;
+            run = extra + 2;
+        }
+        if (run > words - i) return false;
+
+        uint64_t delta = (zz >> 1) ^ (uint64_t)(-(int64_t)(zz & 1));
+        for (uint64_t j = 0; j < run; j++, i++) {
+            prev += delta;
+            ::memcpy(&dst[i * sizeof(uint64_t)], &prev, sizeof(prev));
+        }
+    }
+
+    if (p != end) return false;
+    ::memcpy(&dst[words * sizeof(uint64_t)], end, tail);
+    return true;
+}
+
+std::unique_ptr<PageCodec> create_page_codec(PageCompression compression)
+{
+    switch (compression) {
+    case PageCompression::DELTA_VARINT:
+        return std::make_unique<DeltaVarintCodec>();
+    case PageCompression::NONE:
+    default:
+        return nullptr;
+    }
+}
+
+} // namespace bptree
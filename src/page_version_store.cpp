@@ -0,0 +1,119 @@
+#include "bptree/page_version_store.h"
+
+#include <algorithm>
+
+namespace bptree {
+
+PageVersionStore::PageVersionStore()
+    : num_snapshots(0), current(1), newest_snapshot(0)
+{}
+
+PageVersionStore::Version PageVersionStore::acquire()
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    Version version = current.fetch_add(1);
+
+    snapshots.insert(version);
+    newest_snapshot.store(version);
+    num_snapshots.store(snapshots.size(), std::memory_order_release);
+    return version;
+}
+
+void PageVersionStore::release(Version version)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    auto it = snapshots.find(version);
+    if (it == snapshots.end()) return;
+    snapshots.erase(it);
+
+    newest_snapshot.store(snapshots.empty() ? 0 : *snapshots.rbegin());
+    num_snapshots.store(snapshots.size(), std::memory_order_release);
+
+    for (auto&& shard : shards) {
+        std::lock_guard<std::mutex> shard_guard(shard.mutex);
+
+        if (snapshots.empty()) {
+            shard.pages.clear();
+            continue;
+        }
+
+        for (auto p = shard.pages.begin(); p != shard.pages.end();) {
+            auto& saved = p->second.saved;
+            saved.erase(std::remove_if(saved.begin(), saved.end(),
+                                       [this](const SavedImage& s) {
+                                           auto it =
+                                               snapshots.lower_bound(s.from);
+                                           return it == snapshots.end() ||
+                                                  *it >= s.until;
+                                       }),
+                        saved.end());
+
+            /* a page that is changed again saves an image that no snapshot
+             * older than the change looks up, so the history can go */
+            if (saved.empty()) {
+                p = shard.pages.erase(p);
+            } else {
+                ++p;
+            }
+        }
+    }
+}
+
+void PageVersionStore::preserve(PageID pid, const uint8_t* buf, size_t size)
+{
+    /* stable while pages are changed, see acquire() */
+    Version version = current.load();
+    auto& shard = get_shard(pid);
+
+    /* the snapshots are read under the shard lock so that an image is not
+     * saved after release() has pruned the shard */
+    std::lock_guard<std::mutex> guard(shard.mutex);
+    if (!has_snapshots()) return;
+    Version newest = newest_snapshot.load();
+
+    auto& history = shard.pages[pid];
+    if (history.modified >= version) return;
+
+    /* the snapshots in [modified, version) see the page as it is */
+    if (newest >= history.modified) {
+        history.saved.push_back(SavedImage{
+            history.modified, version,
+            std::make_shared<const std::vector<uint8_t>>(buf, buf + size)});
+    }
+    history.modified = version;
+}
+
+PageVersionStore::Image PageVersionStore::find(PageID pid, Version version)
+{
+    auto& shard = get_shard(pid);
+    std::lock_guard<std::mutex> guard(shard.mutex);
+
+    auto it = shard.pages.find(pid);
+    if (it == shard.pages.end()) return nullptr;
+
+    for (auto&& s : it->second.saved) {
+        if (s.until > version) {
+            return s.from <= version ? s.image : nullptr;
+        }
+    }
+    return nullptr;
+}
+
+SnapshotStats PageVersionStore::get_stats()
+{
+    SnapshotStats stats{num_snapshots.load(), 0, 0};
+
+    for (auto&& shard : shards) {
+        std::lock_guard<std::mutex> guard(shard.mutex);
+        for (auto&& p : shard.pages) {
+            for (auto&& s : p.second.saved) {
+                stats.page_versions++;
+                stats.bytes += s.image->size();
+            }
+        }
+    }
+
+    return stats;
+}
+
+} // namespace bptree
@@ -0,0 +1,220 @@
+#include "bptree/replacer.h"
+
+#include <algorithm>
+
+namespace bptree {
+
+ClockReplacer::ClockReplacer(size_t num_frames)
+    : hand(0), resident(num_frames, 0),
+      ref_bits(std::make_unique<std::atomic<uint8_t>[]>(num_frames))
+{
+    for (size_t i = 0; i < num_frames; i++) {
+        ref_bits[i].store(0);
+    }
+}
+
+void ClockReplacer::record_access(size_t frame)
+{
+    /* avoid dirtying the cache line if the bit is already set */
+    if (!ref_bits[frame].load(std::memory_order_relaxed)) {
+        ref_bits[frame].store(1, std::memory_order_relaxed);
+    }
+}
+
+void ClockReplacer::record_insert(size_t frame, PageID id)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    resident[frame] = 1;
+    ref_bits[frame].store(1, std::memory_order_relaxed);
+}
+
+void ClockReplacer::record_remove(size_t frame)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    resident[frame] = 0;
+    ref_bits[frame].store(0, std::memory_order_relaxed);
+}
+
+bool ClockReplacer::victim(const std::function<bool(size_t)>& evictable,
+                           size_t& frame)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    size_t num_frames = resident.size();
+
+    /* two full sweeps: the first may only clear reference bits */
+    for (size_t i = 0; i < 2 * num_frames; i++) {
+        size_t f = hand;
+        hand = (hand + 1) % num_frames;
+
+        if (!resident[f] || !evictable(f)) continue;
+
+        if (ref_bits[f].load(std::memory_order_relaxed)) {
+            ref_bits[f].store(0, std::memory_order_relaxed);
+            continue;
+        }
+
+        frame = f;
+        return true;
+    }
+
+    return false;
+}
+
+void ClockReplacer::peek_victims(size_t n, std::vector<size_t>& frames)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    size_t num_frames = resident.size();
+
+    for (size_t i = 0, f = hand; i < num_frames && n > 0;
+         i++, f = (f + 1) % num_frames) {
+        if (resident[f] && !ref_bits[f].load(std::memory_order_relaxed)) {
+            frames.push_back(f);
+            n--;
+        }
+    }
+}
+
+TwoQReplacer::TwoQReplacer(size_t num_frames, double in_ratio,
+                           double out_ratio)
+    : in_capacity(std::max((size_t)1, (size_t)(num_frames * in_ratio))),
+      out_capacity(std::max((size_t)1, (size_t)(num_frames * out_ratio))),
+      am_size(0), hand(0), queue(num_frames, NONE),
+      frame_pages(num_frames, Page::INVALID_PAGE_ID), a1in_pos(num_frames),
+      ref_bits(std::make_unique<std::atomic<uint8_t>[]>(num_frames))
+{
+    for (size_t i = 0; i < num_frames; i++) {
+        ref_bits[i].store(0);
+    }
+}
+
+void TwoQReplacer::record_access(size_t frame)
+{
+    /* hits in A1in are ignored by 2Q, the bit only matters for Am */
+    if (!ref_bits[frame].load(std::memory_order_relaxed)) {
+        ref_bits[frame].store(1, std::memory_order_relaxed);
+    }
+}
+
+void TwoQReplacer::record_insert(size_t frame, PageID id)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+
+    frame_pages[frame] = id;
+    ref_bits[frame].store(0, std::memory_order_relaxed);
+
+    auto it = a1out_set.find(id);
+    if (it != a1out_set.end()) {
+        /* re-referenced after being evicted from A1in: hot page */
+        a1out_set.erase(it);
+        queue[frame] = AM;
+        am_size++;
+    } else {
+        queue[frame] = A1IN;
+        a1in_pos[frame] = a1in.insert(a1in.end(), frame);
+    }
+}
+
+void TwoQReplacer::record_remove(size_t frame)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+
+    switch (queue[frame]) {
+    case A1IN:
+        a1in.erase(a1in_pos[frame]);
+        a1out_push(frame_pages[frame]);
+        break;
+    case AM:
+        am_size--;
+        break;
+    default:
+        break;
+    }
+
+    queue[frame] = NONE;
+    frame_pages[frame] = Page::INVALID_PAGE_ID;
+    ref_bits[frame].store(0, std::memory_order_relaxed);
+}
+
+void TwoQReplacer::a1out_push(PageID id)
+{
+    if (id == Page::INVALID_PAGE_ID) return;
+
+    a1out.push_back(id);
+    a1out_set.insert(id);
+
+    while (a1out.size() > out_capacity) {
+        auto it = a1out_set.find(a1out.front());
+        if (it != a1out_set.end()) a1out_set.erase(it);
+        a1out.pop_front();
+    }
+}
+
+bool TwoQReplacer::clock_victim(const std::function<bool(size_t)>& evictable,
+                                size_t& frame)
+{
+    size_t num_frames = queue.size();
+
+    for (size_t i = 0; i < 2 * num_frames; i++) {
+        size_t f = hand;
+        hand = (hand + 1) % num_frames;
+
+        if (queue[f] != AM || !evictable(f)) continue;
+
+        if (ref_bits[f].load(std::memory_order_relaxed)) {
+            ref_bits[f].store(0, std::memory_order_relaxed);
+            continue;
+        }
+
+        frame = f;
+        return true;
+    }
+
+    return false;
+}
+
+bool TwoQReplacer::victim(const std::function<bool(size_t)>& evictable,
+                          size_t& frame)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+
+    auto a1in_victim = [&]() {
+        for (auto f : a1in) {
+            if (evictable(f)) {
+                frame = f;
+                return true;
+            }
+        }
+        return false;
+    };
+
+    if (a1in.size() > in_capacity || am_size == 0) {
+        if (a1in_victim()) return true;
+        return clock_victim(evictable, frame);
+    }
+
+    if (clock_victim(evictable, frame)) return true;
+    return a1in_victim();
+}
+
+void TwoQReplacer::peek_victims(size_t n, std::vector<size_t>& frames)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+
+    for (auto it = a1in.begin(); it != a1in.end() && n > 0; it++, n--) {
+        frames.push_back(*it);
+    }
+}
+
+std::unique_ptr<AbstractReplacer> create_replacer(ReplacementPolicy policy,
+                                                  size_t num_frames)
+{
+    switch (policy) {
+    case ReplacementPolicy::TWO_Q:
+        return std::make_unique<TwoQReplacer>(num_frames);
+    case ReplacementPolicy::CLOCK:
+    default:
+        return std::make_unique<ClockReplacer>(num_frames);
+    }
+}
+
+} // namespace bptree
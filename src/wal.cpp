@@ -0,0 +1,366 @@
+#include "bptree/wal.h"
+#include "bptree/checksum.h"
+#include "bptree/heap_file.h"
+#include "bptree/io_engine.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bptree {
+
+static void sync_fd(int fd)
+{
+    if (::fdatasync(fd) != 0) {
+        throw IOException(("fdatasync failed(error code: " +
+                           std::to_string(errno) + ")")
+                              .c_str());
+    }
+}
+
+WriteAheadLog::WriteAheadLog(std::string_view path, bool reset,
+                             const WalOptions& options)
+    : path(path), options(options), fd(-1), base_lsn(0), end_lsn(0),
+      written_lsn(0), durable_lsn(0), counter(0), flush_requested(false),
+      failed(false), stop(false), bytes_written(0), sync_count(0)
+{
+    open(reset);
+    flusher_thread = std::thread([this]() { flusher_main(); });
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stop = true;
+    }
+    flush_cv.notify_one();
+    flusher_thread.join();
+
+    ::close(fd);
+}
+
+/* header: | magic(4 bytes) | reserved(4 bytes) | base LSN(8 bytes) | */
+void WriteAheadLog::write_header(int fd, LSN base)
+{
+    uint8_t header[HEADER_SIZE] = {0};
+    uint32_t magic = MAGIC;
+
+    ::memcpy(header, &magic, sizeof(magic));
+    ::memcpy(&header[2 * sizeof(uint32_t)], &base, sizeof(base));
+    pwrite_full(fd, header, HEADER_SIZE, 0);
+}
+
+void WriteAheadLog::open(bool reset)
+{
+    fd = ::open(path.c_str(), O_RDWR | O_CREAT,
+                S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (fd < 0) {
+        throw IOException("unable to open log file");
+    }
+
+    struct stat sbuf;
+    if (::fstat(fd, &sbuf) != 0) {
+        ::close(fd);
+        throw IOException("unable to get log file status");
+    }
+
+    if (reset || (size_t)sbuf.st_size < HEADER_SIZE) {
+        if (ftruncate(fd, 0) != 0) {
+            ::close(fd);
+            throw IOException("unable to resize log file");
+        }
+        write_header(fd, 0);
+        sync_fd(fd);
+        return;
+    }
+
+    uint8_t header[HEADER_SIZE];
+    uint32_t magic;
+    pread_full(fd, header, HEADER_SIZE, 0);
+    ::memcpy(&magic, header, sizeof(magic));
+    if (magic != MAGIC) {
+        ::close(fd);
+        throw IOException("bad log file(magic)");
+    }
+    ::memcpy(&base_lsn, &header[2 * sizeof(uint32_t)], sizeof(base_lsn));
+
+    /* drop a torn entry at the end so that new entries follow the last
+     * good one */
+    end_lsn = written_lsn = durable_lsn = scan(nullptr);
+    if ((size_t)sbuf.st_size != HEADER_SIZE + (end_lsn - base_lsn)) {
+        if (ftruncate(fd, HEADER_SIZE + (end_lsn - base_lsn)) != 0) {
+            ::close(fd);
+            throw IOException("unable to resize log file");
+        }
+    }
+}
+
+LSN WriteAheadLog::scan(
+    const std::function<void(LSN, const uint8_t*, size_t)>& fn)
+{
+    std::vector<uint8_t> data;
+    {
+        /* fn may flush the log, which needs io_mutex */
+        std::lock_guard<std::mutex> io_guard(io_mutex);
+
+        struct stat sbuf;
+        if (::fstat(fd, &sbuf) != 0) {
+            throw IOException("unable to get log file status");
+        }
+
+        data.resize((size_t)sbuf.st_size - HEADER_SIZE);
+        if (!data.empty()) {
+            pread_full(fd, data.data(), data.size(), HEADER_SIZE);
+        }
+    }
+    size_t size = data.size();
+
+    size_t pos = 0;
+    while (pos + ENTRY_HEADER_SIZE <= size) {
+        uint32_t length, crc;
+        ::memcpy(&length, &data[pos], sizeof(length));
+        ::memcpy(&crc, &data[pos + sizeof(uint32_t)], sizeof(crc));
+
+        const uint8_t* payload = &data[pos + ENTRY_HEADER_SIZE];
+        if (length == 0 || length > size - pos - ENTRY_HEADER_SIZE ||
+            crc32c(payload, length) != crc)
+            break;
+
+        pos += ENTRY_HEADER_SIZE + length;
+        if (fn) fn(base_lsn + pos, payload, length);
+    }
+
+    return base_lsn + pos;
+}
+
+void WriteAheadLog::replay(
+    const std::function<void(LSN, const uint8_t*, size_t)>& fn)
+{
+    scan(fn);
+}
+
+LSN WriteAheadLog::append(const uint8_t* payload, size_t length,
+                          int64_t delta)
+{
+    uint32_t header[2] = {(uint32_t)length, crc32c(payload, length)};
+
+    std::lock_guard<std::mutex> guard(mutex);
+    if (failed) throw IOException("log write failed");
+
+    const auto* header_bytes = reinterpret_cast<const uint8_t*>(header);
+    buffer.insert(buffer.end(), header_bytes, header_bytes + sizeof(header));
+    buffer.insert(buffer.end(), payload, payload + length);
+
+    LSN start = end_lsn;
+    end_lsn += ENTRY_HEADER_SIZE + length;
+    in_flight.push_back(InFlight{start, end_lsn, false});
+    counter += delta;
+
+    if (buffer.size() >= MAX_BUFFERED) flush_cv.notify_one();
+    return end_lsn;
+}
+
+void WriteAheadLog::commit(LSN lsn)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+
+    auto it = std::lower_bound(
+        in_flight.begin(), in_flight.end(), lsn,
+        [](const InFlight& entry, LSN lsn) { return entry.end < lsn; });
+    if (it != in_flight.end() && it->end == lsn) it->committed = true;
+    while (!in_flight.empty() && in_flight.front().committed) {
+        in_flight.pop_front();
+    }
+}
+
+void WriteAheadLog::wait_for_commit(LSN lsn)
+{
+    if (!options.sync_commit) return;
+
+    std::unique_lock<std::mutex> guard(mutex);
+    wait_durable(guard, lsn, options.fsync_interval.count() == 0);
+}
+
+void WriteAheadLog::flush(LSN lsn)
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    wait_durable(guard, lsn, true);
+}
+
+LSN WriteAheadLog::get_stable_lsn()
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    return in_flight.empty() ? end_lsn : in_flight.front().start;
+}
+
+LSN WriteAheadLog::get_end_lsn()
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    return end_lsn;
+}
+
+LSN WriteAheadLog::get_durable_lsn()
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    return durable_lsn;
+}
+
+uint64_t WriteAheadLog::get_log_size()
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    return end_lsn - base_lsn;
+}
+
+int64_t WriteAheadLog::get_counter(LSN& lsn)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    lsn = end_lsn;
+    return counter;
+}
+
+void WriteAheadLog::set_counter(int64_t value)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    counter = value;
+}
+
+void WriteAheadLog::wait_durable(std::unique_lock<std::mutex>& guard, LSN lsn,
+                                 bool now)
+{
+    lsn = std::min(lsn, end_lsn);
+
+    while (durable_lsn < lsn) {
+        if (failed) throw IOException("log write failed");
+
+        if (now && !flush_requested) {
+            flush_requested = true;
+            flush_cv.notify_one();
+        }
+        durable_cv.wait(guard);
+    }
+}
+
+void WriteAheadLog::truncate(LSN lsn)
+{
+    std::lock_guard<std::mutex> guard(mutex);
+    lsn = std::min(lsn, end_lsn);
+    if (lsn <= base_lsn) return;
+    if (failed) throw IOException("log write failed");
+
+    /* the flusher takes io_mutex before it releases the mutex, so it is
+     * not writing anything taken out of the buffer */
+    std::lock_guard<std::mutex> io_guard(io_mutex);
+
+    if (!buffer.empty()) {
+        pwrite_full(fd, buffer.data(), buffer.size(),
+                    HEADER_SIZE + (written_lsn - base_lsn));
+        bytes_written += buffer.size();
+        buffer.clear();
+        written_lsn = end_lsn;
+    }
+
+    std::vector<uint8_t> tail(end_lsn - lsn);
+    if (!tail.empty()) {
+        pread_full(fd, tail.data(), tail.size(), HEADER_SIZE + (lsn - base_lsn));
+    }
+
+    std::string tmp_path = path + ".tmp";
+    int new_fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC,
+                        S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    if (new_fd < 0) {
+        throw IOException("unable to create log file");
+    }
+
+    try {
+        write_header(new_fd, lsn);
+        if (!tail.empty()) {
+            pwrite_full(new_fd, tail.data(), tail.size(), HEADER_SIZE);
+        }
+        sync_fd(new_fd);
+
+        if (::rename(tmp_path.c_str(), path.c_str()) != 0) {
+            throw IOException("unable to replace log file");
+        }
+    } catch (IOException&) {
+        ::close(new_fd);
+        throw;
+    }
+
+    /* make the rename durable */
+    std::string dir_path = path;
+    int dir_fd = ::open(::dirname(&dir_path[0]), O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+
+    ::close(fd);
+    fd = new_fd;
+    base_lsn = lsn;
+    durable_lsn = end_lsn;
+    sync_count++;
+    durable_cv.notify_all();
+}
+
+void WriteAheadLog::flusher_main()
+{
+    std::unique_lock<std::mutex> guard(mutex);
+    std::vector<uint8_t> data;
+
+    while (true) {
+        auto wake = [this]() {
+            return stop || flush_requested || buffer.size() >= MAX_BUFFERED;
+        };
+        if (options.fsync_interval.count() > 0) {
+            flush_cv.wait_for(guard, options.fsync_interval, wake);
+        } else {
+            flush_cv.wait(guard, wake);
+        }
+
+        /* requests that arrive during the write are served by the next
+         * one, together with the entries appended in the meantime */
+        flush_requested = false;
+
+        if (!buffer.empty() && !failed) {
+            data.swap(buffer);
+            LSN end = end_lsn;
+            off64_t offset = HEADER_SIZE + (written_lsn - base_lsn);
+            written_lsn = end;
+
+            std::unique_lock<std::mutex> io_guard(io_mutex);
+            guard.unlock();
+
+            bool ok = true;
+            try {
+                pwrite_full(fd, data.data(), data.size(), offset);
+                sync_fd(fd);
+            } catch (IOException& e) {
+                std::cerr << "Failed to write log: " << e.what() << std::endl;
+                ok = false;
+            }
+
+            io_guard.unlock();
+            guard.lock();
+
+            if (ok) {
+                durable_lsn = std::max(durable_lsn, end);
+                bytes_written += data.size();
+                sync_count++;
+            } else {
+                failed = true;
+            }
+            data.clear();
+            durable_cv.notify_all();
+        }
+
+        if (stop) break;
+    }
+}
+
+} // namespace bptree
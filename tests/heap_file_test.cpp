@@ -0,0 +1,526 @@
+#include <gtest/gtest.h>
+
+#include "bptree/checksum.h"
+#include "bptree/heap_file.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+static std::string heap_file_path(const char* name)
+{
+    return std::string("/tmp/bptree_") + name + "_" + std::to_string(getpid()) +
+           ".heap";
+}
+
+TEST(HeapFileTest, ReadWritePage)
+{
+    auto path = heap_file_path("read_write");
+    std::remove(path.c_str());
+
+    {
+        bptree::HeapFile heap_file(path, true, 4096);
+
+        for (int i = 0; i < 8; i++) {
+            bptree::Page page(heap_file.new_page(), 4096);
+            boost::upgrade_lock<bptree::Page> lock(page);
+            {
+                boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+                ::memset(page.get_buffer(ulock), 'a' + i, 4096);
+            }
+            heap_file.write_page(&page, lock);
+        }
+    }
+
+    bptree::HeapFile heap_file(path, false, 4096);
+    for (int i = 0; i < 8; i++) {
+        bptree::Page page(i + 1, 4096);
+        boost::upgrade_lock<bptree::Page> lock(page);
+        boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+        heap_file.read_page(&page, ulock);
+
+        const auto* buf = page.get_buffer(ulock);
+        EXPECT_EQ(buf[0], 'a' + i);
+        EXPECT_EQ(buf[4095], 'a' + i);
+    }
+
+    bptree::Page page(100, 4096);
+    boost::upgrade_lock<bptree::Page> lock(page);
+    boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+    EXPECT_THROW(heap_file.read_page(&page, ulock), bptree::IOException);
+
+    std::remove(path.c_str());
+}
+
+TEST(HeapFileTest, VectoredReadWrite)
+{
+    const int N = 16;
+    auto path = heap_file_path("vectored");
+    std::remove(path.c_str());
+
+    bptree::HeapFile heap_file(path, true, 4096);
+    std::vector<std::unique_ptr<bptree::Page>> pages;
+    std::vector<bptree::Page*> page_ptrs;
+
+    for (int i = 0; i < N; i++) {
+        pages.push_back(
+            std::make_unique<bptree::Page>(heap_file.new_page(), 4096));
+        page_ptrs.push_back(pages.back().get());
+    }
+
+    {
+        std::vector<boost::upgrade_lock<bptree::Page>> locks;
+        for (int i = 0; i < N; i++) {
+            locks.emplace_back(*pages[i]);
+            boost::upgrade_to_unique_lock<bptree::Page> ulock(locks.back());
+            ::memset(pages[i]->get_buffer(ulock), i, 4096);
+        }
+        heap_file.write_pages(page_ptrs.data(), locks.data(), N);
+    }
+
+    std::vector<std::unique_ptr<bptree::Page>> read_pages;
+    std::vector<bptree::Page*> read_ptrs;
+    std::vector<boost::upgrade_lock<bptree::Page>> locks;
+    std::vector<boost::upgrade_to_unique_lock<bptree::Page>> ulocks;
+    for (int i = 0; i < N; i++) {
+        read_pages.push_back(
+            std::make_unique<bptree::Page>(pages[i]->get_id(), 4096));
+        read_ptrs.push_back(read_pages.back().get());
+    }
+    for (int i = 0; i < N; i++) {
+        locks.emplace_back(*read_pages[i]);
+    }
+    for (int i = 0; i < N; i++) {
+        ulocks.emplace_back(locks[i]);
+    }
+
+    heap_file.read_pages(read_ptrs.data(), ulocks.data(), N);
+    for (int i = 0; i < N; i++) {
+        const auto* buf = read_pages[i]->get_buffer(ulocks[i]);
+        EXPECT_EQ(buf[0], i);
+        EXPECT_EQ(buf[4095], i);
+    }
+
+    /* runs must be contiguous */
+    std::swap(read_ptrs[0], read_ptrs[1]);
+    std::swap(ulocks[0], ulocks[1]);
+    EXPECT_THROW(heap_file.read_pages(read_ptrs.data(), ulocks.data(), N),
+                 bptree::IOException);
+
+    std::remove(path.c_str());
+}
+
+static void async_read_write(const bptree::HeapFileOptions& options,
+                             const char* name)
+{
+    const int N = 300; /* more than the queue depth */
+    auto path = heap_file_path(name);
+    std::remove(path.c_str());
+
+    bptree::HeapFile heap_file(path, true, 4096, options);
+    std::vector<std::unique_ptr<bptree::Page>> pages;
+    std::vector<bptree::Page*> page_ptrs;
+
+    for (int i = 0; i < N; i++) {
+        pages.push_back(
+            std::make_unique<bptree::Page>(heap_file.new_page(), 4096));
+    }
+    /* submit in reverse order to exercise non-contiguous batches */
+    for (int i = N - 1; i >= 0; i--) {
+        page_ptrs.push_back(pages[i].get());
+    }
+
+    {
+        std::vector<boost::upgrade_lock<bptree::Page>> locks;
+        for (auto* page : page_ptrs) {
+            locks.emplace_back(*page);
+            boost::upgrade_to_unique_lock<bptree::Page> ulock(locks.back());
+            ::memset(page->get_buffer(ulock), page->get_id() & 0xff, 4096);
+        }
+
+        auto ticket = heap_file.submit_write_pages(page_ptrs.data(),
+                                                   locks.data(), N);
+        heap_file.wait(ticket);
+    }
+
+    std::vector<boost::upgrade_lock<bptree::Page>> locks;
+    std::vector<boost::upgrade_to_unique_lock<bptree::Page>> ulocks;
+    for (auto* page : page_ptrs) {
+        locks.emplace_back(*page);
+    }
+    for (auto&& lock : locks) {
+        ulocks.emplace_back(lock);
+        ::memset(ulocks.back().mutex()->get_buffer(ulocks.back()), 0, 4096);
+    }
+
+    auto ticket = heap_file.submit_read_pages(page_ptrs.data(), ulocks.data(), N);
+    heap_file.wait(ticket);
+
+    for (int i = 0; i < N; i++) {
+        const auto* buf = page_ptrs[i]->get_buffer(ulocks[i]);
+        EXPECT_EQ(buf[0], page_ptrs[i]->get_id() & 0xff);
+        EXPECT_EQ(buf[4095], page_ptrs[i]->get_id() & 0xff);
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(HeapFileTest, AsyncReadWrite)
+{
+    bptree::HeapFileOptions options;
+    options.use_io_uring = true;
+    options.io_queue_depth = 64;
+
+    async_read_write(options, "async");
+}
+
+TEST(HeapFileTest, ConcurrentAsyncIO)
+{
+    const int NUM_THREADS = 4;
+    const int PAGES_PER_THREAD = 48;
+    const int ROUNDS = 50;
+    auto path = heap_file_path("concurrent_async");
+    std::remove(path.c_str());
+
+    bptree::HeapFileOptions options;
+    options.use_io_uring = true;
+    options.io_queue_depth = 32;
+    bptree::HeapFile heap_file(path, true, 4096, options);
+
+    std::vector<std::unique_ptr<bptree::Page>> pages;
+    for (int i = 0; i < NUM_THREADS * PAGES_PER_THREAD; i++) {
+        pages.push_back(
+            std::make_unique<bptree::Page>(heap_file.new_page(), 4096));
+    }
+
+    /* the threads wait for their own batches while the others submit */
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; t++) {
+        threads.emplace_back([&, t]() {
+            std::vector<bptree::Page*> batch;
+            for (int i = 0; i < PAGES_PER_THREAD; i++) {
+                batch.push_back(pages[t * PAGES_PER_THREAD + i].get());
+            }
+
+            for (int round = 0; round < ROUNDS; round++) {
+                {
+                    std::vector<boost::upgrade_lock<bptree::Page>> locks;
+                    for (auto* page : batch) {
+                        locks.emplace_back(*page);
+                        boost::upgrade_to_unique_lock<bptree::Page> ulock(
+                            locks.back());
+                        ::memset(page->get_buffer(ulock),
+                                 (page->get_id() + round) & 0xff, 4096);
+                    }
+                    heap_file.wait(heap_file.submit_write_pages(
+                        batch.data(), locks.data(), batch.size()));
+                }
+
+                std::vector<boost::upgrade_lock<bptree::Page>> locks;
+                std::vector<boost::upgrade_to_unique_lock<bptree::Page>> ulocks;
+                for (auto* page : batch) {
+                    locks.emplace_back(*page);
+                }
+                for (auto&& lock : locks) {
+                    ulocks.emplace_back(lock);
+                    ::memset(ulocks.back().mutex()->get_buffer(ulocks.back()),
+                             0, 4096);
+                }
+                heap_file.wait(heap_file.submit_read_pages(
+                    batch.data(), ulocks.data(), batch.size()));
+
+                for (size_t i = 0; i < batch.size(); i++) {
+                    const auto* buf = batch[i]->get_buffer(ulocks[i]);
+                    ASSERT_EQ(buf[0], (batch[i]->get_id() + round) & 0xff);
+                    ASSERT_EQ(buf[4095], (batch[i]->get_id() + round) & 0xff);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(HeapFileTest, DirectIO)
+{
+    bptree::HeapFileOptions options;
+    options.use_io_uring = true;
+    options.direct_io = true;
+
+    try {
+        async_read_write(options, "direct_io");
+    } catch (bptree::IOException& e) {
+        GTEST_SKIP() << "direct I/O is not supported: " << e.what();
+    }
+
+    options.use_io_uring = false;
+    try {
+        async_read_write(options, "direct_io_sync");
+    } catch (bptree::IOException& e) {
+        GTEST_SKIP() << "direct I/O is not supported: " << e.what();
+    }
+}
+
+static size_t file_size(const std::string& path)
+{
+    struct stat sbuf;
+    if (::stat(path.c_str(), &sbuf) != 0) return 0;
+    return sbuf.st_size;
+}
+
+TEST(HeapFileTest, FreeList)
+{
+    const int N = 2000;
+    auto path = heap_file_path("free_list");
+    std::remove(path.c_str());
+
+    bptree::HeapFileOptions options;
+    options.extent_pages = 32;
+
+    {
+        bptree::HeapFile heap_file(path, true, 4096, options);
+
+        for (int i = 0; i < N; i++) {
+            EXPECT_EQ(heap_file.new_page(), i + 1);
+        }
+        /* the file grows in extents */
+        EXPECT_EQ(file_size(path) % (32 * 4096), 4096);
+
+        for (int i = 1; i <= N; i += 2) {
+            heap_file.free_page(i);
+        }
+    }
+
+    {
+        bptree::HeapFile heap_file(path, false, 4096, options);
+        EXPECT_EQ(heap_file.get_num_pages(), N + 1);
+        EXPECT_EQ(heap_file.get_num_free_pages(), N / 2);
+
+        /* the lowest free pages are reused first */
+        EXPECT_EQ(heap_file.new_page(), 1);
+        EXPECT_EQ(heap_file.new_page(), 3);
+
+        for (int i = 2; i <= N; i += 2) {
+            heap_file.free_page(i);
+        }
+        heap_file.free_page(1);
+        heap_file.free_page(3);
+
+        /* everything but the header is free */
+        EXPECT_EQ(heap_file.shrink(), N);
+        EXPECT_EQ(heap_file.get_num_pages(), 1);
+        EXPECT_EQ(file_size(path), 4096);
+        EXPECT_EQ(heap_file.new_page(), 1);
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(HeapFileTest, CompressedPages)
+{
+    const int N = 1000;
+    auto path = heap_file_path("compressed");
+    std::remove(path.c_str());
+
+    bptree::HeapFileOptions options;
+    options.compression = bptree::PageCompression::DELTA_VARINT;
+    options.extent_pages = 8;
+
+    /* pages that are half filled with sorted integers like a node and every
+     * 10th page of random bytes, which is stored uncompressed */
+    auto fill = [](bptree::Page& page, int i) {
+        boost::upgrade_lock<bptree::Page> lock(page);
+        boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+        auto* buf = reinterpret_cast<uint64_t*>(page.get_buffer(ulock));
+        std::mt19937_64 rng(i);
+        for (size_t j = 0; j < 4096 / sizeof(uint64_t); j++) {
+            if (i % 10 == 0) {
+                buf[j] = rng();
+            } else {
+                buf[j] = j < 256 ? i * 100000 + j * j : 0;
+            }
+        }
+    };
+
+    {
+        bptree::HeapFile heap_file(path, true, 4096, options);
+        EXPECT_TRUE(heap_file.is_compressed());
+
+        for (int i = 0; i < N; i++) {
+            bptree::Page page(heap_file.new_page(), 4096);
+            fill(page, i);
+            boost::upgrade_lock<bptree::Page> lock(page);
+            heap_file.write_page(&page, lock);
+        }
+        EXPECT_LT(heap_file.get_stored_bytes() * 4, N * 4096);
+        EXPECT_LT(file_size(path) * 2, (N + 1) * 4096);
+
+        for (int i = N / 2; i < N; i++) {
+            heap_file.free_page(i + 1);
+        }
+    }
+
+    /* the codec is taken from the file */
+    bptree::HeapFile heap_file(path, false, 4096);
+    EXPECT_TRUE(heap_file.is_compressed());
+    EXPECT_EQ(heap_file.get_num_free_pages(), N / 2);
+
+    for (int i = 0; i < N / 2; i++) {
+        bptree::Page expected(i + 1, 4096);
+        fill(expected, i);
+
+        bptree::Page page(i + 1, 4096);
+        boost::upgrade_lock<bptree::Page> lock(page);
+        boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+        heap_file.read_page(&page, ulock);
+
+        /* but for the checksum and the page ID set on write */
+        boost::upgrade_lock<bptree::Page> expected_lock(expected);
+        const auto* buf = page.get_buffer(ulock);
+        const auto* expected_buf = expected.get_buffer(expected_lock);
+        ASSERT_EQ(::memcmp(buf, expected_buf, bptree::Page::CHECKSUM_OFFSET),
+                  0);
+        ASSERT_EQ(::memcmp(&buf[bptree::Page::HEADER_SIZE],
+                           &expected_buf[bptree::Page::HEADER_SIZE],
+                           4096 - bptree::Page::HEADER_SIZE),
+                  0);
+    }
+
+    /* the sectors of the freed pages at the end are truncated */
+    size_t size = file_size(path);
+    EXPECT_EQ(heap_file.shrink(), N / 2);
+    EXPECT_LT(file_size(path), size);
+
+    std::remove(path.c_str());
+}
+
+TEST(HeapFileTest, Crc32c)
+{
+    const char* check = "123456789";
+    EXPECT_EQ(bptree::crc32c((const uint8_t*)check, 9), 0xE3069283);
+    EXPECT_EQ(bptree::crc32c_sw((const uint8_t*)check, 9), 0xE3069283);
+
+    /* unaligned lengths, chained over two parts */
+    std::vector<uint8_t> buf(1000);
+    std::mt19937 rng(0);
+    for (auto&& b : buf) {
+        b = rng();
+    }
+    for (size_t len : {0, 1, 7, 8, 13, 64, 999}) {
+        uint32_t crc = bptree::crc32c_sw(&buf[1], len);
+        EXPECT_EQ(bptree::crc32c(&buf[1], len), crc);
+        EXPECT_EQ(bptree::crc32c(&buf[1 + len / 3], len - len / 3,
+                                 bptree::crc32c(&buf[1], len / 3)),
+                  crc);
+    }
+}
+
+/* overwrite part of a page in the file behind the heap file's back */
+static void write_raw(const std::string& path, off64_t offset, const void* buf,
+                      size_t len)
+{
+    int fd = ::open(path.c_str(), O_WRONLY);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(::pwrite(fd, buf, len, offset), (ssize_t)len);
+    ::close(fd);
+}
+
+static void read_one(bptree::HeapFile& heap_file, bptree::PageID pid)
+{
+    bptree::Page page(pid, 4096);
+    boost::upgrade_lock<bptree::Page> lock(page);
+    boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+    heap_file.read_page(&page, ulock);
+}
+
+TEST(HeapFileTest, Checksums)
+{
+    auto path = heap_file_path("checksums");
+    std::remove(path.c_str());
+
+    auto create = [&](const bptree::HeapFileOptions& options) {
+        std::remove(path.c_str());
+        bptree::HeapFile heap_file(path, true, 4096, options);
+        EXPECT_EQ(heap_file.has_checksums(), options.page_checksums);
+
+        for (int i = 0; i < 8; i++) {
+            bptree::Page page(heap_file.new_page(), 4096);
+            boost::upgrade_lock<bptree::Page> lock(page);
+            {
+                boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+                ::memset(page.get_buffer(ulock), 'a' + i, 4096);
+            }
+            heap_file.write_page(&page, lock);
+        }
+        /* allocated but never written */
+        heap_file.new_page();
+    };
+
+    bptree::HeapFileOptions options;
+    create(options);
+
+    /* a flipped bit, a torn write that left half of the page old and a
+     * page written to the wrong place */
+    char garbage[2048];
+    ::memset(garbage, 'z', sizeof(garbage));
+    write_raw(path, 2 * 4096 + 100, "\x01", 1);
+    write_raw(path, 3 * 4096 + 2048, garbage, 2048);
+    {
+        std::vector<char> page1(4096);
+        int fd = ::open(path.c_str(), O_RDONLY);
+        ASSERT_EQ(::pread(fd, page1.data(), 4096, 4096), 4096);
+        ::close(fd);
+        write_raw(path, 4 * 4096, page1.data(), 4096);
+    }
+
+    {
+        bptree::HeapFile heap_file(path, false, 4096);
+        EXPECT_TRUE(heap_file.has_checksums());
+
+        read_one(heap_file, 1);
+        read_one(heap_file, 9);
+        EXPECT_THROW(read_one(heap_file, 2), bptree::ChecksumException);
+        EXPECT_THROW(read_one(heap_file, 3), bptree::ChecksumException);
+        try {
+            read_one(heap_file, 4);
+            ADD_FAILURE() << "misdirected page not detected";
+        } catch (bptree::ChecksumException& e) {
+            EXPECT_NE(std::string(e.what()).find("holds page (1)"),
+                      std::string::npos);
+        }
+    }
+
+    /* lazily verified pages are checked once after the file is opened */
+    {
+        options.verify_checksums = bptree::ChecksumVerification::FIRST_READ;
+        bptree::HeapFile heap_file(path, false, 4096, options);
+
+        read_one(heap_file, 5);
+        write_raw(path, 5 * 4096 + 100, "\x01", 1);
+        read_one(heap_file, 5);
+        EXPECT_THROW(read_one(heap_file, 2), bptree::ChecksumException);
+        EXPECT_THROW(read_one(heap_file, 2), bptree::ChecksumException);
+    }
+
+    /* the setting is taken from the file */
+    options = bptree::HeapFileOptions{};
+    options.page_checksums = false;
+    create(options);
+    write_raw(path, 2 * 4096 + 100, "\x01", 1);
+    {
+        bptree::HeapFile heap_file(path, false, 4096);
+        EXPECT_FALSE(heap_file.has_checksums());
+        read_one(heap_file, 2);
+    }
+
+    std::remove(path.c_str());
+}
@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include "bptree/node_search.h"
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+/* compare the search kernels, with and without a key summary, with
+ * std::lower_bound()/std::upper_bound() on sorted keys with duplicates, for
+ * all node sizes up to max_size and for keys below, between, on and above
+ * the stored ones */
+template <typename K> static void check_search(size_t max_size)
+{
+    static_assert(bptree::is_simd_searchable<K, std::less<K>>::value);
+
+    std::mt19937_64 rng(0);
+    std::uniform_int_distribution<K> dist(std::numeric_limits<K>::min() + 1,
+                                          std::numeric_limits<K>::max() - 1);
+    std::less<K> kcmp;
+
+    for (size_t n = 0; n <= max_size; n++) {
+        std::vector<K> keys(n);
+        for (size_t i = 0; i < n; i++) {
+            /* every fourth key repeats the previous one */
+            keys[i] = (i % 4 == 3) ? keys[i - 1] : dist(rng);
+        }
+        std::sort(keys.begin(), keys.end());
+
+        bptree::KeySummary<K, std::less<K>> summary;
+        summary.build(keys.data(), n);
+
+        std::vector<K> probes = {std::numeric_limits<K>::min(),
+                                 std::numeric_limits<K>::max()};
+        for (auto key : keys) {
+            probes.push_back(key);
+            probes.push_back(key + 1);
+        }
+
+        for (auto key : probes) {
+            size_t lower =
+                std::lower_bound(keys.begin(), keys.end(), key) - keys.begin();
+            size_t upper =
+                std::upper_bound(keys.begin(), keys.end(), key) - keys.begin();
+
+            ASSERT_EQ(bptree::node_lower_bound(keys.data(), n, key, kcmp),
+                      lower);
+            ASSERT_EQ(bptree::node_upper_bound(keys.data(), n, key, kcmp),
+                      upper);
+            ASSERT_EQ(summary.lower_bound(keys.data(), n, key, kcmp), lower);
+            ASSERT_EQ(summary.upper_bound(keys.data(), n, key, kcmp), upper);
+        }
+    }
+}
+
+TEST(NodeSearchTest, Unsigned64) { check_search<uint64_t>(300); }
+
+TEST(NodeSearchTest, Unsigned32) { check_search<uint32_t>(300); }
+
+TEST(NodeSearchTest, Signed64) { check_search<int64_t>(300); }
+
+TEST(NodeSearchTest, Signed32) { check_search<int32_t>(300); }
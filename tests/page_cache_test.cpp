@@ -0,0 +1,745 @@
+#include <gtest/gtest.h>
+
+#include "bptree/heap_page_cache.h"
+#include "bptree/tree.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std::chrono;
+
+using KeyType = uint64_t;
+using ValueType = uint64_t;
+
+static std::string heap_file_path(const char* name)
+{
+    return std::string("/tmp/bptree_") + name + "_" + std::to_string(getpid()) +
+           ".heap";
+}
+
+TEST(PageCacheTest, DirtyFlagSurvivesCleanUnpin)
+{
+    auto path = heap_file_path("dirty_flag");
+    std::remove(path.c_str());
+
+    bptree::HeapPageCache page_cache(path, true, 16);
+
+    boost::upgrade_lock<bptree::Page> lock;
+    auto* page = page_cache.new_page(lock);
+    auto id = page->get_id();
+    page_cache.unpin_page(page, true, lock);
+    lock.unlock();
+
+    EXPECT_TRUE(page->is_dirty());
+    EXPECT_EQ(page_cache.get_dirty_page_count(), 1);
+
+    page = page_cache.fetch_page(id, lock);
+    page_cache.unpin_page(page, false, lock);
+    lock.unlock();
+
+    EXPECT_TRUE(page->is_dirty());
+
+    page_cache.flush_all_pages();
+    EXPECT_FALSE(page->is_dirty());
+    EXPECT_EQ(page_cache.get_dirty_page_count(), 0);
+
+    std::remove(path.c_str());
+}
+
+static void write_back_reopen(const bptree::PageCacheOptions& options,
+                              const char* name)
+{
+    const int N = 10000;
+    auto path = heap_file_path(name);
+    std::remove(path.c_str());
+
+    {
+        /* small cache to force write-back on eviction */
+        bptree::HeapPageCache page_cache(path, true, 32, 4096, options);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        for (int i = 0; i < N; i++) {
+            tree.insert(i, i + 1);
+        }
+    }
+
+    {
+        bptree::HeapPageCache page_cache(path, false, 32, 4096, options);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        EXPECT_EQ(tree.size(), N);
+        for (int i = 0; i < N; i++) {
+            std::vector<ValueType> values;
+            tree.get_value(i, values);
+            EXPECT_EQ(values.size(), 1);
+            if (values.size() == 1) {
+                EXPECT_EQ(values.front(), i + 1);
+            }
+        }
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(PageCacheTest, WriteBackPersistsOnReopen)
+{
+    write_back_reopen(bptree::PageCacheOptions{}, "write_back");
+}
+
+TEST(PageCacheTest, AsyncWriteBackPersistsOnReopen)
+{
+    bptree::PageCacheOptions options;
+    options.heap_file.use_io_uring = true;
+    options.write_back_batch = 8;
+
+    write_back_reopen(options, "async_write_back");
+}
+
+TEST(PageCacheTest, CompressedWriteBackPersistsOnReopen)
+{
+    bptree::PageCacheOptions options;
+    options.heap_file.compression = bptree::PageCompression::DELTA_VARINT;
+    /* compressed files fall back to synchronous I/O */
+    options.heap_file.use_io_uring = true;
+
+    write_back_reopen(options, "compressed_write_back");
+}
+
+TEST(PageCacheTest, NodesPinTheirFrames)
+{
+    const int N = 20000;
+    const size_t max_pages = 64;
+    auto path = heap_file_path("node_frames");
+    std::remove(path.c_str());
+
+    {
+        bptree::HeapPageCache page_cache(path, true, max_pages);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        for (int i = 0; i < N; i++) {
+            tree.insert(i, i + 1);
+
+            /* decoded nodes never take more than their share of the pool */
+            auto stats = tree.get_node_cache_stats();
+            ASSERT_LE(stats.pinned_pages, max_pages / 2 + 8);
+        }
+
+        auto stats = tree.get_node_cache_stats();
+        EXPECT_EQ(stats.budget, max_pages / 2 * page_cache.get_page_size());
+        EXPECT_GT(stats.evictions, 0);
+
+        for (int i = 0; i < N; i++) {
+            std::vector<ValueType> values;
+            tree.get_value(i, values);
+            ASSERT_EQ(values.size(), 1);
+            EXPECT_EQ(values.front(), i + 1);
+        }
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(PageCacheTest, BackgroundFlusher)
+{
+    auto path = heap_file_path("flusher");
+    std::remove(path.c_str());
+
+    bptree::PageCacheOptions options;
+    options.background_flush = true;
+    options.max_dirty_age = milliseconds(10);
+    options.flush_interval = milliseconds(5);
+    bptree::HeapPageCache page_cache(path, true, 16, 4096, options);
+
+    boost::upgrade_lock<bptree::Page> lock;
+    auto* page = page_cache.new_page(lock);
+    page_cache.unpin_page(page, true, lock);
+    lock.unlock();
+
+    auto deadline = steady_clock::now() + seconds(5);
+    while (page_cache.get_dirty_page_count() > 0 &&
+           steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(milliseconds(5));
+    }
+
+    EXPECT_EQ(page_cache.get_dirty_page_count(), 0);
+
+    std::remove(path.c_str());
+}
+
+TEST(PageCacheTest, PrefetchPages)
+{
+    const int N = 64;
+    auto path = heap_file_path("prefetch");
+    std::remove(path.c_str());
+
+    std::vector<bptree::PageID> ids;
+    {
+        bptree::HeapPageCache page_cache(path, true, N);
+
+        for (int i = 0; i < N; i++) {
+            boost::upgrade_lock<bptree::Page> lock;
+            auto* page = page_cache.new_page(lock);
+            {
+                boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+                page->get_buffer(ulock)[0] = (uint8_t)i;
+            }
+            ids.push_back(page->get_id());
+            page_cache.unpin_page(page, true, lock);
+        }
+    }
+
+    bptree::PageCacheOptions options;
+    options.heap_file.use_io_uring = true;
+    bptree::HeapPageCache page_cache(path, false, N / 2, 4096, options);
+
+    /* only half of the pages fit in the cache */
+    page_cache.prefetch_pages(ids.data(), ids.size());
+    EXPECT_EQ(page_cache.size(), N / 2);
+
+    for (int i = 0; i < N; i++) {
+        boost::upgrade_lock<bptree::Page> lock;
+        auto* page = page_cache.fetch_page(ids[i], lock);
+        ASSERT_NE(page, nullptr);
+        EXPECT_EQ(page->get_buffer(lock)[0], (uint8_t)i);
+        page_cache.unpin_page(page, false, lock);
+    }
+
+    std::remove(path.c_str());
+}
+
+static void concurrent_fetch(bptree::ReplacementPolicy policy, const char* name)
+{
+    const int N = 256;
+    auto path = heap_file_path(name);
+    std::remove(path.c_str());
+
+    bptree::PageCacheOptions options;
+    options.replacement_policy = policy;
+    options.num_shards = 4;
+    bptree::HeapPageCache page_cache(path, true, 32, 4096, options);
+
+    std::vector<bptree::PageID> ids;
+    for (int i = 0; i < N; i++) {
+        boost::upgrade_lock<bptree::Page> lock;
+        auto* page = page_cache.new_page(lock);
+        {
+            boost::upgrade_to_unique_lock<bptree::Page> ulock(lock);
+            *reinterpret_cast<bptree::PageID*>(page->get_buffer(ulock)) =
+                page->get_id();
+        }
+        ids.push_back(page->get_id());
+        page_cache.unpin_page(page, true, lock);
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; i++) {
+        threads.emplace_back([i, &ids, &page_cache]() {
+            std::mt19937 rng(i);
+            /* skewed accesses: half of them go to 8 hot pages */
+            std::uniform_int_distribution<int> dist(0, N - 1);
+            for (int j = 0; j < 2000; j++) {
+                auto id = ids[(j & 1) ? dist(rng) : dist(rng) % 8];
+                boost::upgrade_lock<bptree::Page> lock;
+                auto* page = page_cache.fetch_page(id, lock);
+                ASSERT_NE(page, nullptr);
+                EXPECT_EQ(page->get_id(), id);
+                EXPECT_EQ(*reinterpret_cast<const bptree::PageID*>(
+                              page->get_buffer(lock)),
+                          id);
+                page_cache.unpin_page(page, false, lock);
+            }
+        });
+    }
+
+    for (auto&& t : threads) {
+        t.join();
+    }
+
+    EXPECT_EQ(page_cache.size(), 32);
+    std::remove(path.c_str());
+}
+
+TEST(PageCacheTest, ConcurrentFetchClock)
+{
+    concurrent_fetch(bptree::ReplacementPolicy::CLOCK, "fetch_clock");
+}
+
+TEST(PageCacheTest, ConcurrentFetchTwoQ)
+{
+    concurrent_fetch(bptree::ReplacementPolicy::TWO_Q, "fetch_2q");
+}
+
+TEST(PageCacheTest, FreedPagesAreReused)
+{
+    const int N = 20000;
+    auto path = heap_file_path("free_pages");
+    std::remove(path.c_str());
+
+    {
+        bptree::HeapPageCache page_cache(path, true, 256);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        for (int i = 0; i < N; i++) {
+            tree.insert(i, i);
+        }
+        page_cache.flush_all_pages();
+
+        struct stat sbuf;
+        ASSERT_EQ(::stat(path.c_str(), &sbuf), 0);
+        auto file_size = sbuf.st_size;
+
+        for (int round = 0; round < 3; round++) {
+            for (int i = 0; i < N; i++) {
+                ASSERT_EQ(tree.erase(i), 1);
+            }
+            for (int i = 0; i < N; i++) {
+                tree.insert(i, i + round);
+            }
+        }
+        page_cache.flush_all_pages();
+
+        /* pages of merged nodes are reused by later splits */
+        ASSERT_EQ(::stat(path.c_str(), &sbuf), 0);
+        EXPECT_LE(sbuf.st_size, file_size + 64 * 4096);
+
+        for (int i = 0; i < N; i++) {
+            std::vector<ValueType> values;
+            tree.get_value(i, values);
+            ASSERT_EQ(values.size(), 1);
+            EXPECT_EQ(values.front(), i + 2);
+        }
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(PageCacheTest, PinnedPageIsFreedOnUnpin)
+{
+    auto path = heap_file_path("free_pinned");
+    std::remove(path.c_str());
+
+    {
+        bptree::HeapPageCache page_cache(path, true, 16);
+        auto* heap_file = page_cache.get_heap_file();
+
+        boost::upgrade_lock<bptree::Page> lock;
+        auto* page = page_cache.new_page(lock);
+        auto pid = page->get_id();
+        page_cache.unpin_page(page, true, lock);
+        lock.unlock();
+
+        /* pinned by e.g. an iterator while its node is freed */
+        page = page_cache.fetch_page(pid, lock);
+        ASSERT_NE(page, nullptr);
+        lock.unlock();
+        auto free_pages = heap_file->get_num_free_pages();
+        page_cache.free_page(pid);
+        EXPECT_EQ(heap_file->get_num_free_pages(), free_pages);
+
+        lock = boost::upgrade_lock<bptree::Page>(*page);
+        page_cache.unpin_page(page, false, lock);
+        lock.unlock();
+        EXPECT_EQ(heap_file->get_num_free_pages(), free_pages + 1);
+
+        page = page_cache.new_page(lock);
+        EXPECT_EQ(page->get_id(), pid);
+        page_cache.unpin_page(page, true, lock);
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST(PageCacheTest, CompactTree)
+{
+    const int N = 50000;
+    auto path = heap_file_path("compact");
+    std::remove(path.c_str());
+
+    {
+        bptree::HeapPageCache page_cache(path, true, 256);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        for (int i = 0; i < N; i++) {
+            tree.insert(i, i);
+        }
+        /* keep the high key range, whose nodes are at the end of the file */
+        for (int i = 0; i < N - N / 10; i++) {
+            ASSERT_EQ(tree.erase(i), 1);
+        }
+
+        size_t num_pages = page_cache.get_heap_file()->get_num_pages();
+        tree.compact();
+        /* the old pages of moved nodes are truncated by the second pass */
+        tree.compact();
+        EXPECT_LT(page_cache.get_heap_file()->get_num_pages() * 4, num_pages);
+    }
+
+    bptree::HeapPageCache page_cache(path, false, 256);
+    bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+    EXPECT_EQ(tree.size(), N / 10);
+    for (int i = N - N / 10; i < N; i++) {
+        std::vector<ValueType> values;
+        tree.get_value(i, values);
+        ASSERT_EQ(values.size(), 1);
+        EXPECT_EQ(values.front(), i);
+    }
+
+    /* the sibling links of moved leaves are updated */
+    KeyType expected = N - N / 10;
+    for (auto it = tree.begin(); it != tree.end(); it++) {
+        EXPECT_EQ(it->first, expected++);
+    }
+    EXPECT_EQ(expected, N);
+
+    std::remove(path.c_str());
+}
+
+TEST(PageCacheTest, BulkLoadPersists)
+{
+    const int N = 100000;
+    auto path = heap_file_path("bulk_load");
+    std::remove(path.c_str());
+
+    {
+        bptree::HeapPageCache page_cache(path, true, 256);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        KeyType next = 0;
+        tree.bulk_load([&next](KeyType& key, ValueType& value) {
+            if (next == N) return false;
+            key = next;
+            value = next * 2;
+            next++;
+            return true;
+        });
+
+        /* full leaves, a few inner nodes and the pages of the meta page and
+         * the initial root */
+        size_t leaves = (N + 62) / 63;
+        EXPECT_LT(page_cache.get_heap_file()->get_num_pages(),
+                  leaves + leaves / 32 + 8);
+    }
+
+    bptree::HeapPageCache page_cache(path, false, 256);
+    bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+    EXPECT_EQ(tree.size(), N);
+    for (int i = 0; i < N; i++) {
+        std::vector<ValueType> values;
+        tree.get_value(i, values);
+        ASSERT_EQ(values.size(), 1);
+        EXPECT_EQ(values.front(), 2 * i);
+    }
+
+    std::remove(path.c_str());
+}
+
+static void copy_file(const std::string& from, const std::string& to)
+{
+    std::ifstream in(from, std::ios::binary);
+    std::ofstream out(to, std::ios::binary | std::ios::trunc);
+    out << in.rdbuf();
+}
+
+/* copies of the heap file and the log taken while the tree is open stand
+ * in for the files left by a crash */
+static void crash_recovery(bptree::PageCacheOptions options, const char* name,
+                           size_t max_pages = 32, int num_threads = 1)
+{
+    const int N = 20000;
+    auto path = heap_file_path(name);
+    auto crash_path = path + ".crash";
+    std::remove(path.c_str());
+    std::remove((path + ".wal").c_str());
+
+    options.wal.enabled = true;
+    {
+        /* a cache smaller than the tree writes back pages before the
+         * crash */
+        bptree::HeapPageCache page_cache(path, true, max_pages, 4096,
+                                         options);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        for (int i = 0; i < N / 2; i++) {
+            tree.insert(i, i + 1);
+        }
+        tree.checkpoint();
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < num_threads; t++) {
+            threads.emplace_back([&tree, t, num_threads]() {
+                for (int i = N / 2 + t; i < N; i += num_threads) {
+                    tree.insert(i, i + 1);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        for (int i = 0; i < N; i += 3) {
+            tree.erase(i);
+        }
+        tree.update(1, 100);
+
+        auto* wal = page_cache.get_wal();
+        wal->flush(wal->get_end_lsn());
+        copy_file(path, crash_path);
+        copy_file(path + ".wal", crash_path + ".wal");
+    }
+
+    {
+        bptree::HeapPageCache page_cache(crash_path, false, max_pages, 4096,
+                                         options);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        EXPECT_EQ(tree.size(), N - (N + 2) / 3);
+        for (int i = 0; i < N; i++) {
+            std::vector<ValueType> values;
+            tree.get_value(i, values);
+            if (i % 3 == 0) {
+                EXPECT_TRUE(values.empty());
+            } else {
+                ASSERT_EQ(values.size(), 1);
+                EXPECT_EQ(values.front(), i == 1 ? 100 : i + 1);
+            }
+        }
+
+        /* the recovered tree takes new updates */
+        for (int i = 0; i < N; i += 3) {
+            tree.insert(i, i + 1);
+        }
+        EXPECT_EQ(tree.size(), N);
+    }
+
+    /* a clean close leaves an empty log */
+    {
+        bptree::HeapPageCache page_cache(crash_path, false, max_pages, 4096,
+                                         options);
+        auto* wal = page_cache.get_wal();
+        EXPECT_EQ(wal->get_stable_lsn(), wal->get_end_lsn());
+
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+        EXPECT_EQ(tree.size(), N);
+    }
+
+    for (const auto& p : {path, crash_path}) {
+        std::remove(p.c_str());
+        std::remove((p + ".wal").c_str());
+    }
+}
+
+TEST(PageCacheTest, CrashRecovery)
+{
+    crash_recovery(bptree::PageCacheOptions{}, "crash_recovery");
+}
+
+TEST(PageCacheTest, CompressedCrashRecovery)
+{
+    bptree::PageCacheOptions options;
+    options.heap_file.compression = bptree::PageCompression::DELTA_VARINT;
+
+    crash_recovery(options, "compressed_crash_recovery");
+}
+
+TEST(PageCacheTest, ConcurrentCrashRecovery)
+{
+    /* concurrent writers pin the pages of their mini-transactions and keep
+     * retired nodes alive, the cache holds the whole tree */
+    crash_recovery(bptree::PageCacheOptions{}, "concurrent_crash_recovery",
+                   4096, 4);
+}
+
+TEST(PageCacheTest, CrashRecoveryReusesFreedPages)
+{
+    const int N = 20000;
+    auto path = heap_file_path("crash_recovery_reuse");
+    auto crash_path = path + ".crash";
+    std::remove(path.c_str());
+    std::remove((path + ".wal").c_str());
+
+    bptree::PageCacheOptions options;
+    options.wal.enabled = true;
+    {
+        bptree::HeapPageCache page_cache(path, true, 4096, 4096, options);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        for (int i = 0; i < N; i++) {
+            tree.insert(i, i + 1);
+        }
+        for (int i = 0; i < N; i++) {
+            if (i % 50) tree.erase(i);
+        }
+
+        /* the checkpoint writes the free list to trunk pages, which the
+         * inserts below reuse for new nodes that are only in the log */
+        tree.checkpoint();
+        for (int i = N; i < 2 * N; i++) {
+            tree.insert(i, i + 1);
+        }
+
+        auto* wal = page_cache.get_wal();
+        wal->flush(wal->get_end_lsn());
+        copy_file(path, crash_path);
+        copy_file(path + ".wal", crash_path + ".wal");
+    }
+
+    {
+        bptree::HeapPageCache page_cache(crash_path, false, 4096, 4096,
+                                         options);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        EXPECT_EQ(tree.size(), N / 50 + N);
+        for (int i = 0; i < 2 * N; i++) {
+            std::vector<ValueType> values;
+            tree.get_value(i, values);
+            if (i < N && i % 50) {
+                EXPECT_TRUE(values.empty());
+            } else {
+                ASSERT_EQ(values.size(), 1);
+                EXPECT_EQ(values.front(), i + 1);
+            }
+        }
+    }
+
+    for (const auto& p : {path, crash_path}) {
+        std::remove(p.c_str());
+        std::remove((p + ".wal").c_str());
+    }
+}
+
+TEST(PageCacheTest, CrashRecoveryRepairsTornPages)
+{
+    const int N = 20000;
+    auto path = heap_file_path("crash_recovery_torn");
+    auto crash_path = path + ".crash";
+    std::remove(path.c_str());
+    std::remove((path + ".wal").c_str());
+
+    bptree::PageCacheOptions options;
+    options.wal.enabled = true;
+    bptree::PageID torn_pid;
+    {
+        bptree::HeapPageCache page_cache(path, true, 4096, 4096, options);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        for (int i = 0; i < N / 2; i++) {
+            tree.insert(i, i + 1);
+        }
+        tree.checkpoint();
+
+        /* the nodes split off after the checkpoint are logged as images */
+        torn_pid = page_cache.get_heap_file()->get_num_pages();
+        for (int i = N / 2; i < N; i++) {
+            tree.insert(i, i + 1);
+        }
+        ASSERT_LT(torn_pid, page_cache.get_heap_file()->get_num_pages());
+
+        auto* wal = page_cache.get_wal();
+        wal->flush(wal->get_end_lsn());
+        copy_file(path, crash_path);
+        copy_file(path + ".wal", crash_path + ".wal");
+    }
+
+    /* the write-back of the page was cut short by the crash */
+    {
+        std::fstream file(crash_path,
+                          std::ios::binary | std::ios::in | std::ios::out);
+        std::string garbage(2048, 'z');
+        file.seekp((std::streamoff)torn_pid * 4096);
+        file.write(garbage.data(), garbage.size());
+    }
+
+    {
+        bptree::HeapPageCache page_cache(crash_path, false, 4096, 4096,
+                                         options);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        EXPECT_EQ(tree.size(), N);
+        for (int i = 0; i < N; i++) {
+            std::vector<ValueType> values;
+            tree.get_value(i, values);
+            ASSERT_EQ(values.size(), 1);
+            EXPECT_EQ(values.front(), i + 1);
+        }
+    }
+
+    for (const auto& p : {path, crash_path}) {
+        std::remove(p.c_str());
+        std::remove((p + ".wal").c_str());
+    }
+}
+
+TEST(PageCacheTest, BackgroundCheckpoint)
+{
+    const int N = 20000;
+    const size_t LOG_SIZE = 64 << 10;
+    auto path = heap_file_path("background_checkpoint");
+    auto crash_path = path + ".crash";
+
+    bptree::PageCacheOptions options;
+    options.wal.enabled = true;
+    options.wal.checkpoint_log_size = LOG_SIZE;
+    {
+        bptree::HeapPageCache page_cache(path, true, 4096, 4096, options);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+        auto* wal = page_cache.get_wal();
+
+        for (int i = 0; i < N; i++) {
+            tree.insert(i, i + 1);
+        }
+        EXPECT_GT(wal->get_end_lsn(), 4 * LOG_SIZE);
+
+        /* the checkpointer truncates the log in the background */
+        auto wait_for_checkpoint = [wal, LOG_SIZE]() {
+            auto deadline =
+                std::chrono::steady_clock::now() + std::chrono::seconds(10);
+            while (wal->get_log_size() >= LOG_SIZE &&
+                   std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            return wal->get_log_size() < LOG_SIZE;
+        };
+        ASSERT_TRUE(wait_for_checkpoint());
+
+        /* the changes after the last checkpoint are recovered from the log,
+         * the pair count from the meta page and the log */
+        for (int i = 0; i < N; i += 2) {
+            tree.erase(i);
+        }
+        tree.insert(N, N + 1);
+        ASSERT_TRUE(wait_for_checkpoint());
+
+        wal->flush(wal->get_end_lsn());
+        copy_file(path, crash_path);
+        copy_file(path + ".wal", crash_path + ".wal");
+    }
+
+    {
+        bptree::HeapPageCache page_cache(crash_path, false, 4096, 4096,
+                                         options);
+        bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+
+        EXPECT_EQ(tree.size(), N / 2 + 1);
+        for (int i = 0; i <= N; i++) {
+            std::vector<ValueType> values;
+            tree.get_value(i, values);
+            if (i % 2 == 0 && i != N) {
+                EXPECT_TRUE(values.empty());
+            } else {
+                ASSERT_EQ(values.size(), 1);
+                EXPECT_EQ(values.front(), i + 1);
+            }
+        }
+    }
+
+    for (const auto& p : {path, crash_path}) {
+        std::remove(p.c_str());
+        std::remove((p + ".wal").c_str());
+    }
+}
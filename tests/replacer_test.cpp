@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+
+#include "bptree/replacer.h"
+
+static bool all_evictable(size_t) { return true; }
+
+TEST(ReplacerTest, ClockSecondChance)
+{
+    bptree::ClockReplacer replacer(4);
+
+    for (size_t i = 0; i < 4; i++) {
+        replacer.record_insert(i, i + 1);
+    }
+
+    /* all reference bits are set after insertion, the first sweep clears
+     * them and the second one evicts frame 0 */
+    size_t frame;
+    ASSERT_TRUE(replacer.victim(all_evictable, frame));
+    EXPECT_EQ(frame, 0);
+    replacer.record_remove(frame);
+
+    /* frame 1 is referenced again and gets a second chance */
+    replacer.record_access(1);
+    ASSERT_TRUE(replacer.victim(all_evictable, frame));
+    EXPECT_EQ(frame, 2);
+    replacer.record_remove(frame);
+
+    /* pinned frames are skipped */
+    ASSERT_TRUE(replacer.victim([](size_t f) { return f != 3; }, frame));
+    EXPECT_EQ(frame, 1);
+    replacer.record_remove(frame);
+
+    EXPECT_FALSE(replacer.victim([](size_t f) { return f != 3; }, frame));
+}
+
+TEST(ReplacerTest, TwoQScanResistance)
+{
+    const size_t N = 8;
+    bptree::TwoQReplacer replacer(N);
+
+    /* page 100 is loaded, evicted from A1in and re-referenced, so it is
+     * promoted to Am */
+    replacer.record_insert(0, 100);
+    size_t frame;
+    ASSERT_TRUE(replacer.victim(all_evictable, frame));
+    EXPECT_EQ(frame, 0);
+    replacer.record_remove(frame);
+    replacer.record_insert(0, 100);
+    replacer.record_access(0);
+
+    /* a scan of pages that are referenced only once */
+    for (size_t i = 1; i < N; i++) {
+        replacer.record_insert(i, 1000 + i);
+    }
+
+    /* the scan pages are evicted before the hot page */
+    for (size_t i = 1; i < N; i++) {
+        ASSERT_TRUE(replacer.victim(all_evictable, frame));
+        EXPECT_NE(frame, 0);
+        replacer.record_remove(frame);
+        replacer.record_insert(frame, 2000 + i);
+    }
+}
@@ -4,10 +4,12 @@
 #include "bptree/mem_page_cache.h"
 #include "bptree/tree.h"
 
+#include <algorithm>
 #include <chrono>
 #include <cstdio>
 #include <cstdlib>
 #include <iostream>
+#include <random>
 #include <thread>
 
 using namespace std::chrono;
@@ -54,7 +56,7 @@ TEST(TreeTest, HandleConcurrentInsert)
 {
     bptree::MemPageCache page_cache(4096);
     const int N = 1000;
-    bptree::BTree<256, KeyType, ValueType> tree(&page_cache);
+    bptree::BTree<255, KeyType, ValueType> tree(&page_cache);
 
     high_resolution_clock::time_point t1 = high_resolution_clock::now();
 
@@ -122,3 +124,1006 @@ TEST(TreeTest, TreeIterator)
 
     EXPECT_EQ(sum1, sum2);
 }
+
+TEST(TreeTest, BoundedNodeCache)
+{
+    const int N = 100000;
+    const size_t budget = 64 * 1024;
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<32, KeyType, ValueType> tree(&page_cache, budget);
+
+    for (int i = 0; i < N; i++) {
+        tree.insert(i, i + 1);
+    }
+
+    auto stats = tree.get_node_cache_stats();
+    EXPECT_EQ(stats.budget, budget);
+    EXPECT_GT(stats.evictions, 0);
+    EXPECT_LE(stats.usage, budget);
+
+    for (int i = 0; i < N; i++) {
+        std::vector<ValueType> values;
+        tree.get_value(i, values);
+        ASSERT_EQ(values.size(), 1);
+        EXPECT_EQ(values.front(), i + 1);
+    }
+
+    EXPECT_LE(tree.get_node_cache_stats().usage, budget);
+
+    /* nodes read back from the page cache do not restart the lookup */
+    EXPECT_EQ(tree.get_restart_stats().lookups, 0);
+}
+
+TEST(TreeTest, BoundedNodeCacheConcurrent)
+{
+    const int N = 5000;
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<16, KeyType, ValueType> tree(&page_cache, 16 * 1024);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([i, &tree]() {
+            std::vector<ValueType> values;
+            for (int j = 0; j < N; j++) {
+                tree.insert(i * N + j, j);
+
+                /* look up a key inserted earlier by this thread */
+                int k = rand() % (j + 1);
+                values.clear();
+                tree.get_value(i * N + k, values);
+                EXPECT_EQ(values.size(), 1);
+                if (values.size() == 1) {
+                    EXPECT_EQ(values.front(), k);
+                }
+            }
+        });
+    }
+
+    for (auto&& p : threads) {
+        p.join();
+    }
+
+    EXPECT_EQ(tree.size(), 4 * N);
+    EXPECT_GT(tree.get_node_cache_stats().evictions, 0);
+}
+
+/* same encoding as CopySerializer but does not qualify for the in-place
+ * node format */
+template <typename T> class PlainCopySerializer : public bptree::CopySerializer<T> {};
+
+TEST(TreeTest, InPlaceNodeFormat)
+{
+    using InPlaceTree = bptree::BTree<64, KeyType, ValueType>;
+    using CopyTree =
+        bptree::BTree<64, KeyType, ValueType, PlainCopySerializer<KeyType>,
+                      std::less<KeyType>, std::equal_to<KeyType>,
+                      PlainCopySerializer<ValueType>>;
+    static_assert(bptree::LeafNode<64, KeyType, ValueType>::IN_PLACE);
+    static_assert(!bptree::LeafNode<64, KeyType, ValueType,
+                                    PlainCopySerializer<KeyType>>::IN_PLACE);
+
+    const int N = 10000;
+    bptree::MemPageCache page_cache(4096);
+    bptree::MemPageCache copy_page_cache(4096);
+    uint64_t in_place_bytes, copy_bytes;
+
+    {
+        InPlaceTree tree(&page_cache);
+        CopyTree copy_tree(&copy_page_cache);
+
+        for (int i = 0; i < N; i++) {
+            tree.insert(i, i + 1);
+            copy_tree.insert(i, i + 1);
+        }
+
+        in_place_bytes = tree.get_node_bytes_copied();
+        copy_bytes = copy_tree.get_node_bytes_copied();
+    }
+
+    /* only the node header is written back by the in-place format */
+    EXPECT_LT(in_place_bytes * 100, copy_bytes);
+
+    /* both formats have the same page layout */
+    CopyTree tree(&page_cache);
+    EXPECT_EQ(tree.size(), N);
+    for (int i = 0; i < N; i++) {
+        std::vector<ValueType> values;
+        tree.get_value(i, values);
+        ASSERT_EQ(values.size(), 1);
+        EXPECT_EQ(values.front(), i + 1);
+    }
+}
+
+TEST(TreeTest, EraseAndUpdate)
+{
+    const int N = 20000;
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<16, KeyType, ValueType> tree(&page_cache);
+
+    for (int i = 0; i < N; i++) {
+        tree.insert(i, i);
+    }
+    tree.insert(0, 1);
+    size_t full_pages = page_cache.size();
+
+    EXPECT_TRUE(tree.update(1, 100));
+    EXPECT_FALSE(tree.update(N, 100));
+    tree.upsert(2, 200);
+    tree.upsert(N, N);
+    EXPECT_EQ(tree.size(), N + 2);
+
+    EXPECT_EQ(tree.erase(0, 1), 1);
+    EXPECT_EQ(tree.erase(0, 1), 0);
+    EXPECT_EQ(tree.erase(N + 1), 0);
+
+    /* remove all but every 16th key */
+    for (int i = 0; i <= N; i++) {
+        if (i % 16) {
+            EXPECT_EQ(tree.erase(i), 1);
+        }
+    }
+    EXPECT_EQ(tree.size(), N / 16 + 1);
+
+    /* merged nodes give their pages back */
+    EXPECT_LT(page_cache.size() * 4, full_pages);
+
+    for (int i = 0; i <= N; i++) {
+        std::vector<ValueType> values;
+        tree.get_value(i, values);
+        if (i % 16) {
+            EXPECT_TRUE(values.empty());
+        } else {
+            ASSERT_EQ(values.size(), 1);
+            EXPECT_EQ(values.front(), i);
+        }
+    }
+
+    for (int i = 0; i <= N; i += 16) {
+        EXPECT_EQ(tree.erase(i), 1);
+    }
+    EXPECT_EQ(tree.size(), 0);
+    EXPECT_EQ(tree.begin(), tree.end());
+}
+
+TEST(TreeTest, ConcurrentErase)
+{
+    const int N = 5000;
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<16, KeyType, ValueType> tree(&page_cache, 16 * 1024);
+
+    for (int i = 0; i < 4 * N; i++) {
+        tree.insert(i, i);
+    }
+
+    /* each thread removes its own keys while inserting new ones */
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([i, &tree]() {
+            std::vector<ValueType> values;
+            for (int j = 0; j < N; j++) {
+                EXPECT_EQ(tree.erase(i * N + j), 1);
+                tree.insert(4 * N + i * N + j, j);
+
+                values.clear();
+                tree.get_value(i * N + j, values);
+                EXPECT_TRUE(values.empty());
+            }
+        });
+    }
+
+    for (auto&& p : threads) {
+        p.join();
+    }
+
+    EXPECT_EQ(tree.size(), 4 * N);
+    for (int i = 0; i < 4 * N; i++) {
+        std::vector<ValueType> values;
+        tree.get_value(4 * N + i, values);
+        ASSERT_EQ(values.size(), 1);
+        EXPECT_EQ(values.front(), i % N);
+    }
+}
+
+TEST(TreeTest, LeafSiblingScan)
+{
+    const int N = 20000;
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<16, KeyType, ValueType> tree(&page_cache);
+
+    /* three pairs per key so that runs of duplicates span leaves */
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < 3; j++) {
+            tree.insert(i, j);
+        }
+    }
+
+    size_t count = 0;
+    KeyType prev = 0;
+    for (auto it = tree.begin(); it != tree.end(); it++) {
+        EXPECT_LE(prev, it->first);
+        prev = it->first;
+        count++;
+    }
+    EXPECT_EQ(count, 3 * N);
+
+    count = 0;
+    for (auto it = tree.begin(N / 2); it != tree.end(); it++) {
+        EXPECT_GE(it->first, N / 2);
+        count++;
+    }
+    EXPECT_EQ(count, 3 * (N - N / 2));
+
+    count = 0;
+    prev = N;
+    for (auto it = tree.rbegin(); it != tree.rend(); it++) {
+        EXPECT_GE(prev, it->first);
+        prev = it->first;
+        count++;
+    }
+    EXPECT_EQ(count, 3 * N);
+
+    count = 0;
+    for (auto it = tree.rbegin(N / 2); it != tree.rend(); it++) {
+        EXPECT_LE(it->first, N / 2);
+        count++;
+    }
+    EXPECT_EQ(count, 3 * (N / 2 + 1));
+
+    /* merged leaves are unlinked */
+    bptree::MemPageCache erase_page_cache(4096);
+    bptree::BTree<16, KeyType, ValueType> erase_tree(&erase_page_cache);
+    for (int i = 0; i < N; i++) {
+        erase_tree.insert(i, i);
+    }
+    for (int i = 0; i < N; i++) {
+        if (i % 10) erase_tree.erase(i);
+    }
+
+    std::vector<KeyType> keys, rkeys;
+    for (auto it = erase_tree.begin(); it != erase_tree.end(); it++) {
+        keys.push_back(it->first);
+    }
+    for (auto it = erase_tree.rbegin(); it != erase_tree.rend(); it++) {
+        rkeys.push_back(it->first);
+    }
+    ASSERT_EQ(keys.size(), N / 10);
+    for (size_t i = 0; i < keys.size(); i++) {
+        EXPECT_EQ(keys[i], i * 10);
+    }
+    std::reverse(rkeys.begin(), rkeys.end());
+    EXPECT_EQ(keys, rkeys);
+}
+
+TEST(TreeTest, ScanDuringSplits)
+{
+    const int N = 20000;
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<16, KeyType, ValueType> tree(&page_cache);
+
+    for (int i = 0; i < N; i++) {
+        tree.insert(2 * i, i);
+    }
+
+    /* odd keys are inserted while the even keys are scanned. every even key
+     * is returned once and in order */
+    std::thread writer([&tree]() {
+        for (int i = 0; i < N; i++) {
+            tree.insert(2 * i + 1, i);
+        }
+    });
+
+    for (int round = 0; round < 4; round++) {
+        KeyType expected = 0;
+        bool first = true;
+        KeyType prev = 0;
+        for (auto it = tree.begin(); it != tree.end(); it++) {
+            EXPECT_TRUE(first || prev < it->first);
+            first = false;
+            prev = it->first;
+
+            if (it->first % 2 == 0) {
+                EXPECT_EQ(it->first, expected);
+                expected += 2;
+            }
+        }
+        EXPECT_EQ(expected, 2 * N);
+
+        size_t count = 0;
+        for (auto it = tree.rbegin(); it != tree.rend(); it++) {
+            EXPECT_TRUE(count == 0 || prev > it->first);
+            prev = it->first;
+            if (it->first % 2 == 0) count++;
+        }
+        EXPECT_EQ(count, N);
+    }
+
+    writer.join();
+}
+
+TEST(TreeTest, BulkLoad)
+{
+    const int N = 100000;
+    std::vector<std::pair<KeyType, ValueType>> pairs;
+    for (int i = 0; i < N; i++) {
+        pairs.emplace_back(2 * i, i);
+    }
+
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+    bptree::BulkLoadOptions options;
+    options.fill_factor = 0.8;
+    tree.bulk_load(pairs.begin(), pairs.end(), options);
+
+    EXPECT_EQ(tree.size(), N);
+    KeyType expected = 0;
+    for (auto it = tree.begin(); it != tree.end(); ++it) {
+        ASSERT_EQ(it->first, expected);
+        EXPECT_EQ(it->second, expected / 2);
+        expected += 2;
+    }
+    EXPECT_EQ(expected, 2 * N);
+
+    /* the loaded tree takes regular updates */
+    for (int i = 0; i < N; i++) {
+        tree.insert(2 * i + 1, i);
+    }
+    for (int i = 0; i < N; i += 2) {
+        EXPECT_EQ(tree.erase(2 * i), 1);
+    }
+    EXPECT_EQ(tree.size(), 2 * N - N / 2);
+    for (int i = 0; i < 2 * N; i++) {
+        std::vector<ValueType> values;
+        tree.get_value(i, values);
+        ASSERT_EQ(values.size(), (i % 4 == 0) ? 0 : 1);
+    }
+
+    EXPECT_THROW(tree.bulk_load(pairs.begin(), pairs.end()), std::logic_error);
+
+    bptree::MemPageCache empty_page_cache(4096);
+    bptree::BTree<64, KeyType, ValueType> empty_tree(&empty_page_cache);
+    empty_tree.bulk_load(pairs.end(), pairs.end());
+    EXPECT_EQ(empty_tree.begin(), empty_tree.end());
+    EXPECT_EQ(empty_tree.rbegin(), empty_tree.rend());
+
+    bptree::MemPageCache unsorted_page_cache(4096);
+    bptree::BTree<64, KeyType, ValueType> unsorted_tree(&unsorted_page_cache);
+    EXPECT_THROW(unsorted_tree.bulk_load(pairs.rbegin(), pairs.rend()),
+                 std::invalid_argument);
+}
+
+TEST(TreeTest, BulkLoadUnsorted)
+{
+    const int N = 100000;
+    std::vector<std::pair<KeyType, ValueType>> pairs;
+    for (int i = 0; i < N; i++) {
+        pairs.emplace_back(i, i + 1);
+    }
+    std::mt19937_64 rng(0);
+    std::shuffle(pairs.begin(), pairs.end(), rng);
+
+    /* small enough to spill several runs */
+    bptree::BulkLoadOptions options;
+    options.sorted = false;
+    options.sort_memory = 64 << 10;
+
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<64, KeyType, ValueType> tree(&page_cache);
+    size_t pos = 0;
+    tree.bulk_load(
+        [&](KeyType& key, ValueType& value) {
+            if (pos == pairs.size()) return false;
+            key = pairs[pos].first;
+            value = pairs[pos].second;
+            pos++;
+            return true;
+        },
+        options);
+
+    EXPECT_EQ(tree.size(), N);
+    KeyType expected = 0;
+    for (auto it = tree.begin(); it != tree.end(); ++it) {
+        ASSERT_EQ(it->first, expected);
+        EXPECT_EQ(it->second, expected + 1);
+        expected++;
+    }
+    EXPECT_EQ(expected, N);
+}
+
+TEST(TreeTest, BatchInsertAndLookup)
+{
+    const int N = 20000;
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<16, KeyType, ValueType> tree(&page_cache);
+
+    /* even keys, with a few duplicates, in random order */
+    std::vector<std::pair<KeyType, ValueType>> pairs;
+    for (int i = 0; i < N; i++) {
+        pairs.emplace_back(2 * i, i);
+        if (i % 100 == 0) pairs.emplace_back(2 * i, i + N);
+    }
+    std::mt19937_64 rng(0);
+    std::shuffle(pairs.begin(), pairs.end(), rng);
+
+    for (size_t i = 0; i < pairs.size(); i += 3000) {
+        tree.insert_batch(&pairs[i], std::min<size_t>(3000, pairs.size() - i));
+    }
+    EXPECT_EQ(tree.size(), pairs.size());
+
+    KeyType last = 0;
+    size_t count = 0;
+    for (auto it = tree.begin(); it != tree.end(); ++it, count++) {
+        ASSERT_LE(last, it->first);
+        last = it->first;
+    }
+    EXPECT_EQ(count, pairs.size());
+
+    /* look up present and absent keys in random order, with repeats */
+    std::vector<KeyType> keys;
+    for (int i = 0; i < 2 * N; i++) {
+        keys.push_back(i);
+    }
+    keys.push_back(0);
+    keys.push_back(2 * N + 1);
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    std::vector<std::vector<ValueType>> value_lists;
+    tree.get_values_batch(keys.data(), keys.size(), value_lists);
+    ASSERT_EQ(value_lists.size(), keys.size());
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        std::vector<ValueType> values;
+        tree.get_value(keys[i], values);
+        std::sort(values.begin(), values.end());
+        std::sort(value_lists[i].begin(), value_lists[i].end());
+        EXPECT_EQ(value_lists[i], values);
+
+        /* like get_value(), duplicates are only found in one leaf */
+        if (keys[i] % 2 || keys[i] >= 2 * N) {
+            EXPECT_TRUE(values.empty());
+        } else {
+            EXPECT_FALSE(values.empty());
+        }
+    }
+}
+
+TEST(TreeTest, ConcurrentBatchInsert)
+{
+    const int N = 20000;
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<32, KeyType, ValueType> tree(&page_cache);
+
+    /* the threads insert interleaved keys so that they share leaves */
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([i, &tree]() {
+            std::vector<std::pair<KeyType, ValueType>> batch;
+            for (int j = 0; j < N; j++) {
+                batch.emplace_back(j * 4 + i, j);
+                if (batch.size() == 1000) {
+                    tree.insert_batch(batch.data(), batch.size());
+                    batch.clear();
+                }
+            }
+        });
+    }
+
+    for (auto&& p : threads) {
+        p.join();
+    }
+
+    EXPECT_EQ(tree.size(), 4 * N);
+
+    std::vector<KeyType> keys;
+    for (int i = 0; i < 4 * N; i++) {
+        keys.push_back(i);
+    }
+    std::vector<std::vector<ValueType>> value_lists;
+    tree.get_values_batch(keys.data(), keys.size(), value_lists);
+
+    for (int i = 0; i < 4 * N; i++) {
+        ASSERT_EQ(value_lists[i].size(), 1);
+        EXPECT_EQ(value_lists[i].front(), i / 4);
+    }
+}
+
+TEST(TreeTest, PairCountRecovery)
+{
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<16, KeyType, ValueType> tree(&page_cache);
+
+    for (int i = 0; i < 1000; i++) {
+        tree.insert(i, i);
+    }
+    tree.checkpoint();
+
+    /* a second tree on the same pages acts as a reopen of the first one
+     * without closing it */
+    {
+        bptree::BTree<16, KeyType, ValueType> reopened(&page_cache);
+        EXPECT_EQ(reopened.size(), 1000);
+    }
+
+    /* updates after the checkpoint mark the count on the meta page stale
+     * and the pairs are recounted */
+    for (int i = 1000; i < 1500; i++) {
+        tree.insert(i, i);
+    }
+    for (int i = 0; i < 100; i++) {
+        tree.erase(i);
+    }
+    EXPECT_EQ(tree.size(), 1400);
+
+    bptree::BTree<16, KeyType, ValueType> reopened(&page_cache);
+    EXPECT_EQ(reopened.size(), 1400);
+}
+
+using StringTree =
+    bptree::BTree<64, std::string, std::string,
+                  bptree::VarLenSerializer<std::string>, std::less<>,
+                  std::equal_to<>, bptree::VarLenSerializer<std::string>>;
+
+/* keys of varying length that sort like i */
+static std::string string_key(int i)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%08d", i);
+    return std::string(buf) + std::string(i % 37, 'k');
+}
+
+static std::string string_value(int i)
+{
+    return std::to_string(i) + std::string(i % 101, 'v');
+}
+
+TEST(TreeTest, VarLenKeysAndValues)
+{
+    const int N = 20000;
+    std::vector<int> order(N);
+    for (int i = 0; i < N; i++) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(0));
+
+    bptree::MemPageCache page_cache(4096);
+    {
+        StringTree tree(&page_cache);
+        for (int i : order) {
+            tree.insert(string_key(i), string_value(i));
+        }
+        EXPECT_EQ(tree.size(), N);
+
+        /* longer values are replaced in place or split the leaf */
+        for (int i = 0; i < N; i += 3) {
+            EXPECT_TRUE(tree.update(string_key(i), string_value(i) + "+++"));
+        }
+        for (int i = 0; i < N; i++) {
+            std::vector<std::string> values;
+            tree.get_value(string_key(i), values);
+            ASSERT_EQ(values.size(), 1);
+            EXPECT_EQ(values.front(),
+                      string_value(i) + (i % 3 ? "" : "+++"));
+        }
+
+        /* pairs that take more than a quarter of a node are rejected */
+        EXPECT_THROW(tree.insert(std::string(2000, 'x'), "v"),
+                     std::length_error);
+
+        for (int i = 0; i < N; i++) {
+            if (i % 8) {
+                EXPECT_EQ(tree.erase(string_key(i)), 1);
+            }
+        }
+        EXPECT_EQ(tree.size(), N / 8);
+    }
+
+    /* the pairs are read back from the slotted pages */
+    StringTree tree(&page_cache);
+    int expected = 0;
+    for (auto it = tree.begin(); it != tree.end(); ++it) {
+        ASSERT_EQ(it->first, string_key(expected));
+        EXPECT_EQ(it->second,
+                  string_value(expected) + (expected % 3 ? "" : "+++"));
+        expected += 8;
+    }
+    EXPECT_EQ(expected, N);
+}
+
+TEST(TreeTest, VarLenBulkLoadAndBatch)
+{
+    const int N = 20000;
+    std::vector<std::pair<std::string, std::string>> pairs;
+    for (int i = 0; i < N; i += 2) {
+        pairs.emplace_back(string_key(i), string_value(i));
+    }
+
+    bptree::MemPageCache page_cache(4096);
+    StringTree tree(&page_cache);
+    bptree::BulkLoadOptions options;
+    options.fill_factor = 0.8;
+    tree.bulk_load(pairs.begin(), pairs.end(), options);
+
+    std::vector<std::pair<std::string, std::string>> batch;
+    for (int i = 1; i < N; i += 2) {
+        batch.emplace_back(string_key(i), string_value(i));
+    }
+    tree.insert_batch(batch.data(), batch.size());
+    EXPECT_EQ(tree.size(), N);
+
+    std::vector<std::string> keys;
+    for (int i = N - 1; i >= 0; i--) {
+        keys.push_back(string_key(i));
+    }
+    std::vector<std::vector<std::string>> value_lists;
+    tree.get_values_batch(keys.data(), keys.size(), value_lists);
+    for (int i = 0; i < N; i++) {
+        ASSERT_EQ(value_lists[i].size(), 1);
+        EXPECT_EQ(value_lists[i].front(), string_value(N - 1 - i));
+    }
+
+    int expected = N;
+    for (auto it = tree.rbegin(); it != tree.rend(); ++it) {
+        ASSERT_EQ(it->first, string_key(--expected));
+    }
+    EXPECT_EQ(expected, 0);
+}
+
+/* composite keys with a long common prefix */
+static std::string composite_key(int i)
+{
+    char buf[64];
+    snprintf(buf, sizeof(buf), "tenant-%08d/order-%010d/item-%03d", i % 4,
+             i / 7, i % 7);
+    return buf;
+}
+
+/* orders keys like std::less<> but does not enable prefix compression */
+struct PlainLess {
+    using is_transparent = void;
+    template <typename A, typename B>
+    bool operator()(const A& a, const B& b) const
+    {
+        return std::string_view(a) < std::string_view(b);
+    }
+};
+
+TEST(TreeTest, PrefixAndSuffixTruncation)
+{
+    const int N = 20000;
+    std::vector<int> order(N);
+    for (int i = 0; i < N; i++) {
+        order[i] = i;
+    }
+    std::shuffle(order.begin(), order.end(), std::mt19937(0));
+
+    /* nodes of order 256 are full by bytes before they are by count */
+    using Tree =
+        bptree::BTree<256, std::string, std::string,
+                      bptree::VarLenSerializer<std::string>, std::less<>,
+                      std::equal_to<>, bptree::VarLenSerializer<std::string>>;
+
+    bptree::MemPageCache plain_cache(4096);
+    bptree::BTree<256, std::string, std::string,
+                  bptree::VarLenSerializer<std::string>, PlainLess,
+                  std::equal_to<>, bptree::VarLenSerializer<std::string>>
+        plain(&plain_cache);
+    for (int i : order) {
+        plain.insert(composite_key(i), std::to_string(i));
+    }
+
+    bptree::MemPageCache page_cache(4096);
+    {
+        Tree tree(&page_cache);
+        for (int i : order) {
+            tree.insert(composite_key(i), std::to_string(i));
+        }
+
+        /* the prefixes are stored once per node */
+        EXPECT_LT(page_cache.size() * 2, plain_cache.size());
+
+        for (int i = 0; i < N; i++) {
+            std::vector<std::string> values;
+            tree.get_value(composite_key(i), values);
+            ASSERT_EQ(values.size(), 1);
+            EXPECT_EQ(values.front(), std::to_string(i));
+        }
+        /* truncated separators route to the leaves but are not keys */
+        std::vector<std::string> values;
+        tree.get_value("tenant-00000001/order-0000000100", values);
+        EXPECT_TRUE(values.empty());
+
+        /* leaves with different prefixes are merged */
+        for (int i = 0; i < N; i++) {
+            if (i % 16) {
+                EXPECT_EQ(tree.erase(composite_key(i)), 1);
+            }
+        }
+        EXPECT_EQ(tree.size(), N / 16);
+    }
+
+    Tree tree(&page_cache);
+    std::vector<std::string> expected;
+    for (int i = 0; i < N; i += 16) {
+        expected.push_back(composite_key(i));
+    }
+    std::sort(expected.begin(), expected.end());
+
+    size_t idx = 0;
+    for (auto it = tree.begin(); it != tree.end(); ++it) {
+        ASSERT_LT(idx, expected.size());
+        EXPECT_EQ(it->first, expected[idx++]);
+    }
+    EXPECT_EQ(idx, expected.size());
+}
+
+TEST(TreeTest, ConcurrentVarLenInsert)
+{
+    const int N = 5000;
+    bptree::MemPageCache page_cache(4096);
+    StringTree tree(&page_cache);
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back([i, &tree]() {
+            for (int j = i; j < N; j += 4) {
+                tree.insert(string_key(j), string_value(j));
+
+                std::vector<std::string> values;
+                tree.get_value(string_key(j / 2), values);
+                for (auto&& v : values) {
+                    EXPECT_EQ(v, string_value(j / 2));
+                }
+            }
+        });
+    }
+    for (auto&& p : threads) {
+        p.join();
+    }
+
+    EXPECT_EQ(tree.size(), N);
+    int expected = 0;
+    for (auto it = tree.begin(); it != tree.end(); ++it) {
+        ASSERT_EQ(it->first, string_key(expected++));
+    }
+    EXPECT_EQ(expected, N);
+}
+
+/* a snapshot keeps returning the pairs of the time it was taken while the
+ * tree is changed by inserts that split nodes, erases that merge them and
+ * updates, and the snapshot after it sees the changes */
+template <typename Tree> static void check_snapshot(Tree& tree, int n)
+{
+    for (int i = 0; i < n; i++) {
+        tree.insert(2 * i, i);
+    }
+
+    auto snap = tree.snapshot();
+    EXPECT_EQ(snap->size(), n);
+
+    for (int i = 0; i < n; i++) {
+        tree.insert(2 * i + 1, i);
+    }
+    for (int i = 0; i < n; i += 3) {
+        EXPECT_TRUE(tree.update(2 * i, i + 1));
+    }
+    for (int i = n / 2; i < n; i++) {
+        tree.erase(2 * i);
+    }
+    tree.compact();
+
+    int expected = 0;
+    for (auto it = snap->begin(); it != snap->end(); ++it) {
+        ASSERT_EQ(it->first, 2 * expected);
+        ASSERT_EQ(it->second, expected);
+        expected++;
+    }
+    EXPECT_EQ(expected, n);
+
+    expected = n / 4;
+    for (auto it = snap->begin(2 * expected - 1); !it.is_end(); ++it) {
+        ASSERT_EQ(it->first, 2 * expected++);
+    }
+    EXPECT_EQ(expected, n);
+
+    std::vector<typename Tree::Snapshot::iterator::value_type::second_type>
+        values;
+    snap->get_value(6, values);
+    ASSERT_EQ(values.size(), 1);
+    EXPECT_EQ(values.front(), 3);
+    snap->get_value(7, values);
+    EXPECT_TRUE(values.empty());
+    EXPECT_GT(tree.get_snapshot_stats().page_versions, 0);
+
+    auto next = tree.snapshot();
+    EXPECT_EQ(next->size(), tree.size());
+    size_t count = 0;
+    for (auto it = next->begin(); it != next->end(); ++it) {
+        count++;
+    }
+    EXPECT_EQ(count, n + n / 2);
+    next->get_value(6, values);
+    ASSERT_EQ(values.size(), 1);
+    EXPECT_EQ(values.front(), 4);
+
+    /* the old versions go with the last snapshot that sees them */
+    snap.reset();
+    EXPECT_EQ(tree.get_snapshot_stats().snapshots, 1);
+    EXPECT_EQ(tree.get_snapshot_stats().page_versions, 0);
+    next.reset();
+    EXPECT_EQ(tree.get_snapshot_stats().snapshots, 0);
+}
+
+TEST(TreeTest, Snapshot)
+{
+    using CopyTree =
+        bptree::BTree<16, KeyType, ValueType, PlainCopySerializer<KeyType>,
+                      std::less<KeyType>, std::equal_to<KeyType>,
+                      PlainCopySerializer<ValueType>>;
+
+    {
+        bptree::MemPageCache page_cache(4096);
+        bptree::BTree<16, KeyType, ValueType> tree(&page_cache);
+        check_snapshot(tree, 5000);
+    }
+    {
+        bptree::MemPageCache page_cache(4096);
+        CopyTree tree(&page_cache);
+        check_snapshot(tree, 5000);
+    }
+    {
+        /* pages are evicted from a small page cache and read back */
+        std::string path = "/tmp/bptree_snapshot_test.heap";
+        std::remove(path.c_str());
+        bptree::HeapPageCache page_cache(path, true, 64);
+        bptree::BTree<16, KeyType, ValueType> tree(&page_cache);
+        check_snapshot(tree, 5000);
+    }
+    {
+        /* the pages of logged operations are written in mini-transactions */
+        std::string path = "/tmp/bptree_snapshot_wal_test.heap";
+        std::remove(path.c_str());
+        std::remove((path + ".wal").c_str());
+        bptree::PageCacheOptions options;
+        options.wal.enabled = true;
+        bptree::HeapPageCache page_cache(path, true, 64, 4096, options);
+        bptree::BTree<16, KeyType, ValueType> tree(&page_cache);
+        check_snapshot(tree, 5000);
+    }
+}
+
+TEST(TreeTest, VarLenSnapshot)
+{
+    const int N = 5000;
+    bptree::MemPageCache page_cache(4096);
+    StringTree tree(&page_cache);
+
+    for (int i = 0; i < N; i += 2) {
+        tree.insert(string_key(i), string_value(i));
+    }
+    auto snap = tree.snapshot();
+
+    for (int i = 1; i < N; i += 2) {
+        tree.insert(string_key(i), string_value(i));
+    }
+    for (int i = 0; i < N; i += 4) {
+        tree.erase(string_key(i));
+    }
+
+    int expected = 0;
+    for (auto it = snap->begin(); it != snap->end(); ++it) {
+        ASSERT_EQ(it->first, string_key(expected));
+        ASSERT_EQ(it->second, string_value(expected));
+        expected += 2;
+    }
+    EXPECT_EQ(expected, N);
+
+    std::vector<std::string> values;
+    snap->get_value(string_key(N / 2), values);
+    ASSERT_EQ(values.size(), 1);
+    EXPECT_EQ(values.front(), string_value(N / 2));
+}
+
+TEST(TreeTest, ConcurrentSnapshots)
+{
+    const int N = 20000;
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<16, KeyType, ValueType> tree(&page_cache);
+
+    /* the writers update the pairs with odd keys and insert and erase
+     * pairs with even keys. every snapshot has all odd keys once, in
+     * order, and as many pairs as it says */
+    for (int i = 0; i < N; i++) {
+        tree.insert(2 * i + 1, 0);
+    }
+
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 2; t++) {
+        writers.emplace_back([t, &tree, &stop]() {
+            std::mt19937 rng(t);
+            while (!stop.load()) {
+                KeyType key = rng() % (4 * N);
+                if (key % 2) {
+                    tree.update(key, (ValueType)t + 1);
+                } else {
+                    tree.insert(key, 0);
+                    tree.erase(key);
+                }
+            }
+        });
+    }
+
+    for (int round = 0; round < 20; round++) {
+        auto snap = tree.snapshot();
+        size_t count = 0, odd = 0;
+        KeyType prev = 0;
+        for (auto it = snap->begin(); it != snap->end(); ++it) {
+            EXPECT_TRUE(count == 0 || prev <= it->first);
+            if (it->first % 2) {
+                EXPECT_EQ(it->first, 2 * odd + 1);
+                odd++;
+            }
+            prev = it->first;
+            count++;
+        }
+        EXPECT_EQ(count, snap->size());
+        EXPECT_EQ(odd, N);
+    }
+
+    stop.store(true);
+    for (auto&& p : writers) {
+        p.join();
+    }
+    EXPECT_EQ(tree.get_snapshot_stats().page_versions, 0);
+}
+
+TEST(TreeTest, ReclaimUnderLoad)
+{
+    const int N = 20000;
+    bptree::MemPageCache page_cache(4096);
+    bptree::BTree<16, KeyType, ValueType> tree(&page_cache);
+
+    for (int i = 0; i < N; i++) {
+        tree.insert(i, i);
+    }
+
+    /* lookups are in flight all the time. the nodes retired by the merges
+     * of the erases are freed while they go on */
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([t, &tree, &stop]() {
+            std::mt19937 rng(t);
+            std::vector<ValueType> values;
+            while (!stop.load()) {
+                KeyType key = rng() % N;
+                tree.get_value(key, values);
+                if (!values.empty()) {
+                    EXPECT_EQ(values.front(), key);
+                }
+                if (key % 4 == 0) {
+                    EXPECT_EQ(values.size(), 1);
+                }
+            }
+        });
+    }
+
+    for (int i = 0; i < N; i++) {
+        if (i % 4) tree.erase(i);
+    }
+
+    size_t retired = 0;
+    for (int i = 0; i < 1000; i++) {
+        std::vector<ValueType> values;
+        tree.get_value(1, values);
+        retired = tree.get_node_cache_stats().retired;
+        if (retired == 0) break;
+        std::this_thread::sleep_for(milliseconds(1));
+    }
+    EXPECT_EQ(retired, 0);
+
+    stop.store(true);
+    for (auto&& p : readers) {
+        p.join();
+    }
+    EXPECT_EQ(tree.size(), N / 4);
+}
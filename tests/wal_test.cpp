@@ -0,0 +1,109 @@
+#include <gtest/gtest.h>
+
+#include "bptree/wal.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+static std::string wal_path(const char* name)
+{
+    return std::string("/tmp/bptree_") + name + "_" + std::to_string(getpid()) +
+           ".wal";
+}
+
+static std::vector<std::vector<uint8_t>>
+read_entries(bptree::WriteAheadLog& wal, std::vector<bptree::LSN>* lsns = nullptr)
+{
+    std::vector<std::vector<uint8_t>> entries;
+    wal.replay([&](bptree::LSN lsn, const uint8_t* data, size_t length) {
+        entries.emplace_back(data, data + length);
+        if (lsns) lsns->push_back(lsn);
+    });
+    return entries;
+}
+
+TEST(WalTest, AppendAndReplay)
+{
+    auto path = wal_path("append");
+    std::remove(path.c_str());
+
+    std::vector<bptree::LSN> lsns;
+    {
+        bptree::WriteAheadLog wal(path, true);
+
+        for (int i = 0; i < 100; i++) {
+            std::vector<uint8_t> payload(i + 1, (uint8_t)i);
+            auto lsn = wal.append(payload.data(), payload.size());
+            wal.commit(lsn);
+            lsns.push_back(lsn);
+        }
+        EXPECT_EQ(wal.get_stable_lsn(), lsns.back());
+
+        wal.flush(lsns.back());
+        EXPECT_EQ(wal.get_durable_lsn(), lsns.back());
+    }
+
+    /* a torn entry at the end is dropped */
+    int fd = ::open(path.c_str(), O_WRONLY | O_APPEND);
+    ASSERT_GE(fd, 0);
+    uint8_t garbage[] = {100, 0, 0, 0, 1, 2, 3, 4, 5};
+    ASSERT_EQ(::write(fd, garbage, sizeof(garbage)), (ssize_t)sizeof(garbage));
+    ::close(fd);
+
+    bptree::WriteAheadLog wal(path, false);
+    std::vector<bptree::LSN> replayed_lsns;
+    auto entries = read_entries(wal, &replayed_lsns);
+
+    ASSERT_EQ(entries.size(), 100);
+    EXPECT_EQ(replayed_lsns, lsns);
+    for (int i = 0; i < 100; i++) {
+        EXPECT_EQ(entries[i], std::vector<uint8_t>(i + 1, (uint8_t)i));
+    }
+    EXPECT_EQ(wal.get_end_lsn(), lsns.back());
+
+    std::remove(path.c_str());
+}
+
+TEST(WalTest, TruncateKeepsLSNs)
+{
+    auto path = wal_path("truncate");
+    std::remove(path.c_str());
+
+    std::vector<bptree::LSN> lsns;
+    {
+        bptree::WriteAheadLog wal(path, true);
+
+        for (int i = 0; i < 10; i++) {
+            uint8_t payload[16] = {(uint8_t)i};
+            lsns.push_back(wal.append(payload, sizeof(payload)));
+        }
+
+        /* uncommitted entries hold back the stable LSN */
+        EXPECT_EQ(wal.get_stable_lsn(), 0);
+        for (int i = 0; i < 5; i++) {
+            wal.commit(lsns[i]);
+        }
+        EXPECT_EQ(wal.get_stable_lsn(), lsns[4]);
+
+        wal.truncate(wal.get_stable_lsn());
+        auto entries = read_entries(wal);
+        ASSERT_EQ(entries.size(), 5);
+        EXPECT_EQ(entries[0][0], 5);
+    }
+
+    bptree::WriteAheadLog wal(path, false);
+    std::vector<bptree::LSN> replayed_lsns;
+    auto entries = read_entries(wal, &replayed_lsns);
+    ASSERT_EQ(entries.size(), 5);
+    EXPECT_EQ(replayed_lsns,
+              std::vector<bptree::LSN>(lsns.begin() + 5, lsns.end()));
+
+    /* new entries continue after the old ones */
+    uint8_t payload[4] = {0};
+    EXPECT_GT(wal.append(payload, sizeof(payload)), lsns.back());
+
+    std::remove(path.c_str());
+}